@@ -0,0 +1,535 @@
+/**
+ * @file 	rudp_bench.cpp
+ * @author 	James Horner (jwehorner@gmail.com)
+ * @brief 	File rudp_bench.cpp contains the benchmark suite of the RUDP library.
+ * @details The suite measures the ping-pong latency of messages, the rate at which messages are delivered for a
+ * 			number of payload sizes and connections, and the goodput of a connection whose ends drop, delay,
+ * 			reorder and limit the rate of the datagrams they send with a seeded impairment. The allocations made
+ * 			per message in a steady state are counted by replacing the global operator new. Each result is printed
+ * 			as one line of JSON so that runs can be compared between releases.
+ * @date 	2022-07-18
+ * @copyright Copyright (c) 2022
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rudp_macros.h"
+#include "Connection.hpp"
+#include "ConnectionController.hpp"
+
+using namespace std;
+using namespace rudp;
+
+/// Number of calls to the global operator new made by every thread of the benchmark.
+static atomic<uint64_t> allocation_count(0);
+
+void *operator new(size_t size)
+{
+	allocation_count.fetch_add(1, memory_order_relaxed);
+	void *block = malloc(size > 0 ? size : 1);
+	if (block == nullptr)
+	{
+		throw bad_alloc();
+	}
+	return block;
+}
+
+void operator delete(void *block) noexcept
+{
+	free(block);
+}
+
+void operator delete(void *block, size_t) noexcept
+{
+	free(block);
+}
+
+/**
+ * @brief   Struct Scenario is a named impairment of both directions of a connection.
+ */
+struct Scenario
+{
+	/// Name of the scenario in the results.
+	string name;
+	/// Impairment of the datagrams sent by each end.
+	Impairment impairment;
+};
+
+/**
+ * @brief   Function make_scenario makes a scenario from the fields of an impairment that the benchmarks vary.
+ * @param   name const string & name of the scenario.
+ * @param   loss double probability that a datagram is dropped.
+ * @param   delay_us int delay of each datagram in microseconds.
+ * @param   jitter_us int spread of the delay in microseconds.
+ * @param   reorder double probability that a datagram is reordered.
+ * @param   rate_bytes_per_s uint64_t rate of each direction in bytes per second, 0 for no limit.
+ * @return  Scenario the scenario.
+ */
+Scenario make_scenario(const string &name, double loss, int delay_us, int jitter_us, double reorder, uint64_t rate_bytes_per_s)
+{
+	Scenario scenario = Scenario{name, Impairment()};
+	scenario.impairment.loss = loss;
+	scenario.impairment.delay_us = delay_us;
+	scenario.impairment.jitter_us = jitter_us;
+	scenario.impairment.reorder = reorder;
+	scenario.impairment.reorder_delay_us = 2000;
+	scenario.impairment.rate_bytes_per_s = rate_bytes_per_s;
+	return scenario;
+}
+
+/**
+ * @brief   Function print_result prints one result as a line of JSON.
+ * @param   benchmark const string & name of the benchmark.
+ * @param   fields const vector<pair<string, string>> & fields of the result, whose values are already JSON.
+ */
+void print_result(const string &benchmark, const vector<pair<string, string>> &fields)
+{
+	ostringstream line;
+	line << "{\"benchmark\": \"" << benchmark << "\"";
+	for (const pair<string, string> &field : fields)
+	{
+		line << ", \"" << field.first << "\": " << field.second;
+	}
+	line << "}";
+	cout << line.str() << endl;
+}
+
+/**
+ * @brief   Function format_number formats a number for a JSON field.
+ * @param   value double value of the field.
+ * @return  string value in JSON.
+ */
+string format_number(double value)
+{
+	ostringstream number;
+	number.precision(6);
+	number << value;
+	return number.str();
+}
+
+/**
+ * @brief   Function percentile gets a percentile of sorted samples.
+ * @param   samples const vector<double> & samples in ascending order.
+ * @param   fraction double fraction of the samples that are at most the percentile.
+ * @return  double the percentile.
+ */
+double percentile(const vector<double> &samples, double fraction)
+{
+	size_t index = min(samples.size() - 1, (size_t)(fraction * samples.size()));
+	return samples[index];
+}
+
+/**
+ * @brief   Function bench_latency measures the round trip time of a message echoed back by another connection.
+ * @param   payload int size of the message in bytes.
+ * @param   iterations int number of round trips measured.
+ */
+void bench_latency(int payload, int iterations)
+{
+	Connection connection_client = Connection(100);
+	Connection connection_echo = Connection(100);
+	connection_client.setWindowSize(32);
+	connection_echo.setWindowSize(32);
+	connection_client.setEndpointLocal(24000);
+	connection_echo.setEndpointLocal(24001);
+	connection_client.setEndpointRemote("127.0.0.1", 24001);
+	int warmup = max(iterations / 10, 10);
+	thread echo_thread([&]()
+					   {
+		vector<char> buffer(payload);
+		char address[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		for (int i = 0; i < warmup + iterations; i++)
+		{
+			int len = connection_echo.receive(buffer.data(), payload, address, &port);
+			connection_echo.sendTo(buffer.data(), len, address, port);
+		} });
+	vector<char> message(payload, 'x');
+	vector<char> buffer(payload);
+	char address[IPV4_ADDRESS_LENGTH_BYTES];
+	int port;
+	vector<double> samples;
+	for (int i = 0; i < warmup + iterations; i++)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		connection_client.send(message.data(), payload);
+		connection_client.receive(buffer.data(), payload, address, &port);
+		if (i >= warmup)
+		{
+			samples.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+		}
+	}
+	echo_thread.join();
+	sort(samples.begin(), samples.end());
+	print_result("latency", {{"payload_bytes", to_string(payload)}, {"samples", to_string(samples.size())}, {"p50_us", format_number(percentile(samples, 0.5))}, {"p99_us", format_number(percentile(samples, 0.99))}, {"p999_us", format_number(percentile(samples, 0.999))}, {"max_us", format_number(samples.back())}});
+}
+
+/**
+ * @brief   Function bench_throughput measures the rate at which messages are delivered over a number of
+ *          connections at once, each sending to its own receiver.
+ * @param   payload int size of the messages in bytes.
+ * @param   connections int number of connections sending at once.
+ * @param   messages int number of messages sent by each connection.
+ * @param   batch int number of messages sent and received by each call, 1 to use send() and receive().
+ * @param   transport int TRANSPORT_ASIO or TRANSPORT_IO_URING, the transport of every connection.
+ */
+void bench_throughput(int payload, int connections, int messages, int batch, int transport = DEFAULT_TRANSPORT)
+{
+	vector<unique_ptr<Connection>> senders;
+	vector<unique_ptr<Connection>> receivers;
+	for (int i = 0; i < connections; i++)
+	{
+		receivers.emplace_back(new Connection(100, ConnectionController::getIOService(), transport));
+		receivers.back()->setReceiveQueueLimit(4096);
+		receivers.back()->setEndpointLocal(24100 + i);
+		senders.emplace_back(new Connection(100, ConnectionController::getIOService(), transport));
+		// A window larger than the reorder buffer of the receiver has its packets past a gap dropped.
+		senders.back()->setWindowSize(REORDER_BUFFER_SIZE);
+		senders.back()->setEndpointRemote("127.0.0.1", 24100 + i);
+	}
+	vector<char> message(payload, 'x');
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	vector<thread> threads;
+	for (int i = 0; i < connections; i++)
+	{
+		threads.emplace_back([&, i]()
+							 {
+			vector<BatchMessage> batch_messages(batch);
+			for (BatchMessage &batch_message : batch_messages)
+			{
+				batch_message.buf = message.data();
+				batch_message.len = payload;
+			}
+			for (int j = 0; j < messages; j += batch)
+			{
+				if (batch == 1)
+					senders[i]->send(message.data(), payload);
+				else
+					senders[i]->sendBatch(batch_messages.data(), min(batch, messages - j));
+			}
+			senders[i]->flush(); });
+		threads.emplace_back([&, i]()
+							 {
+			vector<vector<char>> buffers(batch, vector<char>(payload));
+			vector<BatchMessage> batch_messages(batch);
+			char address[IPV4_ADDRESS_LENGTH_BYTES];
+			int port;
+			for (int j = 0; j < messages;)
+			{
+				if (batch == 1)
+				{
+					receivers[i]->receive(buffers[0].data(), payload, address, &port);
+					j++;
+					continue;
+				}
+				for (int k = 0; k < batch; k++)
+				{
+					batch_messages[k].buf = buffers[k].data();
+					batch_messages[k].len = payload;
+				}
+				j += receivers[i]->receiveBatch(batch_messages.data(), min(batch, messages - j));
+			} });
+	}
+	for (thread &bench_thread : threads)
+	{
+		bench_thread.join();
+	}
+	double elapsed_s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	uint64_t retransmissions = 0;
+	for (unique_ptr<Connection> &sender : senders)
+	{
+		retransmissions += sender->getStats().retransmissions;
+	}
+	double total = (double)connections * messages;
+	print_result("throughput", {{"payload_bytes", to_string(payload)}, {"connections", to_string(connections)}, {"batch", to_string(batch)}, {"transport", transport == TRANSPORT_IO_URING ? "\"io_uring\"" : "\"asio\""}, {"messages", format_number(total)}, {"elapsed_s", format_number(elapsed_s)}, {"messages_per_s", format_number(total / elapsed_s)}, {"goodput_mbit_s", format_number(total * payload * 8 / elapsed_s / 1e6)}, {"retransmissions", to_string(retransmissions)}});
+}
+
+/**
+ * @brief   Function bench_sharded measures the rate at which a port shared by a number of shards ingests messages
+ *          from many peers, each shard receiving asynchronously on the thread of its own IO service.
+ * @param   payload int size of the messages in bytes.
+ * @param   shards int number of shards bound to the port.
+ * @param   peers int number of connections sending to the port at once.
+ * @param   messages int number of messages sent by each peer.
+ */
+void bench_sharded(int payload, int shards, int peers, int messages)
+{
+	/**
+	 * @brief   Struct ShardReceiver is the receive of one shard, which starts the next receive as each completes.
+	 */
+	struct ShardReceiver
+	{
+		Connection *connection;
+		vector<char> buffer;
+		char address[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		CompletionHandler handler;
+	};
+
+	unsigned short port = 24300 + shards;
+	vector<int> shard_numbers = ConnectionController::addShardedConnections(100, port, shards);
+	vector<unique_ptr<Connection>> senders;
+	for (int i = 0; i < peers; i++)
+	{
+		senders.emplace_back(new Connection(100));
+		senders.back()->setWindowSize(REORDER_BUFFER_SIZE);
+		senders.back()->setEndpointRemote("127.0.0.1", port);
+	}
+	int total = peers * messages;
+	atomic<int> received(0);
+	promise<void> done;
+	vector<unique_ptr<ShardReceiver>> receivers;
+	for (int shard_number : shard_numbers)
+	{
+		receivers.emplace_back(new ShardReceiver());
+		ShardReceiver *receiver = receivers.back().get();
+		receiver->connection = ConnectionController::getConnection(shard_number);
+		receiver->connection->setReceiveQueueLimit(4096);
+		receiver->buffer.resize(payload);
+		// The receives still waiting when the shards are removed fail, which ends them.
+		receiver->handler = [&, receiver](int, exception_ptr error)
+		{
+			if (error)
+				return;
+			if (++received == total)
+				done.set_value();
+			receiver->connection->asyncReceive(receiver->buffer.data(), payload, receiver->address, &receiver->port, receiver->handler);
+		};
+		receiver->connection->asyncReceive(receiver->buffer.data(), payload, receiver->address, &receiver->port, receiver->handler);
+	}
+	vector<char> message(payload, 'x');
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	vector<thread> threads;
+	for (int i = 0; i < peers; i++)
+	{
+		threads.emplace_back([&, i]()
+							 {
+			for (int j = 0; j < messages; j++)
+			{
+				senders[i]->send(message.data(), payload);
+			}
+			senders[i]->flush(); });
+	}
+	done.get_future().wait();
+	double elapsed_s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	for (thread &bench_thread : threads)
+	{
+		bench_thread.join();
+	}
+	uint64_t retransmissions = 0;
+	for (unique_ptr<Connection> &sender : senders)
+	{
+		retransmissions += sender->getStats().retransmissions;
+	}
+	for (int shard_number : shard_numbers)
+	{
+		ConnectionController::removeConnection(shard_number);
+	}
+	print_result("sharded", {{"payload_bytes", to_string(payload)}, {"shards", to_string(shards)}, {"peers", to_string(peers)}, {"messages", to_string(total)}, {"elapsed_s", format_number(elapsed_s)}, {"messages_per_s", format_number(total / elapsed_s)}, {"goodput_mbit_s", format_number((double)total * payload * 8 / elapsed_s / 1e6)}, {"retransmissions", to_string(retransmissions)}});
+}
+
+/**
+ * @brief   Function bench_impairment measures the goodput of a connection whose datagrams, and the ACKs for them,
+ *          are impaired by both of its ends.
+ * @param   scenario const Scenario & impairment of both directions.
+ * @param   payload int size of the messages in bytes.
+ * @param   messages int number of messages sent.
+ */
+void bench_impairment(const Scenario &scenario, int payload, int messages)
+{
+	Connection connection_recv = Connection(100);
+	connection_recv.setReceiveQueueLimit(4096);
+	connection_recv.setEndpointLocal(24200);
+	Connection connection_send = Connection(100);
+	connection_send.setWindowSize(REORDER_BUFFER_SIZE);
+	connection_send.setEndpointRemote("127.0.0.1", 24200);
+	// The two directions draw from different seeds so that the ACKs are not lost in step with the data.
+	Impairment impairment = scenario.impairment;
+	connection_send.setImpairment(impairment);
+	impairment.seed += 1;
+	connection_recv.setImpairment(impairment);
+	vector<char> message(payload, 'x');
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	thread recv_thread([&]()
+					   {
+		vector<char> buffer(payload);
+		char address[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		for (int j = 0; j < messages; j++)
+		{
+			connection_recv.receive(buffer.data(), payload, address, &port);
+		} });
+	for (int j = 0; j < messages; j++)
+	{
+		connection_send.send(message.data(), payload);
+	}
+	connection_send.flush();
+	recv_thread.join();
+	double elapsed_s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	ConnectionStats stats = connection_send.getStats();
+	print_result("impairment", {{"scenario", "\"" + scenario.name + "\""}, {"loss", format_number(impairment.loss)}, {"delay_us", to_string(impairment.delay_us)}, {"jitter_us", to_string(impairment.jitter_us)}, {"reorder", format_number(impairment.reorder)}, {"rate_bytes_per_s", to_string(impairment.rate_bytes_per_s)}, {"payload_bytes", to_string(payload)}, {"messages", to_string(messages)}, {"elapsed_s", format_number(elapsed_s)}, {"goodput_mbit_s", format_number((double)messages * payload * 8 / elapsed_s / 1e6)}, {"retransmissions", to_string(stats.retransmissions)}, {"timeouts", to_string(stats.timeouts)}});
+}
+
+/**
+ * @brief   Function bench_allocations counts the allocations made by both ends of a connection for each message
+ *          once they have sent enough messages to reach their working set.
+ * @param   payload int size of the messages in bytes.
+ * @param   window int window size of the sender, 1 for Stop-and-Wait.
+ * @param   messages int number of messages counted, after a warm-up of as many messages, and at least 5000, that are not.
+ * @param   async bool true to send with asyncSend() a window of messages at a time, false to use send().
+ */
+void bench_allocations(int payload, int window, int messages, bool async)
+{
+	Connection connection_recv = Connection(100);
+	connection_recv.setEndpointLocal(24400);
+	Connection connection_send = Connection(100);
+	connection_send.setWindowSize(window);
+	connection_send.setEndpointRemote("127.0.0.1", 24400);
+	vector<char> message(payload, 'x');
+	atomic<int> completed(0);
+	int warmup = max(messages, 5000);
+	thread recv_thread([&]()
+					   {
+		vector<char> buffer(payload);
+		char address[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		for (int j = 0; j < warmup + messages; j++)
+		{
+			connection_recv.receive(buffer.data(), payload, address, &port);
+		} });
+	uint64_t start_count = 0;
+	for (int j = 0; j < warmup + messages; j++)
+	{
+		if (j == warmup)
+		{
+			start_count = allocation_count.load();
+		}
+		if (async)
+		{
+			connection_send.asyncSend(message.data(), payload, [&completed](int, exception_ptr)
+									  { completed++; });
+			if ((j + 1) % window == 0)
+			{
+				connection_send.flush();
+			}
+		}
+		else
+		{
+			connection_send.send(message.data(), payload);
+		}
+	}
+	connection_send.flush();
+	recv_thread.join();
+	double allocations = (double)(allocation_count.load() - start_count) / messages;
+	print_result("allocations", {{"payload_bytes", to_string(payload)}, {"window", to_string(window)}, {"async", async ? "true" : "false"}, {"messages", to_string(messages)}, {"allocations_per_message", format_number(allocations)}, {"buffer_pool_bytes", to_string(connection_send.getBufferPoolSize())}});
+}
+
+int main(int argc, char **argv)
+{
+	// --quick divides the number of messages by 10 for a fast check, --only runs a single benchmark.
+	int scale = 10;
+	string only;
+	for (int i = 1; i < argc; i++)
+	{
+		string argument = argv[i];
+		if (argument == "--quick")
+		{
+			scale = 1;
+		}
+		else if (argument == "--only" && i + 1 < argc)
+		{
+			only = argv[++i];
+		}
+		else
+		{
+			cerr << "Usage: " << argv[0] << " [--quick] [--only latency|throughput|sharded|impairment|allocations]" << endl;
+			return 1;
+		}
+	}
+	try
+	{
+		if (only.empty() || only == "latency")
+		{
+			for (int payload : {16, 1024, 8192})
+			{
+				bench_latency(payload, 1000 * scale);
+			}
+		}
+		if (only.empty() || only == "throughput")
+		{
+			for (int connections : {1, 4})
+			{
+				for (int payload : {64, 1024, 8192})
+				{
+					bench_throughput(payload, connections, 2000 * scale, 1);
+				}
+			}
+			// The batch calls lock the connection once for every 32 messages and send their packets together.
+			for (int payload : {64, 1024})
+			{
+				bench_throughput(payload, 1, 2000 * scale, 32);
+			}
+#ifdef __linux__
+			// The io_uring transport receives every datagram with one multishot receive and sends each batch of
+			// packets with one system call.
+			for (int payload : {64, 1024})
+			{
+				bench_throughput(payload, 1, 2000 * scale, 1, TRANSPORT_IO_URING);
+				bench_throughput(payload, 1, 2000 * scale, 32, TRANSPORT_IO_URING);
+			}
+#endif
+		}
+		if (only.empty() || only == "sharded")
+		{
+			// A single shard against one shard per IO service of the pool, both with eight peers.
+			vector<int> shard_counts = {1};
+			if (ConnectionController::getIOServiceCount() > 1)
+			{
+				shard_counts.push_back(ConnectionController::getIOServiceCount());
+			}
+			for (int shards : shard_counts)
+			{
+				bench_sharded(1024, shards, 8, 500 * scale);
+			}
+		}
+		if (only.empty() || only == "impairment")
+		{
+			vector<Scenario> scenarios = {
+				make_scenario("clean", 0, 0, 0, 0, 0),
+				make_scenario("loss_1pct", 0.01, 0, 0, 0, 0),
+				make_scenario("loss_5pct", 0.05, 0, 0, 0, 0),
+				make_scenario("delay_5ms", 0, 5000, 0, 0, 0),
+				make_scenario("delay_5ms_jitter_1ms", 0, 5000, 1000, 0, 0),
+				make_scenario("reorder_10pct", 0, 0, 0, 0.1, 0),
+				make_scenario("rate_10mbit", 0, 0, 0, 0, 1250000),
+				make_scenario("loss_1pct_delay_5ms_reorder_10pct", 0.01, 5000, 0, 0.1, 0)};
+			for (const Scenario &scenario : scenarios)
+			{
+				bench_impairment(scenario, 1024, 500 * scale);
+			}
+		}
+		if (only.empty() || only == "allocations")
+		{
+			// The counts are taken after the first half of the messages, once the buffer pools hold the working set.
+			bench_allocations(64, 1, 1000 * scale, false);
+			bench_allocations(64, 32, 1000 * scale, false);
+			bench_allocations(1024, 32, 1000 * scale, false);
+			bench_allocations(1024, 32, 1000 * scale, true);
+		}
+	}
+	catch (runtime_error error)
+	{
+		cerr << error.what() << endl;
+		return 1;
+	}
+	return 0;
+}
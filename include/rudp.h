@@ -8,6 +8,8 @@
 #ifndef RUDP_H
 #define RUDP_H
 
+#include <sys/uio.h>
+
 #include "rudp_macros.h"
 
 #ifdef __cplusplus
@@ -15,6 +17,136 @@ extern "C"
 {
 #endif
 
+	/**
+	 * @brief   			Type rudp_callback is the function called when an asynchronous send or receive completes.
+	 * @details 			The callback is called from the thread running the IO service of the library, so it must
+	 * 						not block or call the blocking functions of this interface.
+	 * @param connection	int ID of the connection the operation was started on.
+	 * @param length		int number of bytes sent or received, -1 if the operation failed.
+	 * @param error			int 0 if the operation succeeded, -1 if it failed.
+	 * @param context		void * pointer supplied by the caller when the operation was started.
+	 */
+	typedef void (*rudp_callback)(int connection, int length, int error, void *context);
+
+	/**
+	 * @brief   			Struct rudp_stats holds the counters of the packets and messages sent and received by connections.
+	 * @details 			Bucket 0 of a latency histogram counts the samples below 64 us, bucket i the samples from 
+	 * 						32 * 2^i to 64 * 2^i us, and the last bucket every sample from 32 * 2^(STATS_HISTOGRAM_BUCKETS - 1) us up.
+	 */
+	struct rudp_stats
+	{
+		/// Data packets sent, including retransmissions.
+		unsigned long long packets_sent;
+		/// Data packets received, including duplicates.
+		unsigned long long packets_received;
+		/// Bytes sent in every datagram, including headers and ACKs.
+		unsigned long long bytes_sent;
+		/// Bytes received in every datagram, including headers and ACKs.
+		unsigned long long bytes_received;
+		/// ACKs sent on their own, not counting those carried by data packets.
+		unsigned long long acks_sent;
+		/// ACKs received, both on their own and carried by data packets.
+		unsigned long long acks_received;
+		/// Data packets that were transmitted again.
+		unsigned long long retransmissions;
+		/// Expiries of a retransmission timer that retransmitted packets.
+		unsigned long long timeouts;
+		/// Data packets received that had already been received.
+		unsigned long long duplicates;
+		/// Data packets received ahead of a missing one and held until it arrived.
+		unsigned long long packets_reordered;
+		/// Data packets received that were malformed or left unacknowledged as they could not be held.
+		unsigned long long packets_dropped;
+		/// Messages acknowledged by their receiver, and unreliable messages sent.
+		unsigned long long messages_sent;
+		/// Messages delivered to a receive or to the receive queue.
+		unsigned long long messages_received;
+		/// Messages abandoned before they were acknowledged.
+		unsigned long long messages_failed;
+		/// Messages dropped at the end of their lifetime or limit of transmissions, as they were sent to be.
+		unsigned long long messages_expired;
+		/// Datagrams dropped by the kernel as the receive buffer of the socket was full, where the kernel reports it.
+		unsigned long long kernel_drops;
+		/// Round trip times measured from packets that were only transmitted once.
+		unsigned long long rtt_histogram[STATS_HISTOGRAM_BUCKETS];
+		/// Times from the first transmission of a packet to its ACK, including packets that were retransmitted.
+		unsigned long long ack_latency_histogram[STATS_HISTOGRAM_BUCKETS];
+	};
+
+	/**
+	 * @brief   			Struct rudp_impairment describes what an impaired connection does to the datagrams it sends.
+	 * @details 			It should be filled with the defaults by rudp_impairment_init() before it is changed.
+	 */
+	struct rudp_impairment
+	{
+		/// Probability that a datagram is dropped.
+		double loss;
+		/// Probability that a datagram that is not dropped is sent twice.
+		double duplicate;
+		/// Probability that a datagram is held back by reorder_delay_us so that the datagrams after it overtake it.
+		double reorder;
+		/// Delay added to every datagram in microseconds.
+		int delay_us;
+		/// Spread of the delay added to every datagram in microseconds, the delay never goes below 0.
+		int jitter_us;
+		/// Distribution the jitter is drawn from, IMPAIRMENT_JITTER_UNIFORM or IMPAIRMENT_JITTER_NORMAL.
+		int jitter_distribution;
+		/// Extra delay of a reordered datagram in microseconds.
+		int reorder_delay_us;
+		/// Rate at which datagrams are sent in bytes per second, 0 for no limit.
+		unsigned long long rate_bytes_per_s;
+		/// Maximum number of datagrams held back at once, more are dropped.
+		int queue_limit;
+		/// Seed of the generator, the same seed and datagrams give the same impairment.
+		unsigned int seed;
+	};
+
+	/**
+	 * @brief   			Struct rudp_delivery describes how a message is delivered.
+	 * @details 			It should be filled with the defaults by rudp_delivery_init() before it is changed.
+	 */
+	struct rudp_delivery
+	{
+		/// DELIVERY_CLASS_RELIABLE, DELIVERY_CLASS_UNORDERED or DELIVERY_CLASS_UNRELIABLE.
+		int delivery_class;
+		/// Time in milliseconds after which a reliable message that has not been acknowledged is dropped, -1 for no limit.
+		int lifetime_ms;
+		/// Maximum number of transmissions of a reliable message before it is dropped, -1 for the send retries limit.
+		int max_attempts;
+		/// Stream of the message from 0 to 65535, each of which is delivered in order independently of the others.
+		int stream;
+	};
+
+	/**
+	 * @brief   			Struct rudp_message is one message of a batch sent with rudp_send_batch() or received with
+	 * 						rudp_receive_batch().
+	 * @details 			It should be filled with the defaults by rudp_message_init() before it is changed.
+	 */
+	struct rudp_message
+	{
+		/// Buffer holding the message to send, or into which a message is received.
+		char *buf;
+		/// Length in bytes of the message to send, or of the buffer to receive into, which is set to the length of
+		/// the message received.
+		int len;
+		/// Address the message is sent to, an empty string to send it to the remote endpoint, or the address it
+		/// was received from.
+		char address[IPV4_ADDRESS_LENGTH_BYTES];
+		/// Port number the message is sent to, or was received from.
+		int port;
+		/// How the message is sent, of which only the stream is set for a message received.
+		struct rudp_delivery delivery;
+	};
+
+	/**
+	 * @brief   				Function rudp_set_io_threads sets the number of threads that run the IO services the 
+	 * 							connections are spread across. It must be called before the first connection is made.
+	 * @param 	count			[in]	int number of threads, 0 (DEFAULT_IO_SERVICE_COUNT) for one per core.
+	 * @param 	pin_to_cores	[in]	int non-zero to pin each thread to its own core.
+	 * @param 	error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_io_threads(int count, int pin_to_cores, int *error);
+
 	/**
 	 * @brief   			Function rudp_make_connection creates a connection for later defintion and use.
 	 * @param   timeout_ms 	[in]	int for the length of the time to wait for an ACK before retransmission.
@@ -23,6 +155,81 @@ extern "C"
 	 */
 	int rudp_make_connection(int timeout_ms, int *error);
 
+	/**
+	 * @brief   			Function rudp_make_connection_with_transport creates a connection that sends and receives its
+	 * 						datagrams through a transport other than the default.
+	 * @param   timeout_ms 	[in]	int for the length of the time to wait for an ACK before retransmission.
+	 * @param 	transport	[in]	int TRANSPORT_ASIO for the Boost ASIO reactor, or TRANSPORT_IO_URING for an io_uring
+	 * 								on Linux.
+	 * @param 	error		[out]	int * to hold any errors that occur, 0 if none.
+	 * @return  			int connection number corresponding to the newly created connection.
+	 */
+	int rudp_make_connection_with_transport(int timeout_ms, int transport, int *error);
+
+	/**
+	 * @brief   			Function rudp_make_external_connection creates a connection that is driven by the application's
+	 * 						own event loop rather than by the IO threads: the loop waits for the descriptor from
+	 * 						rudp_get_fd to become readable, or for the time from rudp_get_process_timeout to pass, then
+	 * 						calls rudp_process. The blocking functions run the connection on the calling thread while
+	 * 						they wait, so they must not be called while another thread is in rudp_process.
+	 * @param   timeout_ms 	[in]	int for the length of the time to wait for an ACK before retransmission.
+	 * @param 	error		[out]	int * to hold any errors that occur, 0 if none.
+	 * @return  			int connection number corresponding to the newly created connection.
+	 */
+	int rudp_make_external_connection(int timeout_ms, int *error);
+
+	/**
+	 * @brief   			Function rudp_make_sharded_connections creates a group of connections that all receive on one
+	 * 						port through SO_REUSEPORT, each serviced by its own IO thread. The kernel sends every
+	 * 						datagram of a peer to the same shard, and each shard is received from separately.
+	 * @param   timeout_ms 	[in]	int for the length of the time to wait for an ACK before retransmission.
+	 * @param 	port		[in]	unsigned short port number that every shard is bound to.
+	 * @param 	shards		[in]	int number of shards, at least 1, usually the number of IO threads.
+	 * @param 	connections	[out]	int * array of at least shards elements to hold the connection numbers of the shards.
+	 * @param 	error		[out]	int * to hold any errors that occur, 0 if none.
+	 * @return  			int number of shards created, 0 on error.
+	 */
+	int rudp_make_sharded_connections(int timeout_ms, unsigned short port, int shards, int *connections, int *error);
+
+	/**
+	 * @brief 				Function rudp_get_fd gets the descriptor of the socket of a connection, which an event loop waits
+	 * 						to become readable. It must not be read, written or closed by the application.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 * @return				int descriptor of the socket.
+	 */
+	int rudp_get_fd(int connection, int *error);
+
+	/**
+	 * @brief 				Function rudp_get_process_timeout gets the time after which rudp_process must next be called if
+	 * 						the socket does not become readable first, in the form taken by epoll_wait and poll.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 * @return				int milliseconds rounded up, 0 if handlers are ready to run, -1 if no timer is armed.
+	 */
+	int rudp_get_process_timeout(int connection, int *error);
+
+	/**
+	 * @brief 				Function rudp_process runs the work of a connection made by rudp_make_external_connection that
+	 * 						is ready without blocking: it reads the datagrams waiting on the socket, retransmits the
+	 * 						packets whose timers have expired and invokes the completions of asynchronous operations.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 * @return				int number of handlers run.
+	 */
+	int rudp_process(int connection, int *error);
+
+	/**
+	 * @brief   			Function rudp_remove_connection closes a connection and frees it, failing the operations still in 
+	 * 						progress on it. A call using the connection in another thread keeps it until that call returns.
+	 * @warning				When called from a completion callback of the connection, such as one of rudp_async_send, the
+	 * 						connection is closed straight away but only freed after the callback returns, once the
+	 * 						callbacks of the operations it failed have run. The ID must not be used again.
+	 * @param 	connection	[in]	int ID of the connection.
+	 * @param 	error		[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_remove_connection(int connection, int *error);
+
 	/**
 	 * @brief           	Function rudp_set_remote_endpoint sets the remote endpoint of the connection where packets will be sent.
 	 * @param connection	[in]	int ID of the connection.
@@ -51,6 +258,183 @@ extern "C"
 	 */
 	void rudp_set_send_retries_limit(int connection, int send_retries_limit, int *error);
 
+	/**
+	 * @brief 				Function rudp_set_window_size sets the maximum number of packets that can be in flight at once.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param window_size	[in]	int number of packets that can be sent before an ACK is received, 1 for Stop-and-Wait.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_window_size(int connection, int window_size, int *error);
+
+	/**
+	 * @brief 				Function rudp_set_mtu sets the largest IP packet that can be sent without being fragmented by IP,
+	 * 						larger messages are split into fragments that are retransmitted and reassembled separately.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param mtu			[in]	int MTU in bytes, including the IPv4, UDP and RUDP headers, DEFAULT_MTU by default.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_mtu(int connection, int mtu, int *error);
+
+	/**
+	 * @brief 				Function rudp_set_ack_policy sets when the ACKs for received packets are sent, as a single
+	 * 						ACK acknowledges every packet delivered from a sender so far.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param ack_packets	[in]	int number of packets after which an ACK is sent.
+	 * @param ack_delay_us	[in]	int maximum time in microseconds that an ACK is delayed, 0 to never delay ACKs.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_ack_policy(int connection, int ack_packets, int ack_delay_us, int *error);
+
+	/**
+	 * @brief 				Function rudp_set_adaptive_timeout sets if the retransmission timeout adapts to the measured
+	 * 						round trip time, backing off on every timeout, or is fixed at the timeout of the connection.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param adaptive		[in]	int 1 for an adaptive timeout (the default), 0 for a fixed timeout.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_adaptive_timeout(int connection, int adaptive, int *error);
+
+	/**
+	 * @brief 				Function rudp_set_timeout_limits sets the range within which an adaptive timeout is kept.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param min_ms		[in]	int minimum timeout in milliseconds.
+	 * @param max_ms		[in]	int maximum timeout in milliseconds, which also limits the backoff.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_timeout_limits(int connection, int min_ms, int max_ms, int *error);
+
+	/**
+	 * @brief 				Function rudp_set_peer_idle_timeout sets how long the receive state of a sender is kept after
+	 * 						its last packet, a sender that is evicted starts a new session with its next packet.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param timeout_ms	[in]	int timeout in milliseconds, DEFAULT_PEER_IDLE_TIMEOUT_MS by default or -1 to never evict.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_peer_idle_timeout(int connection, int timeout_ms, int *error);
+
+	/**
+	 * @brief 				Function rudp_set_max_message_size sets the size of the largest message that is received, the
+	 * 						packets of larger messages are dropped before any memory is taken for them.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param size			[in]	int size in bytes, DEFAULT_MAX_MESSAGE_SIZE by default.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_max_message_size(int connection, int size, int *error);
+
+	/**
+	 * @brief 				Function rudp_set_buffer_pool_size reserves the pool from which the connection takes the memory
+	 * 						of its queues, payload copies and I/O operations, so that it does not allocate once running.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param bytes			[in]	int bytes to reserve, DEFAULT_BUFFER_POOL_BYTES by default, the pool never shrinks.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_buffer_pool_size(int connection, int bytes, int *error);
+
+	/**
+	 * @brief 				Function rudp_set_socket_buffer_sizes sets the sizes of the kernel buffers of the socket of the
+	 * 						connection, so that a burst of datagrams is not dropped by the kernel before it is read.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param receive_bytes	[in]	int size in bytes of the receive buffer (SO_RCVBUF), 0 to leave it as it is.
+	 * @param send_bytes	[in]	int size in bytes of the send buffer (SO_SNDBUF), 0 to leave it as it is.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_socket_buffer_sizes(int connection, int receive_bytes, int send_bytes, int *error);
+
+	/**
+	 * @brief 				Function rudp_set_dscp sets the Differentiated Services code point the datagrams of the
+	 * 						connection are marked with.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param dscp			[in]	int code point from 0 (best effort, the default) to 63.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_dscp(int connection, int dscp, int *error);
+
+	/**
+	 * @brief 				Function rudp_set_busy_poll sets how long a read of the socket of the connection busy polls the
+	 * 						network device for datagrams rather than waiting for an interrupt (SO_BUSY_POLL).
+	 * @param connection	[in]	int ID of the connection.
+	 * @param busy_poll_us	[in]	int time in microseconds to busy poll for, 0 to wait for interrupts (the default).
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_busy_poll(int connection, int busy_poll_us, int *error);
+
+	/**
+	 * @brief 				Function rudp_set_segmentation_offload sets if datagrams of the connection to one endpoint are
+	 * 						sent together with UDP GSO and received together with UDP GRO on Linux.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param enabled		[in]	int non-zero to use segmentation offload, 0 to send and receive every datagram on its own
+	 * 						(the default).
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_segmentation_offload(int connection, int enabled, int *error);
+
+	/**
+	 * @brief 				Function rudp_impairment_init fills an impairment with the defaults, which impair nothing.
+	 * @param impairment	[out]	struct rudp_impairment * to be filled.
+	 */
+	void rudp_impairment_init(struct rudp_impairment *impairment);
+
+	/**
+	 * @brief 				Function rudp_set_impairment passes every datagram the connection sends through a seeded 
+	 * 						link that drops, duplicates, delays and reorders them and limits their rate.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param impairment	[in]	const struct rudp_impairment * impairment of the datagrams, NULL to stop impairing them.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_impairment(int connection, const struct rudp_impairment *impairment, int *error);
+
+	/**
+	 * @brief 				Function rudp_set_congestion_control sets the congestion controller of every endpoint the
+	 * 						connection sends to, which limits its packets in flight and paces them.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param algorithm		[in]	int CONGESTION_CONTROL_NEWRENO (DEFAULT_CONGESTION_CONTROL), CONGESTION_CONTROL_BBR
+	 * 						or CONGESTION_CONTROL_NONE.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_congestion_control(int connection, int algorithm, int *error);
+
+	/**
+	 * @brief 				Function rudp_set_rate_limit limits the rate at which the connection sends data packets.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param bytes_per_s	[in]	unsigned long long largest rate in bytes per second, 0 for no limit.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_rate_limit(int connection, unsigned long long bytes_per_s, int *error);
+
+	/**
+	 * @brief 				Function rudp_set_coalescing packs small reliable messages sent together into one packet,
+	 * 						which the receiver delivers as separate messages.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param delay_us		[in]	int longest time in microseconds that a message waits for others to share its packet
+	 * 						before it is sent, or until rudp_flush, -1 to send each message in its own packet (the default).
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_set_coalescing(int connection, int delay_us, int *error);
+
+	/**
+	 * @brief 				Function rudp_get_timeout gets the current retransmission timeout for the remote endpoint.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 * @return				int timeout in milliseconds.
+	 */
+	int rudp_get_timeout(int connection, int *error);
+
+	/**
+	 * @brief 				Function rudp_get_stats gets the counters of a connection without blocking its IO.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param stats			[out]	struct rudp_stats * to which the counters will be written.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_get_stats(int connection, struct rudp_stats *stats, int *error);
+
+	/**
+	 * @brief 				Function rudp_get_global_stats gets the sum of the counters of every connection that has been 
+	 * 						made, including those that have been removed.
+	 * @param stats			[out]	struct rudp_stats * to which the counters will be written.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_get_global_stats(struct rudp_stats *stats, int *error);
+
 	/**
 	 * @brief 				Function rudp_reset_connection_send resets the sequence number of the send channel to 0.
 	 * @param connection	[in]	int ID of the connection.
@@ -75,6 +459,116 @@ extern "C"
 	 */
 	int rudp_send(int connection, const char *buf, int len, int *error);
 
+	/**
+	 * @brief       		Function rudp_send_to sends the data contained in the buffer to any remote endpoint, using a 
+	 * 						separate sequence number and send window for each one so one connection can serve many peers.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param buf   		[in]	char * buffer that contains the data to be sent.
+	 * @param len   		[in]	int length in bytes of the data contained in buf.
+	 * @param address   	[in]	char * address that the packet should be sent to.
+	 * @param port      	[in]	unsigned short port number that the packet should be sent to.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 * @return      		int number of bytes successfully sent to the remote endpoint.
+	 */
+	int rudp_send_to(int connection, const char *buf, int len, char *address, unsigned short port, int *error);
+
+	/**
+	 * @brief 				Function rudp_delivery_init fills a delivery with the defaults, reliable and in order.
+	 * @param delivery		[out]	struct rudp_delivery * to be filled.
+	 */
+	void rudp_delivery_init(struct rudp_delivery *delivery);
+
+	/**
+	 * @brief       		Function rudp_send_with_delivery sends the data contained in the buffer to the remote 
+	 * 						endpoint that was previously set with a delivery class.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param buf   		[in]	char * buffer that contains the data to be sent.
+	 * @param len   		[in]	int length in bytes of the data contained in buf.
+	 * @param delivery		[in]	const struct rudp_delivery * how the message is delivered.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 * @return      		int number of bytes sent, or queued to be sent for an unreliable message.
+	 */
+	int rudp_send_with_delivery(int connection, const char *buf, int len, const struct rudp_delivery *delivery, int *error);
+
+	/**
+	 * @brief       		Function rudp_send_to_with_delivery sends the data contained in the buffer to any remote 
+	 * 						endpoint with a delivery class.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param buf   		[in]	char * buffer that contains the data to be sent.
+	 * @param len   		[in]	int length in bytes of the data contained in buf.
+	 * @param address   	[in]	char * address that the packet should be sent to.
+	 * @param port      	[in]	unsigned short port number that the packet should be sent to.
+	 * @param delivery		[in]	const struct rudp_delivery * how the message is delivered.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 * @return      		int number of bytes sent, or queued to be sent for an unreliable message.
+	 */
+	int rudp_send_to_with_delivery(int connection, const char *buf, int len, char *address, unsigned short port, const struct rudp_delivery *delivery, int *error);
+
+	/**
+	 * @brief       		Function rudp_sendv sends one message gathered from an array of buffers to the remote endpoint
+	 * 						that was previously set, as rudp_send() does.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param iov   		[in]	const struct iovec * buffers that contain the data of the message, in order.
+	 * @param iovcnt   		[in]	int number of buffers.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 * @return      		int number of bytes successfully sent to the remote endpoint.
+	 */
+	int rudp_sendv(int connection, const struct iovec *iov, int iovcnt, int *error);
+
+	/**
+	 * @brief 				Function rudp_message_init fills a message with the defaults, no buffer sent reliably and in
+	 * 						order to the remote endpoint.
+	 * @param message		[out]	struct rudp_message * to be filled.
+	 */
+	void rudp_message_init(struct rudp_message *message);
+
+	/**
+	 * @brief       		Function rudp_send_batch sends each message of a batch as rudp_send_to_with_delivery() would,
+	 * 						or as rudp_send_with_delivery() would for a message with an empty address, looking up the
+	 * 						connection and locking it once for the batch and sending the packets together.
+	 * @details 			A message that fails does not stop the rest of the batch. Errors of earlier messages fail
+	 * 						the first message of the batch, which is not sent.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param messages		[in]	const struct rudp_message * messages to send.
+	 * @param count			[in]	int number of messages.
+	 * @param errors		[out]	int * array of count to hold the error of each message, 0 if it was sent.
+	 * @return      		int number of messages sent, -1 if the batch could not be sent at all.
+	 */
+	int rudp_send_batch(int connection, const struct rudp_message *messages, int count, int *errors);
+
+	/**
+	 * @brief       		Function rudp_async_send starts sending the data contained in the buffer to the remote endpoint 
+	 * 						that was previously set and returns immediately.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param buf   		[in]	char * buffer that contains the data to be sent, it must remain valid until the callback is called.
+	 * @param len   		[in]	int length in bytes of the data contained in buf.
+	 * @param callback		[in]	rudp_callback called once the data has been acknowledged or the send has failed.
+	 * @param context		[in]	void * pointer passed to the callback.
+	 * @param error			[out]	int * to hold any errors that occur while starting the send, 0 if none.
+	 */
+	void rudp_async_send(int connection, const char *buf, int len, rudp_callback callback, void *context, int *error);
+
+	/**
+	 * @brief       		Function rudp_async_send_to starts sending the data contained in the buffer to any remote 
+	 * 						endpoint and returns immediately.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param buf   		[in]	char * buffer that contains the data to be sent, it must remain valid until the callback is called.
+	 * @param len   		[in]	int length in bytes of the data contained in buf.
+	 * @param address   	[in]	char * address that the packet should be sent to.
+	 * @param port      	[in]	unsigned short port number that the packet should be sent to.
+	 * @param callback		[in]	rudp_callback called once the data has been acknowledged or the send has failed.
+	 * @param context		[in]	void * pointer passed to the callback.
+	 * @param error			[out]	int * to hold any errors that occur while starting the send, 0 if none.
+	 */
+	void rudp_async_send_to(int connection, const char *buf, int len, char *address, unsigned short port, rudp_callback callback, void *context, int *error);
+
+	/**
+	 * @brief 				Function rudp_flush blocks until every packet sent on the connection has been acknowledged or abandoned.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 */
+	void rudp_flush(int connection, int *error);
+
 	/**
 	 * @brief           	Function rudp_receive receives a packet that another connection has sent to the
 	 *                  	previously specified local endpoint then replies with an ACK.
@@ -88,6 +582,47 @@ extern "C"
 	 */
 	int rudp_receive(int connection, char *buf, int len, char *address_remote, int *port_remote, int *error);
 
+	/**
+	 * @brief           	Function rudp_receive_with_stream receives a packet as rudp_receive() does, along with the
+	 * 						stream it was sent on.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param buf       	[out]   char * buffer to which the received data will be written.
+	 * @param len       	[in]    int length of the provided buffer in bytes.
+	 * @param address   	[out]   char * address from which the packet was received.
+	 * @param port      	[out]   int * port from which the packet was received.
+	 * @param stream		[out]	int * stream on which the packet was sent.
+	 * @param error			[out]	int * to hold any errors that occur, 0 if none.
+	 * @return          	int number of bytes written to the buffer.
+	 */
+	int rudp_receive_with_stream(int connection, char *buf, int len, char *address_remote, int *port_remote, int *stream, int *error);
+
+	/**
+	 * @brief           	Function rudp_receive_batch waits for the next packet as rudp_receive() does, then takes the
+	 * 						packets that are already queued, up to the number of messages, without waiting for more.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param messages		[in, out]	struct rudp_message * buffers and their lengths, each set to the length,
+	 * 						address, port and stream of the packet received.
+	 * @param count			[in]	int number of messages.
+	 * @param errors		[out]	int * array of count to hold the error of each message, 0 if it was received.
+	 * @return          	int number of messages whose errors were set, the last of which failed if its buffer was
+	 * 						too small for the next packet, -1 if nothing could be received.
+	 */
+	int rudp_receive_batch(int connection, struct rudp_message *messages, int count, int *errors);
+
+	/**
+	 * @brief           	Function rudp_async_receive starts a receive of the next packet that another connection sends 
+	 * 						to the previously specified local endpoint and returns immediately.
+	 * @param connection	[in]	int ID of the connection.
+	 * @param buf       	[out]   char * buffer to which the received data will be written, valid once the callback is called.
+	 * @param len       	[in]    int length of the provided buffer in bytes.
+	 * @param address   	[out]   char * address from which the packet was received.
+	 * @param port      	[out]   int * port from which the packet was received.
+	 * @param callback		[in]	rudp_callback called once the output arguments have been written or the receive has failed.
+	 * @param context		[in]	void * pointer passed to the callback.
+	 * @param error			[out]	int * to hold any errors that occur while starting the receive, 0 if none.
+	 */
+	void rudp_async_receive(int connection, char *buf, int len, char *address_remote, int *port_remote, rudp_callback callback, void *context, int *error);
+
 #ifdef __cplusplus
 }
 #endif
@@ -5,4 +5,70 @@
 
 #define DEFAULT_TIMEOUT_MS 100
 
+#define DEFAULT_MIN_TIMEOUT_MS 10
+
+#define DEFAULT_MAX_TIMEOUT_MS 60000
+
+#define DEFAULT_RECEIVE_QUEUE_LIMIT 1024
+
+#define DEFAULT_ACK_PACKETS 2
+
+#define DEFAULT_ACK_DELAY_US 500
+
+#define DEFAULT_MTU 1500
+
+#define DEFAULT_IO_SERVICE_COUNT 0
+
+#define DEFAULT_PEER_IDLE_TIMEOUT_MS 120000
+
+#define DEFAULT_MAX_MESSAGE_SIZE 16777216
+
+#define STATS_HISTOGRAM_BUCKETS 16
+
+#define IMPAIRMENT_JITTER_UNIFORM 0
+
+#define IMPAIRMENT_JITTER_NORMAL 1
+
+#define DEFAULT_IMPAIRMENT_REORDER_DELAY_US 1000
+
+#define DEFAULT_IMPAIRMENT_QUEUE_LIMIT 1000
+
+#define CONGESTION_CONTROL_NONE 0
+
+#define CONGESTION_CONTROL_NEWRENO 1
+
+#define CONGESTION_CONTROL_BBR 2
+
+#define DEFAULT_CONGESTION_CONTROL CONGESTION_CONTROL_NEWRENO
+
+#define INITIAL_CONGESTION_WINDOW 10
+
+#define PACING_BURST_US 1000
+
+#define TRANSPORT_ASIO 0
+
+#define TRANSPORT_IO_URING 1
+
+#define DEFAULT_TRANSPORT TRANSPORT_ASIO
+
+#define DEFAULT_BUFFER_POOL_BYTES 65536
+
+#define DEFAULT_BUFFER_POOL_SLAB_BYTES 65536
+
+#define DELIVERY_CLASS_RELIABLE 0
+
+#define DELIVERY_CLASS_UNORDERED 1
+
+#define DELIVERY_CLASS_UNRELIABLE 2
+
+#define TRACE_LEVEL_NONE 0
+
+#define TRACE_LEVEL_EVENT 1
+
+#define TRACE_LEVEL_PACKET 2
+
+#ifndef RUDP_TRACE_LEVEL
+#define RUDP_TRACE_LEVEL TRACE_LEVEL_PACKET
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,110 @@
+/**
+ * @file 	BufferPool.cpp
+ * @author 	James Horner (jwehorner@gmail.com)
+ * @brief 	File BufferPool.cpp contains the definition of the BufferPool class of the RUDP library.
+ * @details Blocks are carved from slabs in powers of two and kept on a free list for their size once they are
+ * 			freed, so a connection in a steady state reuses the same blocks for every message.
+ * @date 	2022-07-18
+ * @copyright Copyright (c) 2022
+ */
+#ifndef BUFFERPOOL_CPP
+#define BUFFERPOOL_CPP
+
+#include "BufferPool.hpp"
+
+#include <algorithm>
+#include <new>
+
+using namespace rudp;
+
+BufferPool::BufferPool(size_t capacity) : slab_position(nullptr), slab_end(nullptr), slab_bytes(0)
+{
+	free_lists.fill(nullptr);
+	reserve(capacity);
+}
+
+void *BufferPool::allocate(size_t bytes)
+{
+	if (bytes > BUFFER_POOL_MAX_BLOCK)
+	{
+		return ::operator new(bytes);
+	}
+	size_t index = size_class(bytes);
+	size_t block_size = BUFFER_POOL_MIN_BLOCK << index;
+	std::lock_guard<std::mutex> lock(mutex);
+	FreeBlock *block = free_lists[index];
+	if (block != nullptr)
+	{
+		free_lists[index] = block->next;
+		return block;
+	}
+	if ((size_t)(slab_end - slab_position) < block_size)
+	{
+		add_slab(std::max((size_t)DEFAULT_BUFFER_POOL_SLAB_BYTES, block_size));
+	}
+	void *carved = slab_position;
+	slab_position += block_size;
+	return carved;
+}
+
+void BufferPool::deallocate(void *block, size_t bytes) noexcept
+{
+	if (bytes > BUFFER_POOL_MAX_BLOCK)
+	{
+		::operator delete(block);
+		return;
+	}
+	size_t index = size_class(bytes);
+	std::lock_guard<std::mutex> lock(mutex);
+	FreeBlock *free_block = static_cast<FreeBlock *>(block);
+	free_block->next = free_lists[index];
+	free_lists[index] = free_block;
+}
+
+void BufferPool::reserve(size_t capacity)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (capacity > slab_bytes)
+	{
+		add_slab(capacity - slab_bytes);
+	}
+}
+
+size_t BufferPool::capacity()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return slab_bytes;
+}
+
+void BufferPool::add_slab(size_t bytes)
+{
+	// The end of the last slab is carved into the largest blocks that fit so that none of it is wasted.
+	for (size_t index = BUFFER_POOL_CLASSES; index-- > 0;)
+	{
+		size_t block_size = BUFFER_POOL_MIN_BLOCK << index;
+		while ((size_t)(slab_end - slab_position) >= block_size)
+		{
+			FreeBlock *free_block = reinterpret_cast<FreeBlock *>(slab_position);
+			free_block->next = free_lists[index];
+			free_lists[index] = free_block;
+			slab_position += block_size;
+		}
+	}
+	bytes = (bytes + BUFFER_POOL_MIN_BLOCK - 1) / BUFFER_POOL_MIN_BLOCK * BUFFER_POOL_MIN_BLOCK;
+	slabs.emplace_back(new char[bytes]);
+	slab_position = slabs.back().get();
+	slab_end = slab_position + bytes;
+	slab_bytes += bytes;
+}
+
+size_t BufferPool::size_class(size_t bytes)
+{
+	size_t index = 0;
+	while ((BUFFER_POOL_MIN_BLOCK << index) < bytes)
+	{
+		++index;
+	}
+	return index;
+}
+
+#endif /* BUFFERPOOL_CPP */
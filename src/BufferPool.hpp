@@ -0,0 +1,344 @@
+/**
+ * @file 	BufferPool.hpp
+ * @author 	James Horner (jwehorner@gmail.com)
+ * @brief 	File BufferPool.hpp contains the declaration of the BufferPool class and of the allocator, buffer and
+ * 			handler types that draw their memory from it in the RUDP library.
+ * @details Each connection has a slab arena from which the copies of the payloads it sends, the queues and windows of
+ * 			its channels, and the asynchronous operations of its socket and timers take their memory. Blocks that
+ * 			are freed are kept by the pool for the next block of the same size, so once a connection has reached
+ * 			its working set it sends and receives messages without calling malloc.
+ * @date 	2022-07-18
+ * @copyright Copyright (c) 2022
+ */
+#ifndef BUFFERPOOL_HPP
+#define BUFFERPOOL_HPP
+
+// Standard Libraries
+#include <array>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "rudp_macros.h"
+
+namespace rudp
+{
+    /// Size in bytes of the smallest block handed out by a buffer pool.
+    constexpr size_t BUFFER_POOL_MIN_BLOCK = 64;
+    /// Number of sizes of block kept by a buffer pool, each twice the last, up to 64 KiB.
+    constexpr size_t BUFFER_POOL_CLASSES = 11;
+    /// Size in bytes of the largest block kept by a buffer pool, larger blocks are allocated on their own.
+    constexpr size_t BUFFER_POOL_MAX_BLOCK = BUFFER_POOL_MIN_BLOCK << (BUFFER_POOL_CLASSES - 1);
+
+    /**
+     * @brief   Class BufferPool is a slab arena that hands out blocks of memory in powers of two.
+     * @details Blocks are carved from slabs, the first of which is reserved when the pool is made, and a freed
+     *          block is put on the free list of its size, from which the next block of that size is taken. The
+     *          pool grows by another slab whenever it runs out and never shrinks, so its memory is only given back
+     *          when it is destroyed. Blocks larger than BUFFER_POOL_MAX_BLOCK are allocated and freed on their
+     *          own. The pool has its own mutex, as blocks are also taken and freed by callers that do not hold the
+     *          mutex of the connection.
+     */
+    class BufferPool
+    {
+    public:
+        /**
+         * @brief           Constructor for the BufferPool class that reserves its first slab.
+         * @param capacity  size_t bytes reserved up front, 0 to reserve nothing until the first block is taken.
+         */
+        BufferPool(size_t capacity);
+
+        /**
+         * @brief Delete the cloning constructor so the blocks of a pool are only freed once.
+         */
+        BufferPool(const BufferPool &) = delete;
+
+        /**
+         * @brief Delete the assignment operator so the blocks of a pool are only freed once.
+         */
+        void operator=(const BufferPool &) = delete;
+
+        /**
+         * @brief           Method allocate takes a block from the pool.
+         * @param bytes     size_t size of the block in bytes.
+         * @return          void * block of at least the size, aligned for any type.
+         */
+        void *allocate(size_t bytes);
+
+        /**
+         * @brief           Method deallocate gives a block back to the pool.
+         * @param block     void * block taken by allocate().
+         * @param bytes     size_t size in bytes that the block was taken with.
+         */
+        void deallocate(void *block, size_t bytes) noexcept;
+
+        /**
+         * @brief           Method reserve adds slabs to the pool until it holds at least a number of bytes, so that
+         *                  the blocks a connection needs are reserved before it starts sending.
+         * @param capacity  size_t bytes that the slabs of the pool hold in total.
+         */
+        void reserve(size_t capacity);
+
+        /**
+         * @brief   Method capacity gets the number of bytes held by the slabs of the pool.
+         * @return  size_t bytes of the slabs, whether their blocks are in use or free.
+         */
+        size_t capacity();
+
+    private:
+        /**
+         * @brief   Struct FreeBlock is the link written into a free block of the pool.
+         */
+        struct FreeBlock
+        {
+            /// Next free block of the same size.
+            FreeBlock *next;
+        };
+
+        /// Mutex of the free lists and slabs.
+        std::mutex mutex;
+        /// Free blocks of each size, class i holding blocks of BUFFER_POOL_MIN_BLOCK << i bytes.
+        std::array<FreeBlock *, BUFFER_POOL_CLASSES> free_lists;
+        /// Slabs that the blocks are carved from, each kept until the pool is destroyed.
+        std::vector<std::unique_ptr<char[]>> slabs;
+        /// Next byte of the last slab that has not been carved into a block.
+        char *slab_position;
+        /// End of the last slab.
+        char *slab_end;
+        /// Bytes held by the slabs of the pool.
+        size_t slab_bytes;
+
+        /**
+         * @brief           Method add_slab adds a slab from which the next blocks are carved.
+         * @param bytes     size_t size of the slab in bytes.
+         * @note            The caller must hold the mutex.
+         */
+        void add_slab(size_t bytes);
+
+        /**
+         * @brief           Method size_class gets the class of the blocks that hold a number of bytes.
+         * @param bytes     size_t bytes, at most BUFFER_POOL_MAX_BLOCK.
+         * @return          size_t index of the class.
+         */
+        static size_t size_class(size_t bytes);
+    };
+
+    /**
+     * @brief   Class PoolAllocator is an allocator for the standard containers that takes their memory from a
+     *          buffer pool, so that a queue whose elements come and go reuses the same blocks.
+     */
+    template <typename T>
+    class PoolAllocator
+    {
+    public:
+        typedef T value_type;
+
+        /**
+         * @brief       Constructor for the PoolAllocator class.
+         * @param pool  BufferPool * pool that the memory is taken from, which must outlive the container.
+         */
+        PoolAllocator(BufferPool *pool) noexcept : pool(pool) {}
+
+        /**
+         * @brief       Constructor for the PoolAllocator class from an allocator of another type of the same pool.
+         * @param other const PoolAllocator<U> & allocator of the other type.
+         */
+        template <typename U>
+        PoolAllocator(const PoolAllocator<U> &other) noexcept : pool(other.pool) {}
+
+        T *allocate(size_t count)
+        {
+            return static_cast<T *>(pool->allocate(count * sizeof(T)));
+        }
+
+        void deallocate(T *elements, size_t count) noexcept
+        {
+            pool->deallocate(elements, count * sizeof(T));
+        }
+
+        template <typename U>
+        bool operator==(const PoolAllocator<U> &other) const noexcept
+        {
+            return pool == other.pool;
+        }
+
+        template <typename U>
+        bool operator!=(const PoolAllocator<U> &other) const noexcept
+        {
+            return pool != other.pool;
+        }
+
+        /// Pool that the memory is taken from.
+        BufferPool *pool;
+    };
+
+    /**
+     * @brief   Type PoolDeque is a deque whose blocks are taken from a buffer pool.
+     */
+    template <typename T>
+    using PoolDeque = std::deque<T, PoolAllocator<T>>;
+
+    /**
+     * @brief   Type PoolVector is a vector whose storage is taken from a buffer pool.
+     */
+    template <typename T>
+    using PoolVector = std::vector<T, PoolAllocator<T>>;
+
+    /**
+     * @brief   Class PooledBuffer is a buffer of bytes taken from a buffer pool and given back when it is destroyed.
+     * @details Moving a buffer moves the block, so the data stays in place, like the data of a moved vector.
+     */
+    class PooledBuffer
+    {
+    public:
+        /**
+         * @brief Constructor for the PooledBuffer class of an empty buffer.
+         */
+        PooledBuffer() : pool(nullptr), buffer(nullptr), length(0) {}
+
+        /**
+         * @brief           Constructor for the PooledBuffer class that takes a block from a pool.
+         * @param pool      BufferPool * pool that the block is taken from, which must outlive the buffer.
+         * @param length    size_t length of the buffer in bytes, whose contents are not initialised.
+         */
+        PooledBuffer(BufferPool *pool, size_t length) : pool(pool), buffer(length > 0 ? static_cast<char *>(pool->allocate(length)) : nullptr), length(length) {}
+
+        PooledBuffer(PooledBuffer &&other) noexcept : pool(other.pool), buffer(other.buffer), length(other.length)
+        {
+            other.buffer = nullptr;
+            other.length = 0;
+        }
+
+        PooledBuffer &operator=(PooledBuffer &&other) noexcept
+        {
+            if (this != &other)
+            {
+                release();
+                pool = other.pool;
+                buffer = other.buffer;
+                length = other.length;
+                other.buffer = nullptr;
+                other.length = 0;
+            }
+            return *this;
+        }
+
+        PooledBuffer(const PooledBuffer &) = delete;
+
+        PooledBuffer &operator=(const PooledBuffer &) = delete;
+
+        /**
+         * @brief Destructor for the PooledBuffer class that gives the block back to its pool.
+         */
+        ~PooledBuffer()
+        {
+            release();
+        }
+
+        /**
+         * @brief   Member to get the bytes of the buffer.
+         * @return  char * bytes of the buffer, null if it is empty.
+         */
+        char *data() const
+        {
+            return buffer;
+        }
+
+        /**
+         * @brief   Member to get the length of the buffer.
+         * @return  size_t length in bytes.
+         */
+        size_t size() const
+        {
+            return length;
+        }
+
+        /**
+         * @brief   Member to check if the buffer is empty.
+         * @return  bool true if it holds no bytes.
+         */
+        bool empty() const
+        {
+            return length == 0;
+        }
+
+    private:
+        /// Pool that the block was taken from.
+        BufferPool *pool;
+        /// Block holding the bytes, null if the buffer is empty.
+        char *buffer;
+        /// Length of the buffer in bytes.
+        size_t length;
+
+        /**
+         * @brief   Member to give the block back to its pool.
+         */
+        void release()
+        {
+            if (buffer != nullptr)
+            {
+                pool->deallocate(buffer, length);
+                buffer = nullptr;
+                length = 0;
+            }
+        }
+    };
+
+    /**
+     * @brief   Class PoolHandler wraps the handler of an asynchronous operation of Boost ASIO so that the operation
+     *          takes its memory from a buffer pool instead of the heap.
+     * @details Boost ASIO allocates the state of each operation with the allocator associated with its handler, so
+     *          the timers and the receive loop of a connection re-arm with blocks that their last operation freed.
+     */
+    template <typename Handler>
+    class PoolHandler
+    {
+    public:
+        typedef PoolAllocator<void> allocator_type;
+
+        /**
+         * @brief           Constructor for the PoolHandler class.
+         * @param pool      BufferPool * pool that the operation takes its memory from.
+         * @param handler   Handler handler that is invoked when the operation completes.
+         */
+        PoolHandler(BufferPool *pool, Handler handler) : pool(pool), handler(std::move(handler)) {}
+
+        /**
+         * @brief   Member to get the allocator of the operation, which Boost ASIO looks up.
+         * @return  allocator_type allocator of the pool.
+         */
+        allocator_type get_allocator() const noexcept
+        {
+            return allocator_type(pool);
+        }
+
+        template <typename... Args>
+        void operator()(Args &&...args)
+        {
+            handler(std::forward<Args>(args)...);
+        }
+
+    private:
+        /// Pool that the operation takes its memory from.
+        BufferPool *pool;
+        /// Handler invoked when the operation completes.
+        Handler handler;
+    };
+
+    /**
+     * @brief           Function make_pool_handler wraps a handler so that its operation takes its memory from a pool.
+     * @param pool      BufferPool & pool that the operation takes its memory from.
+     * @param handler   Handler handler that is invoked when the operation completes.
+     * @return          PoolHandler<Handler> wrapped handler.
+     */
+    template <typename Handler>
+    PoolHandler<Handler> make_pool_handler(BufferPool &pool, Handler handler)
+    {
+        return PoolHandler<Handler>(&pool, std::move(handler));
+    }
+}
+
+#endif /* BUFFERPOOL_HPP */
@@ -0,0 +1,279 @@
+/**
+ * @file 	CongestionControl.cpp
+ * @author 	James Horner (jwehorner@gmail.com)
+ * @brief 	File CongestionControl.cpp contains the definition of the CongestionController classes and the TokenBucket
+ * 			class of the RUDP library.
+ * @details Each send channel of a connection has a congestion controller that limits how many packets it keeps in
+ * 			flight and the rate at which it paces them, and a token bucket that spaces the packets at that rate.
+ * @date 	2022-07-18
+ * @copyright Copyright (c) 2022
+ */
+#ifndef CONGESTIONCONTROL_CPP
+#define CONGESTIONCONTROL_CPP
+
+#include "CongestionControl.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+using namespace rudp;
+
+CongestionController::CongestionController() : packet_bytes(0), delivered(0), delivered_time(boost::posix_time::neg_infin), next_round_delivered(0) {}
+
+DeliveryState CongestionController::sent(size_t bytes, const boost::posix_time::ptime &now)
+{
+	packet_bytes = std::max(packet_bytes, bytes);
+	// Until something is delivered the rate is measured from the time the first packet was sent.
+	if (delivered_time.is_special())
+	{
+		delivered_time = now;
+	}
+	return DeliveryState{delivered, delivered_time};
+}
+
+void CongestionController::acked(const DeliveryState &state, size_t bytes, bool retransmitted, double rtt_ms, size_t in_flight, const boost::posix_time::ptime &now)
+{
+	delivered += bytes;
+	delivered_time = now;
+	AckSample sample = AckSample{bytes, rtt_ms, 0, false, in_flight, now};
+
+	// The rate is the bytes delivered while the packet was in flight over the time they took, which is not known
+	// for a retransmitted packet as its ACK could be for an earlier transmission.
+	int64_t interval_us = (now - state.delivered_time).total_microseconds();
+	if (!retransmitted && interval_us > 0)
+	{
+		sample.delivery_rate = (double)(delivered - state.delivered) * 1000000 / interval_us;
+	}
+	// A round trip ends once a packet sent after the previous one ended is acknowledged.
+	if (state.delivered >= next_round_delivered)
+	{
+		next_round_delivered = delivered;
+		sample.round_start = true;
+	}
+	on_ack(sample);
+}
+
+NewRenoController::NewRenoController() : window(INITIAL_CONGESTION_WINDOW), slow_start_threshold(INFINITY), srtt_ms(0) {}
+
+void NewRenoController::on_ack(const AckSample &sample)
+{
+	if (sample.rtt_ms >= 0)
+	{
+		srtt_ms = srtt_ms > 0 ? 0.875 * srtt_ms + 0.125 * sample.rtt_ms : sample.rtt_ms;
+	}
+	// The window only grows while it is being used, so a sender that has little to send cannot build a window
+	// that it would later burst into.
+	if ((double)(sample.in_flight + 1) * 2 < window)
+	{
+		return;
+	}
+	if (window < slow_start_threshold)
+	{
+		window += 1;
+	}
+	else
+	{
+		window += 1 / window;
+	}
+}
+
+void NewRenoController::on_loss(const boost::posix_time::ptime &/*now*/)
+{
+	slow_start_threshold = std::max(window / 2, 2.0);
+	window = slow_start_threshold;
+}
+
+void NewRenoController::on_timeout(const boost::posix_time::ptime &/*now*/)
+{
+	slow_start_threshold = std::max(window / 2, 2.0);
+	window = 1;
+}
+
+size_t NewRenoController::congestion_window() const
+{
+	return std::max((size_t)1, (size_t)window);
+}
+
+double NewRenoController::pacing_rate() const
+{
+	if (srtt_ms <= 0)
+	{
+		return 0;
+	}
+	// Pace a little faster than the window each round trip, and twice as fast in slow start so the window can
+	// double, as in Linux.
+	double gain = window < slow_start_threshold ? 2 : 1.2;
+	return gain * window * packet_bytes * 1000 / srtt_ms;
+}
+
+/// Pacing gain of startup, 2 / ln(2), the smallest that doubles the rate delivered each round trip.
+static const double BBR_HIGH_GAIN = 2.885;
+/// Pacing gains cycled through while probing for bandwidth.
+static const double BBR_PROBE_GAINS[] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+/// Time for which the smallest round trip time is kept before a larger one replaces it.
+static const boost::posix_time::time_duration BBR_MIN_RTT_WINDOW = boost::posix_time::seconds(10);
+
+BbrController::BbrController() : mode(MODE_STARTUP), round_bandwidths{}, round_count(0), bottleneck_bandwidth(0), full_bandwidth(0), full_bandwidth_rounds(0), min_rtt_ms(-1), min_rtt_time(boost::posix_time::neg_infin), cycle_index(0), cycle_time(boost::posix_time::neg_infin), pacing_gain(BBR_HIGH_GAIN), window_gain(BBR_HIGH_GAIN), timed_out(false) {}
+
+void BbrController::on_ack(const AckSample &sample)
+{
+	timed_out = false;
+	if (sample.rtt_ms >= 0 && (min_rtt_ms < 0 || sample.rtt_ms <= min_rtt_ms || sample.now - min_rtt_time > BBR_MIN_RTT_WINDOW))
+	{
+		min_rtt_ms = sample.rtt_ms;
+		min_rtt_time = sample.now;
+	}
+
+	// Keep the largest rate of each round trip, the bottleneck bandwidth being the largest of the recent ones.
+	if (sample.round_start)
+	{
+		++round_count;
+		round_bandwidths[round_count % BANDWIDTH_ROUNDS] = 0;
+	}
+	double &round_bandwidth = round_bandwidths[round_count % BANDWIDTH_ROUNDS];
+	round_bandwidth = std::max(round_bandwidth, sample.delivery_rate);
+	bottleneck_bandwidth = *std::max_element(round_bandwidths.begin(), round_bandwidths.end());
+
+	switch (mode)
+	{
+	case MODE_STARTUP:
+		// The pipe is full once three round trips have not grown the bandwidth by a quarter.
+		if (sample.round_start && bottleneck_bandwidth > 0)
+		{
+			if (bottleneck_bandwidth >= full_bandwidth * 1.25)
+			{
+				full_bandwidth = bottleneck_bandwidth;
+				full_bandwidth_rounds = 0;
+			}
+			else if (++full_bandwidth_rounds >= 3)
+			{
+				mode = MODE_DRAIN;
+				pacing_gain = 1 / BBR_HIGH_GAIN;
+			}
+		}
+		break;
+	case MODE_DRAIN:
+		// Drain the queue that startup built until only the bandwidth-delay product is in flight.
+		if ((double)sample.in_flight <= bdp_packets(1))
+		{
+			mode = MODE_PROBE_BW;
+			window_gain = 2;
+			cycle_index = 0;
+			cycle_time = sample.now;
+			pacing_gain = BBR_PROBE_GAINS[cycle_index];
+		}
+		break;
+	case MODE_PROBE_BW:
+		// Move to the next gain after each smallest round trip time.
+		if (min_rtt_ms > 0 && (sample.now - cycle_time).total_microseconds() > min_rtt_ms * 1000)
+		{
+			cycle_index = (cycle_index + 1) % (sizeof(BBR_PROBE_GAINS) / sizeof(BBR_PROBE_GAINS[0]));
+			cycle_time = sample.now;
+			pacing_gain = BBR_PROBE_GAINS[cycle_index];
+		}
+		break;
+	}
+}
+
+void BbrController::on_loss(const boost::posix_time::ptime &/*now*/) {}
+
+void BbrController::on_timeout(const boost::posix_time::ptime &/*now*/)
+{
+	timed_out = true;
+}
+
+size_t BbrController::congestion_window() const
+{
+	if (timed_out)
+	{
+		return 1;
+	}
+	double window = bdp_packets(window_gain);
+	if (window <= 0)
+	{
+		return INITIAL_CONGESTION_WINDOW;
+	}
+	return std::max((size_t)4, (size_t)std::ceil(window));
+}
+
+double BbrController::pacing_rate() const
+{
+	return pacing_gain * bottleneck_bandwidth;
+}
+
+double BbrController::bdp_packets(double gain) const
+{
+	if (bottleneck_bandwidth <= 0 || min_rtt_ms <= 0 || packet_bytes == 0)
+	{
+		return 0;
+	}
+	return gain * bottleneck_bandwidth * min_rtt_ms / 1000 / packet_bytes;
+}
+
+CongestionControlFactory rudp::make_congestion_control(int algorithm)
+{
+	switch (algorithm)
+	{
+	case CONGESTION_CONTROL_NONE:
+		return CongestionControlFactory();
+	case CONGESTION_CONTROL_NEWRENO:
+		return []()
+		{ return std::unique_ptr<CongestionController>(new NewRenoController()); };
+	case CONGESTION_CONTROL_BBR:
+		return []()
+		{ return std::unique_ptr<CongestionController>(new BbrController()); };
+	default:
+		throw std::runtime_error("[RUDP] (ERROR) [INIT] Error setting congestion control: unknown algorithm " + std::to_string(algorithm) + ".");
+	}
+}
+
+TokenBucket::TokenBucket() : rate(0), burst(0), tokens(0), last_time(boost::posix_time::neg_infin) {}
+
+void TokenBucket::set_rate(double rate_bytes_per_s, size_t packet_bytes)
+{
+	rate = rate_bytes_per_s;
+	burst = std::max(2.0 * packet_bytes, rate * PACING_BURST_US / 1000000);
+	tokens = std::min(tokens, burst);
+}
+
+boost::posix_time::ptime TokenBucket::ready_time(const boost::posix_time::ptime &now)
+{
+	if (rate <= 0)
+	{
+		return now;
+	}
+	refill(now);
+	if (tokens > 0)
+	{
+		return now;
+	}
+	return now + boost::posix_time::microseconds((int64_t)std::ceil((1 - tokens) * 1000000 / rate));
+}
+
+void TokenBucket::consume(size_t bytes, const boost::posix_time::ptime &now)
+{
+	if (rate <= 0)
+	{
+		return;
+	}
+	refill(now);
+	tokens -= bytes;
+}
+
+void TokenBucket::refill(const boost::posix_time::ptime &now)
+{
+	// The bucket starts full, and fills at the rate while it is not being used.
+	if (last_time.is_special())
+	{
+		tokens = burst;
+	}
+	else if (now > last_time)
+	{
+		tokens = std::min(burst, tokens + rate * (now - last_time).total_microseconds() / 1000000);
+	}
+	last_time = now;
+}
+
+#endif /* CONGESTIONCONTROL_CPP */
@@ -0,0 +1,310 @@
+/**
+ * @file 	CongestionControl.hpp
+ * @author 	James Horner (jwehorner@gmail.com)
+ * @brief 	File CongestionControl.hpp contains the declaration of the CongestionController classes and the TokenBucket
+ * 			class of the RUDP library.
+ * @details Each send channel of a connection has a congestion controller that limits how many packets it keeps in
+ * 			flight and the rate at which it paces them onto the wire, so that a window of packets does not arrive at
+ * 			a shared link all at once. The controllers are told of every packet sent and acknowledged and of every
+ * 			loss, and can be replaced by the application with controllers of its own.
+ * @date 	2022-07-18
+ * @copyright Copyright (c) 2022
+ */
+#ifndef CONGESTIONCONTROL_HPP
+#define CONGESTIONCONTROL_HPP
+
+// Standard Libraries
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+// Boost networking libraries
+#include <boost/asio.hpp>
+
+#include "rudp_macros.h"
+
+namespace rudp
+{
+    /**
+     * @brief   Struct DeliveryState is the progress of the deliveries of a channel when one of its packets was sent,
+     *          from which the rate of delivery is measured once the packet is acknowledged.
+     */
+    struct DeliveryState
+    {
+        /// Bytes that had been acknowledged when the packet was sent.
+        uint64_t delivered;
+        /// Time at which the last of those bytes was acknowledged.
+        boost::posix_time::ptime delivered_time;
+    };
+
+    /**
+     * @brief   Struct AckSample describes a packet that has been acknowledged.
+     */
+    struct AckSample
+    {
+        /// Bytes of the packet.
+        size_t bytes;
+        /// Round trip time of the packet in milliseconds, negative if it was not measured.
+        double rtt_ms;
+        /// Rate at which the channel delivered bytes while the packet was in flight in bytes per second, 0 if it
+        /// was not measured because the packet was retransmitted.
+        double delivery_rate;
+        /// Flag for if the packet was the first acknowledged of a new round trip.
+        bool round_start;
+        /// Number of packets still in flight.
+        size_t in_flight;
+        /// Time at which the ACK was received.
+        boost::posix_time::ptime now;
+    };
+
+    /**
+     * @brief   Class CongestionController is the base of the congestion controllers of the send channels.
+     * @details The base class keeps count of the bytes delivered and of round trips so that every controller can be
+     *          given rate samples, while the subclasses decide the congestion window and the pacing rate. A
+     *          controller is only used by its channel while the connection mutex is held.
+     */
+    class CongestionController
+    {
+    public:
+        /**
+         * @brief Constructor for the CongestionController class that starts with nothing delivered.
+         */
+        CongestionController();
+
+        virtual ~CongestionController() = default;
+
+        /**
+         * @brief           Method sent is called as a packet is transmitted.
+         * @param bytes     size_t bytes of the packet.
+         * @param now       const ptime & time at which it is sent.
+         * @return          DeliveryState progress of the deliveries to be passed to acked() with the packet.
+         */
+        DeliveryState sent(size_t bytes, const boost::posix_time::ptime &now);
+
+        /**
+         * @brief               Method acked is called as a packet in flight is acknowledged.
+         * @param state         const DeliveryState & progress returned by sent() when the packet was last sent.
+         * @param bytes         size_t bytes of the packet.
+         * @param retransmitted bool true if the packet was transmitted more than once.
+         * @param rtt_ms        double round trip time of the packet in milliseconds, negative if it was not measured.
+         * @param in_flight     size_t number of packets still in flight.
+         * @param now           const ptime & time at which the ACK was received.
+         */
+        void acked(const DeliveryState &state, size_t bytes, bool retransmitted, double rtt_ms, size_t in_flight, const boost::posix_time::ptime &now);
+
+        /**
+         * @brief       Method on_loss is called once for each episode of losses detected from the ACKs of the
+         *              packets sent after those lost.
+         * @param now   const ptime & time at which the loss was detected.
+         */
+        virtual void on_loss(const boost::posix_time::ptime &now) = 0;
+
+        /**
+         * @brief       Method on_timeout is called when the retransmission timer of the channel expires.
+         * @param now   const ptime & time at which the timer expired.
+         */
+        virtual void on_timeout(const boost::posix_time::ptime &now) = 0;
+
+        /**
+         * @brief   Method congestion_window gets the number of packets the channel may have in flight.
+         * @return  size_t number of packets, at least 1.
+         */
+        virtual size_t congestion_window() const = 0;
+
+        /**
+         * @brief   Method pacing_rate gets the rate at which the channel spaces its packets on the wire.
+         * @return  double rate in bytes per second, 0 to send them without pacing.
+         */
+        virtual double pacing_rate() const = 0;
+
+    protected:
+        /// Largest packet sent in bytes, which the windows in bytes are converted with.
+        size_t packet_bytes;
+
+        /**
+         * @brief           Method on_ack is called by acked() with a sample of the packet acknowledged.
+         * @param sample    const AckSample & sample of the packet.
+         */
+        virtual void on_ack(const AckSample &sample) = 0;
+
+    private:
+        /// Bytes acknowledged since the channel was made.
+        uint64_t delivered;
+        /// Time at which the last bytes were acknowledged.
+        boost::posix_time::ptime delivered_time;
+        /// Bytes that must have been delivered when a packet was sent for its ACK to start the next round trip.
+        uint64_t next_round_delivered;
+    };
+
+    /**
+     * @brief   Class NewRenoController is a loss-based controller that grows its window by a packet for each packet
+     *          acknowledged in slow start and by a packet each round trip after, halving it on a loss and dropping
+     *          to one packet on a timeout, as in RFC 5681 and RFC 6582. Its packets are paced at a little over the
+     *          window each smoothed round trip time.
+     */
+    class NewRenoController : public CongestionController
+    {
+    public:
+        /**
+         * @brief Constructor for the NewRenoController class that starts in slow start with the initial window.
+         */
+        NewRenoController();
+
+        void on_loss(const boost::posix_time::ptime &now) override;
+        void on_timeout(const boost::posix_time::ptime &now) override;
+        size_t congestion_window() const override;
+        double pacing_rate() const override;
+
+    protected:
+        void on_ack(const AckSample &sample) override;
+
+    private:
+        /// Window in packets.
+        double window;
+        /// Window at which slow start ends.
+        double slow_start_threshold;
+        /// Smoothed round trip time in milliseconds, 0 until it is measured.
+        double srtt_ms;
+    };
+
+    /**
+     * @brief   Class BbrController is a delay-based controller modelled on BBR, which paces its packets at the
+     *          largest rate of delivery measured over recent round trips and keeps about twice the product of that
+     *          rate and the smallest round trip time in flight, so it does not fill the queue of the bottleneck.
+     * @details It starts by doubling its rate each round trip until the rate stops growing, drains the queue this
+     *          built, then cycles its pacing gain to probe for more bandwidth and to drain what the probe queued.
+     *          Losses leave its model unchanged, but a timeout limits it to one packet in flight until the next ACK.
+     */
+    class BbrController : public CongestionController
+    {
+    public:
+        /**
+         * @brief Constructor for the BbrController class that starts in its startup mode.
+         */
+        BbrController();
+
+        void on_loss(const boost::posix_time::ptime &now) override;
+        void on_timeout(const boost::posix_time::ptime &now) override;
+        size_t congestion_window() const override;
+        double pacing_rate() const override;
+
+    protected:
+        void on_ack(const AckSample &sample) override;
+
+    private:
+        /**
+         * @brief   Enum Mode lists the modes of the controller.
+         */
+        enum Mode
+        {
+            MODE_STARTUP,
+            MODE_DRAIN,
+            MODE_PROBE_BW
+        };
+
+        /// Number of round trips over which the largest rate of delivery is kept.
+        static constexpr size_t BANDWIDTH_ROUNDS = 10;
+
+        /// Mode of the controller.
+        Mode mode;
+        /// Largest rate of delivery measured in each of the recent round trips, indexed by round % BANDWIDTH_ROUNDS.
+        std::array<double, BANDWIDTH_ROUNDS> round_bandwidths;
+        /// Number of round trips that have started.
+        uint64_t round_count;
+        /// Largest rate of delivery over the recent round trips in bytes per second.
+        double bottleneck_bandwidth;
+        /// Bandwidth that startup compares against to decide if the rate is still growing.
+        double full_bandwidth;
+        /// Number of round trips of startup in which the rate did not grow by a quarter.
+        int full_bandwidth_rounds;
+        /// Smallest round trip time measured recently in milliseconds, negative until it is measured.
+        double min_rtt_ms;
+        /// Time at which the smallest round trip time was measured.
+        boost::posix_time::ptime min_rtt_time;
+        /// Index of the pacing gain in use while probing for bandwidth.
+        size_t cycle_index;
+        /// Time at which the current pacing gain started to be used.
+        boost::posix_time::ptime cycle_time;
+        /// Gain applied to the bottleneck bandwidth to pace the packets.
+        double pacing_gain;
+        /// Gain applied to the bandwidth-delay product to get the window.
+        double window_gain;
+        /// Flag for if the retransmission timer expired since the last ACK.
+        bool timed_out;
+
+        /**
+         * @brief   Method bdp_packets gets the window in packets for a gain of the bandwidth-delay product.
+         * @param   gain double gain of the bandwidth-delay product.
+         * @return  double window in packets, 0 if the bandwidth or the round trip time has not been measured.
+         */
+        double bdp_packets(double gain) const;
+    };
+
+    /**
+     * @brief   Type CongestionControlFactory is a function that makes the congestion controller of a new send channel.
+     */
+    typedef std::function<std::unique_ptr<CongestionController>()> CongestionControlFactory;
+
+    /**
+     * @brief               Function make_congestion_control gets the factory of one of the built-in congestion controllers.
+     * @param algorithm     int CONGESTION_CONTROL_NONE, CONGESTION_CONTROL_NEWRENO or CONGESTION_CONTROL_BBR.
+     * @return              CongestionControlFactory factory of the controller, empty for CONGESTION_CONTROL_NONE.
+     * @throws              runtime_error if the algorithm is not one of these.
+     */
+    CongestionControlFactory make_congestion_control(int algorithm);
+
+    /**
+     * @brief   Class TokenBucket limits the rate at which bytes are sent, letting through a burst of up to a
+     *          millisecond of bytes, or two packets if that is more, after it has been idle.
+     * @details Sending is allowed while the bucket holds any tokens, and taking a packet can leave it in debt, so
+     *          packets larger than the burst are still sent at the rate on average.
+     */
+    class TokenBucket
+    {
+    public:
+        /**
+         * @brief Constructor for the TokenBucket class that starts with no limit.
+         */
+        TokenBucket();
+
+        /**
+         * @brief                   Method set_rate sets the rate of the bucket.
+         * @param rate_bytes_per_s  double rate in bytes per second, 0 for no limit.
+         * @param packet_bytes      size_t largest packet sent in bytes, which sets the smallest burst.
+         */
+        void set_rate(double rate_bytes_per_s, size_t packet_bytes);
+
+        /**
+         * @brief       Method ready_time gets the time at which the bucket next allows a packet to be sent.
+         * @param now   const ptime & current time.
+         * @return      ptime now if a packet can be sent straight away, otherwise the time at which it can.
+         */
+        boost::posix_time::ptime ready_time(const boost::posix_time::ptime &now);
+
+        /**
+         * @brief       Method consume takes the tokens of a packet that has been sent.
+         * @param bytes size_t bytes of the packet.
+         * @param now   const ptime & time at which it was sent.
+         */
+        void consume(size_t bytes, const boost::posix_time::ptime &now);
+
+    private:
+        /// Rate of the bucket in bytes per second, 0 for no limit.
+        double rate;
+        /// Largest number of tokens the bucket holds.
+        double burst;
+        /// Tokens in the bucket, negative while it is in debt.
+        double tokens;
+        /// Time at which the tokens were last added.
+        boost::posix_time::ptime last_time;
+
+        /**
+         * @brief       Method refill adds the tokens accumulated since they were last added.
+         * @param now   const ptime & current time.
+         */
+        void refill(const boost::posix_time::ptime &now);
+    };
+}
+
+#endif /* CONGESTIONCONTROL_HPP */
@@ -14,26 +14,79 @@
 #define CONNECTION_CPP
 
 #include "Connection.hpp"
+#include "ConnectionController.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/sock_diag.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 using namespace rudp;
 
-Connection::Connection(int timeout_ms) : timeout_ms(timeout_ms)
+Connection::Connection(int timeout_ms) : Connection(timeout_ms, ConnectionController::getIOService()) {}
+
+Connection::Connection(int timeout_ms, std::unique_ptr<boost::asio::io_service> io_service, int transport) : Connection(timeout_ms, *io_service, transport)
+{
+	owned_io_service = std::move(io_service);
+	owned_io_service_work.reset(new boost::asio::io_service::work(*owned_io_service));
+}
+
+Connection::Connection(int timeout_ms, boost::asio::io_service &io_service, int transport) : buffer_pool(DEFAULT_BUFFER_POOL_BYTES), io_service(io_service), unreliable_batch(PoolAllocator<SendSlot>(&buffer_pool)), timeout_ms(timeout_ms), receive_requests(PoolAllocator<ReceiveRequest>(&buffer_pool))
 {
 	// Initialise the members and open the socket, throwing an error on failure.
-	sequence_recv_map = std::map<std::string, uint16_t>();
-	sequence_send = 0;
+	reorder_stalled = false;
+	epoch_generator.seed(std::random_device()());
+	peer_idle_timeout_ms = DEFAULT_PEER_IDLE_TIMEOUT_MS;
+	max_message_size = DEFAULT_MAX_MESSAGE_SIZE;
+	peer_sweep_time = boost::posix_time::neg_infin;
+	tracing = false;
+	trace_buffer = nullptr;
+#ifdef DEBUG
+	// Debug builds print every trace record as it is made.
+	setTraceHandler([](const TraceRecord &record)
+					{ std::cout << record.to_string(); });
+#endif
 	has_endpoint_local = false;
 	has_endpoint_remote = false;
 	send_retries_limit = -1;
-	send_retries = 0;
-
-	// No deadline is required until the first socket operation is started. We
-	// set the deadline to positive infinity so that the actor takes no action
-	// until a specific deadline is set.
-	timer.expires_at(boost::posix_time::pos_infin);
-
-	// Start the persistent actor that checks for deadline expiry.
-	check_deadline();
+	window_size = 1;
+	coalesce_delay_us = -1;
+	mtu = DEFAULT_MTU;
+	adaptive_timeout = true;
+	timeout_min_ms = DEFAULT_MIN_TIMEOUT_MS;
+	timeout_max_ms = DEFAULT_MAX_TIMEOUT_MS;
+	receive_queue_limit = DEFAULT_RECEIVE_QUEUE_LIMIT;
+	receive_queues.emplace_back(new ReceiveQueue(receive_queue_limit));
+	receive_queue = receive_queues.back().get();
+#ifdef __linux__
+	size_t read_batch_size = IO_BATCH_SIZE;
+#else
+	size_t read_batch_size = 1;
+#endif
+	read_buffers = std::vector<std::vector<char>>(read_batch_size, std::vector<char>(MAX_DATAGRAM_SIZE));
+	read_lengths = std::vector<size_t>(read_batch_size);
+	read_endpoints = std::vector<boost::asio::ip::udp::endpoint>(read_batch_size);
+	read_segment_sizes = std::vector<size_t>(read_batch_size);
+	read_target = nullptr;
+	read_target_len = 0;
+	send_batch.reserve(IO_BATCH_SIZE);
+	ack_count = 0;
+	segmentation_offload = false;
+	ack_packets = DEFAULT_ACK_PACKETS;
+	ack_delay_us = DEFAULT_ACK_DELAY_US;
+	ack_timer.expires_at(boost::posix_time::pos_infin);
+	impairment_timer.expires_at(boost::posix_time::pos_infin);
+	closing = false;
+	closed = false;
+	destroy_pending = false;
+	congestion_control = make_congestion_control(DEFAULT_CONGESTION_CONTROL);
+	rate_limit = 0;
 
 	try
 	{
@@ -44,16 +97,135 @@ Connection::Connection(int timeout_ms) : timeout_ms(timeout_ms)
 		std::string error_message = std::string("[RUDP] (ERROR) [INIT] Error opening socket: ") + error.what();
 		throw std::runtime_error(error_message);
 	}
+	if (transport == TRANSPORT_IO_URING)
+	{
+#ifdef __linux__
+		uring.reset(new UringTransport(socket.native_handle()));
+		uring_descriptor.reset(new boost::asio::posix::stream_descriptor(io_service, dup(uring->descriptor())));
+		// The kernel runs parts of the receive on the thread that started it, so the IO service starts it.
+		post([this]()
+			 {
+			std::lock_guard<std::mutex> lock(io_mutex);
+			if (!closing)
+			{
+				uring->start_receive();
+			} });
+#else
+		throw std::runtime_error("[RUDP] (ERROR) [INIT] Error setting transport: io_uring is only supported on Linux.");
+#endif
+	}
+	else if (transport != TRANSPORT_ASIO)
+	{
+		throw std::runtime_error("[RUDP] (ERROR) [INIT] Error setting transport: unknown transport " + std::to_string(transport) + ".");
+	}
+
+	// Start the persistent receive loop that handles both data packets and ACKs.
+	start_receive();
 }
 
 Connection::~Connection()
 {
-	// Stop and close the networking services.
-	io_service.stop();
-	socket.close();
+	// A connection destroyed from one of its own handlers was closed then, and its aborted handlers have run.
+	if (closed)
+	{
+		return;
+	}
+	// Close the socket and the timers from the IO service then wait for a marker posted behind the
+	// aborted handlers, so that no handler runs after the connection has been destroyed.
+	std::promise<void> closed_marker;
+	std::future<void> closed_future = closed_marker.get_future();
+	io_service.post([this, &closed_marker]()
+					{
+		close();
+		io_service.post([&closed_marker]() { closed_marker.set_value(); }); });
+	if (owned_io_service)
+	{
+		while (closed_future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			io_service.run_one();
+		}
+	}
+	closed_future.wait();
+}
+
+void Connection::destroy(Connection *connection)
+{
+	if (!connection->io_service.get_executor().running_in_this_thread())
+	{
+		delete connection;
+		return;
+	}
+	// The thread running the IO service cannot wait for it, so the connection is closed straight away and deleted
+	// by a handler posted behind the handlers its close aborted.
+	connection->close();
+	if (connection->owned_io_service)
+	{
+		// The IO service cannot be destroyed while it runs, so process() deletes the connection once it returns.
+		connection->destroy_pending = true;
+		return;
+	}
+	connection->io_service.post([connection]()
+								{ delete connection; });
+}
+
+void Connection::close()
+{
+	std::unique_lock<std::mutex> lock(io_mutex);
+	// Send the delayed ACKs so their senders are not left retransmitting packets that were delivered.
+	receive_channels.for_each([this](ReceiveChannel &channel)
+							  {
+		if (channel.ack.packets > 0)
+		{
+			channel.ack.packets = 0;
+			send_ack(channel.ack.sequence, channel.ack.cumulative, channel.ack.sack, channel.epoch, channel.stream, channel.sender);
+		} });
+	flush_send_batch();
+	closing = true;
+	std::string error_message = "[RUDP] (ERROR) [CLOSE] Connection closed before the operation completed.\n";
+	boost::system::error_code err;
+	for (auto &channel : send_channels)
+	{
+		reset_send_channel(channel.second, error_message);
+		channel.second.timer.cancel(err);
+		channel.second.pacing_timer.cancel(err);
+	}
+	receive_channels.for_each([this](ReceiveChannel &channel)
+							  {
+		if (channel.has_partial && channel.partial.has_request)
+		{
+			receive_requests.push_front(channel.partial.request);
+		} });
+	receive_channels.clear();
+	for (ReceiveRequest &request : receive_requests)
+	{
+		completions.push_back(Completion{std::move(request.handler), -1, std::make_exception_ptr(std::runtime_error(error_message))});
+	}
+	receive_requests.clear();
+	ack_timer.cancel(err);
+	if (impaired_link)
+	{
+		send_impaired(boost::posix_time::pos_infin);
+	}
+	impairment_timer.cancel(err);
+#ifdef __linux__
+	if (uring)
+	{
+		uring->stop();
+		uring_descriptor->close(err);
+	}
+#endif
+	socket.close(err);
+	lock.unlock();
+	dispatch_completions();
+	closed = true;
 }
 
 void Connection::setEndpointLocal(unsigned short port)
+{
+	setEndpointLocal(port, false);
+}
+
+void Connection::setEndpointLocal(unsigned short port, bool reuse_port)
 {
 	try
 	{
@@ -61,6 +233,18 @@ void Connection::setEndpointLocal(unsigned short port)
 		// Also, reset the receive sequence as a new connection is being set up.
 		std::unique_lock<std::mutex> lock(io_mutex);
 		endpoint_local = boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::any(), port);
+		if (reuse_port)
+		{
+#ifdef SO_REUSEPORT
+			int enable = 1;
+			if (setsockopt(socket.native_handle(), SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0)
+			{
+				throw std::runtime_error("[RUDP] (ERROR) [INIT] Error setting local endpoint to port " + std::to_string(port) + ": SO_REUSEPORT could not be set: " + std::strerror(errno));
+			}
+#else
+			throw std::runtime_error("[RUDP] (ERROR) [INIT] Error setting local endpoint to port " + std::to_string(port) + ": SO_REUSEPORT is not supported.");
+#endif
+		}
 		socket.bind(endpoint_local);
 		has_endpoint_local = true;
 		lock.unlock();
@@ -80,21 +264,16 @@ void Connection::setEndpointLocal(unsigned short port)
 
 void Connection::setEndpointRemote(std::string address, unsigned short port)
 {
-	try
-	{
-		// Gain access to the mutex then try to set the remote endpoint.
-		// Also, reset the send sequence as a new connection is being set up.
-		std::unique_lock<std::mutex> lock(io_mutex);
-		endpoint_remote = boost::asio::ip::udp::endpoint(boost::asio::ip::address::from_string(address), port);
-		has_endpoint_remote = true;
-		lock.unlock();
-		resetConnectionSend();
-	}
-	catch (boost::system::system_error error)
-	{
-		std::string error_message = std::string("[RUDP] (ERROR) [INIT] Error setting remote endpoint: ") + error.what();
-		throw std::runtime_error(error_message);
-	}
+	// Try to set the remote endpoint then gain access to the mutex.
+	// Also, reset the send sequence of the endpoint as a new connection is being set up.
+	boost::asio::ip::udp::endpoint endpoint = parse_endpoint(address, port);
+	std::unique_lock<std::mutex> lock(io_mutex);
+	endpoint_remote = endpoint;
+	has_endpoint_remote = true;
+	reset_endpoint_channels(endpoint_remote, "[RUDP] (ERROR) [SEND] Send channel reset before the message was acknowledged.\n");
+	lock.unlock();
+	post([this]()
+		 { dispatch_completions(); });
 
 #ifdef DEBUG
 	std::string message = "[RUDP] (DEBUG) [INIT] Remote endpoint set: " + endpoint_remote.address().to_string() + ":" + std::to_string(endpoint_remote.port()) + "\n";
@@ -120,321 +299,3192 @@ void Connection::setSendRetriesLimit(int send_retries_limit)
 #endif
 }
 
-void Connection::resetConnectionReceive()
+void Connection::setWindowSize(int window_size)
 {
 	std::lock_guard<std::mutex> lock(io_mutex);
-	sequence_recv_map.clear();
+	if (window_size > 0)
+	{
+		this->window_size = window_size;
+	}
+	else
+	{
+		std::string error_message = std::string("[RUDP] (ERROR) [INIT] Error setting window size: must be at least 1.");
+		throw std::runtime_error(error_message);
+	}
+#ifdef DEBUG
+	std::string message = "[RUDP] (DEBUG) [INIT] Window size set: " + std::to_string(window_size) + "\n";
+	std::cout << message;
+#endif
 }
 
-void Connection::resetConnectionSend()
+int Connection::getWindowSize()
 {
 	std::lock_guard<std::mutex> lock(io_mutex);
-	sequence_send = 0;
+	return window_size;
 }
 
-int Connection::send(const char *buf, int len)
+void Connection::setCongestionControl(int algorithm)
+{
+	setCongestionControl(make_congestion_control(algorithm));
+}
+
+void Connection::setCongestionControl(CongestionControlFactory factory)
 {
 	std::lock_guard<std::mutex> lock(io_mutex);
-	// Throw an error if the destination is unknown.
-	if (!has_endpoint_remote)
+	congestion_control = factory;
+	for (auto &channel : send_channels)
 	{
-		std::string error_message = "[RUDP] (ERROR) [SEND] (SEQ-SEND: " + std::to_string(sequence_send) + ") Error sending packet: No remote endpoint set.";
-		throw std::runtime_error(error_message);
+		channel.second.congestion = congestion_control ? congestion_control() : nullptr;
+		channel.second.in_recovery = false;
 	}
-	else
-	{
-		send_retries = 0;
-
-		boost::system::error_code err;
-		size_t sent_size;
-		std::ostringstream bytestream = std::ostringstream();
+}
 
-		bool ack_received = false;
+int Connection::getCongestionWindow()
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	return get_endpoint_congestion_window(has_endpoint_remote ? &endpoint_remote : nullptr);
+}
 
-		// Write the input data to a stringstream to the string into a byte array.
-		bytestream.write(static_cast<char *>(static_cast<void *>(&sequence_send)), sizeof(sequence_send));
-		bytestream.write(static_cast<char *>(static_cast<void *>(&len)), sizeof(len));
-		bytestream.write(buf, len);
-		if (!bytestream.good())
-		{
-			std::string error_message = "[RUDP] (ERROR) [SEND] (SEQ-SEND: " + std::to_string(sequence_send) + ") Error copying input data to the message buffer being sent to " + endpoint_remote.address().to_string() + ":" + std::to_string(endpoint_remote.port()) + "\n";
-			throw std::runtime_error(error_message);
-		}
+int Connection::getCongestionWindow(std::string address, unsigned short port)
+{
+	boost::asio::ip::udp::endpoint endpoint = parse_endpoint(address, port);
+	std::lock_guard<std::mutex> lock(io_mutex);
+	return get_endpoint_congestion_window(&endpoint);
+}
 
-		// While a valid ACK has not been received,
-		while (!ack_received && (send_retries_limit == -1 || send_retries < send_retries_limit))
-		{
-			++send_retries;
-			// Transmit the data to the remote endpoint
-			sent_size = socket.send_to(boost::asio::buffer(bytestream.str()), endpoint_remote, 0, err);
-			if (err.value() != 0)
-			{
-				std::string error_message = "[RUDP] (ERROR) [SEND] (SEQ-SEND: " + std::to_string(sequence_send) + ") Error in sending packet to " + endpoint_remote.address().to_string() + ":" + std::to_string(endpoint_remote.port()) + " with error: " + err.message() + "\n";
-				send_retries = 0;
-				throw std::runtime_error(error_message);
-			}
-#ifdef DEBUG
-			std::string message = "[RUDP] (DEBUG) [SEND] (SEQ-SEND: " + std::to_string(sequence_send) + ") Sent " + std::to_string(sent_size) + " bytes to " + endpoint_remote.address().to_string() + ":" + std::to_string(endpoint_remote.port()) + "\n";
-			std::cout << message;
-#endif
+int Connection::get_endpoint_congestion_window(const boost::asio::ip::udp::endpoint *endpoint)
+{
+	// An endpoint that has not been sent to has no channel, and would start from the initial window, which every
+	// congestion controller shares.
+	auto channel = endpoint == nullptr ? send_channels.end() : send_channels.find(std::make_pair(*endpoint, (uint16_t)0));
+	if (channel == send_channels.end())
+	{
+		return congestion_control ? std::min(INITIAL_CONGESTION_WINDOW, window_size) : window_size;
+	}
+	return channel->second.congestion ? std::min((int)channel->second.congestion->congestion_window(), window_size) : window_size;
+}
 
-			// Set a deadline for the asynchronous operation.
-			timer.expires_from_now(boost::posix_time::milliseconds(timeout_ms));
-
-			// Set up the variables that receive the result of the asynchronous
-			// operation. The error code is set to would_block to signal that the
-			// operation is incomplete.
-			boost::system::error_code err = boost::asio::error::would_block;
-			std::size_t length = 0;
-
-			unsigned short received_sequence;
-			char *buffer = new char[sizeof(received_sequence)];
-			// Start the asynchronous operation itself. The handle_receive function
-			// used as a callback will update the ec and length variables.
-			socket.async_receive(boost::asio::buffer(buffer, sizeof(received_sequence)),
-								 boost::bind(&Connection::handle_receive,
-											 this,
-											 boost::asio::placeholders::error,
-											 boost::asio::placeholders::bytes_transferred,
-											 &err,
-											 &length));
-
-			// Block until the asynchronous operation has completed.
-			do
-			{
-				timer_expired = false;
-				ack_packet_received = false;
-				io_service.run_one();
-			} while (!timer_expired && !ack_packet_received);
-
-			if (length <= 0)
-			{
-				// If the socket timed out just send the packet again and wait for an ACK.
-				ack_received = false;
-#ifdef DEBUG
-				message = "[RUDP] (DEBUG) [SEND] (SEQ-SEND: " + std::to_string(sequence_send) + ") Timed out when receiving ACK from " + endpoint_remote.address().to_string() + ":" + std::to_string(endpoint_remote.port()) + "\n";
-				std::cout << message;
-#endif
-			}
-			else
-			{
-				// If no errors occured and the socket didn't timeout, try to compare the received sequence number to the current sequence number.
-				if (!memcpy(&received_sequence, buffer, sizeof(received_sequence)))
-				{
-					std::string error_message = "[RUDP] (ERROR) [SEND] (SEQ-SEND: " + std::to_string(sequence_send) + ") Error copying ACK sequence number received from " + endpoint_remote.address().to_string() + ":" + std::to_string(endpoint_remote.port()) + "\n";
-					std::cout << error_message;
-					ack_received = false;
-				}
-				else
-				{
-					ack_received = (received_sequence == sequence_send);
-				}
-#ifdef DEBUG
-				message = "[RUDP] (DEBUG) [SEND] (SEQ-SEND: " + std::to_string(sequence_send) + ") " + std::string(ack_received ? "Received" : "Did not receive") + " ACK with correct sequence from " + endpoint_remote.address().to_string() + ":" + std::to_string(endpoint_remote.port()) + "\n";
-				std::cout << message;
-#endif
-			}
-		}
-		if (send_retries_limit != -1 && send_retries >= send_retries_limit)
-		{
-			std::string error_message = "[RUDP] (ERROR) [SEND] (SEQ-SEND: " + std::to_string(sequence_send) + ") Error sending packet to " + endpoint_remote.address().to_string() + ":" + std::to_string(endpoint_remote.port()) + " after " + std::to_string(send_retries) + " tries.\n";
-			send_retries = 0;
-			throw std::runtime_error(error_message);
-		}
-		else
-		{
-			// Once a successful ACK has been received increment the send sequence number.
-			sequence_send = (sequence_send + 1) % USHRT_MAX;
-			send_retries = 0;
-			return sent_size;
-		}
+void Connection::setRateLimit(uint64_t bytes_per_s)
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	rate_limit = bytes_per_s;
+	rate_limiter.set_rate((double)rate_limit, mtu - IPV4_UDP_HEADER_SIZE);
+	// Channels waiting for the old limit check it again.
+	for (auto &channel : send_channels)
+	{
+		channel.second.pacing_timer.expires_at(boost::posix_time::pos_infin);
+		advance_send_window(channel.second);
 	}
+	flush_send_batch();
 }
 
-int Connection::receive(char *buf, int len, char *address, int *port)
+uint64_t Connection::getRateLimit()
 {
 	std::lock_guard<std::mutex> lock(io_mutex);
-	// Throw an error if the local endpoint is unknown.
-	if (!has_endpoint_local)
+	return rate_limit;
+}
+
+void Connection::setCoalescing(int delay_us)
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	if (delay_us >= -1)
 	{
-		std::string error_message = "[RUDP] (ERROR) [RECV] Error receiving packet: No local endpoint set.\n";
+		coalesce_delay_us = delay_us;
+	}
+	else
+	{
+		std::string error_message = std::string("[RUDP] (ERROR) [INIT] Error setting coalescing: delay must be at least 0 us or -1.");
 		throw std::runtime_error(error_message);
 	}
+}
+
+void Connection::setMTU(int mtu)
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	if (mtu > IPV4_UDP_HEADER_SIZE + (int)(DATA_HEADER_SIZE + ACK_INFO_SIZE) && mtu <= USHRT_MAX)
+	{
+		this->mtu = mtu;
+		rate_limiter.set_rate((double)rate_limit, mtu - IPV4_UDP_HEADER_SIZE);
+	}
 	else
 	{
-		boost::system::error_code err;
-		boost::asio::ip::udp::endpoint endpoint_sender;
-		std::string sender_id;
+		std::string error_message = "[RUDP] (ERROR) [INIT] Error setting MTU: must be between " + std::to_string(IPV4_UDP_HEADER_SIZE + DATA_HEADER_SIZE + ACK_INFO_SIZE + 1) + " and " + std::to_string(USHRT_MAX) + " bytes.";
+		throw std::runtime_error(error_message);
+	}
+#ifdef DEBUG
+	std::string message = "[RUDP] (DEBUG) [INIT] MTU set: " + std::to_string(mtu) + "\n";
+	std::cout << message;
+#endif
+}
 
-		std::vector<char> buffer(sizeof(uint16_t) + sizeof(int) + len);
-		std::vector<char> char_cache;
-		int offset;
+int Connection::getMTU()
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	return mtu;
+}
 
-		int received_len;
-		unsigned short received_sequence;
+void Connection::setAckPolicy(int ack_packets, int ack_delay_us)
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	if (ack_packets > 0 && ack_delay_us >= 0)
+	{
+		this->ack_packets = ack_packets;
+		this->ack_delay_us = ack_delay_us;
+	}
+	else
+	{
+		std::string error_message = std::string("[RUDP] (ERROR) [INIT] Error setting ACK policy: the number of packets must be at least 1 and the delay cannot be negative.");
+		throw std::runtime_error(error_message);
+	}
+}
 
-		bool continue_receiving = true;
+void Connection::setAdaptiveTimeout(bool adaptive)
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	adaptive_timeout = adaptive;
+}
 
-		// While a message with the correct sequence number has not been received without errors.
-		while (continue_receiving)
+void Connection::setTimeoutLimits(int min_ms, int max_ms)
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	if (min_ms > 0 && min_ms <= max_ms)
+	{
+		timeout_min_ms = min_ms;
+		timeout_max_ms = max_ms;
+		for (auto &channel : send_channels)
 		{
-			bool error_occured = false;
-			offset = 0;
-
-			// Receive a packet on the local endpoint.
-			int packet_size = socket.receive_from(boost::asio::buffer(buffer, buffer.capacity()), endpoint_sender, 0, err);
-			if (err.value() != 0)
-			{
-				std::string error_message = "[RUDP] (ERROR) [RECV] (SEQ-RECV: Error in receiving packet from " + endpoint_sender.address().to_string() + ":" + std::to_string(endpoint_sender.port()) + " with error: " + err.message() + "\n";
-				std::cout << error_message;
-				error_occured = true;
-			}
-			sender_id = endpoint_sender.address().to_string() + ":" + std::to_string(endpoint_sender.port());
-			if (sequence_recv_map.find(sender_id) == sequence_recv_map.end())
-			{
-				sequence_recv_map[sender_id] = 0;
-			}
-			uint16_t sequence_recv = sequence_recv_map[sender_id];
-
-#ifdef DEBUG
-			std::string message = "[RUDP] (DEBUG) [RECV] (SEQ-RECV: " + std::to_string(sequence_recv) + ") Received " + std::to_string(packet_size) + " bytes from " + endpoint_sender.address().to_string() + ":" + std::to_string(endpoint_sender.port()) + "\n";
-			std::cout << message;
-#endif
-			if (!error_occured)
-			{
-				// Parse the bytes of the received sequence number.
-				char_cache = std::vector<char>(sizeof(received_sequence));
-				for (int i = 0; i < sizeof(received_sequence); i++)
-				{
-					char_cache[i] = buffer[i + offset];
-				}
-				offset += sizeof(received_sequence);
-				if (!memcpy(&received_sequence, char_cache.data(), sizeof(received_sequence)))
-				{
-					std::string error_message = "[RUDP] (ERROR) [RECV] (SEQ-RECV: " + std::to_string(sequence_recv) + ") Error copying message sequence number received from " + endpoint_sender.address().to_string() + ":" + std::to_string(endpoint_sender.port()) + "\n";
-					std::cout << error_message;
-					error_occured = true;
-				}
-			}
-
-			// If the received sequence number is greater than the current, fast forward to the received.
-			// This assumes that the receiver has been reset in the time that the sender has been active.
-			if (!error_occured && received_sequence > sequence_recv)
-			{
-#ifdef DEBUG
-				message = "[RUDP] (DEBUG) [RECV] (SEQ-RECV: " + std::to_string(sequence_recv) + ") Received sequence ahead of current sequence number from " + endpoint_sender.address().to_string() + ":" + std::to_string(endpoint_sender.port()) + " fast forwarding from " + std::to_string(sequence_recv) + " to " + std::to_string(received_sequence) + "\n";
-				std::cout << message;
-#endif
-				sequence_recv = received_sequence;
-				sequence_recv_map[sender_id] = received_sequence;
-			}
+			channel.second.timeout_ms = std::min(std::max(channel.second.timeout_ms, (double)min_ms), (double)max_ms);
+		}
+	}
+	else
+	{
+		std::string error_message = std::string("[RUDP] (ERROR) [INIT] Error setting timeout limits: the minimum must be at least 1 and no greater than the maximum.");
+		throw std::runtime_error(error_message);
+	}
+}
 
-			if (!error_occured && received_sequence == sequence_recv)
-			{
-				// Parse the bytes of the received length of the data.
-				char_cache = std::vector<char>(sizeof(received_len));
-				for (int i = 0; i < sizeof(received_len); i++)
-				{
-					char_cache[i] = buffer[i + offset];
-				}
-				offset += sizeof(int);
-				if (!memcpy(&received_len, char_cache.data(), sizeof(received_len)))
-				{
-					std::string error_message = "[RUDP] (ERROR) [RECV] (SEQ-RECV: " + std::to_string(sequence_recv) + ") Error copying length of message received from " + endpoint_sender.address().to_string() + ":" + std::to_string(endpoint_sender.port()) + "\n";
-					std::cout << error_message;
-					error_occured = true;
-				}
-				// If the output buffer is too small the accomodate the data in the message,
-				// throw an error.
-				if (!error_occured && len < received_len)
-				{
-					std::string error_message = "[RUDP] (ERROR) [RECV] (SEQ-RECV: " + std::to_string(sequence_recv) + ") Error buffer allocated to receive message is too small to fit message from " + endpoint_sender.address().to_string() + ":" + std::to_string(endpoint_sender.port()) + "\n";
-					throw std::runtime_error(error_message);
-				}
-			}
+int Connection::getTimeout()
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	return get_endpoint_timeout(has_endpoint_remote ? &endpoint_remote : nullptr);
+}
 
-			// If the message had the correct sequence number and no error occured,
-			if (!error_occured && received_sequence == sequence_recv)
-			{
-				// Parse the bytes of the received data.
-				char_cache = std::vector<char>(received_len);
-				for (int i = 0; i < received_len; i++)
-				{
-					char_cache[i] = buffer[i + offset];
-				}
-				offset += received_len;
-				// Copy the received data into the output buffer.
-				if (!memcpy(buf, char_cache.data(), len))
-				{
-					std::string error_message = "[RUDP] (ERROR) [RECV] (SEQ-RECV: " + std::to_string(sequence_recv) + ") Error copying message buffer received from " + endpoint_sender.address().to_string() + ":" + std::to_string(endpoint_sender.port()) + "\n";
-					throw std::runtime_error(error_message);
-				}
-			}
+int Connection::getTimeout(std::string address, unsigned short port)
+{
+	boost::asio::ip::udp::endpoint endpoint = parse_endpoint(address, port);
+	std::lock_guard<std::mutex> lock(io_mutex);
+	return get_endpoint_timeout(&endpoint);
+}
 
-			if (!error_occured && received_sequence == sequence_recv)
-			{
-				// Copy the information about where the packet came from.
-				*port = (int)endpoint_sender.port();
-				strcpy(address, endpoint_sender.address().to_string().c_str());
-			}
+int Connection::get_endpoint_timeout(const boost::asio::ip::udp::endpoint *endpoint)
+{
+	// An endpoint that has not been sent to has no channel, and would start from the initial timeout.
+	auto channel = endpoint == nullptr ? send_channels.end() : send_channels.find(std::make_pair(*endpoint, (uint16_t)0));
+	if (channel == send_channels.end())
+	{
+		return adaptive_timeout ? std::min(std::max(timeout_ms, timeout_min_ms), timeout_max_ms) : timeout_ms;
+	}
+	return std::ceil(get_channel_timeout(channel->second));
+}
 
-			// If no errors occured send an ACK for the message with the sequence number that was received.
-			if (!error_occured && received_sequence <= sequence_recv)
+void Connection::setReceiveQueueLimit(int limit)
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	if (limit > 0)
+	{
+		receive_queue_limit = limit;
+		// Move the queued messages to a larger queue, keeping the old one as a receive may still be taking from it.
+		ReceiveQueue *queue = receive_queue;
+		if (receive_queue_limit > queue->capacity())
+		{
+			receive_queues.emplace_back(new ReceiveQueue(receive_queue_limit));
+			ReceiveQueue *next_queue = receive_queues.back().get();
+			std::vector<char> payload;
+			boost::asio::ip::udp::endpoint sender;
+			uint16_t stream;
+			while (queue->pop(payload, sender, stream))
 			{
-				char *ack_buffer = new char[sizeof(unsigned short)];
-				if (!memcpy(ack_buffer, &received_sequence, sizeof(received_sequence)))
-				{
-					std::string error_message = "[RUDP] (ERROR) [RECV] (SEQ-RECV: " + std::to_string(sequence_recv) + ") Error copying ACK sequence number received from " + endpoint_sender.address().to_string() + ":" + std::to_string(endpoint_sender.port()) + "\n";
-					std::cout << error_message;
-					error_occured = true;
-				}
-				size_t sent_size = socket.send_to(boost::asio::buffer(ack_buffer, sizeof(ack_buffer)), endpoint_sender, 0, err);
-				if (err.value() != 0)
-				{
-					std::string error_message = "[RUDP] (ERROR) [RECV] (SEQ-RECV: " + std::to_string(sequence_recv) + ") Error in sending ACK to " + endpoint_sender.address().to_string() + ":" + std::to_string(endpoint_sender.port()) + " with error: " + err.message() + "\n";
-					std::cout << error_message;
-					error_occured = true;
-				}
-#ifdef DEBUG
-				message = "[RUDP] (DEBUG) [RECV] (SEQ-RECV: " + std::to_string(sequence_recv) + ") Sent ACK with " + std::to_string(sent_size) + " bytes to " + endpoint_sender.address().to_string() + ":" + std::to_string(endpoint_sender.port()) + "\n";
-				std::cout << message;
-#endif
+				next_queue->reserve()->swap(payload);
+				next_queue->commit(sender, stream);
 			}
-
-			// If an error occured or the received sequence number does not match the current sequence number, continue receiving messages.
-			continue_receiving = error_occured || (received_sequence != sequence_recv);
+			receive_queue = next_queue;
 		}
-		// Once the correct message has been received increment the receive sequence number.
-		sequence_recv_map[sender_id] = (sequence_recv_map[sender_id] + 1) % USHRT_MAX;
-		return received_len;
+	}
+	else
+	{
+		std::string error_message = std::string("[RUDP] (ERROR) [INIT] Error setting receive queue limit: must be at least 1.");
+		throw std::runtime_error(error_message);
 	}
 }
 
-void Connection::check_deadline()
+void Connection::setBufferPoolSize(int bytes)
 {
-	// Check whether the deadline has passed.
-	if (timer.expires_at() <= boost::asio::deadline_timer::traits_type::now())
+	if (bytes < 0)
 	{
-		// Cancel the socket operation as the ACK has not been received in time.
-		socket.cancel();
-
-		// Set the timer expiry to infinity and set the expired flag.
-		timer.expires_at(boost::posix_time::pos_infin);
-		timer_expired = true;
+		std::string error_message = std::string("[RUDP] (ERROR) [INIT] Error setting buffer pool size: must be at least 0.");
+		throw std::runtime_error(error_message);
 	}
+	// The pool has its own mutex, as it is also used by callers that do not hold the mutex of the connection.
+	buffer_pool.reserve((size_t)bytes);
+}
 
-	// Put the timer back to sleep.
-	timer.async_wait(boost::bind(&Connection::check_deadline, this));
+size_t Connection::getBufferPoolSize()
+{
+	return buffer_pool.capacity();
 }
 
-void Connection::handle_receive(const boost::system::error_code &err, std::size_t length, boost::system::error_code *err_out, std::size_t *length_out)
+void Connection::setSocketBufferSizes(int receive_bytes, int send_bytes)
 {
-	// Set the output arguments.
-	*err_out = err;
-	*length_out = length;
-	// If there are no errors, an ACK was successfully received.
-	if (!err)
-		ack_packet_received = true;
+	if (receive_bytes < 0 || send_bytes < 0)
+	{
+		std::string error_message = std::string("[RUDP] (ERROR) [INIT] Error setting socket buffer sizes: must be at least 0.");
+		throw std::runtime_error(error_message);
+	}
+	std::lock_guard<std::mutex> lock(io_mutex);
+	if (receive_bytes > 0)
+	{
+		set_socket_option(SOL_SOCKET, SO_RCVBUF, receive_bytes, "SO_RCVBUF");
+#ifdef SO_RCVBUFFORCE
+		// The kernel limits the size to net.core.rmem_max unless it is forced, which needs CAP_NET_ADMIN.
+		if (get_socket_option(SOL_SOCKET, SO_RCVBUF, "SO_RCVBUF") < receive_bytes)
+		{
+			setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVBUFFORCE, &receive_bytes, sizeof(receive_bytes));
+		}
+#endif
+	}
+	if (send_bytes > 0)
+	{
+		set_socket_option(SOL_SOCKET, SO_SNDBUF, send_bytes, "SO_SNDBUF");
+#ifdef SO_SNDBUFFORCE
+		if (get_socket_option(SOL_SOCKET, SO_SNDBUF, "SO_SNDBUF") < send_bytes)
+		{
+			setsockopt(socket.native_handle(), SOL_SOCKET, SO_SNDBUFFORCE, &send_bytes, sizeof(send_bytes));
+		}
+#endif
+	}
+}
+
+int Connection::getReceiveBufferSize()
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	return get_socket_option(SOL_SOCKET, SO_RCVBUF, "SO_RCVBUF");
+}
+
+int Connection::getSendBufferSize()
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	return get_socket_option(SOL_SOCKET, SO_SNDBUF, "SO_SNDBUF");
+}
+
+void Connection::setDSCP(int dscp)
+{
+	if (dscp < 0 || dscp > 63)
+	{
+		std::string error_message = std::string("[RUDP] (ERROR) [INIT] Error setting DSCP: must be from 0 to 63.");
+		throw std::runtime_error(error_message);
+	}
+	std::lock_guard<std::mutex> lock(io_mutex);
+	// The code point is the upper six bits of the TOS byte, the lower two being left for ECN.
+	set_socket_option(IPPROTO_IP, IP_TOS, dscp << 2, "IP_TOS");
+}
+
+void Connection::setBusyPoll(int busy_poll_us)
+{
+	if (busy_poll_us < 0)
+	{
+		std::string error_message = std::string("[RUDP] (ERROR) [INIT] Error setting busy poll: must be at least 0.");
+		throw std::runtime_error(error_message);
+	}
+#ifdef SO_BUSY_POLL
+	std::lock_guard<std::mutex> lock(io_mutex);
+	set_socket_option(SOL_SOCKET, SO_BUSY_POLL, busy_poll_us, "SO_BUSY_POLL");
+#else
+	throw std::runtime_error("[RUDP] (ERROR) [INIT] Error setting socket option SO_BUSY_POLL: busy polling is not supported.");
+#endif
+}
+
+void Connection::setSegmentationOffload(bool enabled)
+{
+#if defined(__linux__) && defined(UDP_SEGMENT) && defined(UDP_GRO)
+	std::lock_guard<std::mutex> lock(io_mutex);
+	if (!enabled && !segmentation_offload)
+	{
+		return;
+	}
+	if (uring)
+	{
+		throw std::runtime_error("[RUDP] (ERROR) [INIT] Error setting segmentation offload: it is not supported by the io_uring transport.");
+	}
+	// UDP GSO needs no option of its own, as each send gives its segment size, so the kernel supports it if it
+	// supports GRO, which came later.
+	set_socket_option(SOL_UDP, UDP_GRO, enabled ? 1 : 0, "UDP_GRO");
+	segmentation_offload = enabled;
+	segment_iovecs.resize(enabled ? IO_BATCH_SIZE * GSO_MAX_SEGMENTS * 3 : 0);
+#else
+	throw std::runtime_error("[RUDP] (ERROR) [INIT] Error setting segmentation offload: UDP GSO and GRO are only supported on Linux.");
+#endif
+}
+
+void Connection::set_socket_option(int level, int option, int value, const std::string &name)
+{
+	if (setsockopt(socket.native_handle(), level, option, &value, sizeof(value)) != 0)
+	{
+		throw std::runtime_error("[RUDP] (ERROR) [INIT] Error setting socket option " + name + " to " + std::to_string(value) + ": " + std::strerror(errno));
+	}
+}
+
+int Connection::get_socket_option(int level, int option, const std::string &name)
+{
+	int value = 0;
+	socklen_t value_len = sizeof(value);
+	if (getsockopt(socket.native_handle(), level, option, &value, &value_len) != 0)
+	{
+		throw std::runtime_error("[RUDP] (ERROR) [INIT] Error getting socket option " + name + ": " + std::strerror(errno));
+	}
+	return value;
+}
+
+void Connection::setPeerIdleTimeout(int timeout_ms)
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	if (timeout_ms > 0 || timeout_ms == -1)
+	{
+		peer_idle_timeout_ms = timeout_ms;
+		peer_sweep_time = boost::posix_time::neg_infin;
+	}
+	else
+	{
+		std::string error_message = std::string("[RUDP] (ERROR) [INIT] Error setting peer idle timeout: must be at least 1 ms or -1.");
+		throw std::runtime_error(error_message);
+	}
+}
+
+void Connection::setMaxMessageSize(int size)
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	if (size > 0)
+	{
+		max_message_size = size;
+	}
+	else
+	{
+		std::string error_message = std::string("[RUDP] (ERROR) [INIT] Error setting maximum message size: must be at least 1 byte.");
+		throw std::runtime_error(error_message);
+	}
+}
+
+void Connection::setImpairment(const Impairment &impairment)
+{
+	impairment.validate();
+	std::lock_guard<std::mutex> lock(io_mutex);
+	if (impaired_link)
+	{
+		send_impaired(boost::posix_time::pos_infin);
+	}
+	impaired_link.reset(new ImpairedLink(impairment));
+}
+
+void Connection::clearImpairment()
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	if (impaired_link)
+	{
+		send_impaired(boost::posix_time::pos_infin);
+		impaired_link.reset();
+	}
+}
+
+int Connection::getPeerCount()
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	return receive_channels.size();
+}
+
+ConnectionStats Connection::getStats()
+{
+	ConnectionStats snapshot = stats.snapshot();
+#if defined(SO_MEMINFO) && defined(SK_MEMINFO_DROPS)
+	// The kernel counts the datagrams it drops for the socket itself, which are read along with its other memory.
+	uint32_t meminfo[SK_MEMINFO_VARS];
+	socklen_t meminfo_len = sizeof(meminfo);
+	if (getsockopt(socket.native_handle(), SOL_SOCKET, SO_MEMINFO, meminfo, &meminfo_len) == 0 && meminfo_len > SK_MEMINFO_DROPS * sizeof(uint32_t))
+	{
+		snapshot.kernel_drops = meminfo[SK_MEMINFO_DROPS];
+	}
+#endif
+	return snapshot;
+}
+
+void Connection::setTraceHandler(TraceHandler handler)
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	trace_handler = handler;
+	tracing = trace_handler || trace_buffer.load() != nullptr;
+}
+
+void Connection::setTraceBuffer(size_t capacity)
+{
+	// The buffer being replaced is kept, as a thread may still be reading it without the mutex.
+	std::lock_guard<std::mutex> lock(io_mutex);
+	if (capacity > 0)
+	{
+		trace_buffers.emplace_back(new TraceBuffer(capacity));
+		trace_buffer.store(trace_buffers.back().get());
+	}
+	else
+	{
+		trace_buffer.store(nullptr);
+	}
+	tracing = trace_handler || trace_buffer.load() != nullptr;
+}
+
+size_t Connection::readTrace(TraceRecord *records, size_t count)
+{
+	TraceBuffer *buffer = trace_buffer.load();
+	return buffer != nullptr ? buffer->pop(records, count) : 0;
+}
+
+uint64_t Connection::getTraceDropped()
+{
+	TraceBuffer *buffer = trace_buffer.load();
+	return buffer != nullptr ? buffer->dropped() : 0;
+}
+
+bool Connection::isExternallyDriven()
+{
+	return owned_io_service != nullptr;
+}
+
+int Connection::getFileDescriptor()
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+#ifdef __linux__
+	if (uring)
+	{
+		return uring->descriptor();
+	}
+#endif
+	return (int)socket.native_handle();
+}
+
+boost::posix_time::ptime Connection::getNextDeadline()
+{
+	boost::posix_time::ptime now = boost::asio::deadline_timer::traits_type::now();
+	if (posted_handlers > 0)
+	{
+		return now;
+	}
+	// A timer that is not armed, or whose handler has run, expires at pos_infin.
+	std::lock_guard<std::mutex> lock(io_mutex);
+	boost::posix_time::ptime deadline = std::min(ack_timer.expires_at(), impairment_timer.expires_at());
+	for (auto &channel : send_channels)
+	{
+		deadline = std::min({deadline, channel.second.timer.expires_at(), channel.second.pacing_timer.expires_at()});
+	}
+	return deadline;
+}
+
+size_t Connection::process()
+{
+	if (!owned_io_service)
+	{
+		throw std::runtime_error("[RUDP] (ERROR) [PROCESS] Error processing connection: the connection is run by the IO service of the controller.");
+	}
+	size_t count = io_service.poll();
+	if (destroy_pending)
+	{
+		delete this;
+	}
+	return count;
+}
+
+void Connection::resetConnectionReceive()
+{
+	std::lock_guard<std::mutex> lock(io_mutex);
+	receive_channels.for_each([this](ReceiveChannel &channel)
+							  { discard_partial_message(channel); });
+	receive_channels.clear();
+}
+
+void Connection::resetConnectionSend()
+{
+	std::unique_lock<std::mutex> lock(io_mutex);
+	for (auto &channel : send_channels)
+	{
+		reset_send_channel(channel.second, "[RUDP] (ERROR) [SEND] Send channel reset before the message was acknowledged.\n");
+	}
+	send_window_error.clear();
+	lock.unlock();
+	post([this]()
+		 { dispatch_completions(); });
+}
+
+void Connection::resetConnectionSend(std::string address, unsigned short port)
+{
+	boost::asio::ip::udp::endpoint endpoint = parse_endpoint(address, port);
+	std::unique_lock<std::mutex> lock(io_mutex);
+	reset_endpoint_channels(endpoint, "[RUDP] (ERROR) [SEND] Send channel reset before the message was acknowledged.\n");
+	lock.unlock();
+	post([this]()
+		 { dispatch_completions(); });
+}
+
+int Connection::send(const char *buf, int len)
+{
+	return send(buf, len, Delivery());
+}
+
+int Connection::send(const char *buf, int len, const Delivery &delivery)
+{
+	std::unique_lock<std::mutex> lock(io_mutex);
+	// Throw an error if the destination is unknown.
+	if (!has_endpoint_remote)
+	{
+		std::string error_message = "[RUDP] (ERROR) [SEND] Error sending packet: No remote endpoint set.";
+		throw std::runtime_error(error_message);
+	}
+	boost::asio::ip::udp::endpoint endpoint = endpoint_remote;
+	lock.unlock();
+	return send_to_endpoint(endpoint, buf, len, delivery);
+}
+
+int Connection::sendTo(const char *buf, int len, std::string address, unsigned short port)
+{
+	return send_to_endpoint(parse_endpoint(address, port), buf, len, Delivery());
+}
+
+int Connection::sendTo(const char *buf, int len, std::string address, unsigned short port, const Delivery &delivery)
+{
+	return send_to_endpoint(parse_endpoint(address, port), buf, len, delivery);
+}
+
+int Connection::send_to_endpoint(const boost::asio::ip::udp::endpoint &endpoint, const char *buf, int len, const Delivery &delivery)
+{
+	std::unique_lock<std::mutex> lock(io_mutex);
+	// Report any packets that were abandoned since the last call before accepting more data.
+	throw_send_window_error();
+	std::string delivery_error = get_delivery_error(delivery, len);
+	if (!delivery_error.empty())
+	{
+		throw std::runtime_error(delivery_error);
+	}
+
+	// An unreliable message does not wait for the send window or for an ACK.
+	if (delivery.delivery_class == DELIVERY_UNRELIABLE)
+	{
+		int message_size = get_message_size(len);
+		lock.unlock();
+		async_send_to_endpoint(endpoint, buf, len, delivery, CompletionHandler(), true);
+		return message_size;
+	}
+
+	// For Stop-and-Wait the send does not complete until the packet is acknowledged.
+	if (window_size == 1)
+	{
+		lock.unlock();
+		// The caller's buffer stays valid until the send returns, so it is referenced rather than copied.
+		BlockingResult result{0, nullptr, false};
+		async_send_to_endpoint(endpoint, buf, len, delivery, make_blocking_handler(result), false);
+		return wait_for_result(result);
+	}
+
+	// Otherwise wait for space in the send window of the stream then queue a copy of the message without a
+	// handler, so that if it is abandoned the error is reported by a later send or flush. Messages waiting to be
+	// coalesced do not hold up the next message, which may share their packet.
+	SendChannel &channel = get_send_channel(endpoint, delivery.stream);
+	wait_for_state(lock, [this, &channel]()
+				   { return closing || send_queue_ready(channel); });
+	int message_size = get_message_size(len);
+	lock.unlock();
+	async_send_to_endpoint(endpoint, buf, len, delivery, CompletionHandler(), true);
+	return message_size;
+}
+
+void Connection::asyncSend(const char *buf, int len, CompletionHandler handler)
+{
+	asyncSend(buf, len, Delivery(), handler);
+}
+
+void Connection::asyncSend(const char *buf, int len, const Delivery &delivery, CompletionHandler handler)
+{
+	std::unique_lock<std::mutex> lock(io_mutex);
+	// Fail the send if the destination is unknown.
+	if (!has_endpoint_remote)
+	{
+		std::string error_message = "[RUDP] (ERROR) [SEND] Error sending packet: No remote endpoint set.";
+		lock.unlock();
+		if (handler)
+		{
+			post(std::bind(handler, -1, std::make_exception_ptr(std::runtime_error(error_message))));
+		}
+		return;
+	}
+	boost::asio::ip::udp::endpoint endpoint = endpoint_remote;
+	lock.unlock();
+	async_send_to_endpoint(endpoint, buf, len, delivery, handler, false);
+}
+
+std::future<int> Connection::asyncSend(const char *buf, int len)
+{
+	std::shared_ptr<std::promise<int>> promise = std::make_shared<std::promise<int>>();
+	std::future<int> future = promise->get_future();
+	asyncSend(buf, len, [promise](int length, std::exception_ptr error)
+			  {
+		if (error)
+			promise->set_exception(error);
+		else
+			promise->set_value(length); });
+	return future;
+}
+
+void Connection::asyncSendTo(const char *buf, int len, std::string address, unsigned short port, CompletionHandler handler)
+{
+	async_send_to_endpoint(parse_endpoint(address, port), buf, len, Delivery(), handler, false);
+}
+
+void Connection::asyncSendTo(const char *buf, int len, std::string address, unsigned short port, const Delivery &delivery, CompletionHandler handler)
+{
+	async_send_to_endpoint(parse_endpoint(address, port), buf, len, delivery, handler, false);
+}
+
+std::future<int> Connection::asyncSendTo(const char *buf, int len, std::string address, unsigned short port)
+{
+	boost::asio::ip::udp::endpoint endpoint = parse_endpoint(address, port);
+	std::shared_ptr<std::promise<int>> promise = std::make_shared<std::promise<int>>();
+	std::future<int> future = promise->get_future();
+	async_send_to_endpoint(endpoint, buf, len, Delivery(), [promise](int length, std::exception_ptr error)
+						   {
+		if (error)
+			promise->set_exception(error);
+		else
+			promise->set_value(length); }, false);
+	return future;
+}
+
+void Connection::async_send_to_endpoint(const boost::asio::ip::udp::endpoint &endpoint, const char *buf, int len, const Delivery &delivery, CompletionHandler handler, bool copy)
+{
+	// Queue the message on the channel of the endpoint and move it into the send window from the calling thread,
+	// or send it straight away if it is unreliable, like a batch of messages.
+	SendRequest request = make_send_request(buf, len, delivery, handler, copy);
+	std::unique_lock<std::mutex> lock(io_mutex);
+	std::string delivery_error = get_delivery_error(delivery, len);
+	if (!delivery_error.empty())
+	{
+		lock.unlock();
+		if (handler)
+		{
+			post(std::bind(handler, -1, std::make_exception_ptr(std::runtime_error(delivery_error))));
+		}
+		return;
+	}
+	SendChannel &channel = get_send_channel(endpoint, delivery.stream);
+	queue_send_request(channel, std::move(request));
+	if (!closing)
+	{
+		advance_send_window(channel);
+		flush_send_batch();
+	}
+	bool completed = !completions.empty();
+	lock.unlock();
+	if (completed)
+	{
+		post([this]()
+			 { dispatch_completions(); });
+	}
+}
+
+SendRequest Connection::make_send_request(const char *buf, int len, const Delivery &delivery, CompletionHandler handler, bool copy)
+{
+	// The lifetime of a message starts as it is submitted.
+	SendRequest request{buf, len, 0, PooledBuffer(), std::move(handler), delivery, boost::posix_time::pos_infin, false, boost::posix_time::pos_infin};
+	if (delivery.lifetime_ms >= 0)
+	{
+		request.expiry = boost::asio::deadline_timer::traits_type::now() + boost::posix_time::milliseconds(delivery.lifetime_ms);
+	}
+	if (copy && len > 0)
+	{
+		request.payload_copy = PooledBuffer(&buffer_pool, len);
+		memcpy(request.payload_copy.data(), buf, len);
+		request.payload = request.payload_copy.data();
+	}
+	return request;
+}
+
+void Connection::queue_send_request(SendChannel &channel, SendRequest &&request)
+{
+	// A small message sent in order without a lifetime or a limit of attempts may wait for the messages after it
+	// to share its packet.
+	const Delivery &delivery = request.delivery;
+	if (coalesce_delay_us >= 0 && delivery.delivery_class == DELIVERY_RELIABLE && delivery.lifetime_ms < 0 && delivery.max_attempts < 0 && (int)sizeof(int) + request.len <= get_fragment_size())
+	{
+		request.coalesce = true;
+		request.coalesce_deadline = boost::asio::deadline_timer::traits_type::now() + boost::posix_time::microseconds(coalesce_delay_us);
+	}
+	(delivery.delivery_class == DELIVERY_UNRELIABLE ? channel.unreliable_queue : channel.send_queue).push_back(std::move(request));
+}
+
+bool Connection::send_queue_ready(SendChannel &channel)
+{
+	// Messages waiting to be coalesced do not hold up the next message, which may share their packet.
+	return channel.send_window.size() < (size_t)window_size && channel.send_queue.size() < MAX_COALESCED_MESSAGES && std::all_of(channel.send_queue.begin(), channel.send_queue.end(), [](const SendRequest &request)
+																																	  { return request.coalesce; });
+}
+
+int Connection::sendv(const struct iovec *iov, int count)
+{
+	return sendv(iov, count, Delivery());
+}
+
+int Connection::sendv(const struct iovec *iov, int count, const Delivery &delivery)
+{
+	// Gather the message into the copy that the request owns, so it is only copied once whichever way it is sent.
+	size_t len = 0;
+	for (int i = 0; i < count; i++)
+	{
+		len += iov[i].iov_len;
+	}
+	if (len > (size_t)INT_MAX)
+	{
+		throw std::runtime_error("[RUDP] (ERROR) [SEND] Error sending packet: the message is larger than " + std::to_string(INT_MAX) + " bytes.");
+	}
+	PooledBuffer payload(&buffer_pool, len);
+	char *position = payload.data();
+	for (int i = 0; i < count; i++)
+	{
+		if (iov[i].iov_len > 0)
+		{
+			memcpy(position, iov[i].iov_base, iov[i].iov_len);
+			position += iov[i].iov_len;
+		}
+	}
+	std::unique_lock<std::mutex> lock(io_mutex);
+	bool stop_and_wait = window_size == 1 && delivery.delivery_class != DELIVERY_UNRELIABLE;
+	lock.unlock();
+	BatchMessage message;
+	message.len = (int)len;
+	message.delivery = delivery;
+	std::vector<std::future<int>> results(1);
+	std::vector<SendRequest> requests;
+	requests.push_back(make_send_request(nullptr, (int)len, delivery, stop_and_wait ? make_promise_handler(results[0]) : CompletionHandler(), false));
+	requests[0].payload_copy = std::move(payload);
+	requests[0].payload = requests[0].payload_copy.data();
+	send_requests(&message, requests, results);
+	if (message.error)
+	{
+		std::rethrow_exception(message.error);
+	}
+	return message.result;
+}
+
+size_t Connection::sendBatch(BatchMessage *messages, size_t count)
+{
+	// The buffers of the messages sent with Stop-and-Wait are referenced, as the batch waits for their ACKs, and
+	// the others are copied before the mutex is taken, as they are by send().
+	std::unique_lock<std::mutex> lock(io_mutex);
+	bool stop_and_wait = window_size == 1;
+	lock.unlock();
+	std::vector<std::future<int>> results(count);
+	std::vector<SendRequest> requests;
+	requests.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		bool referenced = stop_and_wait && messages[i].delivery.delivery_class != DELIVERY_UNRELIABLE;
+		requests.push_back(make_send_request(messages[i].buf, messages[i].len, messages[i].delivery, referenced ? make_promise_handler(results[i]) : CompletionHandler(), !referenced));
+	}
+	return send_requests(messages, requests, results);
+}
+
+size_t Connection::send_requests(BatchMessage *messages, std::vector<SendRequest> &requests, std::vector<std::future<int>> &results)
+{
+	std::unique_lock<std::mutex> lock(io_mutex);
+	// Move the messages queued so far into the send windows and send them together.
+	std::vector<SendChannel *> channels;
+	auto advance_channels = [this, &channels]()
+	{
+		if (!closing)
+		{
+			for (SendChannel *channel : channels)
+			{
+				advance_send_window(*channel);
+			}
+			flush_send_batch();
+		}
+		channels.clear();
+	};
+
+	// Like send(), report any packets that were abandoned since the last call before accepting more data.
+	std::string window_error = send_window_error;
+	send_window_error.clear();
+	std::string last_address;
+	int last_port = -1;
+	boost::asio::ip::udp::endpoint last_endpoint;
+	size_t sent = 0;
+	for (size_t i = 0; i < requests.size(); i++)
+	{
+		BatchMessage &message = messages[i];
+		SendRequest &request = requests[i];
+		message.result = -1;
+		message.error = nullptr;
+		std::string error_message = i == 0 ? window_error : std::string();
+		if (error_message.empty())
+		{
+			error_message = get_delivery_error(request.delivery, request.len);
+		}
+		boost::asio::ip::udp::endpoint endpoint = endpoint_remote;
+		if (error_message.empty() && message.address[0] != '\0')
+		{
+			// The messages of a batch usually share a destination, which is only parsed once.
+			if (last_port != message.port || last_address != message.address)
+			{
+				try
+				{
+					last_endpoint = parse_endpoint(message.address, (unsigned short)message.port);
+					last_address = message.address;
+					last_port = message.port;
+				}
+				catch (std::runtime_error error)
+				{
+					error_message = error.what();
+					last_port = -1;
+				}
+			}
+			endpoint = last_endpoint;
+		}
+		else if (error_message.empty() && !has_endpoint_remote)
+		{
+			error_message = "[RUDP] (ERROR) [SEND] Error sending packet: No remote endpoint set.";
+		}
+
+		// Wait for space in the send window of the stream, sending the messages queued so far so it can advance.
+		SendChannel *channel = nullptr;
+		if (error_message.empty())
+		{
+			channel = &get_send_channel(endpoint, request.delivery.stream);
+			if (!results[i].valid() && request.delivery.delivery_class != DELIVERY_UNRELIABLE && !send_queue_ready(*channel))
+			{
+				advance_channels();
+				wait_for_state(lock, [this, channel]()
+							   { return closing || send_queue_ready(*channel); });
+			}
+			if (closing)
+			{
+				error_message = "[RUDP] (ERROR) [CLOSE] Connection closed before the operation completed.\n";
+			}
+		}
+		if (!error_message.empty())
+		{
+			message.error = std::make_exception_ptr(std::runtime_error(error_message));
+			results[i] = std::future<int>();
+			continue;
+		}
+
+		int message_size = get_message_size(request.len);
+		queue_send_request(*channel, std::move(request));
+		if (std::find(channels.begin(), channels.end(), channel) == channels.end())
+		{
+			channels.push_back(channel);
+		}
+		if (!results[i].valid())
+		{
+			message.result = message_size;
+			++sent;
+		}
+	}
+	advance_channels();
+	bool completed = !completions.empty();
+	lock.unlock();
+	if (completed)
+	{
+		post([this]()
+			 { dispatch_completions(); });
+	}
+
+	// The messages sent with Stop-and-Wait complete once they have been acknowledged.
+	for (size_t i = 0; i < requests.size(); i++)
+	{
+		if (results[i].valid())
+		{
+			try
+			{
+				messages[i].result = wait_for_result(results[i]);
+				++sent;
+			}
+			catch (...)
+			{
+				messages[i].error = std::current_exception();
+			}
+		}
+	}
+	return sent;
+}
+
+CompletionHandler Connection::make_promise_handler(std::future<int> &future)
+{
+	std::shared_ptr<std::promise<int>> promise = std::make_shared<std::promise<int>>();
+	future = promise->get_future();
+	return [promise](int length, std::exception_ptr error)
+	{
+		if (error)
+			promise->set_exception(error);
+		else
+			promise->set_value(length);
+	};
+}
+
+CompletionHandler Connection::make_blocking_handler(BlockingResult &result)
+{
+	BlockingResult *target = &result;
+	return [this, target](int length, std::exception_ptr error)
+	{
+		std::unique_lock<std::mutex> lock(io_mutex);
+		target->length = length;
+		target->error = error;
+		target->done = true;
+		lock.unlock();
+		state_changed.notify_all();
+	};
+}
+
+void Connection::flush()
+{
+	std::unique_lock<std::mutex> lock(io_mutex);
+	// Send the messages waiting to be coalesced without waiting for their deadlines.
+	bool coalesced = false;
+	for (auto &channel : send_channels)
+	{
+		bool waiting = false;
+		for (SendRequest &request : channel.second.send_queue)
+		{
+			if (request.coalesce && request.coalesce_deadline != boost::posix_time::neg_infin)
+			{
+				request.coalesce_deadline = boost::posix_time::neg_infin;
+				waiting = true;
+			}
+		}
+		if (waiting && !closing)
+		{
+			advance_send_window(channel.second);
+			coalesced = true;
+		}
+	}
+	if (coalesced)
+	{
+		flush_send_batch();
+		post([this]()
+			 { dispatch_completions(); });
+	}
+	wait_for_state(lock, [this]()
+				   {
+		for (auto &channel : send_channels)
+		{
+			if (!channel.second.send_queue.empty() || !channel.second.send_window.empty() || !channel.second.unreliable_queue.empty())
+			{
+				return closing;
+			}
+		}
+		return true; });
+	throw_send_window_error();
+}
+
+int Connection::receive(char *buf, int len, char *address, int *port)
+{
+	return receive(buf, len, address, port, nullptr);
+}
+
+int Connection::receive(char *buf, int len, char *address, int *port, uint16_t *stream)
+{
+	// Take a message that is already queued without locking the connection, otherwise wait for the next one.
+	boost::asio::ip::udp::endpoint sender;
+	uint16_t received_stream;
+	int received_len = receive_queue.load()->pop(buf, len, sender, received_stream);
+	if (received_len >= 0)
+	{
+		*port = (int)sender.port();
+		strcpy(address, sender.address().to_string().c_str());
+		if (stream != nullptr)
+		{
+			*stream = received_stream;
+		}
+		return received_len;
+	}
+	BlockingResult result{0, nullptr, false};
+	asyncReceive(buf, len, address, port, stream, make_blocking_handler(result));
+	return wait_for_result(result);
+}
+
+size_t Connection::receiveBatch(BatchMessage *messages, size_t count)
+{
+	if (count == 0)
+	{
+		return 0;
+	}
+	// Wait for the first message, then take the messages that are already queued without locking the connection.
+	uint16_t stream = 0;
+	messages[0].delivery = Delivery();
+	messages[0].error = nullptr;
+	try
+	{
+		messages[0].result = receive(messages[0].buf, messages[0].len, messages[0].address, &messages[0].port, &stream);
+		messages[0].delivery.stream = stream;
+	}
+	catch (std::runtime_error error)
+	{
+		messages[0].result = -1;
+		messages[0].error = std::current_exception();
+		return 1;
+	}
+	ReceiveQueue *queue = receive_queue;
+	for (size_t i = 1; i < count; i++)
+	{
+		BatchMessage &message = messages[i];
+		boost::asio::ip::udp::endpoint sender;
+		int received_len = queue->pop(message.buf, message.len, sender, stream);
+		if (received_len == ReceiveQueue::EMPTY)
+		{
+			return i;
+		}
+		message.delivery = Delivery();
+		message.error = nullptr;
+		if (received_len == ReceiveQueue::TOO_SMALL)
+		{
+			message.result = -1;
+			message.error = std::make_exception_ptr(std::runtime_error("[RUDP] (ERROR) [RECV] Error buffer allocated to receive message is too small to fit the next message.\n"));
+			return i + 1;
+		}
+		message.result = received_len;
+		message.port = (int)sender.port();
+		strcpy(message.address, sender.address().to_string().c_str());
+		message.delivery.stream = stream;
+	}
+	return count;
+}
+
+void Connection::asyncReceive(char *buf, int len, char *address, int *port, CompletionHandler handler)
+{
+	asyncReceive(buf, len, address, port, nullptr, handler);
+}
+
+void Connection::asyncReceive(char *buf, int len, char *address, int *port, uint16_t *stream, CompletionHandler handler)
+{
+	std::unique_lock<std::mutex> lock(io_mutex);
+	// Fail the receive if the local endpoint is unknown.
+	if (!has_endpoint_local)
+	{
+		std::string error_message = "[RUDP] (ERROR) [RECV] Error receiving packet: No local endpoint set.\n";
+		lock.unlock();
+		post(std::bind(handler, -1, std::make_exception_ptr(std::runtime_error(error_message))));
+		return;
+	}
+
+	// Queue the receive and give it a message straight away if one has already been delivered, including the
+	// packets held by stalled receive channels now that the receive queue may have room for them.
+	receive_requests.push_back(ReceiveRequest{buf, len, address, port, stream, std::move(handler)});
+	serve_receive_requests();
+	if (reorder_stalled)
+	{
+		reorder_stalled = false;
+		receive_channels.for_each([this](ReceiveChannel &channel)
+								  {
+			if (channel.stalled)
+			{
+				deliver_reordered(channel);
+			} });
+		serve_receive_requests();
+	}
+	bool completed = !completions.empty();
+	lock.unlock();
+	if (completed)
+	{
+		post([this]()
+			 { dispatch_completions(); });
+	}
+}
+
+std::future<int> Connection::asyncReceive(char *buf, int len, char *address, int *port)
+{
+	std::shared_ptr<std::promise<int>> promise = std::make_shared<std::promise<int>>();
+	std::future<int> future = promise->get_future();
+	asyncReceive(buf, len, address, port, [promise](int length, std::exception_ptr error)
+				 {
+		if (error)
+			promise->set_exception(error);
+		else
+			promise->set_value(length); });
+	return future;
+}
+
+void Connection::start_receive()
+{
+	// A completion that destroyed the connection has closed the socket, and nothing may be queued behind its delete.
+	if (closed)
+	{
+		return;
+	}
+#ifdef __linux__
+	if (uring)
+	{
+		// Wait until the ring signals that it has received datagrams.
+		uring_descriptor->async_read_some(boost::asio::buffer(&uring_events, sizeof(uring_events)),
+										  make_pool_handler(buffer_pool, boost::bind(&Connection::handle_uring_completions,
+																					 this,
+																					 boost::asio::placeholders::error)));
+		return;
+	}
+	// Wait until the socket is readable then read every waiting datagram, up to a batch, in one system call.
+	socket.async_receive(boost::asio::null_buffers(),
+						 make_pool_handler(buffer_pool, boost::bind(&Connection::handle_datagram,
+																	this,
+																	boost::asio::placeholders::error,
+																	boost::asio::placeholders::bytes_transferred)));
+#else
+	std::unique_lock<std::mutex> lock(io_mutex);
+	set_read_target();
+	std::vector<char> &read_buffer = read_buffers[0];
+	std::array<boost::asio::mutable_buffer, 3> buffers = {{boost::asio::buffer(read_buffer.data(), DATA_HEADER_SIZE),
+														   boost::asio::buffer(read_target, read_target_len),
+														   boost::asio::buffer(read_buffer.data() + DATA_HEADER_SIZE, read_buffer.size() - DATA_HEADER_SIZE)}};
+	socket.async_receive_from(buffers,
+							  read_endpoints[0],
+							  make_pool_handler(buffer_pool, boost::bind(&Connection::handle_datagram,
+																		 this,
+																		 boost::asio::placeholders::error,
+																		 boost::asio::placeholders::bytes_transferred)));
+#endif
+}
+
+void Connection::set_read_target()
+{
+	// The next message in order is delivered to the first waiting receive when nothing is queued, which cannot
+	// change until the read completes, so the payload can be written straight into its buffer.
+	// A datagram coalesced by UDP GRO is read whole, as the payloads of its segments are not next to each other.
+	read_target = nullptr;
+	read_target_len = 0;
+	if (receive_queue.load()->empty() && !receive_requests.empty() && !segmentation_offload)
+	{
+		read_target = receive_requests.front().buf;
+		read_target_len = receive_requests.front().len;
+	}
+}
+
+#ifdef __linux__
+size_t Connection::read_datagrams()
+{
+	// Only the payload of the first datagram can be read into the read target.
+	set_read_target();
+	std::array<mmsghdr, IO_BATCH_SIZE> headers;
+	std::array<std::array<iovec, 3>, IO_BATCH_SIZE> iovecs;
+#ifdef UDP_GRO
+	// With UDP GRO the kernel gives the size of the segments of each coalesced datagram in a control message.
+	union
+	{
+		char buffer[CMSG_SPACE(sizeof(int))];
+		cmsghdr align;
+	} controls[IO_BATCH_SIZE];
+#endif
+	for (size_t i = 0; i < read_buffers.size(); i++)
+	{
+		char *read_buffer = read_buffers[i].data();
+		iovecs[i][0].iov_base = read_buffer;
+		iovecs[i][0].iov_len = DATA_HEADER_SIZE;
+		iovecs[i][1].iov_base = i == 0 ? read_target : nullptr;
+		iovecs[i][1].iov_len = i == 0 ? read_target_len : 0;
+		iovecs[i][2].iov_base = read_buffer + DATA_HEADER_SIZE;
+		iovecs[i][2].iov_len = read_buffers[i].size() - DATA_HEADER_SIZE;
+		headers[i].msg_hdr = msghdr();
+		headers[i].msg_hdr.msg_name = read_endpoints[i].data();
+		headers[i].msg_hdr.msg_namelen = read_endpoints[i].capacity();
+		headers[i].msg_hdr.msg_iov = iovecs[i].data();
+		headers[i].msg_hdr.msg_iovlen = iovecs[i].size();
+#ifdef UDP_GRO
+		if (segmentation_offload)
+		{
+			headers[i].msg_hdr.msg_control = controls[i].buffer;
+			headers[i].msg_hdr.msg_controllen = sizeof(controls[i].buffer);
+		}
+#endif
+	}
+
+	int count = recvmmsg(socket.native_handle(), headers.data(), read_buffers.size(), MSG_DONTWAIT, nullptr);
+	if (count < 0)
+	{
+		// The socket can be reported as readable without a datagram being available.
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			std::string error_message = "[RUDP] (ERROR) [RECV] Error in receiving packets with error: " + std::string(strerror(errno)) + "\n";
+			std::cout << error_message;
+		}
+		return 0;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		read_endpoints[i].resize(headers[i].msg_hdr.msg_namelen);
+		read_lengths[i] = headers[i].msg_len;
+		read_segment_sizes[i] = 0;
+#ifdef UDP_GRO
+		for (cmsghdr *control = CMSG_FIRSTHDR(&headers[i].msg_hdr); control != nullptr; control = CMSG_NXTHDR(&headers[i].msg_hdr, control))
+		{
+			if (control->cmsg_level == SOL_UDP && control->cmsg_type == UDP_GRO)
+			{
+				int segment_size;
+				memcpy(&segment_size, CMSG_DATA(control), sizeof(segment_size));
+				read_segment_sizes[i] = segment_size > 0 ? (size_t)segment_size : 0;
+			}
+		}
+#endif
+	}
+	return count;
+}
+#endif
+
+#ifdef __linux__
+void Connection::handle_datagram(const boost::system::error_code &err, std::size_t /*length*/)
+#else
+void Connection::handle_datagram(const boost::system::error_code &err, std::size_t length)
+#endif
+{
+	// The receive is only aborted when the socket is closed.
+	if (err == boost::asio::error::operation_aborted)
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(io_mutex);
+	if (closing)
+	{
+		return;
+	}
+	if (err.value() != 0)
+	{
+		std::string error_message = "[RUDP] (ERROR) [RECV] Error in receiving packet from " + read_endpoints[0].address().to_string() + ":" + std::to_string(read_endpoints[0].port()) + " with error: " + err.message() + "\n";
+		std::cout << error_message;
+	}
+	else
+	{
+#ifdef __linux__
+		size_t count = read_datagrams();
+#else
+		read_lengths[0] = length;
+		size_t count = 1;
+#endif
+		read_time = boost::asio::deadline_timer::traits_type::now();
+		if (read_time >= peer_sweep_time)
+		{
+			evict_idle_peers();
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			// Only the first datagram was scattered into the read target.
+			if (i == 1)
+			{
+				read_target = nullptr;
+				read_target_len = 0;
+			}
+			// A datagram coalesced by UDP GRO is split back into the datagrams that were sent, the last of which
+			// may be shorter than the rest.
+			size_t segment_size = read_segment_sizes[i] > 0 ? read_segment_sizes[i] : read_lengths[i];
+			for (size_t offset = 0; offset < read_lengths[i]; offset += segment_size)
+			{
+				size_t segment_len = std::min(segment_size, read_lengths[i] - offset);
+				StatsCounters::add(stats.bytes_received, segment_len);
+				dispatch_datagram(read_buffers[i].data() + offset, segment_len, read_endpoints[i]);
+			}
+		}
+		// Send the ACKs and packets produced by the whole batch together.
+		flush_send_batch();
+	}
+	lock.unlock();
+	dispatch_completions();
+
+	// Read the next datagram.
+	start_receive();
+}
+
+#ifdef __linux__
+void Connection::handle_uring_completions(const boost::system::error_code &err)
+{
+	// The wait is only aborted when the socket is closed.
+	if (err == boost::asio::error::operation_aborted)
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(io_mutex);
+	if (closing)
+	{
+		return;
+	}
+	if (err.value() != 0)
+	{
+		std::string error_message = "[RUDP] (ERROR) [RECV] Error in waiting for the io_uring with error: " + err.message() + "\n";
+		std::cout << error_message;
+	}
+	else
+	{
+		uring_datagrams.clear();
+		uring->receive(uring_datagrams);
+		read_time = boost::asio::deadline_timer::traits_type::now();
+		if (read_time >= peer_sweep_time)
+		{
+			evict_idle_peers();
+		}
+		// The datagrams are parsed in the buffers the kernel received them into, which are given back once every
+		// packet has been handled.
+		boost::asio::ip::udp::endpoint sender;
+		for (UringDatagram &datagram : uring_datagrams)
+		{
+			if (datagram.error != 0)
+			{
+				std::string error_message = "[RUDP] (ERROR) [RECV] Error in receiving packets with error: " + std::string(strerror(datagram.error)) + "\n";
+				std::cout << error_message;
+				continue;
+			}
+			if (datagram.length > 0)
+			{
+				memcpy(sender.data(), datagram.name, std::min((size_t)datagram.name_len, sender.capacity()));
+				sender.resize(datagram.name_len);
+				StatsCounters::add(stats.bytes_received, datagram.length);
+				dispatch_datagram(datagram.data, datagram.length, sender);
+			}
+		}
+		uring->release();
+		// Send the ACKs and packets produced by the whole batch together.
+		flush_send_batch();
+	}
+	lock.unlock();
+	dispatch_completions();
+
+	// Wait for the next datagrams.
+	start_receive();
+}
+#endif
+
+void Connection::dispatch_datagram(const char *packet, std::size_t length, const boost::asio::ip::udp::endpoint &sender)
+{
+	// Parse the rest of the datagram according to its type.
+	switch (packet[0])
+	{
+	case PACKET_TYPE_DATA:
+	case PACKET_TYPE_DATA_ACK:
+		handle_data(packet, length, sender);
+		break;
+	case PACKET_TYPE_ACK:
+		handle_ack(packet, length, sender);
+		break;
+	default:
+		std::string error_message = "[RUDP] (ERROR) [RECV] Received packet of unknown type " + std::to_string((int)packet[0]) + " from " + sender.address().to_string() + ":" + std::to_string(sender.port()) + "\n";
+		std::cout << error_message;
+		break;
+	}
+}
+
+void Connection::handle_data(const char *packet, std::size_t length, const boost::asio::ip::udp::endpoint &sender)
+{
+	// Parse the header of the packet, discarding it if the length does not match the datagram.
+	if (length < DATA_HEADER_SIZE)
+	{
+		std::string error_message = "[RUDP] (ERROR) [RECV] Error parsing header of packet received from " + sender.address().to_string() + ":" + std::to_string(sender.port()) + "\n";
+		std::cout << error_message;
+		StatsCounters::add(stats.packets_dropped);
+		return;
+	}
+	// Each stream of the sender has its own channel, so a packet is only ordered with those of its stream.
+	uint16_t received_stream;
+	memcpy(&received_stream, packet + DATA_STREAM_OFFSET, sizeof(received_stream));
+	PeerKey sender_key = PeerKey::from_endpoint(sender, received_stream);
+	ReceiveChannel *channel = receive_channels.find(sender_key);
+	bool sender_known = channel != nullptr;
+	uint32_t sequence_recv = sender_known ? channel->sequence_recv : 0;
+
+	uint32_t received_sequence;
+	uint32_t received_base;
+	int received_len;
+	int received_message_len;
+	int received_offset;
+	uint32_t received_epoch;
+	memcpy(&received_sequence, packet + sizeof(uint8_t), sizeof(received_sequence));
+	memcpy(&received_base, packet + sizeof(uint8_t) + sizeof(received_sequence), sizeof(received_base));
+	memcpy(&received_len, packet + sizeof(uint8_t) + sizeof(received_sequence) + sizeof(received_base), sizeof(received_len));
+	memcpy(&received_message_len, packet + sizeof(uint8_t) + sizeof(received_sequence) + sizeof(received_base) + sizeof(received_len), sizeof(received_message_len));
+	memcpy(&received_offset, packet + sizeof(uint8_t) + sizeof(received_sequence) + sizeof(received_base) + sizeof(received_len) + sizeof(received_message_len), sizeof(received_offset));
+	memcpy(&received_epoch, packet + sizeof(uint8_t) + sizeof(received_sequence) + sizeof(received_base) + sizeof(received_len) + sizeof(received_message_len) + sizeof(received_offset), sizeof(received_epoch));
+	uint8_t received_flags = packet[DATA_DELIVERY_OFFSET];
+	uint8_t received_delivery = received_flags & ~DATA_FLAG_COALESCED;
+	bool received_coalesced = (received_flags & DATA_FLAG_COALESCED) != 0;
+	size_t trailer_len = packet[0] == PACKET_TYPE_DATA_ACK ? ACK_INFO_SIZE : 0;
+	if (received_delivery > DELIVERY_UNRELIABLE)
+	{
+		std::string error_message = "[RUDP] (ERROR) [RECV] (SEQ-RECV: " + std::to_string(sequence_recv) + ") Error unknown delivery class " + std::to_string((int)received_delivery) + " of packet received from " + sender.address().to_string() + ":" + std::to_string(sender.port()) + "\n";
+		std::cout << error_message;
+		StatsCounters::add(stats.packets_dropped);
+		return;
+	}
+	if (received_len < 0 || DATA_HEADER_SIZE + received_len + trailer_len != length || received_offset < 0 || (int64_t)received_offset + received_len > received_message_len)
+	{
+		std::string error_message = "[RUDP] (ERROR) [RECV] (SEQ-RECV: " + std::to_string(sequence_recv) + ") Error length of message received from " + sender.address().to_string() + ":" + std::to_string(sender.port()) + " does not match the packet\n";
+		std::cout << error_message;
+		StatsCounters::add(stats.packets_dropped);
+		return;
+	}
+	// The message length comes from the sender, so it is bounded before a buffer of that size is taken for it.
+	if (received_message_len > max_message_size)
+	{
+		std::string error_message = "[RUDP] (ERROR) [RECV] (SEQ-RECV: " + std::to_string(sequence_recv) + ") Error message of " + std::to_string(received_message_len) + " bytes received from " + sender.address().to_string() + ":" + std::to_string(sender.port()) + " is larger than the maximum message size\n";
+		std::cout << error_message;
+		StatsCounters::add(stats.packets_dropped);
+		RUDP_TRACE(TRACE_LEVEL_EVENT, TRACE_MESSAGE_TOO_LARGE, sender, received_sequence, received_message_len, sequence_recv);
+		return;
+	}
+	// Coalesced messages are only sent reliably in order, filling the payload of a single packet.
+	if (received_coalesced && (received_delivery != DELIVERY_RELIABLE || received_len != received_message_len || count_coalesced(packet, received_len) < 0))
+	{
+		std::string error_message = "[RUDP] (ERROR) [RECV] (SEQ-RECV: " + std::to_string(sequence_recv) + ") Error coalesced messages received from " + sender.address().to_string() + ":" + std::to_string(sender.port()) + " do not match the packet\n";
+		std::cout << error_message;
+		StatsCounters::add(stats.packets_dropped);
+		return;
+	}
+	StatsCounters::add(stats.packets_received);
+	RUDP_TRACE(TRACE_LEVEL_PACKET, TRACE_DATA_RECEIVED, sender, received_sequence, received_len, sequence_recv);
+
+	// Process the ACK carried after the payload for the data this connection sends to the sender.
+	if (trailer_len > 0)
+	{
+		std::array<char, ACK_INFO_SIZE> ack;
+		copy_read_payload(ack.data(), packet, received_len, ACK_INFO_SIZE);
+		process_ack(ack.data(), sender);
+	}
+
+	// A packet of the session the sender has left was delayed in the network or sent before the sender restarted,
+	// and following it back would deliver the new session's messages again once it catches up.
+	if (sender_known && received_epoch == channel->retired_epoch && received_epoch != channel->epoch)
+	{
+		RUDP_TRACE(TRACE_LEVEL_EVENT, TRACE_STALE_SESSION, sender, received_sequence, received_epoch);
+		StatsCounters::add(stats.packets_dropped);
+		return;
+	}
+	// If the sender is unknown or has started a new session, because its sequence was reset or it is a new
+	// connection on the same endpoint, start from its window base as every sequence before the base has been
+	// acknowledged (or abandoned) by the sender. The ACKs carry the epoch back, so the sender is resynchronised
+	// with the first of them and ignores those still in flight from the previous session.
+	if (!sender_known || received_epoch != channel->epoch)
+	{
+		RUDP_TRACE(TRACE_LEVEL_EVENT, TRACE_NEW_SESSION, sender, received_base, received_epoch);
+		if (!sender_known)
+		{
+			channel = &receive_channels.insert(sender_key, ReceiveChannel(sender, received_stream, read_time));
+		}
+		else
+		{
+			channel->retired_epoch = channel->epoch;
+		}
+		channel->epoch = received_epoch;
+		channel->sequence_recv = received_base;
+		channel->stalled = false;
+		for (ReorderSlot &slot : channel->reorder_buffer)
+		{
+			slot.used = false;
+		}
+		// Any message being reassembled belonged to the previous session.
+		discard_partial_message(*channel);
+	}
+	ReceiveChannel &receive_channel = *channel;
+	receive_channel.last_active = read_time;
+
+	// Deliver the packets held for the channel that the receive queue had no room for before this one.
+	if (receive_channel.stalled)
+	{
+		deliver_reordered(receive_channel);
+	}
+
+	// If the window base is ahead of the current sequence, the sender has abandoned the packets before it.
+	if (sequence_distance(receive_channel.sequence_recv, received_base) > 0)
+	{
+		RUDP_TRACE(TRACE_LEVEL_EVENT, TRACE_BASE_SKIPPED, sender, receive_channel.sequence_recv, received_base);
+		skip_to_base(receive_channel, received_base);
+	}
+
+	// An unreliable message takes no sequence number, it is delivered as it arrives and never acknowledged.
+	if (received_delivery == DELIVERY_UNRELIABLE)
+	{
+		if (received_len != received_message_len || receive_queue_full())
+		{
+			StatsCounters::add(stats.packets_dropped);
+			return;
+		}
+		deliver_message(receive_channel, packet, 0, received_len);
+		return;
+	}
+
+	int32_t position = sequence_distance(receive_channel.sequence_recv, received_sequence);
+	if (position == 0)
+	{
+		if (!deliver_data(receive_channel, packet))
+		{
+			StatsCounters::add(stats.packets_dropped);
+			return;
+		}
+		// Move on to the next sequence number, along with any packets after it that are already held. If the
+		// sender has nothing else in flight it is waiting for this ACK, so there is no point in delaying it.
+		ReorderSlot *slot = receive_channel.reorder_buffer.empty() ? nullptr : &receive_channel.reorder_buffer[received_sequence % REORDER_BUFFER_SIZE];
+		if (slot != nullptr && slot->used && slot->sequence == received_sequence)
+		{
+			slot->used = false;
+		}
+		++receive_channel.sequence_recv;
+		deliver_reordered(receive_channel);
+		queue_ack(receive_channel, received_sequence, receive_channel.sequence_recv, get_reorder_sack(receive_channel), received_base == received_sequence);
+	}
+	else if (position < 0)
+	{
+		// The packet was delivered previously but the ACK did not get to the sender, so acknowledge it again.
+		StatsCounters::add(stats.duplicates);
+		queue_ack(receive_channel, received_sequence, receive_channel.sequence_recv, get_reorder_sack(receive_channel), true);
+	}
+	else if (position <= (int)REORDER_BUFFER_SIZE)
+	{
+		// Hold the packet until the packets before it arrive, and acknowledge it straight away so that the sender
+		// learns of the gap and does not retransmit the packet.
+		if (receive_channel.reorder_buffer.empty())
+		{
+			receive_channel.reorder_buffer = std::vector<ReorderSlot>(REORDER_BUFFER_SIZE, ReorderSlot{false, false, 0, std::vector<char>()});
+		}
+		// The slots cover the sequence numbers after the next one expected, which wrap along with them as the size
+		// of the buffer divides 2^32, so a used slot always holds the same packet.
+		ReorderSlot &slot = receive_channel.reorder_buffer[received_sequence % REORDER_BUFFER_SIZE];
+		if (slot.used)
+		{
+			StatsCounters::add(stats.duplicates);
+		}
+		else if (received_delivery == DELIVERY_UNORDERED && received_len == received_message_len)
+		{
+			// An unordered message is delivered straight away, and only its sequence is held so that the
+			// messages before it are still delivered in order.
+			if (receive_queue_full())
+			{
+				StatsCounters::add(stats.packets_dropped);
+				return;
+			}
+			deliver_message(receive_channel, packet, 0, received_len);
+			slot.used = true;
+			slot.delivered = true;
+			slot.sequence = received_sequence;
+		}
+		else
+		{
+			RUDP_TRACE(TRACE_LEVEL_PACKET, TRACE_PACKET_HELD, sender, received_sequence, 0, receive_channel.sequence_recv);
+			slot.used = true;
+			slot.delivered = false;
+			slot.sequence = received_sequence;
+			slot.packet.resize(DATA_HEADER_SIZE + received_len);
+			memcpy(slot.packet.data(), packet, DATA_HEADER_SIZE);
+			copy_read_payload(slot.packet.data() + DATA_HEADER_SIZE, packet, 0, received_len);
+			StatsCounters::add(stats.packets_reordered);
+		}
+		queue_ack(receive_channel, received_sequence, receive_channel.sequence_recv, get_reorder_sack(receive_channel), true);
+	}
+	else
+	{
+		// Packets further ahead than the reorder buffer are not acknowledged so the sender will retransmit them.
+		StatsCounters::add(stats.packets_dropped);
+		RUDP_TRACE(TRACE_LEVEL_EVENT, TRACE_PACKET_DROPPED, sender, received_sequence, 0, receive_channel.sequence_recv);
+	}
+}
+
+bool Connection::deliver_data(ReceiveChannel &channel, const char *packet)
+{
+	const boost::asio::ip::udp::endpoint &sender = channel.sender;
+	uint32_t sequence_recv = channel.sequence_recv;
+	int received_len;
+	int received_message_len;
+	int received_offset;
+	const char *field = packet + sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint32_t);
+	memcpy(&received_len, field, sizeof(received_len));
+	memcpy(&received_message_len, field + sizeof(received_len), sizeof(received_message_len));
+	memcpy(&received_offset, field + sizeof(received_len) + sizeof(received_message_len), sizeof(received_offset));
+
+	if (received_offset == 0)
+	{
+		// A new message replaces any message whose remaining fragments were abandoned by the sender.
+		discard_partial_message(channel);
+		// If the receive queue is full leave the packet unacknowledged so the sender retransmits it later.
+		if (receive_queue_full())
+		{
+			RUDP_TRACE(TRACE_LEVEL_EVENT, TRACE_QUEUE_FULL, sender, sequence_recv);
+			return false;
+		}
+		if (packet[DATA_DELIVERY_OFFSET] & DATA_FLAG_COALESCED)
+		{
+			if (!deliver_coalesced(channel, packet, received_len))
+			{
+				RUDP_TRACE(TRACE_LEVEL_EVENT, TRACE_QUEUE_FULL, sender, sequence_recv);
+				return false;
+			}
+		}
+		else if (received_len == received_message_len)
+		{
+			deliver_message(channel, packet, 0, received_len);
+		}
+		else
+		{
+			// Reassemble the fragments of the message in the buffer of the first waiting receive, taking it from
+			// the waiting receives so no other message is delivered to it, or otherwise in a pooled buffer.
+			channel.has_partial = true;
+			PartialMessage &partial_message = channel.partial;
+			partial_message.len = received_message_len;
+			partial_message.received_len = 0;
+			partial_message.has_request = false;
+			if (receive_queue.load()->empty() && !receive_requests.empty() && receive_requests.front().len >= received_message_len)
+			{
+				partial_message.has_request = true;
+				partial_message.request = receive_requests.front();
+				partial_message.buf = partial_message.request.buf;
+				receive_requests.pop_front();
+			}
+			else
+			{
+				partial_message.payload = take_receive_buffer(received_message_len);
+				partial_message.buf = partial_message.payload.data();
+			}
+		}
+	}
+	else if (!channel.has_partial || channel.partial.len != received_message_len || channel.partial.received_len != received_offset)
+	{
+		// The fragment is the rest of a message whose earlier fragments were abandoned by the sender, so it
+		// cannot be delivered, but it is acknowledged so the sender moves on.
+		RUDP_TRACE(TRACE_LEVEL_EVENT, TRACE_FRAGMENT_DROPPED, sender, sequence_recv);
+		discard_partial_message(channel);
+	}
+
+	// Add the fragment to the message being reassembled, delivering it once every fragment has been received.
+	if (channel.has_partial)
+	{
+		PartialMessage &partial_message = channel.partial;
+		// The last fragment is left unacknowledged like a whole message if there is no room to queue the message.
+		if (!partial_message.has_request && partial_message.received_len + received_len == partial_message.len && receive_queue_full())
+		{
+			RUDP_TRACE(TRACE_LEVEL_EVENT, TRACE_QUEUE_FULL, sender, sequence_recv);
+			return false;
+		}
+		copy_read_payload(partial_message.buf + received_offset, packet, 0, received_len);
+		partial_message.received_len += received_len;
+		if (partial_message.received_len == partial_message.len)
+		{
+			if (partial_message.has_request)
+			{
+				complete_receive(partial_message.request, partial_message.len, sender, channel.stream);
+			}
+			else
+			{
+				// Swap the reassembled message into the next cell of the receive queue and pool the old buffer of the cell.
+				ReceiveQueue *queue = receive_queue;
+				queue->reserve()->swap(partial_message.payload);
+				queue->commit(sender, channel.stream);
+				receive_buffer_pool.push_back(std::move(partial_message.payload));
+				serve_receive_requests();
+			}
+			StatsCounters::add(stats.messages_received);
+			channel.has_partial = false;
+		}
+	}
+	return true;
+}
+
+void Connection::deliver_message(ReceiveChannel &channel, const char *packet, int offset, int len)
+{
+	// Deliver the message to the first waiting receive if nothing is queued ahead of it, otherwise write it into
+	// the next cell of the receive queue.
+	ReceiveQueue *queue = receive_queue;
+	if (queue->empty() && !receive_requests.empty() && receive_requests.front().len >= len)
+	{
+		ReceiveRequest &request = receive_requests.front();
+		copy_read_payload(request.buf, packet, offset, len);
+		complete_receive(request, len, channel.sender, channel.stream);
+		receive_requests.pop_front();
+	}
+	else
+	{
+		std::vector<char> *payload = queue->reserve();
+		payload->resize(len);
+		copy_read_payload(payload->data(), packet, offset, len);
+		queue->commit(channel.sender, channel.stream);
+		serve_receive_requests();
+	}
+	StatsCounters::add(stats.messages_received);
+}
+
+bool Connection::deliver_coalesced(ReceiveChannel &channel, const char *packet, int len)
+{
+	// The receive queue limit was checked for the packet, and the queue must have a cell for each message in case
+	// there are no receives waiting for them.
+	int count = count_coalesced(packet, len);
+	ReceiveQueue *queue = receive_queue;
+	if (!queue->available(count))
+	{
+		return false;
+	}
+	// Deliver the messages from a copy of the packet, as the first of them may be delivered to the buffer that the
+	// payload was read into, over the messages after it.
+	const char *source = packet;
+	char *target = read_target;
+	int target_len = read_target_len;
+	if (read_target != nullptr)
+	{
+		coalesced_packet.resize(DATA_HEADER_SIZE + len);
+		memcpy(coalesced_packet.data(), packet, DATA_HEADER_SIZE);
+		copy_read_payload(coalesced_packet.data() + DATA_HEADER_SIZE, packet, 0, len);
+		source = coalesced_packet.data();
+		read_target = nullptr;
+		read_target_len = 0;
+	}
+	int offset = 0;
+	while (offset < len)
+	{
+		int message_len;
+		memcpy(&message_len, source + DATA_HEADER_SIZE + offset, sizeof(message_len));
+		deliver_message(channel, source, offset + sizeof(message_len), message_len);
+		offset += sizeof(message_len) + message_len;
+	}
+	read_target = target;
+	read_target_len = target_len;
+	return true;
+}
+
+int Connection::count_coalesced(const char *packet, int len)
+{
+	int count = 0;
+	int offset = 0;
+	while (offset < len)
+	{
+		int message_len;
+		if (len - offset < (int)sizeof(message_len) || count == (int)MAX_COALESCED_MESSAGES)
+		{
+			return -1;
+		}
+		copy_read_payload((char *)&message_len, packet, offset, sizeof(message_len));
+		offset += sizeof(message_len);
+		if (message_len < 0 || message_len > len - offset)
+		{
+			return -1;
+		}
+		offset += message_len;
+		++count;
+	}
+	return count > 0 ? count : -1;
+}
+
+void Connection::deliver_reordered(ReceiveChannel &channel)
+{
+	channel.stalled = false;
+	if (channel.reorder_buffer.empty())
+	{
+		return;
+	}
+	// The held packets were copied out of the read buffers, so none of their payload is in the read target.
+	char *target = read_target;
+	int target_len = read_target_len;
+	read_target = nullptr;
+	read_target_len = 0;
+	while (true)
+	{
+		ReorderSlot &slot = channel.reorder_buffer[channel.sequence_recv % REORDER_BUFFER_SIZE];
+		if (!slot.used || slot.sequence != channel.sequence_recv)
+		{
+			break;
+		}
+		if (slot.delivered)
+		{
+			// The message was delivered when it arrived, and like any new message it ends one being reassembled.
+			discard_partial_message(channel);
+		}
+		else if (!deliver_data(channel, slot.packet.data()))
+		{
+			// The packet has been acknowledged, so it is delivered once the receive queue has room instead.
+			channel.stalled = true;
+			reorder_stalled = true;
+			break;
+		}
+		slot.used = false;
+		++channel.sequence_recv;
+	}
+	read_target = target;
+	read_target_len = target_len;
+}
+
+void Connection::skip_to_base(ReceiveChannel &channel, uint32_t base)
+{
+	while (!channel.stalled && channel.sequence_recv != base)
+	{
+		// A packet that was held has been acknowledged and is delivered, while a packet that never arrived leaves
+		// a gap in the message being reassembled.
+		bool held = false;
+		for (ReorderSlot &slot : channel.reorder_buffer)
+		{
+			held = held || slot.used;
+		}
+		if (held)
+		{
+			ReorderSlot &slot = channel.reorder_buffer[channel.sequence_recv % REORDER_BUFFER_SIZE];
+			if (slot.used && slot.sequence == channel.sequence_recv)
+			{
+				deliver_reordered(channel);
+				continue;
+			}
+			discard_partial_message(channel);
+			++channel.sequence_recv;
+		}
+		else
+		{
+			// Nothing after the gap is held, so the rest of it, which can span far more sequence numbers than the
+			// reorder buffer, is skipped at once.
+			discard_partial_message(channel);
+			channel.sequence_recv = base;
+		}
+	}
+	// Deliver the packets held from the base onwards.
+	if (!channel.stalled)
+	{
+		deliver_reordered(channel);
+	}
+}
+
+uint32_t Connection::get_reorder_sack(ReceiveChannel &channel)
+{
+	uint32_t sack = 0;
+	if (channel.reorder_buffer.empty())
+	{
+		return sack;
+	}
+	for (int i = 0; i < (int)REORDER_BUFFER_SIZE; i++)
+	{
+		uint32_t sequence = channel.sequence_recv + 1 + i;
+		ReorderSlot &slot = channel.reorder_buffer[sequence % REORDER_BUFFER_SIZE];
+		if (slot.used && slot.sequence == sequence)
+		{
+			sack |= (uint32_t)1 << i;
+		}
+	}
+	return sack;
+}
+
+int32_t Connection::sequence_distance(uint32_t from, uint32_t to)
+{
+	// The difference wraps modulo 2^32 and is read as signed, so to is after from if it is less than 2^31 ahead.
+	return (int32_t)(to - from);
+}
+
+void Connection::handle_ack(const char *packet, std::size_t length, const boost::asio::ip::udp::endpoint &sender)
+{
+	if (length < ACK_PACKET_SIZE)
+	{
+		std::string error_message = "[RUDP] (ERROR) [SEND] Error copying ACK received from " + sender.address().to_string() + ":" + std::to_string(sender.port()) + "\n";
+		std::cout << error_message;
+		return;
+	}
+	process_ack(packet + sizeof(uint8_t), sender);
+}
+
+void Connection::process_ack(const char *ack, const boost::asio::ip::udp::endpoint &sender)
+{
+	// Only the channel that sends on the stream to the endpoint the ACK came from can be acknowledged.
+	uint32_t received_sequence;
+	uint32_t received_cumulative;
+	uint32_t received_sack;
+	uint32_t received_epoch;
+	uint16_t received_stream;
+	memcpy(&received_sequence, ack, sizeof(received_sequence));
+	memcpy(&received_cumulative, ack + sizeof(received_sequence), sizeof(received_cumulative));
+	memcpy(&received_sack, ack + sizeof(received_sequence) + sizeof(received_cumulative), sizeof(received_sack));
+	memcpy(&received_epoch, ack + sizeof(received_sequence) + sizeof(received_cumulative) + sizeof(received_sack), sizeof(received_epoch));
+	memcpy(&received_stream, ack + sizeof(received_sequence) + sizeof(received_cumulative) + sizeof(received_sack) + sizeof(received_epoch), sizeof(received_stream));
+	auto channel = send_channels.find(std::make_pair(sender, received_stream));
+	if (channel == send_channels.end())
+	{
+		return;
+	}
+	SendChannel &send_channel = channel->second;
+	send_channel.last_active = read_time;
+	StatsCounters::add(stats.acks_received);
+	RUDP_TRACE(TRACE_LEVEL_PACKET, TRACE_ACK_RECEIVED, sender, received_sequence, received_cumulative, received_sack);
+
+	// An ACK for another epoch was sent before the channel was reset, and its sequence numbers are those of the
+	// previous session, so it would acknowledge packets of the new session that were never received.
+	if (received_epoch != send_channel.epoch)
+	{
+		RUDP_TRACE(TRACE_LEVEL_EVENT, TRACE_STALE_SESSION, sender, received_sequence, received_epoch);
+		return;
+	}
+
+	// Positions in the window are counted from its base in serial number arithmetic. The cumulative sequence is
+	// ignored if it lies outside of the window, as the ACK is then older than the window or came from a receiver
+	// that is ahead of it.
+	uint32_t base = send_window_base(send_channel);
+	int32_t cumulative = sequence_distance(base, received_cumulative);
+	bool cumulative_valid = cumulative >= 0 && cumulative <= sequence_distance(base, send_channel.sequence_send);
+
+	// Mark every packet in the window that the ACK covers as acknowledged.
+	bool ack_received = false;
+	boost::posix_time::ptime now = boost::asio::deadline_timer::traits_type::now();
+	size_t in_flight = count_in_flight(send_channel);
+	for (SendSlot &slot : send_channel.send_window)
+	{
+		if (slot.acked)
+		{
+			continue;
+		}
+		bool covered = slot.sequence == received_sequence;
+		if (cumulative_valid && !covered)
+		{
+			int32_t position = sequence_distance(base, slot.sequence);
+			int32_t sack_bit = position - cumulative - 1;
+			covered = position < cumulative || (sack_bit >= 0 && sack_bit < 32 && (received_sack >> sack_bit) & 1);
+		}
+		if (!covered)
+		{
+			continue;
+		}
+		slot.acked = true;
+		ack_received = true;
+		--in_flight;
+		StatsCounters::record(stats.ack_latency_histogram, now - slot.first_sent_time);
+		if (slot.message_end)
+		{
+			StatsCounters::add(stats.messages_sent, slot.messages);
+		}
+		// Only the packet that caused the ACK is measured, and not if it was retransmitted as the ACK could
+		// be for any of its transmissions.
+		double rtt_ms = -1;
+		if (slot.sequence == received_sequence && slot.attempts == 1)
+		{
+			rtt_ms = (now - slot.sent_time).total_microseconds() / 1000.0;
+			StatsCounters::record(stats.rtt_histogram, now - slot.sent_time);
+			measure_rtt(send_channel, rtt_ms);
+		}
+		if (send_channel.congestion)
+		{
+			send_channel.congestion->acked(slot.delivery, DATA_HEADER_SIZE + slot.len, slot.attempts > 1, rtt_ms, in_flight, now);
+		}
+		// The handler is cleared as the slot may stay in the window, behind earlier fragments, once it is acknowledged.
+		if (slot.handler)
+		{
+			completions.push_back(Completion{std::move(slot.handler), slot.message_size, std::exception_ptr()});
+			slot.handler = CompletionHandler();
+		}
+	}
+	if (ack_received)
+	{
+		detect_losses(send_channel, now);
+	}
+	advance_send_window(send_channel);
+}
+
+void Connection::queue_ack(ReceiveChannel &channel, uint32_t sequence, uint32_t cumulative, uint32_t sack, bool immediate)
+{
+	PendingAck &ack = channel.ack;
+	ack.sequence = sequence;
+	ack.cumulative = cumulative;
+	ack.sack = sack;
+	++ack.packets;
+	if (immediate || ack.packets >= ack_packets || ack_delay_us == 0)
+	{
+		ack.packets = 0;
+		send_ack(sequence, cumulative, sack, channel.epoch, channel.stream, channel.sender);
+	}
+	else if (ack.packets == 1)
+	{
+		ack.deadline = boost::asio::deadline_timer::traits_type::now() + boost::posix_time::microseconds(ack_delay_us);
+		arm_ack_timer();
+	}
+}
+
+void Connection::arm_ack_timer()
+{
+	boost::posix_time::ptime deadline = boost::posix_time::pos_infin;
+	receive_channels.for_each([&deadline](ReceiveChannel &channel)
+							  {
+		if (channel.ack.packets > 0 && channel.ack.deadline < deadline)
+		{
+			deadline = channel.ack.deadline;
+		} });
+	// The timer is only re-armed for an earlier deadline, if it fires early the handler re-arms it, so that an
+	// ACK, which usually moves the deadline later, does not cancel and restart the wait.
+	if (deadline < ack_timer.expires_at())
+	{
+		ack_timer.expires_at(deadline);
+		ack_timer.async_wait(make_pool_handler(buffer_pool, boost::bind(&Connection::handle_ack_timer, this, boost::asio::placeholders::error)));
+	}
+}
+
+void Connection::handle_ack_timer(const boost::system::error_code &err)
+{
+	// The timer is aborted whenever it is re-armed or the connection is closed.
+	if (err == boost::asio::error::operation_aborted)
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(io_mutex);
+	if (closing)
+	{
+		return;
+	}
+	ack_timer.expires_at(boost::posix_time::pos_infin);
+	boost::posix_time::ptime now = boost::asio::deadline_timer::traits_type::now();
+	receive_channels.for_each([this, &now](ReceiveChannel &channel)
+							  {
+		if (channel.ack.packets > 0 && channel.ack.deadline <= now)
+		{
+			channel.ack.packets = 0;
+			send_ack(channel.ack.sequence, channel.ack.cumulative, channel.ack.sack, channel.epoch, channel.stream, channel.sender);
+		} });
+	arm_ack_timer();
+	flush_send_batch();
+}
+
+void Connection::handle_timer(SendChannel *channel, const boost::system::error_code &err)
+{
+	// The timer is aborted whenever it is re-armed or the connection is closed.
+	if (err == boost::asio::error::operation_aborted)
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(io_mutex);
+	if (closing)
+	{
+		return;
+	}
+	// The timer has no wait pending until it is re-armed below.
+	channel->timer.expires_at(boost::posix_time::pos_infin);
+
+	// Abandon every packet whose deadline has passed after reaching its lifetime or a limit of transmissions,
+	// before any retransmission is queued as that requires the window to stay in place until the batch is sent.
+	boost::posix_time::ptime now = boost::asio::deadline_timer::traits_type::now();
+	for (auto slot = channel->send_window.begin(); slot != channel->send_window.end();)
+	{
+		int expired = !slot->acked && slot->deadline <= now ? expire_slot(*slot, now) : 0;
+		if (expired > 0)
+		{
+			std::string error_message = "[RUDP] (ERROR) [SEND] (SEQ-SEND: " + std::to_string(slot->sequence) + ") Dropped message to " + channel->endpoint.address().to_string() + ":" + std::to_string(channel->endpoint.port()) + " at the end of its lifetime after " + std::to_string(slot->attempts) + " tries.\n";
+			slot = abandon_slot(*channel, slot, error_message, true);
+		}
+		else if (expired < 0)
+		{
+			std::string error_message = "[RUDP] (ERROR) [SEND] (SEQ-SEND: " + std::to_string(slot->sequence) + ") Error sending packet to " + channel->endpoint.address().to_string() + ":" + std::to_string(channel->endpoint.port()) + " after " + std::to_string(slot->attempts) + " tries.\n";
+			slot = abandon_slot(*channel, slot, error_message);
+		}
+		else
+		{
+			++slot;
+		}
+	}
+
+	// Retransmit the rest of them whose own deadline has passed, backing off the timeout once for the timer rather
+	// than for every packet that it retransmits. The receiver holds the packets up to REORDER_BUFFER_SIZE ahead of
+	// the window base and discards those further ahead, so once a packet has timed out the
+	// unacknowledged packets beyond the reorder buffer are retransmitted along with it.
+	bool timed_out = false;
+	uint32_t base = send_window_base(*channel);
+	for (SendSlot &slot : channel->send_window)
+	{
+		if (slot.acked || (slot.deadline > now && !(timed_out && sequence_distance(base, slot.sequence) > (int32_t)REORDER_BUFFER_SIZE)))
+		{
+			continue;
+		}
+		RUDP_TRACE(TRACE_LEVEL_EVENT, TRACE_TIMEOUT, channel->endpoint, slot.sequence, slot.attempts);
+		if (!timed_out)
+		{
+			StatsCounters::add(stats.timeouts);
+			if (adaptive_timeout)
+			{
+				channel->timeout_ms = std::min(channel->timeout_ms * 2, (double)timeout_max_ms);
+			}
+			// The packets sent before the timeout are recovered without signalling their losses again.
+			if (channel->congestion)
+			{
+				channel->congestion->on_timeout(now);
+			}
+			channel->in_recovery = true;
+			channel->recovery_sequence = channel->sequence_send;
+		}
+		timed_out = true;
+		transmit_slot(*channel, slot);
+	}
+
+	// Abandoned packets may have exposed acknowledged packets at the front of the window.
+	advance_send_window(*channel);
+	flush_send_batch();
+	lock.unlock();
+	dispatch_completions();
+}
+
+int Connection::expire_slot(SendSlot &slot, const boost::posix_time::ptime &now)
+{
+	if (slot.expiry <= now)
+	{
+		return 1;
+	}
+	if (slot.max_attempts != -1)
+	{
+		return slot.attempts >= slot.max_attempts ? 1 : 0;
+	}
+	return send_retries_limit != -1 && slot.attempts >= send_retries_limit ? -1 : 0;
+}
+
+void Connection::handle_pacing_timer(SendChannel *channel, const boost::system::error_code &err)
+{
+	// The timer is aborted whenever it is re-armed or the connection is closed.
+	if (err == boost::asio::error::operation_aborted)
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(io_mutex);
+	if (closing)
+	{
+		return;
+	}
+	channel->pacing_timer.expires_at(boost::posix_time::pos_infin);
+	advance_send_window(*channel);
+	flush_send_batch();
+	lock.unlock();
+	dispatch_completions();
+}
+
+bool Connection::pace(SendChannel &channel)
+{
+	boost::posix_time::ptime now = boost::asio::deadline_timer::traits_type::now();
+	size_t packet_bytes = mtu - IPV4_UDP_HEADER_SIZE;
+	channel.pacer.set_rate(channel.congestion ? channel.congestion->pacing_rate() : 0, packet_bytes);
+	boost::posix_time::ptime ready = std::max(channel.pacer.ready_time(now), rate_limiter.ready_time(now));
+	if (ready <= now)
+	{
+		return true;
+	}
+	if (ready != channel.pacing_timer.expires_at())
+	{
+		channel.pacing_timer.expires_at(ready);
+		channel.pacing_timer.async_wait(make_pool_handler(buffer_pool, boost::bind(&Connection::handle_pacing_timer, this, &channel, boost::asio::placeholders::error)));
+	}
+	return false;
+}
+
+size_t Connection::count_in_flight(SendChannel &channel)
+{
+	size_t in_flight = 0;
+	for (SendSlot &slot : channel.send_window)
+	{
+		in_flight += !slot.acked;
+	}
+	return in_flight;
+}
+
+void Connection::detect_losses(SendChannel &channel, const boost::posix_time::ptime &now)
+{
+	// The receiver holds the packets that arrive after a missing one and acknowledges them in its SACK, so a
+	// packet is taken as lost once enough of the packets sent after it are acknowledged. It is only retransmitted
+	// this way once, after which its timeout recovers it.
+	size_t acked_after = 0;
+	for (SendSlot &slot : channel.send_window)
+	{
+		acked_after += slot.acked;
+	}
+	bool lost = false;
+	for (SendSlot &slot : channel.send_window)
+	{
+		if (slot.acked)
+		{
+			--acked_after;
+		}
+		else if (acked_after >= DUPLICATE_ACK_THRESHOLD && slot.attempts == 1)
+		{
+			transmit_slot(channel, slot);
+			lost = true;
+		}
+	}
+	if (lost && !channel.in_recovery)
+	{
+		if (channel.congestion)
+		{
+			channel.congestion->on_loss(now);
+		}
+		channel.in_recovery = true;
+		channel.recovery_sequence = channel.sequence_send;
+	}
+}
+
+void Connection::measure_rtt(SendChannel &channel, double rtt_ms)
+{
+	// Update the estimates as in RFC 6298, with a clock granularity of 1 ms.
+	if (!channel.has_rtt)
+	{
+		channel.srtt_ms = rtt_ms;
+		channel.rttvar_ms = rtt_ms / 2;
+		channel.has_rtt = true;
+	}
+	else
+	{
+		channel.rttvar_ms = 0.75 * channel.rttvar_ms + 0.25 * std::abs(channel.srtt_ms - rtt_ms);
+		channel.srtt_ms = 0.875 * channel.srtt_ms + 0.125 * rtt_ms;
+	}
+	double timeout = channel.srtt_ms + std::max(1.0, 4 * channel.rttvar_ms);
+	channel.timeout_ms = std::min(std::max(timeout, (double)timeout_min_ms), (double)timeout_max_ms);
+	RUDP_TRACE(TRACE_LEVEL_PACKET, TRACE_RTT_MEASURED, channel.endpoint, 0, (uint32_t)(rtt_ms * 1000), (uint32_t)(channel.timeout_ms * 1000));
+}
+
+double Connection::get_channel_timeout(SendChannel &channel)
+{
+	return adaptive_timeout ? channel.timeout_ms : timeout_ms;
+}
+
+void Connection::send_ack(uint32_t sequence, uint32_t cumulative, uint32_t sack, uint32_t epoch, uint16_t stream, const boost::asio::ip::udp::endpoint &sender)
+{
+	// Each ACK of the batch needs its own buffer until the batch is sent.
+	if (ack_count == ack_buffers.size())
+	{
+		flush_send_batch();
+	}
+	std::array<char, ACK_PACKET_SIZE> &ack_buffer = ack_buffers[ack_count++];
+	ack_buffer[0] = PACKET_TYPE_ACK;
+	encode_ack(&ack_buffer[sizeof(uint8_t)], sequence, cumulative, sack, epoch, stream);
+	send_batch.push_back(OutgoingDatagram{sender, ack_buffer.data(), ack_buffer.size(), nullptr, 0, nullptr, 0, nullptr, sequence, 0, boost::system::error_code()});
+}
+
+void Connection::encode_header(SendSlot &slot, int message_len, int offset, uint32_t epoch, DeliveryClass delivery, uint16_t stream)
+{
+	char *header = slot.header.data() + sizeof(uint8_t);
+	memcpy(header, &slot.sequence, sizeof(slot.sequence));
+	header += sizeof(slot.sequence) + sizeof(uint32_t);
+	memcpy(header, &slot.len, sizeof(slot.len));
+	header += sizeof(slot.len);
+	memcpy(header, &message_len, sizeof(message_len));
+	header += sizeof(message_len);
+	memcpy(header, &offset, sizeof(offset));
+	header += sizeof(offset);
+	memcpy(header, &epoch, sizeof(epoch));
+	slot.header[DATA_DELIVERY_OFFSET] = delivery;
+	memcpy(&slot.header[DATA_STREAM_OFFSET], &stream, sizeof(stream));
+}
+
+std::string Connection::get_delivery_error(const Delivery &delivery, int len)
+{
+	if (delivery.delivery_class > DELIVERY_UNRELIABLE)
+	{
+		return "[RUDP] (ERROR) [SEND] Error sending packet: unknown delivery class " + std::to_string((int)delivery.delivery_class) + ".";
+	}
+	if (delivery.delivery_class == DELIVERY_UNRELIABLE && len > get_fragment_size())
+	{
+		return "[RUDP] (ERROR) [SEND] Error sending packet: an unreliable message must fit in one packet of " + std::to_string(get_fragment_size()) + " bytes.";
+	}
+	return std::string();
+}
+
+void Connection::encode_ack(char *ack, uint32_t sequence, uint32_t cumulative, uint32_t sack, uint32_t epoch, uint16_t stream)
+{
+	memcpy(ack, &sequence, sizeof(sequence));
+	memcpy(ack + sizeof(sequence), &cumulative, sizeof(cumulative));
+	memcpy(ack + sizeof(sequence) + sizeof(cumulative), &sack, sizeof(sack));
+	memcpy(ack + sizeof(sequence) + sizeof(cumulative) + sizeof(sack), &epoch, sizeof(epoch));
+	memcpy(ack + sizeof(sequence) + sizeof(cumulative) + sizeof(sack) + sizeof(epoch), &stream, sizeof(stream));
+}
+
+SendChannel &Connection::get_send_channel(const boost::asio::ip::udp::endpoint &endpoint, uint16_t stream)
+{
+	auto channel = send_channels.find(std::make_pair(endpoint, stream));
+	if (channel == send_channels.end())
+	{
+		channel = send_channels.emplace(std::piecewise_construct, std::forward_as_tuple(endpoint, stream), std::forward_as_tuple(io_service, endpoint, stream, std::min(std::max(timeout_ms, timeout_min_ms), timeout_max_ms), epoch_generator(), buffer_pool)).first;
+		if (congestion_control)
+		{
+			channel->second.congestion = congestion_control();
+		}
+	}
+	channel->second.last_active = boost::asio::deadline_timer::traits_type::now();
+	return channel->second;
+}
+
+void Connection::reset_endpoint_channels(const boost::asio::ip::udp::endpoint &endpoint, const std::string &error)
+{
+	for (auto channel = send_channels.lower_bound(std::make_pair(endpoint, (uint16_t)0)); channel != send_channels.end() && channel->first.first == endpoint; ++channel)
+	{
+		reset_send_channel(channel->second, error);
+	}
+}
+
+void Connection::reset_send_channel(SendChannel &channel, const std::string &error)
+{
+	// The receiver restarts from the window base of the new epoch.
+	channel.sequence_send = 0;
+	channel.epoch = epoch_generator();
+	for (auto slot = channel.send_window.begin(); slot != channel.send_window.end();)
+	{
+		slot = abandon_slot(channel, slot, error);
+	}
+	for (PoolDeque<SendRequest> *queue : {&channel.send_queue, &channel.unreliable_queue})
+	{
+		for (SendRequest &request : *queue)
+		{
+			if (request.handler)
+			{
+				completions.push_back(Completion{std::move(request.handler), -1, std::make_exception_ptr(std::runtime_error(error))});
+			}
+		}
+		queue->clear();
+	}
+	// The new session starts with no knowledge of the path.
+	channel.congestion = congestion_control ? congestion_control() : nullptr;
+	channel.in_recovery = false;
+}
+
+int Connection::get_fragment_size()
+{
+	return mtu - IPV4_UDP_HEADER_SIZE - (int)(DATA_HEADER_SIZE + ACK_INFO_SIZE);
+}
+
+int Connection::get_message_size(int len)
+{
+	int fragment_size = get_fragment_size();
+	int fragments = len > 0 ? (len - 1) / fragment_size + 1 : 1;
+	return fragments * (int)DATA_HEADER_SIZE + len;
+}
+
+uint32_t Connection::send_window_base(SendChannel &channel)
+{
+	return channel.send_window.empty() ? channel.sequence_send : channel.send_window.front().sequence;
+}
+
+void Connection::transmit_slot(SendChannel &channel, SendSlot &slot)
+{
+	// Refresh the window base in the header as it may have advanced since the packet was created.
+	uint32_t sequence_base = send_window_base(channel);
+	memcpy(&slot.header[sizeof(uint8_t) + sizeof(slot.sequence)], &sequence_base, sizeof(sequence_base));
+
+	// Carry any ACK owed to the same stream of the endpoint after the payload instead of sending it separately.
+	slot.header[0] = PACKET_TYPE_DATA;
+	size_t trailer_len = 0;
+	ReceiveChannel *receive_channel = receive_channels.find(PeerKey::from_endpoint(channel.endpoint, channel.stream));
+	if (receive_channel != nullptr && receive_channel->ack.packets > 0)
+	{
+		PendingAck &ack = receive_channel->ack;
+		slot.header[0] = PACKET_TYPE_DATA_ACK;
+		encode_ack(slot.trailer.data(), ack.sequence, ack.cumulative, ack.sack, receive_channel->epoch, receive_channel->stream);
+		trailer_len = ACK_INFO_SIZE;
+		ack.packets = 0;
+	}
+
+	++slot.attempts;
+	slot.sent_time = boost::asio::deadline_timer::traits_type::now();
+	if (slot.attempts == 1)
+	{
+		slot.first_sent_time = slot.sent_time;
+	}
+	else
+	{
+		StatsCounters::add(stats.retransmissions);
+	}
+	slot.deadline = std::min(slot.sent_time + boost::posix_time::microseconds((int64_t)(get_channel_timeout(channel) * 1000)), slot.expiry);
+	size_t bytes = DATA_HEADER_SIZE + slot.len + trailer_len;
+	channel.pacer.consume(bytes, slot.sent_time);
+	rate_limiter.consume(bytes, slot.sent_time);
+	if (channel.congestion)
+	{
+		slot.delivery = channel.congestion->sent(bytes, slot.sent_time);
+	}
+	// The header and the payload are gathered into one datagram without joining them, and if it fails
+	// to send the slot is abandoned once the batch has been sent.
+	send_batch.push_back(OutgoingDatagram{channel.endpoint, slot.header.data(), slot.header.size(), slot.payload, (size_t)slot.len, slot.trailer.data(), trailer_len, &channel, slot.sequence, 0, boost::system::error_code()});
+}
+
+void Connection::flush_send_batch()
+{
+	while (!send_batch.empty())
+	{
+		send_datagrams();
+		std::vector<OutgoingDatagram> failed;
+		for (OutgoingDatagram &datagram : send_batch)
+		{
+			// Unreliable packets are sent without a channel, as nothing is done when they fail but to report it.
+			bool data = datagram.header[0] != PACKET_TYPE_ACK;
+			if (datagram.channel == nullptr && data)
+			{
+				SendSlot &slot = unreliable_batch.front();
+				if (datagram.error.value() != 0)
+				{
+					std::string error_message = "[RUDP] (ERROR) [SEND] Error in sending unreliable packet to " + datagram.endpoint.address().to_string() + ":" + std::to_string(datagram.endpoint.port()) + " with error: " + datagram.error.message() + "\n";
+					StatsCounters::add(stats.messages_failed);
+					if (slot.handler)
+					{
+						completions.push_back(Completion{std::move(slot.handler), -1, std::make_exception_ptr(std::runtime_error(error_message))});
+					}
+				}
+				else
+				{
+					StatsCounters::add(stats.messages_sent);
+					if (slot.handler)
+					{
+						completions.push_back(Completion{std::move(slot.handler), slot.message_size, nullptr});
+					}
+				}
+				unreliable_batch.pop_front();
+			}
+			if (datagram.error.value() != 0)
+			{
+				if (datagram.channel != nullptr)
+				{
+					failed.push_back(datagram);
+				}
+				else if (!data)
+				{
+					std::string error_message = "[RUDP] (ERROR) [RECV] (SEQ-RECV: " + std::to_string(datagram.sequence) + ") Error in sending ACK to " + datagram.endpoint.address().to_string() + ":" + std::to_string(datagram.endpoint.port()) + " with error: " + datagram.error.message() + "\n";
+					std::cout << error_message;
+				}
+				continue;
+			}
+			StatsCounters::add(data ? stats.packets_sent : stats.acks_sent);
+			StatsCounters::add(stats.bytes_sent, datagram.sent_size);
+			RUDP_TRACE(TRACE_LEVEL_PACKET, data ? TRACE_DATA_SENT : TRACE_ACK_SENT, datagram.endpoint, datagram.sequence, datagram.sent_size);
+		}
+		send_batch.clear();
+		ack_count = 0;
+
+		// Abandoning a packet can advance its window, which may queue more packets to be sent.
+		for (OutgoingDatagram &datagram : failed)
+		{
+			std::string error_message = "[RUDP] (ERROR) [SEND] (SEQ-SEND: " + std::to_string(datagram.sequence) + ") Error in sending packet to " + datagram.endpoint.address().to_string() + ":" + std::to_string(datagram.endpoint.port()) + " with error: " + datagram.error.message() + "\n";
+			SendChannel &channel = *datagram.channel;
+			for (auto slot = channel.send_window.begin(); slot != channel.send_window.end(); ++slot)
+			{
+				if (slot->sequence == datagram.sequence && !slot->acked)
+				{
+					abandon_slot(channel, slot, error_message);
+					break;
+				}
+			}
+			advance_send_window(channel);
+		}
+	}
+}
+
+void Connection::send_datagrams()
+{
+	if (impaired_link)
+	{
+		impair_datagrams();
+		return;
+	}
+#ifdef __linux__
+	if (uring)
+	{
+		// Submit the whole batch to the ring at once, which reports the result of each datagram.
+		size_t count = send_batch.size();
+		uring_messages.resize(count);
+		uring_iovecs.resize(count);
+		uring_results.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			OutgoingDatagram &datagram = send_batch[i];
+			uring_iovecs[i][0].iov_base = const_cast<char *>(datagram.header);
+			uring_iovecs[i][0].iov_len = datagram.header_len;
+			uring_iovecs[i][1].iov_base = const_cast<char *>(datagram.payload);
+			uring_iovecs[i][1].iov_len = datagram.payload_len;
+			uring_iovecs[i][2].iov_base = const_cast<char *>(datagram.trailer);
+			uring_iovecs[i][2].iov_len = datagram.trailer_len;
+			uring_messages[i] = msghdr();
+			uring_messages[i].msg_name = datagram.endpoint.data();
+			uring_messages[i].msg_namelen = datagram.endpoint.size();
+			uring_messages[i].msg_iov = uring_iovecs[i].data();
+			uring_messages[i].msg_iovlen = uring_iovecs[i].size();
+		}
+		uring->send(uring_messages.data(), count, uring_results.data());
+		for (size_t i = 0; i < count; i++)
+		{
+			if (uring_results[i] >= 0)
+			{
+				send_batch[i].sent_size = uring_results[i];
+			}
+			else
+			{
+				send_batch[i].error = boost::system::error_code(-uring_results[i], boost::system::system_category());
+			}
+		}
+		return;
+	}
+#ifdef UDP_SEGMENT
+	if (segmentation_offload)
+	{
+		send_segmented_datagrams();
+		return;
+	}
+#endif
+	// Send the batch with sendmmsg, falling back to Boost ASIO for a datagram that it could not send so that the
+	// socket waits until it is writable or the error of the datagram is reported.
+	std::array<mmsghdr, IO_BATCH_SIZE> headers;
+	std::array<std::array<iovec, 3>, IO_BATCH_SIZE> iovecs;
+	for (size_t first = 0; first < send_batch.size();)
+	{
+		size_t count = std::min(send_batch.size() - first, IO_BATCH_SIZE);
+		for (size_t i = 0; i < count; i++)
+		{
+			OutgoingDatagram &datagram = send_batch[first + i];
+			iovecs[i][0].iov_base = const_cast<char *>(datagram.header);
+			iovecs[i][0].iov_len = datagram.header_len;
+			iovecs[i][1].iov_base = const_cast<char *>(datagram.payload);
+			iovecs[i][1].iov_len = datagram.payload_len;
+			iovecs[i][2].iov_base = const_cast<char *>(datagram.trailer);
+			iovecs[i][2].iov_len = datagram.trailer_len;
+			headers[i].msg_hdr = msghdr();
+			headers[i].msg_hdr.msg_name = datagram.endpoint.data();
+			headers[i].msg_hdr.msg_namelen = datagram.endpoint.size();
+			headers[i].msg_hdr.msg_iov = iovecs[i].data();
+			headers[i].msg_hdr.msg_iovlen = iovecs[i].size();
+		}
+		int sent = sendmmsg(socket.native_handle(), headers.data(), count, MSG_DONTWAIT);
+		for (int i = 0; i < sent; i++)
+		{
+			send_batch[first + i].sent_size = headers[i].msg_len;
+		}
+		first += std::max(sent, 0);
+		if ((size_t)std::max(sent, 0) < count)
+		{
+			send_datagram(send_batch[first++]);
+		}
+	}
+#else
+	for (OutgoingDatagram &datagram : send_batch)
+	{
+		send_datagram(datagram);
+	}
+#endif
+}
+
+#if defined(__linux__) && defined(UDP_SEGMENT)
+void Connection::send_segmented_datagrams()
+{
+	// Each message of a sendmmsg call gathers a run of datagrams to one endpoint, all of the length of the first
+	// but the last, which may be shorter, and gives that length as the size of the segments the kernel sends.
+	std::array<mmsghdr, IO_BATCH_SIZE> headers;
+	std::array<size_t, IO_BATCH_SIZE> segment_counts;
+	union
+	{
+		char buffer[CMSG_SPACE(sizeof(uint16_t))];
+		cmsghdr align;
+	} controls[IO_BATCH_SIZE];
+	for (size_t first = 0; first < send_batch.size();)
+	{
+		size_t count = 0;
+		size_t next = first;
+		iovec *iovecs = segment_iovecs.data();
+		while (count < IO_BATCH_SIZE && next < send_batch.size())
+		{
+			const OutgoingDatagram &leader = send_batch[next];
+			size_t segment_size = get_datagram_size(leader);
+			size_t segments = 1;
+			while (next + segments < send_batch.size() && segments < GSO_MAX_SEGMENTS && (segments + 1) * segment_size <= GSO_MAX_BYTES)
+			{
+				const OutgoingDatagram &datagram = send_batch[next + segments];
+				size_t size = get_datagram_size(datagram);
+				if (datagram.endpoint != leader.endpoint || size > segment_size || size == 0)
+				{
+					break;
+				}
+				++segments;
+				if (size < segment_size)
+				{
+					break;
+				}
+			}
+			for (size_t i = 0; i < segments; i++)
+			{
+				OutgoingDatagram &datagram = send_batch[next + i];
+				iovecs[3 * i] = iovec{const_cast<char *>(datagram.header), datagram.header_len};
+				iovecs[3 * i + 1] = iovec{const_cast<char *>(datagram.payload), datagram.payload_len};
+				iovecs[3 * i + 2] = iovec{const_cast<char *>(datagram.trailer), datagram.trailer_len};
+			}
+			msghdr &header = headers[count].msg_hdr;
+			header = msghdr();
+			header.msg_name = const_cast<boost::asio::ip::udp::endpoint &>(leader.endpoint).data();
+			header.msg_namelen = leader.endpoint.size();
+			header.msg_iov = iovecs;
+			header.msg_iovlen = 3 * segments;
+			if (segments > 1)
+			{
+				header.msg_control = controls[count].buffer;
+				header.msg_controllen = sizeof(controls[count].buffer);
+				cmsghdr *control = CMSG_FIRSTHDR(&header);
+				control->cmsg_level = SOL_UDP;
+				control->cmsg_type = UDP_SEGMENT;
+				control->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+				uint16_t gso_size = (uint16_t)segment_size;
+				memcpy(CMSG_DATA(control), &gso_size, sizeof(gso_size));
+			}
+			segment_counts[count++] = segments;
+			iovecs += 3 * segments;
+			next += segments;
+		}
+		int sent = sendmmsg(socket.native_handle(), headers.data(), count, MSG_DONTWAIT);
+		for (int i = 0; i < sent; i++)
+		{
+			for (size_t j = 0; j < segment_counts[i]; j++)
+			{
+				send_batch[first + j].sent_size = segment_counts[i] > 1 ? get_datagram_size(send_batch[first + j]) : headers[i].msg_len;
+			}
+			first += segment_counts[i];
+		}
+		// The datagrams of a message that could not be sent are sent on their own, which also reports their errors.
+		if ((size_t)std::max(sent, 0) < count)
+		{
+			for (size_t j = 0; j < segment_counts[std::max(sent, 0)]; j++)
+			{
+				send_datagram(send_batch[first++]);
+			}
+		}
+	}
+}
+#endif
+
+size_t Connection::get_datagram_size(const OutgoingDatagram &datagram)
+{
+	return datagram.header_len + datagram.payload_len + datagram.trailer_len;
+}
+
+void Connection::send_datagram(OutgoingDatagram &datagram)
+{
+	std::array<boost::asio::const_buffer, 3> buffers = {{boost::asio::buffer(datagram.header, datagram.header_len), boost::asio::buffer(datagram.payload, datagram.payload_len), boost::asio::buffer(datagram.trailer, datagram.trailer_len)}};
+	datagram.sent_size = socket.send_to(buffers, datagram.endpoint, 0, datagram.error);
+}
+
+void Connection::impair_datagrams()
+{
+	boost::posix_time::ptime now = boost::asio::deadline_timer::traits_type::now();
+	for (OutgoingDatagram &datagram : send_batch)
+	{
+		std::array<boost::asio::const_buffer, 3> buffers = {{boost::asio::buffer(datagram.header, datagram.header_len), boost::asio::buffer(datagram.payload, datagram.payload_len), boost::asio::buffer(datagram.trailer, datagram.trailer_len)}};
+		impaired_link->enqueue(datagram.endpoint, buffers, now);
+		datagram.sent_size = boost::asio::buffer_size(buffers);
+	}
+	send_impaired(now);
+}
+
+void Connection::send_impaired(const boost::posix_time::ptime &now)
+{
+	// A datagram that the socket fails to send is lost in the same way as one dropped by the link.
+	ImpairedDatagram datagram;
+	boost::system::error_code err;
+	while (impaired_link->pop(now, datagram))
+	{
+		socket.send_to(boost::asio::buffer(datagram.data), datagram.endpoint, 0, err);
+	}
+	boost::posix_time::ptime release = impaired_link->next_release();
+	if (release != impairment_timer.expires_at())
+	{
+		impairment_timer.expires_at(release);
+		if (release != boost::posix_time::pos_infin)
+		{
+			impairment_timer.async_wait(make_pool_handler(buffer_pool, boost::bind(&Connection::handle_impairment_timer, this, boost::asio::placeholders::error)));
+		}
+	}
+}
+
+void Connection::handle_impairment_timer(const boost::system::error_code &err)
+{
+	// The timer is aborted whenever it is re-armed or the connection is closed.
+	if (err == boost::asio::error::operation_aborted)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(io_mutex);
+	if (closing || !impaired_link)
+	{
+		return;
+	}
+	impairment_timer.expires_at(boost::posix_time::pos_infin);
+	send_impaired(boost::asio::deadline_timer::traits_type::now());
+}
+
+void Connection::fill_send_window(SendChannel &channel)
+{
+	send_unreliable(channel);
+
+	// New packets are limited by the window size, the congestion window, the pacer and the rate limit, while
+	// retransmissions only use up the tokens of the pacer and the rate limit.
+	int fragment_size = get_fragment_size();
+	size_t in_flight = count_in_flight(channel);
+	size_t congestion_window = channel.congestion ? channel.congestion->congestion_window() : (size_t)window_size;
+	boost::posix_time::ptime now = boost::asio::deadline_timer::traits_type::now();
+	while (!channel.send_queue.empty() && channel.send_window.size() < (size_t)window_size && in_flight < congestion_window && pace(channel))
+	{
+		// A message whose lifetime ended while it waited for the window is dropped without being sent.
+		SendRequest &request = channel.send_queue.front();
+		if (request.offset == 0 && request.expiry <= now)
+		{
+			std::string error_message = "[RUDP] (ERROR) [SEND] Dropped message to " + channel.endpoint.address().to_string() + ":" + std::to_string(channel.endpoint.port()) + " at the end of its lifetime before it was sent.\n";
+			if (request.handler)
+			{
+				completions.push_back(Completion{std::move(request.handler), -1, std::make_exception_ptr(std::runtime_error(error_message))});
+			}
+			StatsCounters::add(stats.messages_expired);
+			channel.send_queue.pop_front();
+			continue;
+		}
+
+		// Small messages at the front of the queue share a packet, which waits for more of them until it is full
+		// or the deadline of the first has passed. Only messages that all have handlers, or all have none, are
+		// coalesced so that the errors of those without are still reported by the next send.
+		if (request.coalesce)
+		{
+			size_t count = 0;
+			int coalesced_len = 0;
+			for (SendRequest &next : channel.send_queue)
+			{
+				if (!next.coalesce || (bool)next.handler != (bool)request.handler || count == MAX_COALESCED_MESSAGES || coalesced_len + (int)sizeof(int) + next.len > fragment_size)
+				{
+					break;
+				}
+				coalesced_len += sizeof(int) + next.len;
+				++count;
+			}
+			if (count == channel.send_queue.size() && count < MAX_COALESCED_MESSAGES && request.coalesce_deadline > now)
+			{
+				if (request.coalesce_deadline != channel.pacing_timer.expires_at())
+				{
+					channel.pacing_timer.expires_at(request.coalesce_deadline);
+					channel.pacing_timer.async_wait(make_pool_handler(buffer_pool, boost::bind(&Connection::handle_pacing_timer, this, &channel, boost::asio::placeholders::error)));
+				}
+				break;
+			}
+			if (count > 1)
+			{
+				transmit_slot(channel, coalesce_requests(channel, count, coalesced_len));
+				++in_flight;
+				++channel.sequence_send;
+				continue;
+			}
+		}
+
+		// Add the next fragment of the message at the front of the queue to the send window. The last fragment
+		// takes the handler and moves any copy of the payload, so the data of the earlier fragments stays in place.
+		int len = std::min(request.len - request.offset, fragment_size);
+		bool message_end = request.offset + len == request.len;
+		channel.send_window.push_back(SendSlot{channel.sequence_send, {}, {}, request.payload + request.offset, len, message_end, get_message_size(request.len), 1, PooledBuffer(), 0, request.delivery.max_attempts, boost::posix_time::pos_infin, boost::posix_time::pos_infin, boost::posix_time::pos_infin, request.expiry, DeliveryState(), false, CompletionHandler()});
+		SendSlot &slot = channel.send_window.back();
+
+		// Write the header of the packet, the type and window base are written each time it is transmitted.
+		encode_header(slot, request.len, request.offset, channel.epoch, request.delivery.delivery_class, channel.stream);
+
+		if (message_end)
+		{
+			slot.payload_copy = std::move(request.payload_copy);
+			slot.handler = std::move(request.handler);
+			channel.send_queue.pop_front();
+		}
+		else
+		{
+			request.offset += len;
+		}
+		transmit_slot(channel, slot);
+		++in_flight;
+
+		// Each packet uses a new sequence number, even if it is later abandoned, as the
+		// window base tells the receiver which sequence numbers were skipped.
+		++channel.sequence_send;
+	}
+}
+
+SendSlot &Connection::coalesce_requests(SendChannel &channel, size_t count, int len)
+{
+	// Write each message after its length, keeping the handlers to complete each with the size of its own message.
+	PooledBuffer payload(&buffer_pool, len);
+	PoolVector<std::pair<CompletionHandler, int>> handlers{PoolAllocator<std::pair<CompletionHandler, int>>(&buffer_pool)};
+	handlers.reserve(count);
+	char *record = payload.data();
+	for (size_t i = 0; i < count; i++)
+	{
+		SendRequest &request = channel.send_queue.front();
+		memcpy(record, &request.len, sizeof(request.len));
+		if (request.len > 0)
+		{
+			memcpy(record + sizeof(request.len), request.payload, request.len);
+		}
+		record += sizeof(request.len) + request.len;
+		if (request.handler)
+		{
+			handlers.emplace_back(std::move(request.handler), get_message_size(request.len));
+		}
+		channel.send_queue.pop_front();
+	}
+	channel.send_window.push_back(SendSlot{channel.sequence_send, {}, {}, nullptr, len, true, get_message_size(len), (int)count, std::move(payload), 0, -1, boost::posix_time::pos_infin, boost::posix_time::pos_infin, boost::posix_time::pos_infin, boost::posix_time::pos_infin, DeliveryState(), false, CompletionHandler()});
+	SendSlot &slot = channel.send_window.back();
+	slot.payload = slot.payload_copy.data();
+	encode_header(slot, len, 0, channel.epoch, DELIVERY_RELIABLE, channel.stream);
+	slot.header[DATA_DELIVERY_OFFSET] |= DATA_FLAG_COALESCED;
+	if (!handlers.empty())
+	{
+		slot.handler = [handlers = std::move(handlers)](int, std::exception_ptr error)
+		{
+			for (const std::pair<CompletionHandler, int> &handler : handlers)
+			{
+				handler.first(error ? -1 : handler.second, error);
+			}
+		};
+	}
+	return slot;
+}
+
+void Connection::send_unreliable(SendChannel &channel)
+{
+	// The packets take the next sequence number without using it, as the receiver ignores the sequence of an
+	// unreliable packet, and are kept until the batch is sent in case their payload is a copy.
+	boost::posix_time::ptime now = boost::asio::deadline_timer::traits_type::now();
+	uint32_t sequence_base = send_window_base(channel);
+	while (!channel.unreliable_queue.empty())
+	{
+		SendRequest &request = channel.unreliable_queue.front();
+		unreliable_batch.push_back(SendSlot{channel.sequence_send, {}, {}, request.payload, request.len, true, get_message_size(request.len), 1, std::move(request.payload_copy), 1, -1, now, now, boost::posix_time::pos_infin, boost::posix_time::pos_infin, DeliveryState(), false, std::move(request.handler)});
+		channel.unreliable_queue.pop_front();
+		SendSlot &slot = unreliable_batch.back();
+		encode_header(slot, slot.len, 0, channel.epoch, DELIVERY_UNRELIABLE, channel.stream);
+		slot.header[0] = PACKET_TYPE_DATA;
+		memcpy(&slot.header[sizeof(uint8_t) + sizeof(slot.sequence)], &sequence_base, sizeof(sequence_base));
+		size_t bytes = DATA_HEADER_SIZE + slot.len;
+		channel.pacer.consume(bytes, now);
+		rate_limiter.consume(bytes, now);
+		send_batch.push_back(OutgoingDatagram{channel.endpoint, slot.header.data(), slot.header.size(), slot.payload, (size_t)slot.len, nullptr, 0, nullptr, slot.sequence, 0, boost::system::error_code()});
+	}
+}
+
+void Connection::advance_send_window(SendChannel &channel)
+{
+	// Remove the acknowledged packets from the front of the window so it can advance. A stray ACK can
+	// match a packet that is still in the send batch, which must be sent before its slot is removed.
+	while (!channel.send_window.empty() && channel.send_window.front().acked)
+	{
+		for (OutgoingDatagram &datagram : send_batch)
+		{
+			if (datagram.channel == &channel && datagram.sequence == channel.send_window.front().sequence)
+			{
+				flush_send_batch();
+				break;
+			}
+		}
+		channel.send_window.pop_front();
+	}
+	// The recovery ends once every packet that was in flight when it started has been acknowledged.
+	if (channel.in_recovery && sequence_distance(channel.recovery_sequence, send_window_base(channel)) >= 0)
+	{
+		channel.in_recovery = false;
+	}
+	fill_send_window(channel);
+	arm_timer(channel);
+}
+
+void Connection::arm_timer(SendChannel &channel)
+{
+	// Set the deadline of the timer to the earliest retransmission in the window.
+	boost::posix_time::ptime deadline = boost::posix_time::pos_infin;
+	for (SendSlot &slot : channel.send_window)
+	{
+		if (!slot.acked && slot.deadline < deadline)
+		{
+			deadline = slot.deadline;
+		}
+	}
+	// Like the ACK timer, the timer is only re-armed for an earlier deadline and re-arms itself if it fires early.
+	if (deadline < channel.timer.expires_at())
+	{
+		channel.timer.expires_at(deadline);
+		channel.timer.async_wait(make_pool_handler(buffer_pool, boost::bind(&Connection::handle_timer, this, &channel, boost::asio::placeholders::error)));
+	}
+}
+
+PoolDeque<SendSlot>::iterator Connection::abandon_slot(SendChannel &channel, PoolDeque<SendSlot>::iterator slot, const std::string &error, bool expired)
+{
+	// The message cannot be delivered without the fragment, so all of its fragments are removed, which also
+	// frees the copy of the payload that the earlier ones reference.
+	auto first = slot;
+	while (first != channel.send_window.begin() && !std::prev(first)->message_end)
+	{
+		--first;
+	}
+	auto last = slot;
+	while (last != channel.send_window.end() && !last->message_end)
+	{
+		++last;
+	}
+	CompletionHandler handler;
+	bool delivered = false;
+	int messages = 1;
+	if (last != channel.send_window.end())
+	{
+		// The receiver only acknowledges the last fragment after the earlier ones, so the message was delivered.
+		delivered = last->acked;
+		handler = std::move(last->handler);
+		messages = last->messages;
+		++last;
+	}
+	else
+	{
+		// The rest of the message has not been moved into the window yet.
+		handler = std::move(channel.send_queue.front().handler);
+		channel.send_queue.pop_front();
+	}
+
+	// Messages sent without a handler report their errors through the next send or flush, unless they were sent
+	// to be dropped.
+	if (handler)
+	{
+		completions.push_back(Completion{std::move(handler), -1, std::make_exception_ptr(std::runtime_error(error))});
+	}
+	else if (!delivered && !expired)
+	{
+		send_window_error += error;
+	}
+	if (!delivered)
+	{
+		StatsCounters::add(expired ? stats.messages_expired : stats.messages_failed, messages);
+	}
+	RUDP_TRACE(TRACE_LEVEL_EVENT, TRACE_PACKET_ABANDONED, channel.endpoint, slot->sequence, slot->attempts);
+	return channel.send_window.erase(first, last);
+}
+
+void Connection::discard_partial_message(ReceiveChannel &channel)
+{
+	if (!channel.has_partial)
+	{
+		return;
+	}
+	if (channel.partial.has_request)
+	{
+		receive_requests.push_front(channel.partial.request);
+		channel.partial.request = ReceiveRequest();
+	}
+	else
+	{
+		receive_buffer_pool.push_back(std::move(channel.partial.payload));
+	}
+	channel.has_partial = false;
+}
+
+void Connection::trace(TraceEvent event, const boost::asio::ip::udp::endpoint &endpoint, uint32_t sequence, uint32_t value, uint32_t extra)
+{
+	TraceRecord record;
+	record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	record.value = value;
+	record.extra = extra;
+	record.peer = PeerKey::from_endpoint(endpoint);
+	record.sequence = sequence;
+	record.event = event;
+	TraceBuffer *buffer = trace_buffer.load(std::memory_order_relaxed);
+	if (buffer != nullptr)
+	{
+		buffer->push(record);
+	}
+	if (trace_handler)
+	{
+		trace_handler(record);
+	}
+}
+
+void Connection::evict_idle_peers()
+{
+	if (peer_idle_timeout_ms < 0)
+	{
+		peer_sweep_time = boost::posix_time::pos_infin;
+		return;
+	}
+	// A channel that holds packets it acknowledged or owes an ACK is kept until it has delivered or sent them.
+	boost::posix_time::ptime idle_time = read_time - boost::posix_time::milliseconds(peer_idle_timeout_ms);
+	receive_channels.erase_if([this, &idle_time](ReceiveChannel &channel)
+							  {
+		if (channel.last_active > idle_time || channel.stalled || channel.ack.packets > 0)
+		{
+			return false;
+		}
+		for (ReorderSlot &slot : channel.reorder_buffer)
+		{
+			if (slot.used)
+			{
+				return false;
+			}
+		}
+		discard_partial_message(channel);
+		return true; });
+	// A send channel is only removed once its timers have no wait pending, as their handlers refer to it.
+	for (auto channel = send_channels.begin(); channel != send_channels.end();)
+	{
+		SendChannel &send_channel = channel->second;
+		if (send_channel.last_active <= idle_time && send_channel.send_window.empty() && send_channel.send_queue.empty() && send_channel.unreliable_queue.empty() &&
+			send_channel.timer.expires_at() == boost::posix_time::pos_infin && send_channel.pacing_timer.expires_at() == boost::posix_time::pos_infin)
+		{
+			channel = send_channels.erase(channel);
+		}
+		else
+		{
+			++channel;
+		}
+	}
+	// Check again once a quarter of the timeout has passed, so a channel is evicted at most a quarter late.
+	peer_sweep_time = read_time + boost::posix_time::milliseconds(std::max(peer_idle_timeout_ms / 4, 1));
+}
+
+std::vector<char> Connection::take_receive_buffer(int len)
+{
+	std::vector<char> payload;
+	if (!receive_buffer_pool.empty())
+	{
+		payload = std::move(receive_buffer_pool.back());
+		receive_buffer_pool.pop_back();
+	}
+	payload.resize(len);
+	return payload;
+}
+
+bool Connection::receive_queue_full()
+{
+	ReceiveQueue *queue = receive_queue;
+	return queue->size() >= receive_queue_limit || queue->full();
+}
+
+void Connection::serve_receive_requests()
+{
+	ReceiveQueue *queue = receive_queue;
+	while (!receive_requests.empty())
+	{
+		ReceiveRequest &request = receive_requests.front();
+		boost::asio::ip::udp::endpoint sender;
+		uint16_t stream;
+		int received_len = queue->pop(request.buf, request.len, sender, stream);
+		if (received_len == ReceiveQueue::EMPTY)
+		{
+			break;
+		}
+		// If the output buffer is too small the accomodate the data in the message, fail the receive
+		// but keep the message for the next one.
+		if (received_len == ReceiveQueue::TOO_SMALL)
+		{
+			std::string error_message = "[RUDP] (ERROR) [RECV] Error buffer allocated to receive message is too small to fit the next message.\n";
+			completions.push_back(Completion{std::move(request.handler), -1, std::make_exception_ptr(std::runtime_error(error_message))});
+		}
+		else
+		{
+			complete_receive(request, received_len, sender, stream);
+		}
+		receive_requests.pop_front();
+	}
+}
+
+void Connection::copy_read_payload(char *dest, const char *packet, int offset, int len)
+{
+	// The start of the payload was read into the read target, if there was one, and the rest after the header.
+	int target_len = std::max(std::min(offset + len, read_target_len) - offset, 0);
+	if (target_len > 0 && dest != read_target + offset)
+	{
+		memcpy(dest, read_target + offset, target_len);
+	}
+	if (len > target_len)
+	{
+		int rest_offset = offset + target_len - read_target_len;
+		memcpy(dest + target_len, packet + DATA_HEADER_SIZE + rest_offset, len - target_len);
+	}
+}
+
+void Connection::complete_receive(ReceiveRequest &request, int len, const boost::asio::ip::udp::endpoint &sender, uint16_t stream)
+{
+	// Write the information about where the packet came from.
+	*request.port = (int)sender.port();
+	strcpy(request.address, sender.address().to_string().c_str());
+	if (request.stream != nullptr)
+	{
+		*request.stream = stream;
+	}
+	completions.push_back(Completion{std::move(request.handler), len, std::exception_ptr()});
+}
+
+void Connection::dispatch_completions()
+{
+	// Swap in an emptied vector so that the next handler reuses its capacity, and give it back once its
+	// completions have been invoked.
+	std::vector<Completion> ready;
+	std::unique_lock<std::mutex> lock(io_mutex);
+	if (!spare_completions.empty())
+	{
+		ready.swap(spare_completions.back());
+		spare_completions.pop_back();
+	}
+	ready.swap(completions);
+	lock.unlock();
+	for (Completion &completion : ready)
+	{
+		completion.handler(completion.length, completion.error);
+	}
+	ready.clear();
+	lock.lock();
+	spare_completions.push_back(std::move(ready));
+	lock.unlock();
+	// Wake any caller waiting for the state of the send window to change.
+	state_changed.notify_all();
+}
+
+void Connection::wait_for_state(std::unique_lock<std::mutex> &lock, const std::function<bool()> &ready)
+{
+	if (!owned_io_service)
+	{
+		state_changed.wait(lock, ready);
+		return;
+	}
+	// No other thread runs the handlers that change the state, so run them until the condition holds.
+	while (!ready())
+	{
+		lock.unlock();
+		io_service.run_one();
+		lock.lock();
+	}
+}
+
+int Connection::wait_for_result(std::future<int> &future)
+{
+	if (owned_io_service)
+	{
+		while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			io_service.run_one();
+		}
+	}
+	return future.get();
+}
+
+int Connection::wait_for_result(BlockingResult &result)
+{
+	std::unique_lock<std::mutex> lock(io_mutex);
+	wait_for_state(lock, [&result]()
+				   { return result.done; });
+	lock.unlock();
+	if (result.error)
+	{
+		std::rethrow_exception(result.error);
+	}
+	return result.length;
+}
+
+void Connection::throw_send_window_error()
+{
+	if (!send_window_error.empty())
+	{
+		std::string error_message = send_window_error;
+		send_window_error.clear();
+		throw std::runtime_error(error_message);
+	}
+}
+
+boost::asio::ip::udp::endpoint Connection::parse_endpoint(const std::string &address, unsigned short port)
+{
+	try
+	{
+		return boost::asio::ip::udp::endpoint(boost::asio::ip::address::from_string(address), port);
+	}
+	catch (boost::system::system_error error)
+	{
+		std::string error_message = std::string("[RUDP] (ERROR) [INIT] Error setting remote endpoint: ") + error.what();
+		throw std::runtime_error(error_message);
+	}
 }
 
-#endif /* CONNECTION_CPP */
\ No newline at end of file
+#endif /* CONNECTION_CPP */
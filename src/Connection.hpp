@@ -14,11 +14,21 @@
 #define CONNECTION_HPP
 
 // Standard Libraries
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -26,83 +36,1347 @@
 #include <boost/asio.hpp>
 #include <boost/bind/bind.hpp>
 
+// Scatter-gather arrays of vectored sends
+#include <sys/uio.h>
+
 // Library macros header
 #include "rudp_macros.h"
 
-namespace rudp
-{
-    /**
-     * @brief   Class Connection represents a virtual connection over which UDP packets can be sent.
-     * @details The Connection class uses a sequence number and the Stop-and-Wait ARQ protocol to
-     *          send data between two Connection objects.
-     */
-    class Connection
-    {
-    private:
-        /// Mutex for thread synchronization.
-        std::mutex io_mutex;
-        /// Sequence number of the message that the connection is currently sending.
-        uint16_t sequence_send;
-        /// Map of senders to their receive sequence numbers.
-        std::map<std::string, uint16_t> sequence_recv_map;
+#include "BufferPool.hpp"
+#include "CongestionControl.hpp"
+#include "ConnectionStats.hpp"
+#include "Impairment.hpp"
+#include "PeerTable.hpp"
+#include "ReceiveQueue.hpp"
+#include "Trace.hpp"
+#include "UringTransport.hpp"
+
+namespace rudp
+{
+    /**
+     * @brief   Type CompletionHandler is the callback invoked when an asynchronous send or receive completes.
+     * @details The first argument is the number of bytes sent or received, the second is nullptr on success
+     *          or holds the runtime_error that caused the operation to fail.
+     */
+    typedef std::function<void(int, std::exception_ptr)> CompletionHandler;
+
+    /**
+     * @brief   Enum PacketType is the first byte of every datagram and identifies how the rest is parsed.
+     */
+    enum PacketType : uint8_t
+    {
+        /// Packet carrying a message or a fragment of one: [type][uint32 seq][uint32 base][int len][int message len][int offset][uint32 epoch][uint8 delivery class][uint16 stream][payload].
+        PACKET_TYPE_DATA = 0,
+        /// Packet acknowledging messages: [type][ack], see ACK_INFO_SIZE.
+        PACKET_TYPE_ACK = 1,
+        /// Packet carrying a message and an ACK for the other direction: [type][uint32 seq][uint32 base][int len][int message len][int offset][uint32 epoch][uint8 delivery class][uint16 stream][payload][ack].
+        PACKET_TYPE_DATA_ACK = 2
+    };
+
+    /**
+     * @brief   Enum DeliveryClass lists how a message is delivered, which is carried in the header of its packets.
+     */
+    enum DeliveryClass : uint8_t
+    {
+        /// Retransmitted until it is acknowledged and delivered in order.
+        DELIVERY_RELIABLE = DELIVERY_CLASS_RELIABLE,
+        /// Retransmitted until it is acknowledged but delivered as soon as it arrives, without waiting for the
+        /// messages before it. A message larger than one packet is still reassembled and delivered in order.
+        DELIVERY_UNORDERED = DELIVERY_CLASS_UNORDERED,
+        /// Sent once in a single packet outside of the send window and never acknowledged, so it may be lost.
+        DELIVERY_UNRELIABLE = DELIVERY_CLASS_UNRELIABLE
+    };
+
+    /**
+     * @brief   Struct Delivery describes how a message is delivered, by default reliably and in order.
+     */
+    struct Delivery
+    {
+        /// Class of the message.
+        DeliveryClass delivery_class = DELIVERY_RELIABLE;
+        /// Time after the send in milliseconds after which a reliable message that has not been acknowledged is
+        /// dropped, -1 for no limit. A message that has not been sent by then is dropped without being sent.
+        int lifetime_ms = -1;
+        /// Maximum number of times a packet of a reliable message is transmitted before the message is dropped,
+        /// -1 to use the send retries limit of the connection.
+        int max_attempts = -1;
+        /// Stream of the message, which has its own sequence numbers so that the messages of a stream are only
+        /// ordered with each other and never wait for a packet lost on another stream.
+        uint16_t stream = 0;
+    };
+
+    /**
+     * @brief   Struct BatchMessage is one message of a batch sent with sendBatch() or received with receiveBatch().
+     */
+    struct BatchMessage
+    {
+        /// Buffer holding the message to send, or into which a message is received.
+        char *buf = nullptr;
+        /// Length in bytes of the message to send, or of the buffer a message is received into.
+        int len = 0;
+        /// Address the message is sent to, an empty string to send it to the remote endpoint, or the address it was
+        /// received from.
+        char address[IPV4_ADDRESS_LENGTH_BYTES] = {};
+        /// Port number the message is sent to, or was received from.
+        int port = 0;
+        /// How the message is sent, of which only the stream is set for a message received.
+        Delivery delivery;
+        /// Number of bytes sent or received, -1 if the message failed.
+        int result = -1;
+        /// Error of the message if it failed, otherwise null.
+        std::exception_ptr error;
+    };
+
+    /// Size in bytes of the header of a data packet.
+    constexpr size_t DATA_HEADER_SIZE = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(int) + sizeof(int) + sizeof(int) + sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint16_t);
+    /// Offset in bytes of the stream in the header of a data packet.
+    constexpr size_t DATA_STREAM_OFFSET = DATA_HEADER_SIZE - sizeof(uint16_t);
+    /// Offset in bytes of the delivery class in the header of a data packet.
+    constexpr size_t DATA_DELIVERY_OFFSET = DATA_STREAM_OFFSET - sizeof(uint8_t);
+    /// Flag set in the delivery class of a packet whose payload is several whole messages, each written as
+    /// [int len][bytes], instead of one message or a fragment of one.
+    constexpr uint8_t DATA_FLAG_COALESCED = 0x80;
+    /// Size in bytes of an ACK: [uint32 seq][uint32 cumulative][uint32 sack][uint32 epoch][uint16 stream],
+    /// acknowledging seq, every sequence before cumulative (the next sequence the receiver expects) and
+    /// cumulative + 1 + i for every bit i set in sack, all in the sequence numbers of the stream, for the session
+    /// epoch the receiver follows so that the sender ignores an ACK left over from a session it has since reset.
+    constexpr size_t ACK_INFO_SIZE = sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint16_t);
+    /// Size in bytes of an ACK packet.
+    constexpr size_t ACK_PACKET_SIZE = sizeof(uint8_t) + ACK_INFO_SIZE;
+    /// Size in bytes of the IPv4 and UDP headers in front of every datagram.
+    constexpr int IPV4_UDP_HEADER_SIZE = 20 + 8;
+    /// Size in bytes of the largest datagram that can be received.
+    constexpr size_t MAX_DATAGRAM_SIZE = 65536;
+    /// Maximum number of datagrams read or sent by one system call where sendmmsg and recvmmsg are available.
+    constexpr size_t IO_BATCH_SIZE = 8;
+    /// Maximum number of datagrams sent as the segments of one UDP GSO send.
+    constexpr size_t GSO_MAX_SEGMENTS = 64;
+    /// Size in bytes of the largest UDP payload of an IPv4 datagram, which limits the segments of one UDP GSO send.
+    constexpr size_t GSO_MAX_BYTES = 65535 - IPV4_UDP_HEADER_SIZE;
+    /// Number of packets ahead of the next expected sequence that are held from each sender, one per bit of the SACK bitmap.
+    constexpr size_t REORDER_BUFFER_SIZE = 32;
+    /// Number of packets sent after a packet that must be acknowledged before it is taken as lost and retransmitted.
+    constexpr size_t DUPLICATE_ACK_THRESHOLD = 3;
+    /// Maximum number of messages coalesced into one packet, which must fit in the smallest receive queue.
+    constexpr size_t MAX_COALESCED_MESSAGES = 64;
+
+    /**
+     * @brief   Struct SendRequest holds a message that has been submitted for sending but has not been
+     *          given a sequence number because the send window is full.
+     */
+    struct SendRequest
+    {
+        /// Payload of the message, owned by the caller until the handler is invoked unless it was copied.
+        const char *payload;
+        /// Length in bytes of the payload.
+        int len;
+        /// Number of bytes of the payload that have already been moved into the send window as fragments.
+        int offset;
+        /// Copy of the payload, only used when the caller can reuse its buffer before the message is acknowledged.
+        PooledBuffer payload_copy;
+        /// Handler invoked once the message has been acknowledged or abandoned.
+        CompletionHandler handler;
+        /// How the message is delivered.
+        Delivery delivery;
+        /// Time after which the message is dropped, pos_infin if it has no lifetime.
+        boost::posix_time::ptime expiry;
+        /// Flag for if the message is small and plain enough to share a packet with the messages queued after it.
+        bool coalesce;
+        /// Time until which the message waits for more messages to share its packet, if it is coalesced.
+        boost::posix_time::ptime coalesce_deadline;
+    };
+
+    /**
+     * @brief   Struct SendSlot holds a packet that has been transmitted but has not yet been removed from the
+     *          send window of a Connection.
+     */
+    struct SendSlot
+    {
+        /// Sequence number of the packet held in the slot.
+        uint32_t sequence;
+        /// Header of the packet, which is sent before the payload in the same datagram.
+        std::array<char, DATA_HEADER_SIZE> header;
+        /// ACK sent after the payload when the packet was last transmitted with one.
+        std::array<char, ACK_INFO_SIZE> trailer;
+        /// Payload of the packet, either the caller's buffer or the data of payload_copy.
+        const char *payload;
+        /// Length in bytes of the payload.
+        int len;
+        /// Flag for if the packet is the last fragment of its message, which holds the handler and any copy of the payload.
+        bool message_end;
+        /// Number of bytes sent for the whole message, the header of each fragment and the payload, reported to the handler.
+        int message_size;
+        /// Number of messages ended by the packet, more than 1 if they were coalesced into it, otherwise 1.
+        int messages;
+        /// Copy of the payload if the caller's buffer could not be referenced, moving it keeps the data in place.
+        PooledBuffer payload_copy;
+        /// Number of times the packet has been transmitted.
+        int attempts;
+        /// Maximum number of times the packet is transmitted before its message is dropped, -1 to use the send retries limit.
+        int max_attempts;
+        /// Time at which the packet was first transmitted.
+        boost::posix_time::ptime first_sent_time;
+        /// Time at which the packet was last transmitted.
+        boost::posix_time::ptime sent_time;
+        /// Time after which the packet will be retransmitted if no ACK has been received.
+        boost::posix_time::ptime deadline;
+        /// Time after which the message of the packet is dropped, pos_infin if it has no lifetime.
+        boost::posix_time::ptime expiry;
+        /// Progress of the deliveries of the channel when the packet was last transmitted, for its congestion controller.
+        DeliveryState delivery;
+        /// Flag for if an ACK with the sequence number of the slot has been received.
+        bool acked;
+        /// Handler invoked once the packet has been acknowledged or abandoned.
+        CompletionHandler handler;
+    };
+
+    /**
+     * @brief   Struct SendChannel holds the send state of a connection for one stream to a remote endpoint, so that
+     *          one socket can carry independent sessions with many peers, and many streams to each of them.
+     */
+    struct SendChannel
+    {
+        /**
+         * @brief               Constructor for the SendChannel struct that starts the sequence at 0.
+         * @param io_service    io_service & IO service that runs the retransmission timer of the channel.
+         * @param endpoint      const udp::endpoint & remote endpoint that the channel sends to.
+         * @param stream        uint16_t stream that the channel sends on.
+         * @param timeout_ms    double retransmission timeout in milliseconds used until the round trip time is measured.
+         * @param epoch         uint32_t session epoch the channel starts in.
+         * @param pool          BufferPool & pool of the connection that the queues and the window take their memory from.
+         */
+        SendChannel(boost::asio::io_service &io_service, const boost::asio::ip::udp::endpoint &endpoint, uint16_t stream, double timeout_ms, uint32_t epoch, BufferPool &pool) : endpoint(endpoint), stream(stream), sequence_send(0), epoch(epoch), send_window(PoolAllocator<SendSlot>(&pool)), send_queue(PoolAllocator<SendRequest>(&pool)), unreliable_queue(PoolAllocator<SendRequest>(&pool)), has_rtt(false), srtt_ms(0), rttvar_ms(0), timeout_ms(timeout_ms), timer(io_service), in_recovery(false), recovery_sequence(0), pacing_timer(io_service)
+        {
+            timer.expires_at(boost::posix_time::pos_infin);
+            pacing_timer.expires_at(boost::posix_time::pos_infin);
+        }
+
+        /// Remote endpoint that the channel sends to.
+        boost::asio::ip::udp::endpoint endpoint;
+        /// Stream that the channel sends on, carried by every packet and ACK of the channel.
+        uint16_t stream;
+        /// Sequence number of the next message that the channel will send.
+        uint32_t sequence_send;
+        /// Session epoch carried by every packet, drawn again whenever the sequence restarts so the receiver restarts with it.
+        uint32_t epoch;
+        /// Packets that have been sent but not yet acknowledged, ordered by sequence number.
+        PoolDeque<SendSlot> send_window;
+        /// Messages waiting for space in the send window.
+        PoolDeque<SendRequest> send_queue;
+        /// Unreliable messages waiting to be sent, which do not wait for the send window.
+        PoolDeque<SendRequest> unreliable_queue;
+        /// Flag for if the round trip time to the endpoint has been measured.
+        bool has_rtt;
+        /// Smoothed round trip time to the endpoint in milliseconds.
+        double srtt_ms;
+        /// Variation of the round trip time to the endpoint in milliseconds.
+        double rttvar_ms;
+        /// Adaptive retransmission timeout of the channel in milliseconds, including any backoff.
+        double timeout_ms;
+        /// Timer for the earliest retransmission deadline of the send window.
+        boost::asio::deadline_timer timer;
+        /// Congestion controller of the channel, null if its congestion is not controlled.
+        std::unique_ptr<CongestionController> congestion;
+        /// Flag for if the channel is recovering from a loss, during which further losses are not signalled.
+        bool in_recovery;
+        /// Sequence number that the window base must reach to end the recovery.
+        uint32_t recovery_sequence;
+        /// Pacer that spaces the packets of the channel at the pacing rate of its congestion controller.
+        TokenBucket pacer;
+        /// Timer for the time at which the pacer or the rate limit next allow a packet to be sent, or at which the
+        /// messages waiting to be coalesced must be sent.
+        boost::asio::deadline_timer pacing_timer;
+        /// Time at which the channel was last used to send or was acknowledged, after which it may be evicted.
+        boost::posix_time::ptime last_active;
+    };
+
+    /**
+     * @brief   Struct PendingAck holds the latest ACK owed to a sender while it is delayed.
+     */
+    struct PendingAck
+    {
+        /// Sequence number of the latest packet delivered from the sender.
+        uint32_t sequence;
+        /// Next sequence number expected from the sender.
+        uint32_t cumulative;
+        /// Bitmap of the packets after the cumulative sequence that have been received.
+        uint32_t sack;
+        /// Number of packets acknowledged by the ACK, 0 if no ACK is owed.
+        int packets;
+        /// Time by which the ACK is sent if it has not been sent earlier.
+        boost::posix_time::ptime deadline;
+    };
+
+    /**
+     * @brief   Struct OutgoingDatagram holds a datagram that has been queued to be sent with the next batch.
+     */
+    struct OutgoingDatagram
+    {
+        /// Endpoint that the datagram is sent to.
+        boost::asio::ip::udp::endpoint endpoint;
+        /// Header of the datagram, or the whole datagram of an ACK.
+        const char *header;
+        /// Length in bytes of the header.
+        size_t header_len;
+        /// Payload of the datagram, which is gathered after the header.
+        const char *payload;
+        /// Length in bytes of the payload.
+        size_t payload_len;
+        /// Trailer of the datagram, which is gathered after the payload.
+        const char *trailer;
+        /// Length in bytes of the trailer.
+        size_t trailer_len;
+        /// Channel that sends the data packet, null for an ACK.
+        SendChannel *channel;
+        /// Sequence number of the data packet or of the packet being acknowledged.
+        uint32_t sequence;
+        /// Number of bytes sent once the batch has been sent.
+        size_t sent_size;
+        /// Error of sending the datagram once the batch has been sent.
+        boost::system::error_code error;
+    };
+
+    /**
+     * @brief   Struct ReceiveRequest holds the output arguments of a receive that is waiting for a message.
+     */
+    struct ReceiveRequest
+    {
+        /// Buffer to which the received data will be written.
+        char *buf;
+        /// Length of the provided buffer in bytes.
+        int len;
+        /// Buffer to which the address of the sender will be written.
+        char *address;
+        /// Location to which the port of the sender will be written.
+        int *port;
+        /// Location to which the stream of the message will be written, null if it is not wanted.
+        uint16_t *stream;
+        /// Handler invoked once a message has been written to the buffer.
+        CompletionHandler handler;
+    };
+
+    /**
+     * @brief   Struct Completion holds a handler and the result it is invoked with once the mutex is released.
+     */
+    struct Completion
+    {
+        /// Handler of the operation that completed.
+        CompletionHandler handler;
+        /// Length in bytes given to the handler, -1 if the operation failed.
+        int length;
+        /// Error given to the handler, null if the operation succeeded.
+        std::exception_ptr error;
+    };
+
+    /**
+     * @brief   Struct BlockingResult holds the result of an operation that a blocking call is waiting for.
+     */
+    struct BlockingResult
+    {
+        /// Length in bytes of the result.
+        int length;
+        /// Error of the operation, null if it succeeded.
+        std::exception_ptr error;
+        /// Flag for if the operation has completed, only read and written while holding the mutex.
+        bool done;
+    };
+
+    /**
+     * @brief   Struct ReorderSlot holds a packet that arrived ahead of the next sequence expected from its sender.
+     */
+    struct ReorderSlot
+    {
+        /// Flag for if the slot holds a packet.
+        bool used;
+        /// Flag for if the packet is an unordered message that was delivered as it arrived, so only its sequence is held.
+        bool delivered;
+        /// Sequence number of the packet held in the slot.
+        uint32_t sequence;
+        /// Header and payload of the packet, the buffer is reused by later packets.
+        std::vector<char> packet;
+    };
+
+    /**
+     * @brief   Struct PartialMessage holds a message from a sender whose fragments are being reassembled.
+     */
+    struct PartialMessage
+    {
+        /// Buffer the message is reassembled into, either the buffer of the receive or the data of payload.
+        char *buf;
+        /// Length in bytes of the message.
+        int len;
+        /// Number of bytes of the message received so far, the offset of the next fragment.
+        int received_len;
+        /// Flag for if the message is being reassembled into the buffer of a receive that was waiting for it.
+        bool has_request;
+        /// Receive that takes the message once it is complete, if has_request is set.
+        ReceiveRequest request;
+        /// Buffer taken from the receive buffer pool to hold the message if no receive was waiting for it.
+        std::vector<char> payload;
+    };
+
+    /**
+     * @brief   Struct ReceiveChannel holds the receive state of a connection for one stream of a sender, with the
+     *          fields used for every packet first.
+     */
+    struct ReceiveChannel
+    {
+        /**
+         * @brief   Constructor for the ReceiveChannel struct of an empty slot of the peer table.
+         */
+        ReceiveChannel() : ReceiveChannel(boost::asio::ip::udp::endpoint(), 0, boost::posix_time::not_a_date_time) {}
+
+        /**
+         * @brief               Constructor for the ReceiveChannel struct that starts the sequence at 0.
+         * @param sender        const udp::endpoint & endpoint that the channel receives from.
+         * @param stream        uint16_t stream that the channel receives on.
+         * @param last_active   ptime time at which the sender was first heard from.
+         */
+        ReceiveChannel(const boost::asio::ip::udp::endpoint &sender, uint16_t stream, boost::posix_time::ptime last_active) : epoch(0), retired_epoch(0), sequence_recv(0), stalled(false), has_partial(false), stream(stream), ack{0, 0, 0, 0, boost::posix_time::pos_infin}, last_active(last_active), sender(sender), partial{nullptr, 0, 0, false, ReceiveRequest(), std::vector<char>()} {}
+
+        /// Session epoch of the sender, a packet from another epoch restarts the channel.
+        uint32_t epoch;
+        /// Session epoch the sender was in before the current one, whose packets are late and are dropped rather
+        /// than restarting the channel again.
+        uint32_t retired_epoch;
+        /// Sequence number of the next packet expected from the sender.
+        uint32_t sequence_recv;
+        /// Flag for if a packet in the reorder buffer is next in sequence but the receive queue had no room for it.
+        bool stalled;
+        /// Flag for if a message from the sender is being reassembled in partial.
+        bool has_partial;
+        /// Stream that the channel receives on.
+        uint16_t stream;
+        /// Latest ACK owed to the sender, if any.
+        PendingAck ack;
+        /// Time at which a packet was last received from the sender.
+        boost::posix_time::ptime last_active;
+        /// Endpoint that the channel receives from.
+        boost::asio::ip::udp::endpoint sender;
+        /// Message whose fragments are being received from the sender, if has_partial is set.
+        PartialMessage partial;
+        /// Packets received ahead of the next sequence, packet seq is held by slot seq % REORDER_BUFFER_SIZE.
+        /// The slots are only allocated once the sender's packets first arrive out of order.
+        std::vector<ReorderSlot> reorder_buffer;
+    };
+
+    /**
+     * @brief   Class Connection represents a virtual connection over which UDP packets can be sent.
+     * @details The Connection class uses a sequence number and the Selective Repeat ARQ protocol to
+     *          send data between two Connection objects. With the default window size of 1 this is the
+     *          Stop-and-Wait ARQ protocol. The socket is serviced by handlers that run on a Boost IO
+     *          service, which must only be run by one thread at a time, and the blocking send and
+     *          receive methods wait for the same operations that are available asynchronously. The IO
+     *          service is either run by a thread of the ConnectionController or owned by the connection
+     *          and run from the application's event loop.
+     */
+    class Connection
+    {
+    private:
+        /// Pool from which the queues, payload copies and asynchronous operations of the connection take their
+        /// memory, declared first so that it outlives every container and operation that uses it.
+        BufferPool buffer_pool;
+        /// Mutex for thread synchronization of the connection state between callers and the IO service.
+        std::mutex io_mutex;
+        /// Condition variable notified whenever a handler has changed the connection state.
+        std::condition_variable state_changed;
+        /// Map of remote endpoints and streams to the channels that send on them, ordered by endpoint first so that
+        /// the streams to one endpoint are next to each other.
+        std::map<std::pair<boost::asio::ip::udp::endpoint, uint16_t>, SendChannel> send_channels;
+        /// Table of the streams of senders to the channels that receive from them.
+        PeerTable<ReceiveChannel> receive_channels;
+        /// Flag for if any receive channel is stalled, which is retried when a receive would otherwise wait.
+        bool reorder_stalled;
+        /// Generator of the session epochs of the send channels.
+        std::mt19937 epoch_generator;
+        /// Time after which a receive channel that has not received a packet is evicted, -1 to never evict them.
+        int peer_idle_timeout_ms;
+        /// Size in bytes of the largest message that is received, the packets of larger messages are dropped.
+        int max_message_size;
+        /// Time at which the receive channels are next checked for eviction.
+        boost::posix_time::ptime peer_sweep_time;
+
+        /// IO service owned by the connection when it is driven by the application's event loop, null when it
+        /// uses a shared IO service run by another thread.
+        std::unique_ptr<boost::asio::io_service> owned_io_service;
+        /// Work that keeps the owned IO service from stopping while the connection has nothing pending.
+        std::unique_ptr<boost::asio::io_service::work> owned_io_service_work;
+        /// Number of handlers posted to the IO service that have not run yet.
+        std::atomic<int> posted_handlers{0};
+        /// Boost IO service for networking, this is shared with other connections and run by another thread unless
+        /// it is owned by the connection.
+        boost::asio::io_service &io_service;
+        /// Socket over which packets will be sent/received.
+        boost::asio::ip::udp::socket socket{io_service};
+        /// Timer for the earliest deadline of the delayed ACKs.
+        boost::asio::deadline_timer ack_timer{io_service};
+        /// Link through which the datagrams are sent when the connection is impaired, null if it is not.
+        std::unique_ptr<ImpairedLink> impaired_link;
+        /// Timer for the time at which the next datagram held by the impaired link is due.
+        boost::asio::deadline_timer impairment_timer{io_service};
+#ifdef __linux__
+        /// Ring through which the datagrams of the socket are sent and received by the io_uring transport, null
+        /// with the Boost ASIO transport.
+        std::unique_ptr<UringTransport> uring;
+        /// Descriptor of the eventfd of the ring, which the IO service waits on for datagrams to be received.
+        std::unique_ptr<boost::asio::posix::stream_descriptor> uring_descriptor;
+        /// Count read from the eventfd of the ring.
+        uint64_t uring_events;
+        /// Datagrams taken from the ring by the last completion handler.
+        std::vector<UringDatagram> uring_datagrams;
+        /// Headers of the datagrams of the send batch when they are sent through the ring.
+        std::vector<msghdr> uring_messages;
+        /// Buffers gathered into the datagrams of the send batch when they are sent through the ring.
+        std::vector<std::array<iovec, 3>> uring_iovecs;
+        /// Results of sending the datagrams of the send batch through the ring.
+        std::vector<int> uring_results;
+#endif
+        /// Local endpoint where packets will be received.
+        boost::asio::ip::udp::endpoint endpoint_local;
+        /// Remote endpoint where packets will be sent.
+        boost::asio::ip::udp::endpoint endpoint_remote;
+        /// Flag for if the local endpoint has been set.
+        bool has_endpoint_local;
+        /// Flag for if the remote endpoint has been set.
+        bool has_endpoint_remote;
+
+        /// Buffers into which each batch of datagrams is read by the receive loop, only one without recvmmsg.
+        std::vector<std::vector<char>> read_buffers;
+        /// Lengths in bytes of the datagrams in the read buffers.
+        std::vector<size_t> read_lengths;
+        /// Endpoints from which the datagrams in the read buffers were received.
+        std::vector<boost::asio::ip::udp::endpoint> read_endpoints;
+        /// Sizes in bytes of the segments of the datagrams in the read buffers that the kernel coalesced with UDP GRO,
+        /// 0 for a datagram that was not coalesced.
+        std::vector<size_t> read_segment_sizes;
+        /// Buffer of the waiting receive into which the start of the first payload is read, null if there is none.
+        char *read_target;
+        /// Length in bytes of the buffer of the waiting receive into which the start of the first payload is read.
+        int read_target_len;
+        /// Time at which the batch of datagrams being handled was read.
+        boost::posix_time::ptime read_time;
+
+        /// Datagrams queued to be sent together, which is always empty when the mutex is not held by the IO service.
+        std::vector<OutgoingDatagram> send_batch;
+        /// Unreliable packets of the send batch in the order of their datagrams, kept until the batch has been sent.
+        PoolDeque<SendSlot> unreliable_batch;
+        /// Buffers in which the ACKs of the send batch are encoded, reused as ACKs are only sent by the IO service.
+        std::array<std::array<char, ACK_PACKET_SIZE>, IO_BATCH_SIZE> ack_buffers;
+        /// Number of ACKs in the send batch.
+        size_t ack_count;
+        /// Flag for if datagrams of the send batch to one endpoint are sent as the segments of one UDP GSO send and
+        /// datagrams are received coalesced by UDP GRO.
+        bool segmentation_offload;
+        /// Buffers gathered into the datagrams of the send batch when they are sent with UDP GSO.
+        std::vector<iovec> segment_iovecs;
+
+        /// Timeout after which the connection will retransmit a message, or the initial timeout if it is adaptive.
+        int timeout_ms;
+        /// Flag for if the retransmission timeout adapts to the measured round trip time of each endpoint.
+        bool adaptive_timeout;
+        /// Minimum adaptive retransmission timeout in milliseconds.
+        int timeout_min_ms;
+        /// Maximum adaptive retransmission timeout in milliseconds, which limits the exponential backoff.
+        int timeout_max_ms;
+        /// Flag for if the connection is being destroyed, after which no more operations are started.
+        bool closing;
+        /// Flag for if close() has run, after which the destructor does not wait for the IO service.
+        bool closed;
+        /// Flag for if the connection was destroyed from a handler of the IO service it owns, which process() deletes
+        /// once it returns.
+        bool destroy_pending;
+
+        /// Maximum number of times a packet will be transmitted before the send is aborted (-1 for no limit).
+        int send_retries_limit;
+
+        /// Maximum number of packets that can be in flight (sent but not acknowledged) at once to each remote endpoint.
+        int window_size;
+        /// Longest time in microseconds that a small message waits for others to share its packet, -1 if messages
+        /// are not coalesced.
+        int coalesce_delay_us;
+        /// Factory of the congestion controllers of new send channels, empty if their congestion is not controlled.
+        CongestionControlFactory congestion_control;
+        /// Limit of the rate at which the connection sends data packets in bytes per second, 0 for no limit.
+        uint64_t rate_limit;
+        /// Token bucket of the rate limit, shared by every send channel.
+        TokenBucket rate_limiter;
+        /// Largest IP packet in bytes that can be sent without being fragmented by IP, which sets the size of the fragments of a message.
+        int mtu;
+        /// Error message of the packets that were abandoned by the send window, reported by the next send or flush.
+        std::string send_window_error;
+
+        /// Receives waiting for a message to be delivered.
+        PoolDeque<ReceiveRequest> receive_requests;
+        /// Messages that have been delivered but not yet taken by a receive, which receive() takes without the mutex.
+        /// The pointer is only changed while holding the mutex.
+        std::atomic<ReceiveQueue *> receive_queue;
+        /// Every receive queue the connection has had, as a receive may still be taking from one that was replaced
+        /// when the receive queue limit was raised.
+        std::vector<std::unique_ptr<ReceiveQueue>> receive_queues;
+        /// Buffers of messages whose fragments were reassembled, reused to hold the fragments of later messages.
+        std::vector<std::vector<char>> receive_buffer_pool;
+        /// Maximum number of messages held in the receive queue before new messages are left unacknowledged.
+        size_t receive_queue_limit;
+        /// Buffer into which a packet of coalesced messages is copied out of the read buffers, reused for each one.
+        std::vector<char> coalesced_packet;
+
+        /// Number of packets from a sender after which an ACK is sent without waiting for the ACK delay.
+        int ack_packets;
+        /// Maximum time in microseconds that an ACK is delayed for, 0 to acknowledge every packet straight away.
+        int ack_delay_us;
+
+        /// Counters of the packets and messages the connection has sent and received.
+        StatsCounters stats;
+
+        /// Flag for if the connection has a trace handler or a trace buffer.
+        bool tracing;
+        /// Function given every trace record, empty if there is none.
+        TraceHandler trace_handler;
+        /// Ring to which the trace records are written, null if there is none. The pointer is only changed while
+        /// holding the mutex.
+        std::atomic<TraceBuffer *> trace_buffer;
+        /// Every trace buffer the connection has had, as a thread may still be reading one that was replaced.
+        std::vector<std::unique_ptr<TraceBuffer>> trace_buffers;
+
+        /// Completions produced by a handler, invoked once the handler has released the mutex.
+        std::vector<Completion> completions;
+        /// Emptied vectors of completions whose capacity is reused by the next handler.
+        std::vector<std::vector<Completion>> spare_completions;
+
+        /**
+         * @brief   Method start_receive starts the asynchronous read of the next datagram on the socket, or with
+         *          recvmmsg waits for the socket to be readable so that a batch of datagrams can be read at once.
+         */
+        void start_receive();
+
+        /**
+         * @brief   Method set_read_target chooses the read target of the next read.
+         * @details If a receive is waiting and no message is queued for it, the payload of the first datagram is
+         *          scattered straight into the buffer of the receive, between the header and the rest of the read buffer.
+         */
+        void set_read_target();
+
+#ifdef __linux__
+        /**
+         * @brief   Method read_datagrams reads the datagrams waiting on the socket, up to a batch, with recvmmsg.
+         * @return  size_t number of datagrams read into the read buffers.
+         */
+        size_t read_datagrams();
+#endif
+
+		/**
+		 * @brief 			Method handle_datagram is the completion handler of the receive loop.
+		 * @details 		The datagrams that were read are parsed according to their type, every packet this
+		 * 					produces is sent as one batch, then the next read is started, unless the socket has
+		 * 					been closed.
+		 * @param err 		[in]	error_code passed to the method by boost when a packet is received.
+		 * @param length 	[in]	size_t passed to the method by boost when a packet is received, unused on Linux
+		 * 					where the socket is only waited on and the datagrams are read with recvmmsg.
+		 */
+        void handle_datagram(const boost::system::error_code &err, std::size_t length);
+
+#ifdef __linux__
+        /**
+         * @brief       Method handle_uring_completions is the completion handler of the receive loop of the io_uring
+         *              transport, which runs when the eventfd of the ring is readable.
+         * @details     Every datagram the ring has received is parsed according to its type and its buffer given
+         *              back to the kernel, every packet this produces is sent as one batch, then the eventfd is
+         *              waited on again, unless the socket has been closed.
+         * @param err   [in]    error_code passed to the method by boost when the eventfd has been read.
+         */
+        void handle_uring_completions(const boost::system::error_code &err);
+#endif
+
+        /**
+         * @brief           Method dispatch_datagram parses a datagram according to its type.
+         * @param packet    const char * start of the datagram.
+         * @param length    size_t length of the datagram in bytes.
+         * @param sender    const udp::endpoint & endpoint from which the datagram was received.
+         */
+        void dispatch_datagram(const char *packet, std::size_t length, const boost::asio::ip::udp::endpoint &sender);
+
+        /**
+         * @brief           Method handle_data processes a data packet, delivering it if it has the expected sequence
+         *                  number or holding it in the reorder buffer if it is ahead, and acknowledging it if it has
+         *                  been delivered or held.
+         * @param packet    const char * header of the packet, the payload is read with copy_read_payload().
+         * @param length    size_t length of the packet in bytes.
+         * @param sender    const udp::endpoint & endpoint from which the packet was received.
+         */
+        void handle_data(const char *packet, std::size_t length, const boost::asio::ip::udp::endpoint &sender);
+
+        /**
+         * @brief           Method deliver_data delivers the packet that is next in sequence from a sender, as a whole
+         *                  message or as a fragment of the message being reassembled.
+         * @param channel   ReceiveChannel & channel of the sender.
+         * @param packet    const char * header of the packet, the payload is read with copy_read_payload().
+         * @return          bool false if the receive queue had no room for the message, in which case the packet must
+         *                  be left unacknowledged, otherwise true.
+         */
+        bool deliver_data(ReceiveChannel &channel, const char *packet);
+
+        /**
+         * @brief           Method deliver_message delivers a message that arrived whole in one packet to the first
+         *                  waiting receive, or to the receive queue, which must have room for it.
+         * @param channel   ReceiveChannel & channel the message was received on.
+         * @param packet    const char * packet holding the message, whose payload may be in the read target.
+         * @param offset    int offset in bytes of the message in the payload of the packet.
+         * @param len       int length in bytes of the message.
+         */
+        void deliver_message(ReceiveChannel &channel, const char *packet, int offset, int len);
+
+        /**
+         * @brief           Method deliver_coalesced delivers each of the messages coalesced into a packet, or none of
+         *                  them if the receive queue does not have room for them all.
+         * @param channel   ReceiveChannel & channel the packet was received on.
+         * @param packet    const char * header of the packet, the payload is read with copy_read_payload().
+         * @param len       int length in bytes of the payload.
+         * @return          bool true if the messages were delivered, false if the receive queue had no room for them.
+         */
+        bool deliver_coalesced(ReceiveChannel &channel, const char *packet, int len);
+
+        /**
+         * @brief           Method count_coalesced counts the messages coalesced into the payload of a packet.
+         * @param packet    const char * header of the packet, the payload is read with copy_read_payload().
+         * @param len       int length in bytes of the payload.
+         * @return          int number of messages, -1 if their lengths do not add up to the payload or there are
+         *                  none or more than MAX_COALESCED_MESSAGES.
+         */
+        int count_coalesced(const char *packet, int len);
+
+        /**
+         * @brief           Method deliver_reordered delivers the packets of the reorder buffer that are next in
+         *                  sequence, stalling the channel if the receive queue runs out of room.
+         * @param channel   ReceiveChannel & channel of the sender.
+         */
+        void deliver_reordered(ReceiveChannel &channel);
+
+        /**
+         * @brief           Method skip_to_base moves a channel on to the window base of its sender, as the sender has
+         *                  abandoned the packets before it, delivering those of them in the reorder buffer.
+         * @param channel   ReceiveChannel & channel of the sender.
+         * @param base      uint32_t window base of the sender.
+         */
+        void skip_to_base(ReceiveChannel &channel, uint32_t base);
+
+        /**
+         * @brief           Method get_reorder_sack gets the SACK bitmap of the packets in the reorder buffer of a channel.
+         * @param channel   ReceiveChannel & channel of the sender.
+         * @return          uint32_t bit i is set if sequence_recv + 1 + i is held.
+         */
+        uint32_t get_reorder_sack(ReceiveChannel &channel);
+
+        /**
+         * @brief       Method sequence_distance counts the sequence numbers from one to another in serial number
+         *              arithmetic (RFC 1982), as the sequence numbers use every 32 bit value before wrapping.
+         * @param from  uint32_t first sequence number.
+         * @param to    uint32_t second sequence number.
+         * @return      int32_t number of sequence numbers after from that to is, negative if to is before from.
+         */
+        static int32_t sequence_distance(uint32_t from, uint32_t to);
+
+        /**
+         * @brief           Method handle_ack processes an ACK packet from a sender.
+         * @param packet    const char * start of the packet.
+         * @param length    size_t length of the packet in bytes.
+         * @param sender    const udp::endpoint & endpoint from which the packet was received.
+         */
+        void handle_ack(const char *packet, std::size_t length, const boost::asio::ip::udp::endpoint &sender);
+
+        /**
+         * @brief           Method process_ack marks every slot of the send window of the sender's channel that an ACK
+         *                  acknowledges then advances the window.
+         * @param ack       const char * ACK of ACK_INFO_SIZE bytes.
+         * @param sender    const udp::endpoint & endpoint from which the ACK was received.
+         */
+        void process_ack(const char *ack, const boost::asio::ip::udp::endpoint &sender);
+
+        /**
+         * @brief           Method queue_ack records that a packet was delivered from a sender, then sends the ACK
+         *                  once ack_packets packets are owed it, or delays it until the ACK delay has passed or
+         *                  outgoing data to the sender can carry it.
+         * @param channel   ReceiveChannel & channel of the sender.
+         * @param sequence  uint32_t sequence number of the packet.
+         * @param cumulative uint32_t next sequence number expected from the sender.
+         * @param sack      uint32_t bitmap of the packets after the cumulative sequence that have been received.
+         * @param immediate bool true to send the ACK straight away.
+         */
+        void queue_ack(ReceiveChannel &channel, uint32_t sequence, uint32_t cumulative, uint32_t sack, bool immediate);
+
+        /**
+         * @brief   Method arm_ack_timer sets the ACK timer to the earliest deadline of the delayed ACKs.
+         */
+        void arm_ack_timer();
+
+		/**
+		 * @brief 			Method handle_ack_timer is the completion handler of the ACK timer.
+		 * @details 		Every delayed ACK whose deadline has passed is sent.
+		 * @param err 		[in]	error_code passed to the method by boost when the timer expires or is cancelled.
+		 */
+        void handle_ack_timer(const boost::system::error_code &err);
+
+		/**
+		 * @brief 			Method handle_timer is the completion handler of the retransmission timer of a channel.
+		 * @details 		Slots whose deadline has passed are retransmitted, or abandoned if the send retries
+		 * 					limit has been reached.
+		 * @param channel	[in]	SendChannel * channel whose timer expired.
+		 * @param err 		[in]	error_code passed to the method by boost when the timer expires or is cancelled.
+		 */
+        void handle_timer(SendChannel *channel, const boost::system::error_code &err);
+
+        /**
+         * @brief 			Method handle_pacing_timer is the completion handler of the pacing timer of a channel, which
+         * 					sends the packets that were waiting for the pacer, the rate limit or more messages to
+         * 					coalesce.
+         * @param channel	[in]	SendChannel * channel whose timer expired.
+         * @param err 		[in]	error_code passed to the method by boost when the timer expires or is cancelled.
+         */
+        void handle_pacing_timer(SendChannel *channel, const boost::system::error_code &err);
+
+        /**
+         * @brief           Method pace checks if the pacer of a channel and the rate limit allow a packet to be sent,
+         *                  otherwise setting the pacing timer of the channel to the time at which they will.
+         * @param channel   SendChannel & channel that has a packet to send.
+         * @return          bool true if the packet can be sent now.
+         */
+        bool pace(SendChannel &channel);
+
+        /**
+         * @brief           Method count_in_flight counts the packets of a channel that are waiting for an ACK.
+         * @param channel   SendChannel & channel whose packets are counted.
+         * @return          size_t number of packets in flight.
+         */
+        size_t count_in_flight(SendChannel &channel);
+
+        /**
+         * @brief           Method detect_losses retransmits the packets of a channel that DUPLICATE_ACK_THRESHOLD
+         *                  packets sent after them have been acknowledged ahead of, without waiting for their
+         *                  timeout, and signals the loss to the congestion controller once for each recovery.
+         * @param channel   SendChannel & channel whose window is checked.
+         * @param now       const ptime & time at which the ACK was received.
+         */
+        void detect_losses(SendChannel &channel, const boost::posix_time::ptime &now);
+
+        /**
+         * @brief           Method measure_rtt updates the round trip time estimates of a channel with a new sample
+         *                  and recomputes its retransmission timeout, which also clears any backoff.
+         * @param channel   SendChannel & channel the sample was measured on.
+         * @param rtt_ms    double round trip time in milliseconds of a packet that was only transmitted once.
+         */
+        void measure_rtt(SendChannel &channel, double rtt_ms);
+
+        /**
+         * @brief           Method get_channel_timeout gets the retransmission timeout used for a channel.
+         * @param channel   SendChannel & channel being sent on.
+         * @return          double timeout in milliseconds, which is timeout_ms unless the timeout is adaptive.
+         */
+        double get_channel_timeout(SendChannel &channel);
+
+        /**
+         * @brief           Method get_endpoint_timeout gets the retransmission timeout of the channel to an endpoint
+         *                  without creating the channel. Must be called with the mutex held.
+         * @param endpoint  const udp::endpoint * remote endpoint, null if there is none.
+         * @return          int timeout in milliseconds, the initial timeout if the endpoint has no channel.
+         */
+        int get_endpoint_timeout(const boost::asio::ip::udp::endpoint *endpoint);
+
+        /**
+         * @brief           Method get_endpoint_congestion_window gets the congestion window of the channel to an
+         *                  endpoint without creating the channel. Must be called with the mutex held.
+         * @param endpoint  const udp::endpoint * remote endpoint, null if there is none.
+         * @return          int number of packets, the initial window if the endpoint has no channel.
+         */
+        int get_endpoint_congestion_window(const boost::asio::ip::udp::endpoint *endpoint);
+
+        /**
+         * @brief           Method send_ack queues an ACK packet to the endpoint the packets came from.
+         * @param sequence  uint32_t sequence number being acknowledged.
+         * @param cumulative uint32_t next sequence number expected from the sender.
+         * @param sack      uint32_t bitmap of the packets after the cumulative sequence that have been received.
+         * @param epoch     uint32_t session epoch of the sender that the packets were received in.
+         * @param stream    uint16_t stream the packets were received on.
+         * @param sender    const udp::endpoint & endpoint to which the ACK is sent.
+         */
+        void send_ack(uint32_t sequence, uint32_t cumulative, uint32_t sack, uint32_t epoch, uint16_t stream, const boost::asio::ip::udp::endpoint &sender);
+
+        /**
+         * @brief           Method encode_ack writes an ACK into a buffer of ACK_INFO_SIZE bytes.
+         * @param ack       char * buffer the ACK is written to.
+         * @param sequence  uint32_t sequence number being acknowledged.
+         * @param cumulative uint32_t next sequence number expected from the sender.
+         * @param sack      uint32_t bitmap of the packets after the cumulative sequence that have been received.
+         * @param epoch     uint32_t session epoch of the sender that the packets were received in.
+         * @param stream    uint16_t stream the packets were received on.
+         */
+        static void encode_ack(char *ack, uint32_t sequence, uint32_t cumulative, uint32_t sack, uint32_t epoch, uint16_t stream);
+
+        /**
+         * @brief               Method encode_header writes the fields of the header of a data packet that stay the same
+         *                      when it is retransmitted, leaving the type and the window base.
+         * @param slot          SendSlot & slot holding the packet, whose sequence and length are written.
+         * @param message_len   int length in bytes of the message of the packet.
+         * @param offset        int offset in bytes of the packet in its message.
+         * @param epoch         uint32_t session epoch of the channel.
+         * @param delivery      DeliveryClass class of the message.
+         * @param stream        uint16_t stream of the channel.
+         */
+        static void encode_header(SendSlot &slot, int message_len, int offset, uint32_t epoch, DeliveryClass delivery, uint16_t stream);
+
+        /**
+         * @brief           Method get_delivery_error checks if a message can be sent with a delivery.
+         * @param delivery  const Delivery & how the message is delivered.
+         * @param len       int length in bytes of the message.
+         * @return          string message of the error, empty if the message can be sent.
+         */
+        std::string get_delivery_error(const Delivery &delivery, int len);
+
+        /**
+         * @brief           Method send_unreliable queues the unreliable messages of a channel to be sent with the next
+         *                  batch, each in one packet that is never retransmitted.
+         * @param channel   SendChannel & channel whose messages are sent.
+         */
+        void send_unreliable(SendChannel &channel);
+
+        /**
+         * @brief           Method expire_slot checks if the message of a packet whose retransmission deadline has passed
+         *                  is dropped, because it has reached its lifetime or its limit of transmissions.
+         * @param slot      SendSlot & slot of the packet.
+         * @param now       const ptime & current time.
+         * @return          int 1 if the message is dropped as it was sent to be, -1 if it is abandoned after reaching
+         *                  the send retries limit of the connection, 0 if it is retransmitted.
+         */
+        int expire_slot(SendSlot &slot, const boost::posix_time::ptime &now);
+
+        /**
+         * @brief   Method get_fragment_size gets the largest payload of a data packet that fits in the MTU, leaving room
+         *          for an ACK to be carried after it.
+         * @return  int number of bytes of a message sent in each fragment.
+         */
+        int get_fragment_size();
+
+        /**
+         * @brief       Method get_message_size gets the number of bytes sent for a message, including the header of each fragment.
+         * @param len   int length in bytes of the message.
+         * @return      int number of bytes sent.
+         */
+        int get_message_size(int len);
+
+        /**
+         * @brief           Method get_send_channel gets the channel that sends on a stream to a remote endpoint, creating
+         *                  it if needed.
+         * @param endpoint  const udp::endpoint & remote endpoint of the channel.
+         * @param stream    uint16_t stream of the channel.
+         * @return          SendChannel & channel that sends on the stream to the endpoint.
+         */
+        SendChannel &get_send_channel(const boost::asio::ip::udp::endpoint &endpoint, uint16_t stream = 0);
+
+        /**
+         * @brief           Method reset_endpoint_channels resets every channel that sends to a remote endpoint.
+         * @param endpoint  const udp::endpoint & remote endpoint of the channels.
+         * @param error     const std::string & message of the error passed to the handlers of the abandoned messages.
+         */
+        void reset_endpoint_channels(const boost::asio::ip::udp::endpoint &endpoint, const std::string &error);
+
+        /**
+         * @brief           Method reset_send_channel abandons every message of a channel and resets its sequence to 0.
+         * @param channel   SendChannel & channel to be reset.
+         * @param error     const std::string & message of the error passed to the handlers of the abandoned messages.
+         */
+        void reset_send_channel(SendChannel &channel, const std::string &error);
+
+        /**
+         * @brief           Method send_window_base gets the sequence number of the oldest packet that has not been acknowledged.
+         * @param channel   SendChannel & channel of the send window.
+         * @return          uint32_t sequence number of the oldest packet in the send window, or the next sequence number
+         *                  to be sent if the window is empty.
+         */
+        uint32_t send_window_base(SendChannel &channel);
+
+        /**
+         * @brief           Method transmit_slot queues the packet held in a slot of the send window to be sent to the
+         *                  remote endpoint of the channel and sets the deadline for its retransmission.
+         * @param channel   SendChannel & channel of the send window.
+         * @param slot      SendSlot & slot of the send window to be transmitted.
+         * @note            The payload of the slot must stay in place until the send batch has been flushed.
+         */
+        void transmit_slot(SendChannel &channel, SendSlot &slot);
+
+        /**
+         * @brief   Method flush_send_batch sends every datagram in the send batch, abandoning the packets that
+         *          could not be sent.
+         */
+        void flush_send_batch();
+
+        /**
+         * @brief   Method send_datagrams sends the datagrams of the send batch, with sendmmsg where it is available.
+         */
+        void send_datagrams();
+
+#ifdef __linux__
+        /**
+         * @brief   Method send_segmented_datagrams sends the datagrams of the send batch with sendmmsg, each run of
+         *          datagrams to one endpoint of the same length sent as the segments of one UDP GSO send.
+         */
+        void send_segmented_datagrams();
+#endif
+
+        /**
+         * @brief           Method get_datagram_size gets the length in bytes of a datagram of the send batch.
+         * @param datagram  const OutgoingDatagram & datagram of the send batch.
+         * @return          size_t length of its header, payload and trailer.
+         */
+        static size_t get_datagram_size(const OutgoingDatagram &datagram);
+
+        /**
+         * @brief           Method set_socket_option sets an integer option of the socket.
+         * @param level     int level of the option, such as SOL_SOCKET.
+         * @param option    int name of the option.
+         * @param value     int value of the option.
+         * @param name      const std::string & name of the option in the error message.
+         * @throws          runtime_error if the kernel does not accept the option.
+         */
+        void set_socket_option(int level, int option, int value, const std::string &name);
+
+        /**
+         * @brief           Method get_socket_option gets an integer option of the socket.
+         * @param level     int level of the option, such as SOL_SOCKET.
+         * @param option    int name of the option.
+         * @param name      const std::string & name of the option in the error message.
+         * @return          int value of the option.
+         * @throws          runtime_error if the kernel does not report the option.
+         */
+        int get_socket_option(int level, int option, const std::string &name);
+
+        /**
+         * @brief           Method send_datagram sends one datagram of the send batch with Boost ASIO.
+         * @param datagram  OutgoingDatagram & datagram to be sent, which holds the result once it has been sent.
+         */
+        void send_datagram(OutgoingDatagram &datagram);
+
+        /**
+         * @brief   Method impair_datagrams passes the datagrams of the send batch through the impaired link, which
+         *          copies them, so they count as sent whether or not the link drops them.
+         */
+        void impair_datagrams();
+
+        /**
+         * @brief       Method send_impaired sends the datagrams of the impaired link that are due then sets the
+         *              impairment timer to the time at which the next one is due.
+         * @param now   const ptime & current time, or pos_infin to send every datagram held by the link.
+         */
+        void send_impaired(const boost::posix_time::ptime &now);
+
+        /**
+         * @brief 			Method handle_impairment_timer is the completion handler of the impairment timer.
+         * @param err		const boost::system::error_code & error of the wait.
+         */
+        void handle_impairment_timer(const boost::system::error_code &err);
+
+        /**
+         * @brief           Method fill_send_window moves messages from the send queue of a channel into its send window
+         *                  while there is space, giving each a sequence number and transmitting it.
+         * @param channel   SendChannel & channel to be filled.
+         */
+        void fill_send_window(SendChannel &channel);
+
+        /**
+         * @brief           Method coalesce_requests moves messages from the front of the send queue of a channel into
+         *                  one packet at the end of its send window, whose handler completes each of them.
+         * @param channel   SendChannel & channel whose messages are coalesced.
+         * @param count     size_t number of messages, which must all fit in one fragment with their lengths.
+         * @param len       int length in bytes of the payload of the packet.
+         * @return          SendSlot & slot of the packet, which has not been transmitted.
+         */
+        SendSlot &coalesce_requests(SendChannel &channel, size_t count, int len);
+
+        /**
+         * @brief           Method advance_send_window removes acknowledged slots from the front of the send window of a
+         *                  channel then fills the space that was freed.
+         * @param channel   SendChannel & channel to be advanced.
+         */
+        void advance_send_window(SendChannel &channel);
+
+        /**
+         * @brief           Method arm_timer sets the retransmission timer of a channel to the earliest deadline in its
+         *                  send window.
+         * @param channel   SendChannel & channel whose timer is set.
+         */
+        void arm_timer(SendChannel &channel);
+
+        /**
+         * @brief           Method abandon_slot removes a slot from the send window of a channel, along with every other
+         *                  fragment of its message, and fails the handler of the message.
+         * @param channel   SendChannel & channel of the send window.
+         * @param slot      deque<SendSlot>::iterator slot to be removed.
+         * @param error     const std::string & message of the error passed to the handler.
+         * @param expired   bool true if the message is dropped by its own lifetime or limit of transmissions, which is
+         *                  counted as expired and not reported by a later send or flush.
+         * @return          deque<SendSlot>::iterator slot following the removed slots.
+         */
+        PoolDeque<SendSlot>::iterator abandon_slot(SendChannel &channel, PoolDeque<SendSlot>::iterator slot, const std::string &error, bool expired = false);
+
+        /**
+         * @brief           Method send_to_endpoint sends a message to a remote endpoint, blocking as described for send().
+         * @param endpoint  const udp::endpoint & remote endpoint the message is sent to.
+         * @param buf       char * buffer that contains the data to be sent.
+         * @param len       int length in bytes of the data contained in buf.
+         * @param delivery  const Delivery & how the message is delivered.
+         * @return          int number of bytes successfully sent to the remote endpoint.
+         */
+        int send_to_endpoint(const boost::asio::ip::udp::endpoint &endpoint, const char *buf, int len, const Delivery &delivery);
+
+        /**
+         * @brief           Method async_send_to_endpoint queues a message for a remote endpoint then lets the IO service
+         *                  move it into the send window of the endpoint's channel.
+         * @param endpoint  const udp::endpoint & remote endpoint the message is sent to.
+         * @param buf       char * buffer that contains the data to be sent.
+         * @param len       int length in bytes of the data contained in buf.
+         * @param delivery  const Delivery & how the message is delivered.
+         * @param handler   CompletionHandler invoked once the message has been acknowledged or abandoned, may be empty.
+         * @param copy      bool true to copy the payload so the caller can reuse buf immediately, false to reference buf
+         *                  until the handler is invoked.
+         */
+        void async_send_to_endpoint(const boost::asio::ip::udp::endpoint &endpoint, const char *buf, int len, const Delivery &delivery, CompletionHandler handler, bool copy);
+
+        /**
+         * @brief           Method make_send_request makes the request of a message before it is queued, which can be
+         *                  done without holding the mutex.
+         * @param buf       char * buffer that contains the data to be sent.
+         * @param len       int length in bytes of the data contained in buf.
+         * @param delivery  const Delivery & how the message is delivered.
+         * @param handler   CompletionHandler invoked once the message has been acknowledged or abandoned, may be empty.
+         * @param copy      bool true to copy the payload, false to reference buf until the handler is invoked.
+         * @return          SendRequest request of the message, whose lifetime starts now.
+         */
+        SendRequest make_send_request(const char *buf, int len, const Delivery &delivery, CompletionHandler handler, bool copy);
+
+        /**
+         * @brief           Method queue_send_request queues the request of a message on a channel while holding the
+         *                  mutex, without moving it into the send window.
+         * @param channel   SendChannel & channel of the endpoint and stream of the message.
+         * @param request   SendRequest && request of a message whose delivery is valid.
+         */
+        void queue_send_request(SendChannel &channel, SendRequest &&request);
+
+        /**
+         * @brief           Method send_queue_ready checks if a blocking send can queue another message on a channel,
+         *                  which is once the send window has room and only messages waiting to be coalesced are queued.
+         * @param channel   SendChannel & channel of the message.
+         * @return          bool true if the message can be queued.
+         */
+        bool send_queue_ready(SendChannel &channel);
+
+        /**
+         * @brief           Method send_requests sends a batch of messages like send(), holding the mutex once for the
+         *                  batch and moving the messages into the send windows from the calling thread so that they are
+         *                  sent together, then waits for the messages sent with Stop-and-Wait to be acknowledged.
+         * @param messages  BatchMessage * destinations of the messages, whose results and errors are set.
+         * @param requests  std::vector<SendRequest> & requests of the messages, one for each message.
+         * @param results   std::vector<std::future<int>> & futures of the handlers of the requests sent with
+         *                  Stop-and-Wait, invalid for the others.
+         * @return          size_t number of messages sent.
+         */
+        size_t send_requests(BatchMessage *messages, std::vector<SendRequest> &requests, std::vector<std::future<int>> &results);
+
+        /**
+         * @brief           Method make_promise_handler makes a completion handler that fulfils a future.
+         * @param future    [out]   std::future<int> & set to the future of the handler.
+         * @return          CompletionHandler handler that sets the length or the error of the future.
+         */
+        static CompletionHandler make_promise_handler(std::future<int> &future);
+
+        /**
+         * @brief           Method make_blocking_handler makes a completion handler that sets the result of a blocking
+         *                  call, which only captures pointers so that making it does not allocate.
+         * @param result    BlockingResult & result set by the handler, which must outlive it.
+         * @return          CompletionHandler handler that sets the result then wakes the waiting caller.
+         */
+        CompletionHandler make_blocking_handler(BlockingResult &result);
+
+        /**
+         * @brief           Method parse_endpoint converts an address and port into a UDP endpoint.
+         * @param address   string address of the endpoint.
+         * @param port      unsigned short port number of the endpoint.
+         * @return          udp::endpoint endpoint with the address and port.
+         * @throws          runtime_error if the address is not valid.
+         */
+        static boost::asio::ip::udp::endpoint parse_endpoint(const std::string &address, unsigned short port);
+
+        /**
+         * @brief           Method discard_partial_message drops the fragments received so far of a message from a sender,
+         *                  giving any receive that was waiting for it back to the front of the waiting receives.
+         * @param channel   ReceiveChannel & channel of the sender.
+         */
+        void discard_partial_message(ReceiveChannel &channel);
+
+        /**
+         * @brief   Method evict_idle_peers removes the receive channels that have not received a packet for the peer
+         *          idle timeout and hold nothing that is owed to the sender or the application, and the send
+         *          channels that have not been used for as long and have nothing waiting or in flight.
+         */
+        void evict_idle_peers();
+
+        /**
+         * @brief           Method trace makes a trace record and gives it to the trace handler and the trace buffer,
+         *                  called through RUDP_TRACE so that it is compiled out above RUDP_TRACE_LEVEL.
+         * @param event     TraceEvent type of the event.
+         * @param endpoint  const udp::endpoint & endpoint the packet of the event was sent to or received from.
+         * @param sequence  uint32_t sequence number of the event.
+         * @param value     uint32_t first value of the event.
+         * @param extra     uint32_t second value of the event.
+         * @note            The caller must hold the mutex.
+         */
+        void trace(TraceEvent event, const boost::asio::ip::udp::endpoint &endpoint, uint32_t sequence, uint32_t value = 0, uint32_t extra = 0);
+
+        /**
+         * @brief       Method take_receive_buffer takes a buffer from the receive buffer pool, or a new one if it is empty.
+         * @param len   int length in bytes the buffer is resized to.
+         * @return      vector<char> buffer of len bytes.
+         */
+        std::vector<char> take_receive_buffer(int len);
 
-        /// Boost IO service for networking.
-        boost::asio::io_service io_service;
-        /// Socket over which packets will be sent/received.
-        boost::asio::ip::udp::socket socket{io_service};
-        /// Local endpoint where packets will be received.
-        boost::asio::ip::udp::endpoint endpoint_local;
-        /// Remote endpoint where packets will be sent.
-        boost::asio::ip::udp::endpoint endpoint_remote;
-        /// Flag for if the local endpoint has been set.
-        bool has_endpoint_local;
-        /// Flag for if the remote endpoint has been set.
-        bool has_endpoint_remote;
+        /**
+         * @brief   Method receive_queue_full checks if the receive queue holds as many messages as it is allowed to.
+         * @return  bool true if no more messages can be queued.
+         */
+        bool receive_queue_full();
 
-        /// Timeout after which the connection will retransmit a message.
-        int timeout_ms;
-		/// Timer for ACK timeouts.
-        boost::asio::deadline_timer timer{io_service};
-		/// Flag for if the timer has expired.
-        bool timer_expired;
-		/// Flag for if an ACK packet has been received (not if the ACK is valid) 
-        bool ack_packet_received;
+        /**
+         * @brief   Method serve_receive_requests gives the messages in the receive queue to the waiting receives in order.
+         */
+        void serve_receive_requests();
 
-        int send_retries_limit;
-        int send_retries;
+        /**
+         * @brief           Method copy_read_payload copies part of the payload of a datagram that was just read, and
+         *                  anything after it, to a buffer.
+         * @param dest      char * buffer the bytes are copied to, if they are in place in the read target only the
+         *                  rest is copied.
+         * @param packet    const char * start of the datagram in its read buffer.
+         * @param offset    int offset in bytes from the start of the payload of the first byte copied.
+         * @param len       int number of bytes copied.
+         */
+        void copy_read_payload(char *dest, const char *packet, int offset, int len);
 
-		/**
-		 * @brief 	Method check_deadline is for use in checking the ACK timeout timer deadline.
-		 * @details Upon completion of the timer, the timeout will be set to inifity and the timer_expired 
-		 * 			flag will be set.
-		 */
-        void check_deadline();
+        /**
+         * @brief           Method complete_receive writes the sender of a message to the output arguments of a
+         *                  receive whose buffer holds the message, then completes it.
+         * @param request   ReceiveRequest & receive being completed.
+         * @param len       int length in bytes of the message.
+         * @param sender    const udp::endpoint & endpoint that sent the message.
+         * @param stream    uint16_t stream the message was received on.
+         */
+        void complete_receive(ReceiveRequest &request, int len, const boost::asio::ip::udp::endpoint &sender, uint16_t stream);
 
-		/**
-		 * @brief 				Method handle_receive is for use in receiving ACKs after sending a packet.
-		 * @details 			The method is called when a packet is received, at which point it returns 
-		 * 						the size of the packet and any errors through output arguments. If a packet 
-		 * 						is successfully received, the method will set the ack_packet_received flag.
-		 * @param err 			[in]	error_code passed to the method by boost when a packet is received.
-		 * @param length 		[in]	size_t passed to the method by boost when a packet is received.
-		 * @param err_out 		[out]	error_code set by the method when a packet is received.
-		 * @param length_out	[out]	size_t set by the method when a packet is received.
-		 */
-        void handle_receive(const boost::system::error_code &err, std::size_t length, boost::system::error_code *err_out, std::size_t *length_out);
+        /**
+         * @brief   Method dispatch_completions invokes the completions collected by a handler then wakes any
+         *          caller blocked on the connection state. Must be called without holding the mutex.
+         */
+        void dispatch_completions();
+
+        /**
+         * @brief   Method close sends the delayed ACKs, closes the socket and the timers and fails any outstanding
+         *          operations. Must be called from the IO service without holding the mutex.
+         */
+        void close();
+
+        /**
+         * @brief   Method throw_send_window_error throws and clears the stored error of any abandoned packets.
+         * @throws  runtime_error if a packet has been abandoned since the last call.
+         */
+        void throw_send_window_error();
+
+        /**
+         * @brief           Method post posts a handler to the IO service, counting it until it runs so that
+         *                  getNextDeadline() knows the connection has work ready.
+         * @param handler   Handler handler to be run.
+         */
+        template <typename Handler>
+        void post(Handler handler)
+        {
+            ++posted_handlers;
+            io_service.post(make_pool_handler(buffer_pool, [this, handler]() mutable
+                                              {
+                --posted_handlers;
+                handler(); }));
+        }
+
+        /**
+         * @brief           Method wait_for_state waits until a condition on the connection state holds. A connection
+         *                  driven by an event loop runs its own IO service on the calling thread while it waits.
+         * @param lock      std::unique_lock<std::mutex> & lock of the mutex, held on entry and on return.
+         * @param ready     const std::function<bool()> & condition, checked while holding the mutex.
+         */
+        void wait_for_state(std::unique_lock<std::mutex> &lock, const std::function<bool()> &ready);
+
+        /**
+         * @brief           Method wait_for_result waits for the result of an operation. A connection driven by an
+         *                  event loop runs its own IO service on the calling thread while it waits.
+         * @param future    std::future<int> & future of the operation, which must be called without the mutex.
+         * @return          int result of the operation.
+         * @throws          the error of the operation if it failed.
+         */
+        int wait_for_result(std::future<int> &future);
+
+        /**
+         * @brief           Method wait_for_result waits for the result set by a handler of make_blocking_handler().
+         * @param result    BlockingResult & result of the operation, which must be called without the mutex.
+         * @return          int result of the operation.
+         * @throws          the error of the operation if it failed.
+         */
+        int wait_for_result(BlockingResult &result);
 
     public:
         /**
          * @brief               Constructor for the Connection class that opens the socket to be used.
-         * @param timeout_ms    int timeout in milliseconds after which messages will be retransmitted.
+         * @details             The connection is serviced by the IO service shared by the ConnectionController.
+         * @param timeout_ms    int timeout in milliseconds after which messages will be retransmitted, see setAdaptiveTimeout().
          * @throws              runtime_error if there is an error while opening the boost socket.
          */
         Connection(int timeout_ms);
 
         /**
-         * @brief Destructor for the Connection class which stops the IO service and closes the socket.
+         * @brief               Constructor for the Connection class that opens the socket to be used.
+         * @param timeout_ms    int timeout in milliseconds after which messages will be retransmitted, see setAdaptiveTimeout().
+         * @param io_service    io_service & IO service that will run the handlers of the connection. It must be
+         *                      run by exactly one other thread for as long as the connection exists.
+         * @param transport     int TRANSPORT_ASIO to send and receive the datagrams through the Boost ASIO reactor,
+         *                      or TRANSPORT_IO_URING to send and receive them through an io_uring on Linux.
+         * @throws              runtime_error if there is an error while opening the boost socket, the transport is
+         *                      not known or the io_uring cannot be set up.
+         */
+        Connection(int timeout_ms, boost::asio::io_service &io_service, int transport = DEFAULT_TRANSPORT);
+
+        /**
+         * @brief               Constructor for the Connection class that opens the socket to be used and owns the IO
+         *                      service that runs its handlers, which no thread runs. The application drives the
+         *                      connection from its own event loop with getFileDescriptor(), getNextDeadline() and
+         *                      process().
+         * @param timeout_ms    int timeout in milliseconds after which messages will be retransmitted, see setAdaptiveTimeout().
+         * @param io_service    std::unique_ptr<io_service> IO service that is only run by process() and by the
+         *                      blocking methods of the connection while they wait.
+         * @param transport     int TRANSPORT_ASIO or TRANSPORT_IO_URING, see Connection(int, io_service &, int).
+         * @throws              runtime_error if there is an error while opening the boost socket, the transport is
+         *                      not known or the io_uring cannot be set up.
+         */
+        Connection(int timeout_ms, std::unique_ptr<boost::asio::io_service> io_service, int transport = DEFAULT_TRANSPORT);
+
+        /**
+         * @brief   Destructor for the Connection class which closes the socket and fails any outstanding operations.
+         * @note    The destructor waits for the handlers of the connection to finish, so it must not be called from
+         *          the thread running the IO service, see destroy(). A connection that owns its IO service runs it on
+         *          the calling thread until they have finished.
          */
         ~Connection();
 
+        /**
+         * @brief               Method destroy deletes a connection from any thread. From a handler run by the IO service
+         *                      of the connection, such as a completion, it closes the connection straight away and
+         *                      defers the delete until the handlers its close aborted have run: to a handler posted to
+         *                      the IO service, or to the return of process() if the connection owns its IO service.
+         * @param connection    Connection * connection to destroy, which must not be used after the call.
+         */
+        static void destroy(Connection *connection);
+
         /**
          * @brief Delete the cloning constructor so the connection can't be copied.
          */
@@ -117,69 +1391,654 @@ namespace rudp
          * @brief       Method setEndpointLocal sets the local endpoint of the connection where packets will be received.
          * @param port  unsigned short port number that the socket should be bound to.
          * @throws      runtime_error if the socket could not be bound to the local endpoint.
-         * @note        This method resets the sequence number for receiving packets.  
+         * @note        This method resets the sequence number for receiving packets.
          */
         void setEndpointLocal(unsigned short port);
 
+        /**
+         * @brief               Method setEndpointLocal sets the local endpoint of the connection where packets will be
+         *                      received, optionally sharing the port with other connections.
+         * @details             With reuse_port the socket is bound with SO_REUSEPORT, so several connections can
+         *                      listen on the same port and the kernel spreads the peers across them by a hash of
+         *                      each datagram's addresses and ports. Every datagram of a peer reaches the same
+         *                      connection, which keeps the state of that peer to itself, until a connection is
+         *                      added to or removed from the port and the peers are hashed again.
+         * @param port          unsigned short port number that the socket should be bound to.
+         * @param reuse_port    bool true to share the port with the other connections that are bound to it with
+         *                      reuse_port by the same user.
+         * @throws              runtime_error if the socket could not be bound to the local endpoint, or the system
+         *                      does not support SO_REUSEPORT.
+         * @note                This method resets the sequence number for receiving packets.
+         */
+        void setEndpointLocal(unsigned short port, bool reuse_port);
+
         /**
          * @brief           Method setEndpointRemote sets the remote endpoint of the connection where packets will be sent.
          * @param address   string address that the packets should be sent to.
          * @param port      unsigned short port number that the packets should be sent to.
          * @throws          runtime_error if the remote endpoint could not be set.
-         * @note            This method resets the sequence number for sending packets.  
+         * @note            This method resets the sequence number for sending packets.
          */
         void setEndpointRemote(std::string address, unsigned short port);
 
         /**
-         * @brief                       Method setSendRetriesLimit sets the maximum number times the connection will attempt 
+         * @brief                       Method setSendRetriesLimit sets the maximum number times the connection will attempt
          *                              to send a packet before the send is aborted.
          * @param send_retries_limit    int maximum number of retries before the connection is aborted.
          */
         void setSendRetriesLimit(int send_retries_limit);
 
+        /**
+         * @brief           Method setAdaptiveTimeout sets if the retransmission timeout adapts to the round trip time.
+         * @details         An adaptive timeout is computed for each remote endpoint from the smoothed round trip time
+         *                  and its variation (Jacobson/Karels), only measuring packets that were not retransmitted,
+         *                  and doubles on every timeout until an ACK gives a new measurement. A fixed timeout always
+         *                  uses the timeout given to the constructor, which makes retransmissions deterministic.
+         * @param adaptive  bool true for an adaptive timeout (the default), false for a fixed timeout.
+         */
+        void setAdaptiveTimeout(bool adaptive);
+
+        /**
+         * @brief           Method setTimeoutLimits sets the range within which an adaptive timeout is kept.
+         * @param min_ms    int minimum timeout in milliseconds.
+         * @param max_ms    int maximum timeout in milliseconds, which also limits the backoff.
+         * @throws          runtime_error if the minimum is less than 1 or greater than the maximum.
+         */
+        void setTimeoutLimits(int min_ms, int max_ms);
+
+        /**
+         * @brief   Method getTimeout gets the current retransmission timeout for the remote endpoint.
+         * @return  int timeout in milliseconds.
+         */
+        int getTimeout();
+
+        /**
+         * @brief           Method getTimeout gets the current retransmission timeout for any remote endpoint.
+         * @param address   string address of the remote endpoint.
+         * @param port      unsigned short port number of the remote endpoint.
+         * @return          int timeout in milliseconds.
+         * @throws          runtime_error if the address is not valid.
+         */
+        int getTimeout(std::string address, unsigned short port);
+
+        /**
+         * @brief               Method setAckPolicy sets when the ACKs for received packets are sent.
+         * @details             An ACK acknowledges every packet delivered from a sender so far, so it can be sent once
+         *                      several packets are owed one, or carried by a packet of data going the other way. Packets are acknowledged straight
+         *                      away when the sender has nothing else in flight, as with Stop-and-Wait, or when they
+         *                      have already been delivered.
+         * @param ack_packets   int number of packets after which an ACK is sent.
+         * @param ack_delay_us  int maximum time in microseconds that an ACK is delayed, 0 to never delay ACKs.
+         * @throws              runtime_error if the number of packets is less than 1 or the delay is negative.
+         */
+        void setAckPolicy(int ack_packets, int ack_delay_us);
+
+        /**
+         * @brief               Method setWindowSize sets the maximum number of packets that can be in flight at once.
+         * @param window_size   int number of packets that can be sent before an ACK is received, 1 for Stop-and-Wait.
+         * @throws              runtime_error if the window size is less than 1.
+         */
+        void setWindowSize(int window_size);
+
+        /**
+         * @brief   Method getWindowSize gets the maximum number of packets that can be in flight at once.
+         * @return  int number of packets that can be sent before an ACK is received.
+         */
+        int getWindowSize();
+
+        /**
+         * @brief           Method setCongestionControl sets one of the built-in congestion controllers, which limit the
+         *                  packets in flight to each remote endpoint below the window size and pace them on the wire.
+         *                  Every send channel starts again with a new controller.
+         * @param algorithm int CONGESTION_CONTROL_NEWRENO (DEFAULT_CONGESTION_CONTROL), CONGESTION_CONTROL_BBR or
+         *                  CONGESTION_CONTROL_NONE to only be limited by the window size.
+         * @throws          runtime_error if the algorithm is not one of these.
+         */
+        void setCongestionControl(int algorithm);
+
+        /**
+         * @brief           Method setCongestionControl sets a congestion controller made by the application.
+         *                  Every send channel starts again with a new controller.
+         * @param factory   CongestionControlFactory function that makes the controller of each send channel, or an
+         *                  empty function to only be limited by the window size.
+         */
+        void setCongestionControl(CongestionControlFactory factory);
+
+        /**
+         * @brief           Method getCongestionWindow gets the number of packets that the congestion controller allows
+         *                  in flight to the remote endpoint.
+         * @return          int number of packets, the window size if the congestion is not controlled.
+         */
+        int getCongestionWindow();
+
+        /**
+         * @brief           Method getCongestionWindow gets the number of packets that the congestion controller allows
+         *                  in flight to any remote endpoint.
+         * @param address   string address of the remote endpoint.
+         * @param port      unsigned short port number of the remote endpoint.
+         * @return          int number of packets, the window size if the congestion is not controlled.
+         * @throws          runtime_error if the address is not valid.
+         */
+        int getCongestionWindow(std::string address, unsigned short port);
+
+        /**
+         * @brief                   Method setRateLimit limits the rate at which the connection sends data packets to
+         *                          all of its remote endpoints together, including their headers and retransmissions.
+         * @param bytes_per_s       uint64_t largest rate in bytes per second, 0 for no limit.
+         */
+        void setRateLimit(uint64_t bytes_per_s);
+
+        /**
+         * @brief   Method getRateLimit gets the limit of the rate at which the connection sends data packets.
+         * @return  uint64_t rate in bytes per second, 0 if there is no limit.
+         */
+        uint64_t getRateLimit();
+
+        /**
+         * @brief           Method setCoalescing packs small reliable messages queued for an endpoint together into one
+         *                  packet, up to the MTU, and the receiver delivers them as separate messages. A message
+         *                  waits up to the delay for more to share its packet, which is sent as soon as it is full
+         *                  or by flush().
+         * @details         Only messages sent in order without a lifetime or a limit of attempts are coalesced, and
+         *                  those in one packet are acknowledged and retransmitted together. A delay of 0 coalesces
+         *                  only the messages that are already queued, such as while the send window is full.
+         * @param delay_us  int longest time in microseconds that a message waits, -1 to send each message in its own
+         *                  packet (the default).
+         * @throws          runtime_error if the delay is less than -1.
+         */
+        void setCoalescing(int delay_us);
+
+        /**
+         * @brief       Method setMTU sets the largest IP packet that can be sent to the remote endpoints without being
+         *              fragmented by IP.
+         * @details     Messages that do not fit in one packet are split into fragments that each have their own sequence
+         *              number, so a lost fragment is the only part of the message that is retransmitted, and are
+         *              reassembled by the receiver. The MTU includes the IPv4 and UDP headers and the header of the packet.
+         * @param mtu   int MTU in bytes, DEFAULT_MTU by default.
+         * @throws      runtime_error if the MTU leaves no room for a payload or is larger than the largest IPv4 packet.
+         */
+        void setMTU(int mtu);
+
+        /**
+         * @brief   Method getMTU gets the largest IP packet that can be sent to the remote endpoints without being
+         *          fragmented by IP.
+         * @return  int MTU in bytes.
+         */
+        int getMTU();
+
+        /**
+         * @brief       Method setReceiveQueueLimit sets the maximum number of delivered messages that are held for
+         *              later receives. Messages arriving while the queue is full are not acknowledged so the sender
+         *              will retransmit them. Raising the limit above the capacity of the queue moves the queued
+         *              messages to a larger one.
+         * @param limit int maximum number of messages in the receive queue.
+         * @throws      runtime_error if the limit is less than 1.
+         */
+        void setReceiveQueueLimit(int limit);
+
+        /**
+         * @brief       Method setBufferPoolSize reserves the pool from which the connection takes the memory of its
+         *              send queues and windows, the copies of the payloads it sends and the operations of its socket
+         *              and timers. Freed blocks are reused, so a connection whose pool holds its working set sends
+         *              and receives without allocating. The pool grows by itself when it runs out and never shrinks.
+         * @param bytes int bytes the pool holds, DEFAULT_BUFFER_POOL_BYTES by default.
+         * @throws      runtime_error if the size is negative.
+         */
+        void setBufferPoolSize(int bytes);
+
+        /**
+         * @brief   Method getBufferPoolSize gets the number of bytes held by the buffer pool of the connection.
+         * @return  size_t bytes reserved or added since, whether their blocks are in use or free.
+         */
+        size_t getBufferPoolSize();
+
+        /**
+         * @brief               Method setSocketBufferSizes sets the sizes of the kernel buffers of the socket. Under a
+         *                      burst of datagrams from many senders a receive buffer of the default size overflows,
+         *                      and the datagrams the kernel drops, counted in kernel_drops by getStats(), are only
+         *                      recovered by retransmission. On Linux a size above net.core.rmem_max or wmem_max is
+         *                      forced if the process has CAP_NET_ADMIN, and otherwise limited to it.
+         * @param receive_bytes int size in bytes of the receive buffer (SO_RCVBUF), 0 to leave it as it is.
+         * @param send_bytes    int size in bytes of the send buffer (SO_SNDBUF), 0 to leave it as it is.
+         * @throws              runtime_error if a size is negative or the kernel does not accept it.
+         */
+        void setSocketBufferSizes(int receive_bytes, int send_bytes);
+
+        /**
+         * @brief   Method getReceiveBufferSize gets the size of the receive buffer of the socket as the kernel reports
+         *          it, which on Linux is double the size that was set to allow for its bookkeeping.
+         * @return  int size in bytes of the receive buffer.
+         */
+        int getReceiveBufferSize();
+
+        /**
+         * @brief   Method getSendBufferSize gets the size of the send buffer of the socket as the kernel reports it.
+         * @return  int size in bytes of the send buffer.
+         */
+        int getSendBufferSize();
+
+        /**
+         * @brief       Method setDSCP sets the Differentiated Services code point with which the datagrams of the
+         *              connection are marked, so that the network can queue them ahead of bulk traffic.
+         * @param dscp  int code point from 0 (best effort, the default) to 63, such as 46 for expedited forwarding.
+         * @throws      runtime_error if the code point is out of range or the kernel does not accept it.
+         */
+        void setDSCP(int dscp);
+
+        /**
+         * @brief               Method setBusyPoll sets how long a read of the socket busy polls the queue of the
+         *                      network device for datagrams rather than waiting for an interrupt (SO_BUSY_POLL),
+         *                      which lowers the latency of a receive at the cost of the CPU it spins on.
+         * @param busy_poll_us  int time in microseconds to busy poll for, 0 to wait for interrupts (the default).
+         * @throws              runtime_error if the time is negative, busy polling is not supported or the process
+         *                      lacks CAP_NET_ADMIN to raise it.
+         */
+        void setBusyPoll(int busy_poll_us);
+
+        /**
+         * @brief           Method setSegmentationOffload sets if consecutive datagrams of a batch to one endpoint with
+         *                  the same length are sent with one UDP GSO send, which the kernel or the network device
+         *                  splits, and if datagrams are received coalesced by UDP GRO and split by the connection. The
+         *                  datagrams on the wire are the same either way, so each end can set it on its own.
+         * @param enabled   bool true to use segmentation offload, false to send and receive every datagram on its own
+         *                  (the default).
+         * @throws          runtime_error if UDP GSO and GRO are not supported by the kernel or the connection uses the
+         *                  io_uring transport.
+         */
+        void setSegmentationOffload(bool enabled);
+
+        /**
+         * @brief               Method setPeerIdleTimeout sets how long the receive state of a sender is kept after its
+         *                      last packet. A sender heard from again after its state was evicted starts from its
+         *                      window base, as if it were new. The send state of a remote endpoint that has nothing
+         *                      waiting or in flight is evicted likewise, and the next message to it starts a new session.
+         * @param timeout_ms    int idle time in milliseconds after which the state of a sender is evicted, -1 to keep it
+         *                      for as long as the connection exists.
+         * @throws              runtime_error if the timeout is less than 1 and not -1.
+         */
+        void setPeerIdleTimeout(int timeout_ms);
+
+        /**
+         * @brief       Method setMaxMessageSize sets the size of the largest message that is received. The packets of
+         *              a larger message are dropped without being acknowledged, before any memory is taken for its
+         *              reassembly, so a sender cannot make the receiver hold more than this for each of its streams.
+         * @param size  int size in bytes, DEFAULT_MAX_MESSAGE_SIZE by default.
+         * @throws      runtime_error if the size is less than 1.
+         */
+        void setMaxMessageSize(int size);
+
+        /**
+         * @brief               Method setImpairment passes every datagram the connection sends through a link that
+         *                      drops, duplicates, delays and reorders them and limits their rate, from a seeded
+         *                      generator so that the same impairment of the same datagrams can be repeated. The
+         *                      datagrams held by a previous impairment are sent straight away.
+         * @param impairment    const Impairment & impairment of the datagrams sent.
+         * @throws              runtime_error if the impairment is not valid.
+         * @note                Only the datagrams sent are impaired, so impairing both directions of a connection
+         *                      needs both of its ends to be impaired.
+         */
+        void setImpairment(const Impairment &impairment);
+
+        /**
+         * @brief   Method clearImpairment stops impairing the datagrams the connection sends, sending the datagrams
+         *          held by the impaired link straight away.
+         */
+        void clearImpairment();
+
+        /**
+         * @brief   Method getPeerCount gets the number of senders whose receive state is being kept, counting each
+         *          stream that a sender has sent on.
+         * @return  int number of streams of senders.
+         */
+        int getPeerCount();
+
+        /**
+         * @brief   Method getStats gets the counters of the packets and messages the connection has sent and received,
+         *          without locking the connection.
+         * @return  ConnectionStats copy of the counters.
+         */
+        ConnectionStats getStats();
+
+        /**
+         * @brief           Method setTraceHandler sets a function that is given every trace record of the connection.
+         * @param handler   TraceHandler function called from any thread while the connection mutex is held, so it
+         *                  must be quick and must not call the connection, or an empty function to stop calling it.
+         */
+        void setTraceHandler(TraceHandler handler);
+
+        /**
+         * @brief           Method setTraceBuffer sets the size of a lock-free ring that keeps the trace records of the
+         *                  connection until they are read with readTrace(), dropping records while it is full.
+         * @param capacity  size_t maximum number of records held, 0 to stop keeping them.
+         */
+        void setTraceBuffer(size_t capacity);
+
+        /**
+         * @brief           Method readTrace takes the oldest records from the trace buffer without locking the
+         *                  connection. Only one thread may read the trace at a time.
+         * @param records   [out]   TraceRecord * array to which the records will be written.
+         * @param count     size_t maximum number of records to take.
+         * @return          size_t number of records taken, 0 if there is no trace buffer.
+         */
+        size_t readTrace(TraceRecord *records, size_t count);
+
+        /**
+         * @brief   Method getTraceDropped gets the number of records dropped because the trace buffer was full.
+         * @return  uint64_t number of records dropped, 0 if there is no trace buffer.
+         */
+        uint64_t getTraceDropped();
+
+        /**
+         * @brief   Method isExternallyDriven gets if the connection is driven by the application's event loop.
+         * @return  bool true if the connection owns its IO service, false if it is run by a thread of the controller.
+         */
+        bool isExternallyDriven();
+
+        /**
+         * @brief   Method getFileDescriptor gets the descriptor of the socket of the connection, or of the eventfd of
+         *          its ring with the io_uring transport, which an event loop waits to become readable before calling
+         *          process(). The descriptor must not be read, written or closed by the application.
+         * @return  int descriptor of the socket or eventfd.
+         */
+        int getFileDescriptor();
+
+        /**
+         * @brief   Method getNextDeadline gets the time by which process() must next be called if the socket does
+         *          not become readable first, the earliest of the retransmission, pacing, delayed ACK and
+         *          impairment timers of the connection. It is the current time if handlers are ready to run, such
+         *          as the completions of a call made since process() last returned.
+         * @return  ptime time in the clock of boost::asio::deadline_timer, pos_infin if no timer is armed.
+         */
+        boost::posix_time::ptime getNextDeadline();
+
+        /**
+         * @brief   Method process runs the handlers of the connection that are ready without blocking: it reads
+         *          the datagrams waiting on the socket, handles the timers that have expired and invokes the
+         *          completions of the asynchronous operations. It must not be called by more than one thread at a
+         *          time, or while a blocking method of the connection is waiting. If a handler destroyed the
+         *          connection with destroy(), it is deleted before process() returns.
+         * @return  size_t number of handlers run.
+         * @throws  runtime_error if the connection is not driven by an event loop.
+         */
+        size_t process();
+
         /**
          * @brief Method resetConnectionReceive resets the sequence number of all the receive channels.
          */
         void resetConnectionReceive();
 
         /**
-         * @brief Method resetConnectionSend resets the sequence number of the send channel to 0.
+         * @brief Method resetConnectionSend resets the sequence number of every send channel to 0.
+         * @note  Messages that are in flight or waiting to be sent are abandoned.
          */
         void resetConnectionSend();
 
+        /**
+         * @brief           Method resetConnectionSend resets the sequence number of the send channel to one remote endpoint to 0.
+         * @param address   string address of the remote endpoint.
+         * @param port      unsigned short port number of the remote endpoint.
+         * @throws          runtime_error if the address is not valid.
+         * @note            Messages to the endpoint that are in flight or waiting to be sent are abandoned.
+         */
+        void resetConnectionSend(std::string address, unsigned short port);
+
         /**
          * @brief       Method send sends the data contained in the buffer to the remote endpoint that was previously set.
          * @param buf   char * buffer that contains the data to be sent.
-         * @param len   int length in bytes of the data contained in buf. 
+         * @param len   int length in bytes of the data contained in buf.
          * @return      int number of bytes successfully sent to the remote endpoint.
-         * @throws      runtime_error if 
-         *                  - remote endpoint has not been set, 
-         *                  - timeout of the socket could not be set, 
+         * @throws      runtime_error if
+         *                  - remote endpoint has not been set,
+         *                  - timeout of the socket could not be set,
          *                  - data could not be written to the send buffer properly,
          *                  - an error occured while sending the packet using Boost ASIO,
          *                  - an error occured while receiving an ACK from the remote endpoint.
-         * @note        The method will continue to re-send the message until an ACK with the correct sequence number is received. 
+         * @note        With a window size of 1 the method will continue to re-send the message until an ACK with the correct
+         *              sequence number is received. With a larger window the method returns once the message is in the send
+         *              window, only blocking while the window is full, and errors of abandoned messages are thrown by a later
+         *              call to send() or flush().
          */
         int send(const char *buf, int len);
 
         /**
-         * @brief           Method receive receives a packet that another Connection object has sent to the 
-         *                  previously specified local endpoint then replies with an ACK. 
-         * @param buf       [out]   char * buffer to which the received data will be written.  
+         * @brief           Method send sends the data contained in the buffer to the remote endpoint with a delivery class.
+         * @param buf       char * buffer that contains the data to be sent.
+         * @param len       int length in bytes of the data contained in buf.
+         * @param delivery  const Delivery & how the message is delivered.
+         * @return          int number of bytes sent, or queued to be sent for an unreliable message.
+         * @throws          runtime_error for any of the reasons send() would throw, or if an unreliable message does
+         *                  not fit in one packet.
+         * @note            An unreliable message is copied and sent without waiting for the send window, and the
+         *                  method returns straight away. A message with a lifetime or a limit of transmissions that is
+         *                  dropped is thrown by this call with a window size of 1, but is not reported by a later call
+         *                  to send() or flush().
+         */
+        int send(const char *buf, int len, const Delivery &delivery);
+
+        /**
+         * @brief           Method asyncSend starts sending the data contained in the buffer to the remote endpoint and
+         *                  returns immediately.
+         * @param buf       char * buffer that contains the data to be sent, it must remain valid until the handler is invoked.
+         * @param len       int length in bytes of the data contained in buf.
+         * @param handler   CompletionHandler invoked on the IO service once the message has been acknowledged, with the
+         *                  number of bytes sent, or once it has failed for any of the reasons send() would throw.
+         * @note            Messages are sent in the order their sends were started, at most window size at a time.
+         */
+        void asyncSend(const char *buf, int len, CompletionHandler handler);
+
+        /**
+         * @brief           Method asyncSend starts sending the data contained in the buffer to the remote endpoint with
+         *                  a delivery class and returns immediately.
+         * @param buf       char * buffer that contains the data to be sent, it must remain valid until the handler is invoked.
+         * @param len       int length in bytes of the data contained in buf.
+         * @param delivery  const Delivery & how the message is delivered.
+         * @param handler   CompletionHandler invoked as described for asyncSend(), once an unreliable message has been
+         *                  sent, or with an error once a message is dropped by its lifetime or limit of transmissions.
+         */
+        void asyncSend(const char *buf, int len, const Delivery &delivery, CompletionHandler handler);
+
+        /**
+         * @brief       Method asyncSend starts sending the data contained in the buffer to the remote endpoint and
+         *              returns immediately.
+         * @param buf   char * buffer that contains the data to be sent, it must remain valid until the future is ready.
+         * @param len   int length in bytes of the data contained in buf.
+         * @return      future<int> holding the number of bytes sent once the message has been acknowledged, or the
+         *              runtime_error that send() would throw.
+         */
+        std::future<int> asyncSend(const char *buf, int len);
+
+        /**
+         * @brief           Method sendTo sends the data contained in the buffer to any remote endpoint, using a separate
+         *                  sequence number and send window for each one so that a single socket can serve many peers.
+         * @param buf       char * buffer that contains the data to be sent.
+         * @param len       int length in bytes of the data contained in buf.
+         * @param address   string address that the packet should be sent to.
+         * @param port      unsigned short port number that the packet should be sent to.
+         * @return          int number of bytes successfully sent to the remote endpoint.
+         * @throws          runtime_error if the address is not valid or for any of the reasons send() would throw.
+         * @note            The method blocks in the same way as send().
+         */
+        int sendTo(const char *buf, int len, std::string address, unsigned short port);
+
+        /**
+         * @brief           Method sendTo sends the data contained in the buffer to any remote endpoint with a delivery class.
+         * @param buf       char * buffer that contains the data to be sent.
+         * @param len       int length in bytes of the data contained in buf.
+         * @param address   string address that the packet should be sent to.
+         * @param port      unsigned short port number that the packet should be sent to.
+         * @param delivery  const Delivery & how the message is delivered.
+         * @return          int number of bytes sent, or queued to be sent for an unreliable message.
+         * @throws          runtime_error if the address is not valid or for any of the reasons send() would throw.
+         */
+        int sendTo(const char *buf, int len, std::string address, unsigned short port, const Delivery &delivery);
+
+        /**
+         * @brief           Method asyncSendTo starts sending the data contained in the buffer to any remote endpoint and
+         *                  returns immediately.
+         * @param buf       char * buffer that contains the data to be sent, it must remain valid until the handler is invoked.
+         * @param len       int length in bytes of the data contained in buf.
+         * @param address   string address that the packet should be sent to.
+         * @param port      unsigned short port number that the packet should be sent to.
+         * @param handler   CompletionHandler invoked as described for asyncSend().
+         * @throws          runtime_error if the address is not valid.
+         */
+        void asyncSendTo(const char *buf, int len, std::string address, unsigned short port, CompletionHandler handler);
+
+        /**
+         * @brief           Method asyncSendTo starts sending the data contained in the buffer to any remote endpoint
+         *                  with a delivery class and returns immediately.
+         * @param buf       char * buffer that contains the data to be sent, it must remain valid until the handler is invoked.
+         * @param len       int length in bytes of the data contained in buf.
+         * @param address   string address that the packet should be sent to.
+         * @param port      unsigned short port number that the packet should be sent to.
+         * @param delivery  const Delivery & how the message is delivered.
+         * @param handler   CompletionHandler invoked as described for asyncSend() with a delivery class.
+         * @throws          runtime_error if the address is not valid.
+         */
+        void asyncSendTo(const char *buf, int len, std::string address, unsigned short port, const Delivery &delivery, CompletionHandler handler);
+
+        /**
+         * @brief           Method asyncSendTo starts sending the data contained in the buffer to any remote endpoint and
+         *                  returns immediately.
+         * @param buf       char * buffer that contains the data to be sent, it must remain valid until the future is ready.  
+         * @param len       int length in bytes of the data contained in buf.
+         * @param address   string address that the packet should be sent to.
+         * @param port      unsigned short port number that the packet should be sent to.
+         * @return          future<int> as described for asyncSend().
+         * @throws          runtime_error if the address is not valid.
+         */
+        std::future<int> asyncSendTo(const char *buf, int len, std::string address, unsigned short port);
+
+        /**
+         * @brief       Method sendv sends one message gathered from an array of buffers to the remote endpoint that was
+         *              previously set, blocking as described for send().
+         * @param iov   const struct iovec * buffers that contain the data of the message, in order.
+         * @param count int number of buffers.
+         * @return      int number of bytes successfully sent to the remote endpoint.
+         * @throws      runtime_error as described for send().
+         */
+        int sendv(const struct iovec *iov, int count);
+
+        /**
+         * @brief           Method sendv sends one message gathered from an array of buffers to the remote endpoint that
+         *                  was previously set with a delivery class, blocking as described for send().
+         * @param iov       const struct iovec * buffers that contain the data of the message, in order.
+         * @param count     int number of buffers.
+         * @param delivery  const Delivery & how the message is delivered.
+         * @return          int number of bytes successfully sent to the remote endpoint.
+         * @throws          runtime_error as described for send().
+         */
+        int sendv(const struct iovec *iov, int count, const Delivery &delivery);
+
+        /**
+         * @brief           Method sendBatch sends each message of a batch as send() or sendTo() would, locking the
+         *                  connection once for the batch and sending the packets of its messages together.
+         * @details         A message that fails does not stop the rest of the batch. Errors of earlier messages sent
+         *                  without a handler fail the first message of the batch, which is not sent. The buffers may
+         *                  be reused once the batch returns.
+         * @param messages  [in, out]   BatchMessage * messages, whose result is set to the number of bytes sent or to
+         *                  -1 with the error of the message.
+         * @param count     size_t number of messages.
+         * @return          size_t number of messages sent.
+         */
+        size_t sendBatch(BatchMessage *messages, size_t count);
+
+        /**
+         * @brief   Method flush sends the messages waiting to be coalesced then blocks until every packet in the send
+         *          windows has been acknowledged or abandoned.
+         * @throws  runtime_error if
+         *              - a packet in the window was abandoned after reaching the send retries limit,
+         *              - an error occured while sending a packet or receiving an ACK using Boost ASIO.
+         */
+        void flush();
+
+        /**
+         * @brief           Method receive receives a packet that another Connection object has sent to the
+         *                  previously specified local endpoint then replies with an ACK.
+         * @param buf       [out]   char * buffer to which the received data will be written.
          * @param len       [in]    int length of the provided buffer in bytes.
          * @param address   [out]   char * address from which the packet was received.
          * @param port      [out]   int * port from which the packet was received.
          * @return          int number of bytes written to the buffer.
          * @throws          runtime_error if
          *                      - local endpoint has not been set,
-         *                      - timeout of the socket could not be set, 
+         *                      - timeout of the socket could not be set,
          *                      - if the buffer length is not long enough to accomodate the received data,
          *                      - the received data could not be copied to the buffer.
-         * @note            The method will send ACKs for messages with sequence numbers less than the current sequence but will 
+         * @note            The method will send ACKs for messages with sequence numbers less than the current sequence but will
          *                  not return and populate the output arguments until a message with the correct sequence number is received.
+         *                  A message that was sent in fragments is reassembled straight into buf if the receive is waiting for it.
+         *                  A message that is already queued is taken without locking the connection, so any number of threads
+         *                  can receive from the same connection at once.
          */
         int receive(char *buf, int len, char *address, int *port);
+
+        /**
+         * @brief           Method receive receives a message as described for receive(), along with the stream it was
+         *                  sent on.
+         * @param buf       [out]   char * buffer to which the received data will be written.
+         * @param len       [in]    int length of the provided buffer in bytes.
+         * @param address   [out]   char * address from which the packet was received.
+         * @param port      [out]   int * port from which the packet was received.
+         * @param stream    [out]   uint16_t * stream on which the message was sent.
+         * @return          int number of bytes written to the buffer.
+         * @throws          runtime_error for the reasons receive() would throw.
+         * @note            Messages are delivered in order within each stream, but a message on one stream does not wait
+         *                  for the messages of the others.
+         */
+        int receive(char *buf, int len, char *address, int *port, uint16_t *stream);
+
+        /**
+         * @brief           Method receiveBatch waits for the next message like receive(), then takes the messages that
+         *                  are already queued, up to the number of buffers, without waiting for more.
+         * @param messages  [in, out]   BatchMessage * buffers and their lengths, whose results are set to the length
+         *                  of the message received with its address, port and stream, or to -1 with the error.
+         * @param count     size_t number of buffers.
+         * @return          size_t number of messages whose results were set, the last of which failed if its buffer was
+         *                  too small for the next message, which is kept for the next receive.
+         */
+        size_t receiveBatch(BatchMessage *messages, size_t count);
+
+        /**
+         * @brief           Method asyncReceive starts a receive of the next message and returns immediately.
+         * @param buf       [out]   char * buffer to which the received data will be written, it must remain valid until
+         *                          the handler is invoked.
+         * @param len       [in]    int length of the provided buffer in bytes.
+         * @param address   [out]   char * address from which the packet was received.
+         * @param port      [out]   int * port from which the packet was received.
+         * @param handler   [in]    CompletionHandler invoked on the IO service once the output arguments have been
+         *                          written, with the number of bytes written to the buffer, or once the receive has
+         *                          failed for any of the reasons receive() would throw.
+         * @note            Receives are given messages in the order they were started.
+         */
+        void asyncReceive(char *buf, int len, char *address, int *port, CompletionHandler handler);
+
+        /**
+         * @brief           Method asyncReceive starts a receive of the next message and of the stream it was sent on,
+         *                  then returns immediately.
+         * @param buf       [out]   char * buffer to which the received data will be written, it must remain valid until
+         *                          the handler is invoked.
+         * @param len       [in]    int length of the provided buffer in bytes.
+         * @param address   [out]   char * address from which the packet was received.
+         * @param port      [out]   int * port from which the packet was received.
+         * @param stream    [out]   uint16_t * stream on which the message was sent, it must remain valid until the
+         *                          handler is invoked.
+         * @param handler   [in]    CompletionHandler invoked as described for asyncReceive().
+         */
+        void asyncReceive(char *buf, int len, char *address, int *port, uint16_t *stream, CompletionHandler handler);
+
+        /**
+         * @brief           Method asyncReceive starts a receive of the next message and returns immediately.
+         * @param buf       [out]   char * buffer to which the received data will be written, it must remain valid until
+         *                          the future is ready.
+         * @param len       [in]    int length of the provided buffer in bytes.
+         * @param address   [out]   char * address from which the packet was received.
+         * @param port      [out]   int * port from which the packet was received.
+         * @return          future<int> holding the number of bytes written to the buffer, or the runtime_error that
+         *                  receive() would throw.
+         */
+        std::future<int> asyncReceive(char *buf, int len, char *address, int *port);
     };
 }
 
-#endif /* CONNECTION_HPP */
\ No newline at end of file
+#endif /* CONNECTION_HPP */
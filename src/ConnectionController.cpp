@@ -14,54 +14,384 @@
 
 #include "ConnectionController.hpp"
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 using namespace rudp;
 
-ConnectionController *ConnectionController::instance = nullptr;
+std::atomic<ConnectionController *> ConnectionController::instance(nullptr);
 
 std::mutex ConnectionController::io_mutex;
 
-std::map<int, Connection*> ConnectionController::connections;
+std::atomic<ConnectionController::Slot *> ConnectionController::slot_blocks[ConnectionController::SLOT_BLOCK_COUNT];
+
+uint32_t ConnectionController::slot_count = 0;
+
+std::vector<uint32_t> ConnectionController::free_slots;
+
+ConnectionStats ConnectionController::removed_stats;
+
+std::vector<boost::asio::io_service *> ConnectionController::io_services;
+
+std::vector<boost::asio::io_service::work *> ConnectionController::io_service_works;
+
+std::vector<std::thread *> ConnectionController::io_service_threads;
+
+int ConnectionController::io_service_count = DEFAULT_IO_SERVICE_COUNT;
 
-int ConnectionController::connection_count = 0;
+bool ConnectionController::io_service_pinning = true;
+
+size_t ConnectionController::io_service_next = 0;
 
 ConnectionController::ConnectionController() { }
 
+ConnectionRef::~ConnectionRef()
+{
+    if (connection != nullptr)
+    {
+        ConnectionController::release_connection(index);
+    }
+}
+
 ConnectionController *ConnectionController::getInstance()
 {
-    std::lock_guard<std::mutex> lock(io_mutex);
-    if (instance == nullptr)
+    // Only the first call takes the mutex, every later call reads the published instance.
+    ConnectionController *controller = instance.load(std::memory_order_acquire);
+    if (controller == nullptr)
     {
-        instance = new ConnectionController();
+        std::lock_guard<std::mutex> lock(io_mutex);
+        controller = instance.load(std::memory_order_relaxed);
+        if (controller == nullptr)
+        {
+            controller = new ConnectionController();
+            instance.store(controller, std::memory_order_release);
+        }
     }
-    return instance;
+    return controller;
 }
 
 int ConnectionController::addConnection()
 {
-    std::lock_guard<std::mutex> lock(io_mutex);
-    ++connection_count;
-    connections[connection_count] = new Connection(DEFAULT_TIMEOUT_MS);
-    return connection_count;
+    return addConnection(DEFAULT_TIMEOUT_MS);
 }
 
 int ConnectionController::addConnection(int timeout_ms)
 {
-    std::lock_guard<std::mutex> lock(io_mutex);
-    ++connection_count;
-    connections[connection_count] = new Connection(timeout_ms);
-    return connection_count;
+    return addConnection(timeout_ms, DEFAULT_TRANSPORT);
+}
+
+int ConnectionController::addConnection(int timeout_ms, int transport)
+{
+    std::unique_lock<std::mutex> lock(io_mutex);
+    boost::asio::io_service &io_service = next_io_service();
+    lock.unlock();
+    return insert_connection(new Connection(timeout_ms, io_service, transport));
+}
+
+int ConnectionController::addExternalConnection(int timeout_ms, int transport)
+{
+    return insert_connection(new Connection(timeout_ms, std::unique_ptr<boost::asio::io_service>(new boost::asio::io_service()), transport));
+}
+
+std::vector<int> ConnectionController::addShardedConnections(int timeout_ms, unsigned short port, int shards, int transport)
+{
+    if (shards < 0)
+    {
+        throw std::runtime_error("[RUDP] (ERROR) [INIT] Error adding sharded connections: the number of shards cannot be negative.");
+    }
+    std::vector<boost::asio::io_service *> shard_io_services;
+    std::unique_lock<std::mutex> lock(io_mutex);
+    start_io_services();
+    if (shards == 0)
+    {
+        shards = io_services.size();
+    }
+    for (int i = 0; i < shards; i++)
+    {
+        shard_io_services.push_back(io_services[i % io_services.size()]);
+    }
+    lock.unlock();
+
+    std::vector<int> connection_numbers;
+    try
+    {
+        for (boost::asio::io_service *io_service : shard_io_services)
+        {
+            connection_numbers.push_back(insert_connection(new Connection(timeout_ms, *io_service, transport)));
+            getConnection(connection_numbers.back())->setEndpointLocal(port, true);
+        }
+    }
+    catch (...)
+    {
+        for (int connection_number : connection_numbers)
+        {
+            removeConnection(connection_number);
+        }
+        throw;
+    }
+    return connection_numbers;
 }
 
 void ConnectionController::removeConnection(int connection_number)
 {
-    std::lock_guard<std::mutex> lock(io_mutex);
-    connections.erase(connection_number);
+    uint32_t index;
+    Slot *slot = find_slot(connection_number, index);
+    if (slot == nullptr)
+    {
+        return;
+    }
+    // Clear the live bit so no new references are taken, then destroy the connection unless references are held.
+    uint64_t state = slot->state.load();
+    do
+    {
+        if (!is_live(state, connection_number))
+        {
+            return;
+        }
+    } while (!slot->state.compare_exchange_weak(state, state & ~SLOT_LIVE));
+    if ((state & SLOT_REFS) == 0)
+    {
+        destroy_connection(index);
+    }
 }
 
 rudp::Connection *ConnectionController::getConnection(int connection_number)
 {
+    uint32_t index;
+    Slot *slot = find_slot(connection_number, index);
+    if (slot != nullptr)
+    {
+        uint64_t state = slot->state.load(std::memory_order_acquire);
+        if (is_live(state, connection_number))
+        {
+            return slot->connection;
+        }
+    }
+    throw std::runtime_error("[RUDP] (ERROR) [INIT] Error getting connection " + std::to_string(connection_number) + ": no such connection.");
+}
+
+ConnectionRef ConnectionController::acquireConnection(int connection_number)
+{
+    uint32_t index;
+    Slot *slot = find_slot(connection_number, index);
+    if (slot != nullptr)
+    {
+        // Count the reference only while the slot is live with the generation of the number, so a connection
+        // that has been removed (or whose slot has been reused) can not be referenced again.
+        uint64_t state = slot->state.load(std::memory_order_acquire);
+        while (is_live(state, connection_number))
+        {
+            if (slot->state.compare_exchange_weak(state, state + 1))
+            {
+                return ConnectionRef(slot->connection, index);
+            }
+        }
+    }
+    throw std::runtime_error("[RUDP] (ERROR) [INIT] Error getting connection " + std::to_string(connection_number) + ": no such connection.");
+}
+
+void ConnectionController::setIOServiceCount(int count, bool pin_to_cores)
+{
+    std::lock_guard<std::mutex> lock(io_mutex);
+    if (!io_services.empty())
+    {
+        throw std::runtime_error("[RUDP] (ERROR) [INIT] Error setting IO service count: the IO services have already been started.");
+    }
+    if (count < 0)
+    {
+        throw std::runtime_error("[RUDP] (ERROR) [INIT] Error setting IO service count: cannot be a negative number.");
+    }
+    io_service_count = count;
+    io_service_pinning = pin_to_cores;
+}
+
+int ConnectionController::getIOServiceCount()
+{
+    std::lock_guard<std::mutex> lock(io_mutex);
+    start_io_services();
+    return io_services.size();
+}
+
+boost::asio::io_service &ConnectionController::getIOService()
+{
+    std::lock_guard<std::mutex> lock(io_mutex);
+    return next_io_service();
+}
+
+boost::asio::io_service &ConnectionController::getIOService(size_t key)
+{
+    std::lock_guard<std::mutex> lock(io_mutex);
+    start_io_services();
+    return *io_services[key % io_services.size()];
+}
+
+ConnectionStats ConnectionController::getStats()
+{
+    std::unique_lock<std::mutex> lock(io_mutex);
+    ConnectionStats stats = removed_stats;
+    uint32_t count = slot_count;
+    lock.unlock();
+    // Reference each live connection while reading it, releasing it without the mutex as that may destroy it.
+    for (uint32_t index = 0; index < count; index++)
+    {
+        Slot &slot = get_slot(index);
+        uint64_t state = slot.state.load(std::memory_order_acquire);
+        while ((state & SLOT_LIVE) != 0)
+        {
+            if (slot.state.compare_exchange_weak(state, state + 1))
+            {
+                stats += slot.connection->getStats();
+                release_connection(index);
+                break;
+            }
+        }
+    }
+    return stats;
+}
+
+ConnectionController::Slot *ConnectionController::find_slot(int connection_number, uint32_t &index)
+{
+    if (connection_number <= 0)
+    {
+        return nullptr;
+    }
+    uint32_t index_plus_one = (uint32_t)connection_number & MAX_CONNECTIONS;
+    if (index_plus_one == 0)
+    {
+        return nullptr;
+    }
+    index = index_plus_one - 1;
+    Slot *block = slot_blocks[index / SLOT_BLOCK_SIZE].load(std::memory_order_acquire);
+    if (block == nullptr)
+    {
+        return nullptr;
+    }
+    return &block[index % SLOT_BLOCK_SIZE];
+}
+
+ConnectionController::Slot &ConnectionController::get_slot(uint32_t index)
+{
+    return slot_blocks[index / SLOT_BLOCK_SIZE].load(std::memory_order_acquire)[index % SLOT_BLOCK_SIZE];
+}
+
+void ConnectionController::release_connection(uint32_t index)
+{
+    uint64_t state = get_slot(index).state.fetch_sub(1) - 1;
+    if ((state & SLOT_LIVE) == 0 && (state & SLOT_REFS) == 0)
+    {
+        destroy_connection(index);
+    }
+}
+
+void ConnectionController::destroy_connection(uint32_t index)
+{
+    // Nothing can reference the connection any more, so it is destroyed outside the mutex as it waits for its IO
+    // service, or deferred to it when called from one of its handlers, then the slot is given its next generation
+    // and freed.
+    Slot &slot = get_slot(index);
+    ConnectionStats stats = slot.connection->getStats();
+    Connection::destroy(slot.connection);
+    slot.connection = nullptr;
     std::lock_guard<std::mutex> lock(io_mutex);
-    return connections.at(connection_number);
+    removed_stats += stats;
+    uint64_t generation = (slot.state.load() >> 32) + 1;
+    slot.state.store(generation << 32);
+    free_slots.push_back(index);
+}
+
+int ConnectionController::insert_connection(Connection *connection)
+{
+    std::unique_lock<std::mutex> lock(io_mutex);
+    uint32_t index;
+    if (!free_slots.empty())
+    {
+        index = free_slots.back();
+        free_slots.pop_back();
+    }
+    else if (slot_count < MAX_CONNECTIONS)
+    {
+        index = slot_count++;
+        if (slot_blocks[index / SLOT_BLOCK_SIZE].load(std::memory_order_relaxed) == nullptr)
+        {
+            slot_blocks[index / SLOT_BLOCK_SIZE].store(new Slot[SLOT_BLOCK_SIZE], std::memory_order_release);
+        }
+    }
+    else
+    {
+        lock.unlock();
+        delete connection;
+        throw std::runtime_error("[RUDP] (ERROR) [INIT] Error adding connection: the limit of " + std::to_string(MAX_CONNECTIONS) + " connections has been reached.");
+    }
+    // Publish the connection before making the slot live, so any thread that references it sees it.
+    Slot &slot = get_slot(index);
+    slot.connection = connection;
+    uint64_t generation = slot.state.load() >> 32;
+    slot.state.store((generation << 32) | SLOT_LIVE, std::memory_order_release);
+    return (int)(((generation & SLOT_GENERATION_MASK) << SLOT_INDEX_BITS) | (index + 1));
+}
+
+bool ConnectionController::is_live(uint64_t state, int connection_number)
+{
+    return (state & SLOT_LIVE) != 0 && ((state >> 32) & SLOT_GENERATION_MASK) == (uint64_t)(connection_number >> SLOT_INDEX_BITS);
+}
+
+boost::asio::io_service &ConnectionController::next_io_service()
+{
+    start_io_services();
+    boost::asio::io_service &io_service = *io_services[io_service_next];
+    io_service_next = (io_service_next + 1) % io_services.size();
+    return io_service;
+}
+
+void ConnectionController::start_io_services()
+{
+    if (!io_services.empty())
+    {
+        return;
+    }
+
+    unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+    int count = io_service_count > 0 ? io_service_count : cores;
+    for (int i = 0; i < count; i++)
+    {
+        boost::asio::io_service *io_service = new boost::asio::io_service();
+        io_services.push_back(io_service);
+        io_service_works.push_back(new boost::asio::io_service::work(*io_service));
+        io_service_threads.push_back(new std::thread([io_service]()
+                                                     {
+            // Keep running the IO service if a completion handler throws.
+            while (true)
+            {
+                try
+                {
+                    io_service->run();
+                    return;
+                }
+                catch (std::exception &error)
+                {
+                    std::cout << "[RUDP] (ERROR) [IO] Exception thrown by a completion handler: " << error.what() << std::endl;
+                }
+            } }));
+
+#ifdef __linux__
+        // Pin the thread to a core so the connections it services stay in that core's cache.
+        if (io_service_pinning)
+        {
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(i % cores, &cpu_set);
+            if (pthread_setaffinity_np(io_service_threads.back()->native_handle(), sizeof(cpu_set), &cpu_set) != 0)
+            {
+                std::cout << "[RUDP] (ERROR) [INIT] Error pinning IO service thread " << i << " to core " << i % cores << std::endl;
+            }
+        }
+#endif
+
+        // The threads run for the lifetime of the process, like the controller itself.
+        io_service_threads.back()->detach();
+    }
 }
 
 #endif /* CONNECTIONCONTROLLER_CPP */
\ No newline at end of file
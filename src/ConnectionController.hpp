@@ -12,34 +12,213 @@
 #ifndef CONNECTIONCONTROLLER_HPP
 #define CONNECTIONCONTROLLER_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
 #include <mutex>
-#include <map>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "rudp_macros.h"
 #include "Connection.hpp"
 
 namespace rudp
 {
+    class ConnectionController;
+
+    /**
+     * @brief   Class ConnectionRef is a reference to a connection of the ConnectionController that keeps the
+     *          connection from being destroyed until the reference is released.
+     * @details A reference is taken with ConnectionController::acquireConnection() and released when it is
+     *          destroyed, so a connection that is removed while a call is using it is only destroyed once that
+     *          call returns.
+     */
+    class ConnectionRef
+    {
+    public:
+        /**
+         * @brief   Constructor for the ConnectionRef class that refers to no connection.
+         */
+        ConnectionRef() : connection(nullptr), index(0) {}
+
+        /**
+         * @brief   Deleted cloning constructor so each reference is released once.
+         */
+        ConnectionRef(const ConnectionRef &) = delete;
+
+        /**
+         * @brief   Move constructor that takes over the reference of another.
+         */
+        ConnectionRef(ConnectionRef &&other) : connection(other.connection), index(other.index)
+        {
+            other.connection = nullptr;
+        }
+
+        /**
+         * @brief   Destructor for the ConnectionRef class that releases the reference.
+         */
+        ~ConnectionRef();
+
+        /**
+         * @brief   Member to access the connection.
+         * @return  Connection * pointer to the connection.
+         */
+        Connection *operator->() const
+        {
+            return connection;
+        }
+
+        /**
+         * @brief   Member to get the connection.
+         * @return  Connection * pointer to the connection, valid for the lifetime of the reference.
+         */
+        Connection *get() const
+        {
+            return connection;
+        }
+
+    private:
+        friend class ConnectionController;
+
+        /**
+         * @brief   Constructor used by the controller for a reference it has taken.
+         */
+        ConnectionRef(Connection *connection, uint32_t index) : connection(connection), index(index) {}
+
+        /// Connection that is referenced, null if there is none.
+        Connection *connection;
+        /// Index of the slot of the connection in the table of the controller.
+        uint32_t index;
+    };
+
     /**
      * @brief   Class ConnectController is a Singleton that controls all RUDP connections for the library.
      * @details The singleton instance is responsible for creating, managing, removing, and supplying 
      *          access to connections. The class uses mutexes to ensure mutual exclusion between 
-     *          client threads.
+     *          client threads that add or remove connections, while connections are looked up without locking.
+     * @details Connections are held in a table of slots, and a connection number is the index of its slot 
+     *          together with the generation of the slot, which changes every time the slot is freed so that the
+     *          number of a removed connection is never taken for the connection that reuses its slot. Each slot
+     *          has one atomic state word holding its generation, whether it is live and how many references to
+     *          its connection are held, so taking a reference is one compare and swap and the connection is
+     *          destroyed by whichever of the remove and the last reference comes last.
      */
     class ConnectionController
     {
 
     private:
+        friend class ConnectionRef;
+
+        /// Bits of a connection number that hold the index of its slot plus one.
+        static constexpr int SLOT_INDEX_BITS = 16;
+        /// Bits of a slot generation that are kept in a connection number, the rest of the bits of the number.
+        static constexpr uint64_t SLOT_GENERATION_MASK = INT32_MAX >> SLOT_INDEX_BITS;
+        /// Slots in each block of the table, which is allocated one block at a time.
+        static constexpr uint32_t SLOT_BLOCK_SIZE = 256;
+        /// Blocks in the table.
+        static constexpr uint32_t SLOT_BLOCK_COUNT = 256;
+        /// Maximum number of connections, leaving room in the index bits for the index plus one.
+        static constexpr uint32_t MAX_CONNECTIONS = (1u << SLOT_INDEX_BITS) - 1;
+        /// Bit of the state of a slot set while it holds a connection that has not been removed.
+        static constexpr uint64_t SLOT_LIVE = 1ull << 31;
+        /// Bits of the state of a slot that count the references to its connection.
+        static constexpr uint64_t SLOT_REFS = SLOT_LIVE - 1;
+
+        /**
+         * @brief   Struct Slot holds one connection of the table.
+         */
+        struct Slot
+        {
+            /// Generation of the slot in the upper 32 bits, then the live bit and the number of references.
+            std::atomic<uint64_t> state{0};
+            /// Connection held by the slot, written before the slot is made live.
+            Connection *connection = nullptr;
+        };
+
         /// Instance of the ConnectionController Singleton.
-        static ConnectionController *instance;
-        /// Mutex to control access to the class.
+        static std::atomic<ConnectionController *> instance;
+        /// Mutex to control access to the class when adding or removing connections and starting the IO services.
         static std::mutex io_mutex;
-        /// Map of connection numbers to Connection objects that the Singleton is managing.
-        static std::map<int, Connection*> connections;
-        /// Counter of connections that are used for the keys of the map.
-        static int connection_count;
+        /// Blocks of slots of the table, each published once it is allocated and kept for the lifetime of the process.
+        static std::atomic<Slot *> slot_blocks[SLOT_BLOCK_COUNT];
+        /// Number of slots that have been used at least once.
+        static uint32_t slot_count;
+        /// Indexes of slots that have been freed, reused before new slots.
+        static std::vector<uint32_t> free_slots;
+        /// Sum of the counters of the connections that have been destroyed.
+        static ConnectionStats removed_stats;
+        /// Pool of IO services that the connections are spread across, created when it is first needed.
+        static std::vector<boost::asio::io_service *> io_services;
+        /// Work that keeps each IO service of the pool running while it has no handlers.
+        static std::vector<boost::asio::io_service::work *> io_service_works;
+        /// Threads that each run one IO service of the pool.
+        static std::vector<std::thread *> io_service_threads;
+        /// Number of IO services in the pool, 0 for one per core.
+        static int io_service_count;
+        /// Flag for if each thread of the pool is pinned to its own core.
+        static bool io_service_pinning;
+        /// Index of the IO service that the next connection will be assigned to.
+        static size_t io_service_next;
+
+        /**
+         * @brief   Member to start the pool of IO services and their threads if they do not exist yet.
+         * @note    The caller must hold io_mutex.
+         */
+        static void start_io_services();
+
+        /**
+         * @brief   Member to assign an IO service of the pool to a new connection in round-robin order.
+         * @note    The caller must hold io_mutex.
+         * @return  io_service & IO service that the connection will use.
+         */
+        static boost::asio::io_service &next_io_service();
+
+        /**
+         * @brief               Member to find the slot of a connection number.
+         * @param   connection_number int number of the connection.
+         * @param   index       [out]   uint32_t & index of the slot.
+         * @return  Slot *      slot of the connection, null if the number can not refer to a slot.
+         */
+        static Slot *find_slot(int connection_number, uint32_t &index);
+
+        /**
+         * @brief   Member to get a slot by its index.
+         * @param   index uint32_t index of a slot whose block has been allocated.
+         * @return  Slot & slot at the index.
+         */
+        static Slot &get_slot(uint32_t index);
+
+        /**
+         * @brief   Member to release a reference to the connection of a slot, destroying it if it was removed
+         *          and this was the last reference.
+         * @param   index uint32_t index of the slot.
+         */
+        static void release_connection(uint32_t index);
+
+        /**
+         * @brief   Member to destroy the connection of a slot that is no longer live and has no references, then
+         *          free the slot for a new connection.
+         * @param   index uint32_t index of the slot.
+         */
+        static void destroy_connection(uint32_t index);
+
+        /**
+         * @brief   Member to put a new connection in a free slot.
+         * @param   connection Connection * connection to add.
+         * @return  int connection number of the slot.
+         * @throws  runtime_error if the table is full, in which case the connection is destroyed.
+         */
+        static int insert_connection(Connection *connection);
+
+        /**
+         * @brief   Member to check if the state of a slot is live with the generation of a connection number.
+         * @param   state uint64_t state of the slot.
+         * @param   connection_number int number of the connection.
+         * @return  bool true if the slot holds the connection of the number and it has not been removed.
+         */
+        static bool is_live(uint64_t state, int connection_number);
 
     protected:
         /**
@@ -67,14 +246,14 @@ namespace rudp
         static ConnectionController *getInstance();
 
         /**
-         * @brief   Member to create a new Connection object and add it to the map of 
+         * @brief   Member to create a new Connection object and add it to the table of 
          *          active connections. 
          * @return  int connection number corresponding to the newly created connection.
          */
         static int addConnection();
 
         /**
-         * @brief   Member to create a new Connection object and add it to the map of 
+         * @brief   Member to create a new Connection object and add it to the table of 
          *          active connections. 
          * @param   timeout_ms int for the length of the time to wait for an ACK before
          *          retransmission.
@@ -83,18 +262,118 @@ namespace rudp
         static int addConnection(int timeout_ms);
 
         /**
-         * @brief   Member to remove a connection from the map of active connections.
+         * @brief   Member to create a new Connection object that sends and receives its datagrams through a
+         *          transport and add it to the table of active connections.
+         * @param   timeout_ms int for the length of the time to wait for an ACK before
+         *          retransmission.
+         * @param   transport int TRANSPORT_ASIO or TRANSPORT_IO_URING.
+         * @return  int connection number corresponding to the newly created connection.
+         * @throws  runtime_error if the transport is not known or the io_uring cannot be set up.
+         */
+        static int addConnection(int timeout_ms, int transport);
+
+        /**
+         * @brief   Member to create a new Connection object that owns its IO service, so that it is driven by the
+         *          application's event loop through Connection::process() rather than by a thread of the
+         *          controller, and add it to the table of active connections.
+         * @param   timeout_ms int for the length of the time to wait for an ACK before
+         *          retransmission.
+         * @param   transport int TRANSPORT_ASIO or TRANSPORT_IO_URING.
+         * @return  int connection number corresponding to the newly created connection.
+         * @throws  runtime_error if the transport is not known or the io_uring cannot be set up.
+         */
+        static int addExternalConnection(int timeout_ms, int transport = DEFAULT_TRANSPORT);
+
+        /**
+         * @brief   Member to create a sharded listener, a group of connections that all receive on one port, and add
+         *          them to the table of active connections.
+         * @details Each shard is bound to the port with SO_REUSEPORT, so the kernel hashes every peer to one of
+         *          them, and shard i is serviced by IO service i of the pool, so with one IO service per core each
+         *          shard is read by its own pinned thread. The shards share nothing: each keeps the sequences and
+         *          queues of its own peers under its own mutex, and the application receives from each one
+         *          separately, typically with a thread or an asynchronous receive per shard.
+         * @param   timeout_ms int for the length of the time to wait for an ACK before
+         *          retransmission.
+         * @param   port unsigned short port number that every shard is bound to.
+         * @param   shards int number of shards, 0 for one per IO service of the pool.
+         * @param   transport int TRANSPORT_ASIO or TRANSPORT_IO_URING.
+         * @return  std::vector<int> connection numbers of the shards, in the order of their IO services.
+         * @throws  runtime_error if the number of shards is negative, or a shard could not be made or bound, in
+         *          which case the shards already made are removed.
+         */
+        static std::vector<int> addShardedConnections(int timeout_ms, unsigned short port, int shards, int transport = DEFAULT_TRANSPORT);
+
+        /**
+         * @brief   Member to remove a connection from the active connections and destroy it, which fails the
+         *          operations still in progress on it. If references to it are held (see acquireConnection())
+         *          it is destroyed when the last of them is released instead. Removing a connection that does
+         *          not exist does nothing.
          * @param   connection_number int number of the connection to be removed.
+         * @note    When called from a completion handler run by the IO service of the connection, the socket is
+         *          closed straight away but the connection is deleted once the handlers aborted by the close have
+         *          run, see Connection::destroy().
          */
         static void removeConnection(int connection_number);
 
         /**
-         * @brief   Get an existing Connection object from the map of active connections.
+         * @brief   Get an existing Connection object from the active connections without locking.
          * 
          * @param   connection_number int number of the connection to be retrieved.
-         * @return  Connection* pointer to connection object.
+         * @return  Connection* pointer to connection object, valid until the connection is removed.
+         * @throws  runtime_error if there is no connection with the number.
          */
         static Connection *getConnection(int connection_number);
+
+        /**
+         * @brief   Take a reference to an existing Connection object without locking, which keeps it from being
+         *          destroyed by removeConnection() until the reference is released.
+         * 
+         * @param   connection_number int number of the connection to be retrieved.
+         * @return  ConnectionRef reference to the connection object.
+         * @throws  runtime_error if there is no connection with the number.
+         */
+        static ConnectionRef acquireConnection(int connection_number);
+
+        /**
+         * @brief   Get the sum of the counters of every connection the controller has made, including those that
+         *          have been removed.
+         *
+         * @return  ConnectionStats sum of the counters.
+         */
+        static ConnectionStats getStats();
+
+        /**
+         * @brief   Set the number of IO services in the pool and whether their threads are pinned to cores.
+         * @details Each IO service is run by its own thread, and the timers and sockets of every connection 
+         *          assigned to it are multiplexed onto that thread.
+         * @param   count int number of IO services, 0 for one per core.
+         * @param   pin_to_cores bool true to pin the thread of IO service i to core i modulo the number of cores.
+         * @throws  runtime_error if the pool has already been started by a connection or the count is negative.
+         */
+        static void setIOServiceCount(int count, bool pin_to_cores);
+
+        /**
+         * @brief   Get the number of IO services in the pool, starting the pool if it does not exist yet.
+         * 
+         * @return  int number of IO services in the pool.
+         */
+        static int getIOServiceCount();
+
+        /**
+         * @brief   Get an IO service of the pool for a new connection, assigned in round-robin order.
+         *
+         * @return  io_service & IO service run by a thread of the controller.
+         */
+        static boost::asio::io_service &getIOService();
+
+        /**
+         * @brief   Get the IO service of the pool that a key hashes to, so that related connections can
+         *          share a thread.
+         *
+         * @param   key size_t hash of the connection, for example of its remote endpoint.
+         * @return  io_service & IO service run by a thread of the controller.
+         */
+        static boost::asio::io_service &getIOService(size_t key);
     };
 }
 
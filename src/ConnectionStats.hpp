@@ -0,0 +1,190 @@
+/**
+ * @file 	ConnectionStats.hpp
+ * @author 	James Horner (jwehorner@gmail.com)
+ * @brief 	File ConnectionStats.hpp contains the declaration and definition of the ConnectionStats and StatsCounters
+ * 			structs of the RUDP library.
+ * @details The StatsCounters struct holds the counters and latency histograms that a connection updates as it
+ * 			sends and receives packets, which can be read at any time without locking the connection, and the
+ * 			ConnectionStats struct is a copy of them, which the ConnectionController also sums over its connections.
+ * @date 	2022-07-18
+ * @copyright Copyright (c) 2022
+ */
+#ifndef CONNECTIONSTATS_HPP
+#define CONNECTIONSTATS_HPP
+
+// Standard Libraries
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Boost networking libraries
+#include <boost/asio.hpp>
+
+#include "rudp_macros.h"
+
+namespace rudp
+{
+    /**
+     * @brief   Struct ConnectionStats is a copy of the counters of one or more connections.
+     * @details Bucket 0 of a latency histogram counts the samples below 64 µs, bucket i the samples from 32 * 2^i
+     *          to 64 * 2^i µs, and the last bucket every sample from 32 * 2^(STATS_HISTOGRAM_BUCKETS - 1) µs up.
+     */
+    struct ConnectionStats
+    {
+        /// Data packets sent, including retransmissions.
+        uint64_t packets_sent = 0;
+        /// Data packets received, including duplicates.
+        uint64_t packets_received = 0;
+        /// Bytes sent in every datagram, including headers and ACKs.
+        uint64_t bytes_sent = 0;
+        /// Bytes received in every datagram, including headers and ACKs.
+        uint64_t bytes_received = 0;
+        /// ACKs sent on their own, not counting those carried by data packets.
+        uint64_t acks_sent = 0;
+        /// ACKs received, both on their own and carried by data packets.
+        uint64_t acks_received = 0;
+        /// Data packets that were transmitted again.
+        uint64_t retransmissions = 0;
+        /// Expiries of a retransmission timer that retransmitted packets.
+        uint64_t timeouts = 0;
+        /// Data packets received that had already been received.
+        uint64_t duplicates = 0;
+        /// Data packets received ahead of a missing one and held in the reorder buffer.
+        uint64_t packets_reordered = 0;
+        /// Data packets received that were malformed or left unacknowledged as they could not be held.
+        uint64_t packets_dropped = 0;
+        /// Messages acknowledged by their receiver, and unreliable messages sent.
+        uint64_t messages_sent = 0;
+        /// Messages delivered to a receive or to the receive queue.
+        uint64_t messages_received = 0;
+        /// Messages abandoned before they were acknowledged.
+        uint64_t messages_failed = 0;
+        /// Messages dropped at the end of their lifetime or limit of transmissions, as they were sent to be.
+        uint64_t messages_expired = 0;
+        /// Datagrams dropped by the kernel as the receive buffer of the socket was full, where the kernel reports it.
+        uint64_t kernel_drops = 0;
+        /// Round trip times measured from packets that were only transmitted once.
+        std::array<uint64_t, STATS_HISTOGRAM_BUCKETS> rtt_histogram{};
+        /// Times from the first transmission of a packet to its ACK, including packets that were retransmitted.
+        std::array<uint64_t, STATS_HISTOGRAM_BUCKETS> ack_latency_histogram{};
+
+        /**
+         * @brief       Method operator+= adds the counters of other connections to these.
+         * @param other const ConnectionStats & counters to add.
+         * @return      ConnectionStats & these counters.
+         */
+        ConnectionStats &operator+=(const ConnectionStats &other)
+        {
+            packets_sent += other.packets_sent;
+            packets_received += other.packets_received;
+            bytes_sent += other.bytes_sent;
+            bytes_received += other.bytes_received;
+            acks_sent += other.acks_sent;
+            acks_received += other.acks_received;
+            retransmissions += other.retransmissions;
+            timeouts += other.timeouts;
+            duplicates += other.duplicates;
+            packets_reordered += other.packets_reordered;
+            packets_dropped += other.packets_dropped;
+            messages_sent += other.messages_sent;
+            messages_received += other.messages_received;
+            messages_failed += other.messages_failed;
+            messages_expired += other.messages_expired;
+            kernel_drops += other.kernel_drops;
+            for (size_t i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+            {
+                rtt_histogram[i] += other.rtt_histogram[i];
+                ack_latency_histogram[i] += other.ack_latency_histogram[i];
+            }
+            return *this;
+        }
+    };
+
+    /**
+     * @brief   Struct StatsCounters holds the counters that a connection updates, aligned to and padded out to whole
+     *          cache lines so that updating them does not slow the threads reading the rest of the connection.
+     * @details The counters are only updated while holding the connection mutex, so an update is a relaxed load and
+     *          store rather than a locked read-modify-write, and they can be read at any time without the mutex.
+     */
+    struct alignas(64) StatsCounters
+    {
+        /// Counters of the ConnectionStats members of the same names.
+        std::atomic<uint64_t> packets_sent{0};
+        std::atomic<uint64_t> packets_received{0};
+        std::atomic<uint64_t> bytes_sent{0};
+        std::atomic<uint64_t> bytes_received{0};
+        std::atomic<uint64_t> acks_sent{0};
+        std::atomic<uint64_t> acks_received{0};
+        std::atomic<uint64_t> retransmissions{0};
+        std::atomic<uint64_t> timeouts{0};
+        std::atomic<uint64_t> duplicates{0};
+        std::atomic<uint64_t> packets_reordered{0};
+        std::atomic<uint64_t> packets_dropped{0};
+        std::atomic<uint64_t> messages_sent{0};
+        std::atomic<uint64_t> messages_received{0};
+        std::atomic<uint64_t> messages_failed{0};
+        std::atomic<uint64_t> messages_expired{0};
+        std::array<std::atomic<uint64_t>, STATS_HISTOGRAM_BUCKETS> rtt_histogram{};
+        std::array<std::atomic<uint64_t>, STATS_HISTOGRAM_BUCKETS> ack_latency_histogram{};
+
+        /**
+         * @brief           Method add adds to a counter.
+         * @param counter   atomic<uint64_t> & counter of this struct.
+         * @param value     uint64_t amount to add.
+         * @note            The caller must hold the connection mutex.
+         */
+        static void add(std::atomic<uint64_t> &counter, uint64_t value = 1)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief           Method record adds a latency sample to a histogram.
+         * @param histogram array<atomic<uint64_t>> & histogram of this struct.
+         * @param latency   const time_duration & latency of the sample.
+         * @note            The caller must hold the connection mutex.
+         */
+        static void record(std::array<std::atomic<uint64_t>, STATS_HISTOGRAM_BUCKETS> &histogram, const boost::posix_time::time_duration &latency)
+        {
+            int64_t latency_us = latency.total_microseconds();
+            size_t bucket = 0;
+            while (bucket < STATS_HISTOGRAM_BUCKETS - 1 && latency_us >= ((int64_t)64 << bucket))
+            {
+                ++bucket;
+            }
+            add(histogram[bucket]);
+        }
+
+        /**
+         * @brief   Method snapshot copies the counters, each of which is read atomically though not all at once.
+         * @return  ConnectionStats copy of the counters.
+         */
+        ConnectionStats snapshot() const
+        {
+            ConnectionStats stats;
+            stats.packets_sent = packets_sent.load(std::memory_order_relaxed);
+            stats.packets_received = packets_received.load(std::memory_order_relaxed);
+            stats.bytes_sent = bytes_sent.load(std::memory_order_relaxed);
+            stats.bytes_received = bytes_received.load(std::memory_order_relaxed);
+            stats.acks_sent = acks_sent.load(std::memory_order_relaxed);
+            stats.acks_received = acks_received.load(std::memory_order_relaxed);
+            stats.retransmissions = retransmissions.load(std::memory_order_relaxed);
+            stats.timeouts = timeouts.load(std::memory_order_relaxed);
+            stats.duplicates = duplicates.load(std::memory_order_relaxed);
+            stats.packets_reordered = packets_reordered.load(std::memory_order_relaxed);
+            stats.packets_dropped = packets_dropped.load(std::memory_order_relaxed);
+            stats.messages_sent = messages_sent.load(std::memory_order_relaxed);
+            stats.messages_received = messages_received.load(std::memory_order_relaxed);
+            stats.messages_failed = messages_failed.load(std::memory_order_relaxed);
+            stats.messages_expired = messages_expired.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+            {
+                stats.rtt_histogram[i] = rtt_histogram[i].load(std::memory_order_relaxed);
+                stats.ack_latency_histogram[i] = ack_latency_histogram[i].load(std::memory_order_relaxed);
+            }
+            return stats;
+        }
+    };
+}
+
+#endif /* CONNECTIONSTATS_HPP */
@@ -0,0 +1,125 @@
+/**
+ * @file 	Impairment.cpp
+ * @author 	James Horner (jwehorner@gmail.com)
+ * @brief 	File Impairment.cpp contains the definition of the Impairment struct and the ImpairedLink class of the RUDP library.
+ * @details A connection can pass the datagrams it sends through an impaired link that drops, duplicates, delays and
+ * 			reorders them and limits the rate at which they leave, from a seeded generator so that a run can be
+ * 			repeated.
+ * @date 	2022-07-18
+ * @copyright Copyright (c) 2022
+ */
+#ifndef IMPAIRMENT_CPP
+#define IMPAIRMENT_CPP
+
+#include "Impairment.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+using namespace rudp;
+
+void Impairment::validate() const
+{
+	if (loss < 0 || loss > 1 || duplicate < 0 || duplicate > 1 || reorder < 0 || reorder > 1)
+	{
+		throw std::runtime_error("[RUDP] (ERROR) [INIT] Error setting impairment: loss, duplicate and reorder must be between 0 and 1.");
+	}
+	if (delay_us < 0 || jitter_us < 0 || reorder_delay_us < 0)
+	{
+		throw std::runtime_error("[RUDP] (ERROR) [INIT] Error setting impairment: delays must be at least 0.");
+	}
+	if (jitter_distribution != JITTER_UNIFORM && jitter_distribution != JITTER_NORMAL)
+	{
+		throw std::runtime_error("[RUDP] (ERROR) [INIT] Error setting impairment: unknown jitter distribution " + std::to_string((int)jitter_distribution) + ".");
+	}
+	if (queue_limit < 1)
+	{
+		throw std::runtime_error("[RUDP] (ERROR) [INIT] Error setting impairment: queue limit must be at least 1.");
+	}
+}
+
+ImpairedLink::ImpairedLink(const Impairment &impairment) : impairment(impairment), generator(impairment.seed), link_free_time(boost::posix_time::neg_infin), datagram_count(0), dropped_count(0), duplicated_count(0) {}
+
+void ImpairedLink::enqueue(const boost::asio::ip::udp::endpoint &endpoint, const std::array<boost::asio::const_buffer, 3> &buffers, const boost::posix_time::ptime &now)
+{
+	std::uniform_real_distribution<double> chance(0, 1);
+	if (chance(generator) < impairment.loss)
+	{
+		++dropped_count;
+		return;
+	}
+	int copies = chance(generator) < impairment.duplicate ? 2 : 1;
+	duplicated_count += copies - 1;
+
+	std::vector<char> data(boost::asio::buffer_size(buffers));
+	boost::asio::buffer_copy(boost::asio::buffer(data), buffers);
+	for (int copy = 0; copy < copies; copy++)
+	{
+		if (datagrams.size() >= (size_t)impairment.queue_limit)
+		{
+			++dropped_count;
+			return;
+		}
+		// Each copy waits for the link to send the ones before it at the rate of the link, then is delayed.
+		boost::posix_time::ptime sent_time = now;
+		if (impairment.rate_bytes_per_s > 0)
+		{
+			link_free_time = std::max(link_free_time, now) + boost::posix_time::microseconds((int64_t)(data.size() * 1000000 / impairment.rate_bytes_per_s));
+			sent_time = link_free_time;
+		}
+		datagrams.push_back(ImpairedDatagram{sent_time + boost::posix_time::microseconds(draw_delay()), datagram_count++, endpoint, copy + 1 < copies ? data : std::move(data)});
+		std::push_heap(datagrams.begin(), datagrams.end(), std::greater<ImpairedDatagram>());
+	}
+}
+
+bool ImpairedLink::pop(const boost::posix_time::ptime &now, ImpairedDatagram &datagram)
+{
+	if (datagrams.empty() || datagrams.front().release > now)
+	{
+		return false;
+	}
+	std::pop_heap(datagrams.begin(), datagrams.end(), std::greater<ImpairedDatagram>());
+	datagram = std::move(datagrams.back());
+	datagrams.pop_back();
+	return true;
+}
+
+boost::posix_time::ptime ImpairedLink::next_release() const
+{
+	return datagrams.empty() ? boost::posix_time::ptime(boost::posix_time::pos_infin) : datagrams.front().release;
+}
+
+uint64_t ImpairedLink::dropped() const
+{
+	return dropped_count;
+}
+
+uint64_t ImpairedLink::duplicated() const
+{
+	return duplicated_count;
+}
+
+int64_t ImpairedLink::draw_delay()
+{
+	double delay_us = impairment.delay_us;
+	if (impairment.jitter_us > 0)
+	{
+		if (impairment.jitter_distribution == JITTER_NORMAL)
+		{
+			delay_us += std::normal_distribution<double>(0, impairment.jitter_us)(generator);
+		}
+		else
+		{
+			delay_us += std::uniform_real_distribution<double>(-impairment.jitter_us, impairment.jitter_us)(generator);
+		}
+	}
+	if (impairment.reorder > 0 && std::uniform_real_distribution<double>(0, 1)(generator) < impairment.reorder)
+	{
+		delay_us += impairment.reorder_delay_us;
+	}
+	return std::max((int64_t)0, (int64_t)std::llround(delay_us));
+}
+
+#endif /* IMPAIRMENT_CPP */
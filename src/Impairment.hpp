@@ -0,0 +1,168 @@
+/**
+ * @file 	Impairment.hpp
+ * @author 	James Horner (jwehorner@gmail.com)
+ * @brief 	File Impairment.hpp contains the declaration of the Impairment struct and the ImpairedLink class of the RUDP library.
+ * @details A connection can pass the datagrams it sends through an impaired link that drops, duplicates, delays and
+ * 			reorders them and limits the rate at which they leave, like tc netem on the egress of the socket but
+ * 			without root and from a seeded generator, so that a run over the loopback interface can be repeated.
+ * @date 	2022-07-18
+ * @copyright Copyright (c) 2022
+ */
+#ifndef IMPAIRMENT_HPP
+#define IMPAIRMENT_HPP
+
+// Standard Libraries
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <vector>
+
+// Boost networking libraries
+#include <boost/asio.hpp>
+
+#include "rudp_macros.h"
+
+namespace rudp
+{
+    /**
+     * @brief   Enum JitterDistribution lists the distributions the jitter of an impaired link can be drawn from.
+     */
+    enum JitterDistribution : int
+    {
+        /// Jitter drawn uniformly from -jitter_us to jitter_us.
+        JITTER_UNIFORM = IMPAIRMENT_JITTER_UNIFORM,
+        /// Jitter drawn from a normal distribution with a standard deviation of jitter_us.
+        JITTER_NORMAL = IMPAIRMENT_JITTER_NORMAL
+    };
+
+    /**
+     * @brief   Struct Impairment describes what an impaired link does to the datagrams sent through it.
+     */
+    struct Impairment
+    {
+        /// Probability that a datagram is dropped.
+        double loss = 0;
+        /// Probability that a datagram that is not dropped is sent twice.
+        double duplicate = 0;
+        /// Probability that a datagram is held back by reorder_delay_us so that the datagrams after it overtake it.
+        double reorder = 0;
+        /// Delay added to every datagram in microseconds.
+        int delay_us = 0;
+        /// Spread of the delay added to every datagram in microseconds, the delay never goes below 0.
+        int jitter_us = 0;
+        /// Distribution the jitter is drawn from.
+        JitterDistribution jitter_distribution = JITTER_UNIFORM;
+        /// Extra delay of a reordered datagram in microseconds.
+        int reorder_delay_us = DEFAULT_IMPAIRMENT_REORDER_DELAY_US;
+        /// Rate at which datagrams leave the link in bytes per second, 0 for no limit.
+        uint64_t rate_bytes_per_s = 0;
+        /// Maximum number of datagrams waiting in the link, more are dropped.
+        int queue_limit = DEFAULT_IMPAIRMENT_QUEUE_LIMIT;
+        /// Seed of the generator, the same seed and datagrams give the same impairment.
+        uint32_t seed = 1;
+
+        /**
+         * @brief   Method validate checks that the impairment can be used by a link.
+         * @throws  runtime_error if a probability is not between 0 and 1, a delay is negative or the queue limit is
+         *          less than 1.
+         */
+        void validate() const;
+    };
+
+    /**
+     * @brief   Struct ImpairedDatagram is a copy of a datagram waiting in an impaired link.
+     */
+    struct ImpairedDatagram
+    {
+        /// Time at which the datagram leaves the link.
+        boost::posix_time::ptime release;
+        /// Order in which the datagram entered the link, which breaks ties between release times.
+        uint64_t order;
+        /// Endpoint that the datagram is sent to.
+        boost::asio::ip::udp::endpoint endpoint;
+        /// Bytes of the datagram.
+        std::vector<char> data;
+
+        bool operator>(const ImpairedDatagram &other) const
+        {
+            return release > other.release || (release == other.release && order > other.order);
+        }
+    };
+
+    /**
+     * @brief   Class ImpairedLink holds the datagrams sent through an impairment until they are due to be sent.
+     * @details Each datagram that is not dropped is queued behind the ones before it for the time it takes to send
+     *          at the rate of the link, then delayed by the delay, the jitter and, if it is reordered, the reorder
+     *          delay. Datagrams leave the link in the order of the time at which they are due. The link is not
+     *          thread safe, the connection only uses it while holding its mutex.
+     */
+    class ImpairedLink
+    {
+    public:
+        /**
+         * @brief               Constructor for the ImpairedLink class that seeds its generator.
+         * @param impairment    const Impairment & valid impairment of the datagrams.
+         */
+        ImpairedLink(const Impairment &impairment);
+
+        /**
+         * @brief           Method enqueue passes a datagram through the impairment, copying it into the link unless
+         *                  it is dropped.
+         * @param endpoint  const udp::endpoint & endpoint the datagram is sent to.
+         * @param buffers   const std::array<boost::asio::const_buffer, 3> & buffers gathered into the datagram.
+         * @param now       const ptime & time at which the datagram is sent.
+         */
+        void enqueue(const boost::asio::ip::udp::endpoint &endpoint, const std::array<boost::asio::const_buffer, 3> &buffers, const boost::posix_time::ptime &now);
+
+        /**
+         * @brief           Method pop takes the datagram that is due first once it is due.
+         * @param now       const ptime & current time, or pos_infin to take a datagram that is not due yet.
+         * @param datagram  [out]   ImpairedDatagram & to which the datagram is moved.
+         * @return          bool true if a datagram was taken, false if none are due.
+         */
+        bool pop(const boost::posix_time::ptime &now, ImpairedDatagram &datagram);
+
+        /**
+         * @brief   Method next_release gets the time at which the next datagram is due.
+         * @return  ptime time the next datagram is due, pos_infin if the link is empty.
+         */
+        boost::posix_time::ptime next_release() const;
+
+        /**
+         * @brief   Method dropped gets the number of datagrams dropped by the impairment or as the link was full.
+         * @return  uint64_t number of datagrams dropped.
+         */
+        uint64_t dropped() const;
+
+        /**
+         * @brief   Method duplicated gets the number of datagrams sent twice.
+         * @return  uint64_t number of datagrams duplicated.
+         */
+        uint64_t duplicated() const;
+
+    private:
+        /// Impairment of the datagrams.
+        Impairment impairment;
+        /// Generator of the impairment.
+        std::mt19937 generator;
+        /// Datagrams waiting in the link, a min-heap on the time they are due.
+        std::vector<ImpairedDatagram> datagrams;
+        /// Time at which the last datagram queued has been sent at the rate of the link.
+        boost::posix_time::ptime link_free_time;
+        /// Number of datagrams that have entered the link.
+        uint64_t datagram_count;
+        /// Number of datagrams dropped.
+        uint64_t dropped_count;
+        /// Number of datagrams duplicated.
+        uint64_t duplicated_count;
+
+        /**
+         * @brief   Method draw_delay draws the delay of a datagram from the delay, the jitter and the reordering.
+         * @return  int64_t delay in microseconds, at least 0.
+         */
+        int64_t draw_delay();
+    };
+}
+
+#endif /* IMPAIRMENT_HPP */
@@ -0,0 +1,297 @@
+/**
+ * @file 	PeerTable.hpp
+ * @author 	James Horner (jwehorner@gmail.com)
+ * @brief 	File PeerTable.hpp contains the declaration and definition of the PeerTable class template of the RUDP library.
+ * @details The PeerTable class template is an open addressing hash table of per-peer records keyed on the
+ * 			binary address and port of the peer, so a datagram can find the state of its sender without
+ * 			formatting or allocating a string and without chasing the nodes of a tree.
+ * @date 	2022-07-18
+ * @copyright Copyright (c) 2022
+ */
+#ifndef PEERTABLE_HPP
+#define PEERTABLE_HPP
+
+// Standard Libraries
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// Boost networking libraries
+#include <boost/asio.hpp>
+
+namespace rudp
+{
+    /**
+     * @brief   Struct PeerKey is the binary form of a UDP endpoint, an IPv4 address is held in the first 4 bytes.
+     */
+    struct PeerKey
+    {
+        /// Address of the peer in network byte order, zero padded for IPv4.
+        std::array<unsigned char, 16> address;
+        /// Port of the peer.
+        unsigned short port;
+        /// Flag for if the address is IPv6.
+        bool v6;
+        /// Stream of the peer, for a table that keeps a record for each stream a peer sends on, 0 otherwise.
+        uint16_t stream;
+
+        /**
+         * @brief           Method from_endpoint converts an endpoint to its key.
+         * @param endpoint  const udp::endpoint & endpoint of the peer.
+         * @param stream    uint16_t stream of the peer.
+         * @return          PeerKey key of the endpoint.
+         */
+        static PeerKey from_endpoint(const boost::asio::ip::udp::endpoint &endpoint, uint16_t stream = 0)
+        {
+            PeerKey key = PeerKey{{}, endpoint.port(), endpoint.address().is_v6(), stream};
+            if (key.v6)
+            {
+                key.address = endpoint.address().to_v6().to_bytes();
+            }
+            else
+            {
+                std::array<unsigned char, 4> bytes = endpoint.address().to_v4().to_bytes();
+                memcpy(key.address.data(), bytes.data(), bytes.size());
+            }
+            return key;
+        }
+
+        bool operator==(const PeerKey &other) const
+        {
+            return port == other.port && v6 == other.v6 && stream == other.stream && address == other.address;
+        }
+
+        /**
+         * @brief   Method hash mixes the address, port and stream into a 64 bit hash with the finaliser of SplitMix64.
+         * @return  uint64_t hash of the key.
+         */
+        uint64_t hash() const
+        {
+            uint64_t high;
+            uint64_t low;
+            memcpy(&high, address.data(), sizeof(high));
+            memcpy(&low, address.data() + sizeof(high), sizeof(low));
+            uint64_t value = high ^ (low * 0x9e3779b97f4a7c15ULL) ^ ((uint64_t)port << 48) ^ ((uint64_t)stream << 32) ^ (uint64_t)v6;
+            value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+            return value ^ (value >> 31);
+        }
+    };
+
+    /**
+     * @brief   Class PeerTable is an open addressing hash table with linear probing from peers to their records.
+     * @details The records are stored in place in one array whose size is a power of two, kept at most half full
+     *          including the slots of erased records, and shrunk again once most of its records are erased.
+     *          Inserting or erasing a record can move the others, so references to them are only valid until then.
+     * @tparam  T type of the record held for each peer.
+     */
+    template <typename T>
+    class PeerTable
+    {
+    public:
+        /**
+         * @brief Constructor for the PeerTable class that starts with no slots, allocating them on the first insert.
+         */
+        PeerTable() : used(0), erased(0) {}
+
+        /**
+         * @brief   Method size gets the number of records in the table.
+         * @return  size_t number of records.
+         */
+        size_t size()
+        {
+            return used;
+        }
+
+        /**
+         * @brief       Method find finds the record of a peer.
+         * @param key   const PeerKey & key of the peer.
+         * @return      T * record of the peer, null if it has none.
+         */
+        T *find(const PeerKey &key)
+        {
+            if (slots.empty())
+            {
+                return nullptr;
+            }
+            size_t mask = slots.size() - 1;
+            for (size_t index = key.hash() & mask;; index = (index + 1) & mask)
+            {
+                Slot &slot = slots[index];
+                if (slot.state == SLOT_EMPTY)
+                {
+                    return nullptr;
+                }
+                if (slot.state == SLOT_USED && slot.key == key)
+                {
+                    return &slot.value;
+                }
+            }
+        }
+
+        /**
+         * @brief       Method insert adds the record of a peer that does not have one yet.
+         * @param key   const PeerKey & key of the peer.
+         * @param value T record of the peer.
+         * @return      T & record in the table.
+         */
+        T &insert(const PeerKey &key, T value)
+        {
+            if ((used + erased + 1) * 2 > slots.size())
+            {
+                rehash(std::max((size_t)MIN_SLOTS, next_power_of_two((used + 1) * 4)));
+            }
+            size_t mask = slots.size() - 1;
+            size_t index = key.hash() & mask;
+            while (slots[index].state == SLOT_USED)
+            {
+                index = (index + 1) & mask;
+            }
+            Slot &slot = slots[index];
+            if (slot.state == SLOT_ERASED)
+            {
+                --erased;
+            }
+            slot.state = SLOT_USED;
+            slot.key = key;
+            slot.value = std::move(value);
+            ++used;
+            return slot.value;
+        }
+
+        /**
+         * @brief   Method clear removes every record, keeping the slots.
+         */
+        void clear()
+        {
+            for (Slot &slot : slots)
+            {
+                slot.state = SLOT_EMPTY;
+                slot.value = T();
+            }
+            used = 0;
+            erased = 0;
+        }
+
+        /**
+         * @brief       Method for_each invokes a function on every record.
+         * @param f     F function taking T &.
+         */
+        template <typename F>
+        void for_each(F f)
+        {
+            for (Slot &slot : slots)
+            {
+                if (slot.state == SLOT_USED)
+                {
+                    f(slot.value);
+                }
+            }
+        }
+
+        /**
+         * @brief       Method erase_if removes every record for which a predicate holds, then shrinks the table if
+         *              most of it is empty.
+         * @param pred  P predicate taking T &, which may change its record before it is removed.
+         * @return      size_t number of records removed.
+         */
+        template <typename P>
+        size_t erase_if(P pred)
+        {
+            size_t removed = 0;
+            for (Slot &slot : slots)
+            {
+                if (slot.state == SLOT_USED && pred(slot.value))
+                {
+                    // The slot stays marked so that the probes of the records after it still reach them.
+                    slot.state = SLOT_ERASED;
+                    slot.value = T();
+                    ++removed;
+                }
+            }
+            used -= removed;
+            erased += removed;
+            if (slots.size() > MIN_SLOTS && used * 8 < slots.size())
+            {
+                rehash(std::max((size_t)MIN_SLOTS, next_power_of_two(used * 4)));
+            }
+            return removed;
+        }
+
+    private:
+        /// State of a slot that has never held a record since the last rehash.
+        static constexpr uint8_t SLOT_EMPTY = 0;
+        /// State of a slot that holds a record.
+        static constexpr uint8_t SLOT_USED = 1;
+        /// State of a slot whose record was erased.
+        static constexpr uint8_t SLOT_ERASED = 2;
+        /// Number of slots the table starts with.
+        static constexpr size_t MIN_SLOTS = 8;
+
+        /**
+         * @brief   Struct Slot holds the record of one peer in the array of the table.
+         */
+        struct Slot
+        {
+            /// State of the slot.
+            uint8_t state;
+            /// Key of the peer, if the slot is used.
+            PeerKey key;
+            /// Record of the peer, if the slot is used.
+            T value;
+        };
+
+        /// Slots of the table, a power of two of them.
+        std::vector<Slot> slots;
+        /// Number of used slots.
+        size_t used;
+        /// Number of erased slots.
+        size_t erased;
+
+        /**
+         * @brief           Method rehash moves every record to a new array of slots, dropping the erased slots.
+         * @param capacity  size_t number of slots of the new array, a power of two.
+         */
+        void rehash(size_t capacity)
+        {
+            std::vector<Slot> old_slots(capacity);
+            old_slots.swap(slots);
+            size_t mask = slots.size() - 1;
+            for (Slot &old_slot : old_slots)
+            {
+                if (old_slot.state == SLOT_USED)
+                {
+                    size_t index = old_slot.key.hash() & mask;
+                    while (slots[index].state == SLOT_USED)
+                    {
+                        index = (index + 1) & mask;
+                    }
+                    slots[index].state = SLOT_USED;
+                    slots[index].key = old_slot.key;
+                    slots[index].value = std::move(old_slot.value);
+                }
+            }
+            erased = 0;
+        }
+
+        /**
+         * @brief       Method next_power_of_two rounds a number up to a power of two.
+         * @param value size_t number to round.
+         * @return      size_t smallest power of two that is at least value.
+         */
+        static size_t next_power_of_two(size_t value)
+        {
+            size_t power = 1;
+            while (power < value)
+            {
+                power <<= 1;
+            }
+            return power;
+        }
+    };
+}
+
+#endif /* PEERTABLE_HPP */
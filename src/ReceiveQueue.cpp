@@ -0,0 +1,173 @@
+/**
+ * @file 	ReceiveQueue.cpp
+ * @author 	James Horner (jwehorner@gmail.com)
+ * @brief 	File ReceiveQueue.cpp contains the definition of the ReceiveQueue class of the RUDP library.
+ * @details The ReceiveQueue class is a bounded lock-free ring of the messages that a connection has
+ * 			delivered in order but that have not yet been taken by a receive. Messages are only added by
+ * 			the IO service of the connection while it holds the connection mutex, and they can be taken
+ * 			by any number of threads at once without holding it.
+ * @date 	2022-07-18
+ * @copyright Copyright (c) 2022
+ */
+#ifndef RECEIVEQUEUE_CPP
+#define RECEIVEQUEUE_CPP
+
+#include "ReceiveQueue.hpp"
+
+#include <climits>
+#include <cstddef>
+#include <cstring>
+
+using namespace rudp;
+
+ReceiveQueue::ReceiveQueue(size_t capacity) : cells(new Cell[capacity]), cell_count(capacity), write_position(0), read_position(0)
+{
+	for (size_t i = 0; i < cell_count; i++)
+	{
+		cells[i].sequence.store(i, std::memory_order_relaxed);
+		cells[i].len.store(0, std::memory_order_relaxed);
+	}
+}
+
+size_t ReceiveQueue::capacity()
+{
+	return cell_count;
+}
+
+size_t ReceiveQueue::size()
+{
+	// Read the read position first so that the difference can not underflow.
+	size_t read = read_position.load(std::memory_order_acquire);
+	size_t write = write_position.load(std::memory_order_acquire);
+	return write - read;
+}
+
+bool ReceiveQueue::empty()
+{
+	return size() == 0;
+}
+
+bool ReceiveQueue::full()
+{
+	// The cell at the write position is only free once the message it held last time round has been taken.
+	size_t position = write_position.load(std::memory_order_relaxed);
+	return cells[position % cell_count].sequence.load(std::memory_order_acquire) != position;
+}
+
+bool ReceiveQueue::available(size_t count)
+{
+	if (count > cell_count)
+	{
+		return false;
+	}
+	size_t position = write_position.load(std::memory_order_relaxed);
+	for (size_t i = 0; i < count; i++)
+	{
+		if (cells[(position + i) % cell_count].sequence.load(std::memory_order_acquire) != position + i)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+std::vector<char> *ReceiveQueue::reserve()
+{
+	if (full())
+	{
+		return nullptr;
+	}
+	return &cells[write_position.load(std::memory_order_relaxed) % cell_count].payload;
+}
+
+void ReceiveQueue::commit(const boost::asio::ip::udp::endpoint &sender, uint16_t stream)
+{
+	// There is only one producer, so the write position can be advanced without a compare and swap, and the
+	// release of the sequence publishes the payload to the consumer that claims the cell.
+	size_t position = write_position.load(std::memory_order_relaxed);
+	Cell &cell = cells[position % cell_count];
+	cell.len.store(cell.payload.size(), std::memory_order_relaxed);
+	cell.sender = sender;
+	cell.stream = stream;
+	cell.sequence.store(position + 1, std::memory_order_release);
+	write_position.store(position + 1, std::memory_order_release);
+}
+
+int ReceiveQueue::pop(char *buf, int len, boost::asio::ip::udp::endpoint &sender, uint16_t &stream)
+{
+	int result;
+	Cell *cell = claim(len, result);
+	if (cell != nullptr)
+	{
+		memcpy(buf, cell->payload.data(), result);
+		sender = cell->sender;
+		stream = cell->stream;
+		release(*cell);
+	}
+	return result;
+}
+
+bool ReceiveQueue::pop(std::vector<char> &payload, boost::asio::ip::udp::endpoint &sender, uint16_t &stream)
+{
+	int result;
+	Cell *cell = claim(INT_MAX, result);
+	if (cell == nullptr)
+	{
+		return false;
+	}
+	payload.swap(cell->payload);
+	sender = cell->sender;
+	stream = cell->stream;
+	release(*cell);
+	return true;
+}
+
+ReceiveQueue::Cell *ReceiveQueue::claim(int len, int &result)
+{
+	size_t position = read_position.load(std::memory_order_relaxed);
+	while (true)
+	{
+		Cell &cell = cells[position % cell_count];
+		size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		if (sequence == position + 1)
+		{
+			// The cell holds the message at the front, which stays in place until the read position moves past it.
+			int message_len = cell.len.load(std::memory_order_relaxed);
+			if (message_len > len)
+			{
+				size_t current = read_position.load(std::memory_order_relaxed);
+				if (current == position)
+				{
+					result = TOO_SMALL;
+					return nullptr;
+				}
+				position = current;
+			}
+			else if (read_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				result = message_len;
+				return &cell;
+			}
+		}
+		else if ((std::ptrdiff_t)(sequence - (position + 1)) < 0)
+		{
+			// The producer has not added a message at the position yet, or the cell is still being taken from
+			// the previous time round the ring.
+			result = EMPTY;
+			return nullptr;
+		}
+		else
+		{
+			// Another consumer took the message, so try the next one.
+			position = read_position.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+void ReceiveQueue::release(Cell &cell)
+{
+	// The cell held position p with sequence p + 1 and is next used for position p + capacity.
+	cell.sequence.store(cell.sequence.load(std::memory_order_relaxed) - 1 + cell_count, std::memory_order_release);
+}
+
+#endif /* RECEIVEQUEUE_CPP */
@@ -0,0 +1,166 @@
+/**
+ * @file 	ReceiveQueue.hpp
+ * @author 	James Horner (jwehorner@gmail.com)
+ * @brief 	File ReceiveQueue.hpp contains the declaration of the ReceiveQueue class of the RUDP library.
+ * @details The ReceiveQueue class is a bounded lock-free ring of the messages that a connection has
+ * 			delivered in order but that have not yet been taken by a receive. Messages are only added by
+ * 			the IO service of the connection while it holds the connection mutex, and they can be taken
+ * 			by any number of threads at once without holding it.
+ * @date 	2022-07-18
+ * @copyright Copyright (c) 2022
+ */
+#ifndef RECEIVEQUEUE_HPP
+#define RECEIVEQUEUE_HPP
+
+// Standard Libraries
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Boost networking libraries
+#include <boost/asio.hpp>
+
+namespace rudp
+{
+    /**
+     * @brief   Class ReceiveQueue is a bounded ring of received messages with a single producer and many consumers.
+     * @details Each cell of the ring holds the sequence of the position it is waiting for, as in Vyukov's bounded
+     *          queue: a cell at position p is free while its sequence is p and holds a message while its sequence is
+     *          p + 1, so a consumer claims a message with one compare and swap of the read position and nothing is
+     *          ever blocked. The buffer of each cell is kept when its message is taken, so the cells are the pool
+     *          that the payloads of later messages are written into.
+     */
+    class ReceiveQueue
+    {
+    public:
+        /// Value returned by pop() when there is no message in the queue.
+        static constexpr int EMPTY = -1;
+        /// Value returned by pop() when the message at the front of the queue does not fit in the buffer.
+        static constexpr int TOO_SMALL = -2;
+
+        /**
+         * @brief           Constructor for the ReceiveQueue class that allocates the cells of the ring.
+         * @param capacity  size_t maximum number of messages held in the queue, at least 1.
+         */
+        ReceiveQueue(size_t capacity);
+
+        /**
+         * @brief Delete the cloning constructor so the queue can't be copied.
+         */
+        ReceiveQueue(const ReceiveQueue &) = delete;
+
+        /**
+         * @brief   Method capacity gets the maximum number of messages held in the queue.
+         * @return  size_t capacity of the ring.
+         */
+        size_t capacity();
+
+        /**
+         * @brief   Method size gets the number of messages in the queue, which may already be out of date when
+         *          consumers are taking messages.
+         * @return  size_t number of messages in the queue.
+         */
+        size_t size();
+
+        /**
+         * @brief   Method empty checks if the queue holds no messages. For the producer a queue that is empty stays
+         *          empty until it adds a message.
+         * @return  bool true if the queue is empty.
+         */
+        bool empty();
+
+        /**
+         * @brief   Method full checks if a message can not be added. For the producer a queue that is not full stays
+         *          that way until it adds a message.
+         * @return  bool true if the queue is full.
+         */
+        bool full();
+
+        /**
+         * @brief       Method available checks if a number of messages can be added one after the other. For the
+         *              producer the room stays available until it adds a message.
+         * @param count size_t number of messages.
+         * @return      bool true if the next count cells of the queue are free.
+         */
+        bool available(size_t count);
+
+        /**
+         * @brief   Method reserve gets the buffer of the free cell at the back of the queue, into which the producer
+         *          writes (or swaps) the payload of the next message before adding it with commit().
+         * @return  vector<char> * buffer of the cell, null if the queue is full.
+         * @note    Only the producer may call the method.
+         */
+        std::vector<char> *reserve();
+
+        /**
+         * @brief           Method commit adds the message written into the buffer returned by reserve() to the queue.
+         * @param sender    const udp::endpoint & endpoint that sent the message.
+         * @param stream    uint16_t stream the message was sent on.
+         * @note            Only the producer may call the method, after reserve() returned a buffer.
+         */
+        void commit(const boost::asio::ip::udp::endpoint &sender, uint16_t stream);
+
+        /**
+         * @brief           Method pop takes the message at the front of the queue by copying it into a buffer.
+         * @param buf       [out]   char * buffer to which the message will be written.
+         * @param len       int length of the buffer in bytes.
+         * @param sender    [out]   udp::endpoint & endpoint that sent the message.
+         * @param stream    [out]   uint16_t & stream the message was sent on.
+         * @return          int length in bytes of the message, EMPTY if there was none or TOO_SMALL if it does not
+         *                  fit in the buffer, in which case it is left at the front of the queue.
+         */
+        int pop(char *buf, int len, boost::asio::ip::udp::endpoint &sender, uint16_t &stream);
+
+        /**
+         * @brief           Method pop takes the message at the front of the queue by swapping its buffer.
+         * @param payload   [in/out] vector<char> & buffer that takes the message, its old contents are kept by the cell.
+         * @param sender    [out]   udp::endpoint & endpoint that sent the message.
+         * @param stream    [out]   uint16_t & stream the message was sent on.
+         * @return          bool true if a message was taken, false if the queue was empty.
+         */
+        bool pop(std::vector<char> &payload, boost::asio::ip::udp::endpoint &sender, uint16_t &stream);
+
+    private:
+        /**
+         * @brief   Struct Cell holds one message of the ring.
+         */
+        struct Cell
+        {
+            /// Position the cell is free for, or that position plus one once it holds a message.
+            std::atomic<size_t> sequence;
+            /// Length in bytes of the message, atomic as consumers read it before knowing that they own the cell.
+            std::atomic<int> len;
+            /// Buffer holding the payload of the message, reused by later messages.
+            std::vector<char> payload;
+            /// Endpoint that sent the message.
+            boost::asio::ip::udp::endpoint sender;
+            /// Stream the message was sent on.
+            uint16_t stream;
+        };
+
+        /// Cells of the ring, position p is held by cell p % capacity.
+        std::unique_ptr<Cell[]> cells;
+        /// Number of cells of the ring.
+        size_t cell_count;
+        /// Position at which the producer adds the next message, on its own cache line.
+        alignas(64) std::atomic<size_t> write_position;
+        /// Position of the next message to be taken, on its own cache line.
+        alignas(64) std::atomic<size_t> read_position;
+
+        /**
+         * @brief           Method claim takes ownership of the cell at the front of the queue.
+         * @param len       int largest message that can be taken, the message is left in the queue if it is larger.
+         * @param result    [out]   int length of the message, or EMPTY or TOO_SMALL if no cell was claimed.
+         * @return          Cell * cell that is now owned by the caller, null if none was claimed.
+         */
+        Cell *claim(int len, int &result);
+
+        /**
+         * @brief       Method release frees a cell claimed with claim() for the producer to reuse.
+         * @param cell  Cell & cell being freed.
+         */
+        void release(Cell &cell);
+    };
+}
+
+#endif /* RECEIVEQUEUE_HPP */
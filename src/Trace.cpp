@@ -0,0 +1,130 @@
+/**
+ * @file 	Trace.cpp
+ * @author 	James Horner (jwehorner@gmail.com)
+ * @brief 	File Trace.cpp contains the definition of the TraceRecord struct and the TraceBuffer class of the RUDP library.
+ * @details A connection describes what it does with each packet as fixed-size binary trace records, which it gives
+ * 			to a handler or writes to a lock-free ring that another thread drains, and the records are only turned
+ * 			into text when they are decoded here.
+ * @date 	2022-07-18
+ * @copyright Copyright (c) 2022
+ */
+#ifndef TRACE_CPP
+#define TRACE_CPP
+
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace rudp;
+
+boost::asio::ip::udp::endpoint TraceRecord::endpoint() const
+{
+	boost::asio::ip::address address;
+	if (peer.v6)
+	{
+		address = boost::asio::ip::address_v6(peer.address);
+	}
+	else
+	{
+		boost::asio::ip::address_v4::bytes_type bytes;
+		memcpy(bytes.data(), peer.address.data(), bytes.size());
+		address = boost::asio::ip::address_v4(bytes);
+	}
+	return boost::asio::ip::udp::endpoint(address, peer.port);
+}
+
+std::string TraceRecord::to_string() const
+{
+	boost::asio::ip::udp::endpoint peer_endpoint = endpoint();
+	std::string peer_name = peer_endpoint.address().to_string() + ":" + std::to_string(peer_endpoint.port());
+	std::string sequence_name = std::to_string(sequence);
+	std::string message = "[RUDP] (TRACE) " + std::to_string(timestamp_ns / 1000) + " us ";
+	switch (event)
+	{
+	case TRACE_DATA_RECEIVED:
+		message += "[RECV] (SEQ-RECV: " + std::to_string(extra) + ") Received packet " + sequence_name + " with " + std::to_string(value) + " bytes from " + peer_name;
+		break;
+	case TRACE_DATA_SENT:
+		message += "[SEND] (SEQ-SEND: " + sequence_name + ") Sent " + std::to_string(value) + " bytes to " + peer_name;
+		break;
+	case TRACE_ACK_SENT:
+		message += "[RECV] (SEQ-RECV: " + sequence_name + ") Sent ACK with " + std::to_string(value) + " bytes to " + peer_name;
+		break;
+	case TRACE_ACK_RECEIVED:
+		message += "[SEND] (SEQ-SEND: " + sequence_name + ") Received ACK up to " + std::to_string(value) + " with SACK " + std::to_string(extra) + " from " + peer_name;
+		break;
+	case TRACE_RTT_MEASURED:
+		message += "[SEND] Measured round trip time of " + std::to_string(value) + " us to " + peer_name + ", timeout is " + std::to_string(extra) + " us";
+		break;
+	case TRACE_PACKET_HELD:
+		message += "[RECV] (SEQ-RECV: " + std::to_string(extra) + ") Holding packet " + sequence_name + " received out of order from " + peer_name;
+		break;
+	case TRACE_NEW_SESSION:
+		message += "[RECV] Received new session " + std::to_string(value) + " from " + peer_name + " starting from " + sequence_name;
+		break;
+	case TRACE_BASE_SKIPPED:
+		message += "[RECV] (SEQ-RECV: " + sequence_name + ") Received window base ahead of current sequence number from " + peer_name + " skipping to " + std::to_string(value);
+		break;
+	case TRACE_QUEUE_FULL:
+		message += "[RECV] (SEQ-RECV: " + sequence_name + ") Receive queue full, dropping packet from " + peer_name;
+		break;
+	case TRACE_FRAGMENT_DROPPED:
+		message += "[RECV] (SEQ-RECV: " + sequence_name + ") Dropping fragment of incomplete message from " + peer_name;
+		break;
+	case TRACE_PACKET_DROPPED:
+		message += "[RECV] (SEQ-RECV: " + std::to_string(extra) + ") Dropping packet " + sequence_name + " too far ahead to hold from " + peer_name;
+		break;
+	case TRACE_TIMEOUT:
+		message += "[SEND] (SEQ-SEND: " + sequence_name + ") Timed out after " + std::to_string(value) + " tries when receiving ACK from " + peer_name;
+		break;
+	case TRACE_PACKET_ABANDONED:
+		message += "[SEND] (SEQ-SEND: " + sequence_name + ") Abandoned packet to " + peer_name + " after " + std::to_string(value) + " tries";
+		break;
+	case TRACE_STALE_SESSION:
+		message += "Dropping packet " + sequence_name + " of stale session " + std::to_string(value) + " with " + peer_name;
+		break;
+	case TRACE_MESSAGE_TOO_LARGE:
+		message += "[RECV] (SEQ-RECV: " + std::to_string(extra) + ") Dropping packet " + sequence_name + " of message with " + std::to_string(value) + " bytes from " + peer_name + " larger than the maximum message size";
+		break;
+	default:
+		message += "Unknown event " + std::to_string((int)event) + " with sequence " + sequence_name + " for " + peer_name;
+		break;
+	}
+	return message + "\n";
+}
+
+TraceBuffer::TraceBuffer(size_t capacity) : records(new TraceRecord[capacity]), record_count(capacity), dropped_count(0), write_position(0), read_position(0) {}
+
+bool TraceBuffer::push(const TraceRecord &record)
+{
+	size_t write = write_position.load(std::memory_order_relaxed);
+	if (write - read_position.load(std::memory_order_acquire) >= record_count)
+	{
+		dropped_count.store(dropped_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return false;
+	}
+	records[write % record_count] = record;
+	write_position.store(write + 1, std::memory_order_release);
+	return true;
+}
+
+size_t TraceBuffer::pop(TraceRecord *out, size_t count)
+{
+	size_t read = read_position.load(std::memory_order_relaxed);
+	size_t taken = std::min(count, write_position.load(std::memory_order_acquire) - read);
+	for (size_t i = 0; i < taken; i++)
+	{
+		out[i] = records[(read + i) % record_count];
+	}
+	// Free the records for the producer only once they have been copied.
+	read_position.store(read + taken, std::memory_order_release);
+	return taken;
+}
+
+uint64_t TraceBuffer::dropped()
+{
+	return dropped_count.load(std::memory_order_relaxed);
+}
+
+#endif /* TRACE_CPP */
@@ -0,0 +1,174 @@
+/**
+ * @file 	Trace.hpp
+ * @author 	James Horner (jwehorner@gmail.com)
+ * @brief 	File Trace.hpp contains the declaration of the TraceRecord struct and the TraceBuffer class of the RUDP library.
+ * @details A connection describes what it does with each packet as fixed-size binary trace records, which it gives
+ * 			to a handler or writes to a lock-free ring that another thread drains, so that tracing costs a copy of
+ * 			a few bytes rather than building and printing a string. Records can be decoded later with to_string().
+ * 			Trace points above the level RUDP_TRACE_LEVEL are compiled out.
+ * @date 	2022-07-18
+ * @copyright Copyright (c) 2022
+ */
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+// Standard Libraries
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+// Boost networking libraries
+#include <boost/asio.hpp>
+
+#include "rudp_macros.h"
+#include "PeerTable.hpp"
+
+/**
+ * @brief   Macro RUDP_TRACE records a trace event from a method of Connection if its level is compiled in and the
+ *          connection is being traced. The arguments after the level are those of Connection::trace().
+ */
+#define RUDP_TRACE(level, ...)                             \
+    do                                                     \
+    {                                                      \
+        if ((level) <= RUDP_TRACE_LEVEL && tracing)        \
+        {                                                  \
+            trace(__VA_ARGS__);                            \
+        }                                                  \
+    } while (0)
+
+namespace rudp
+{
+    /**
+     * @brief   Enum TraceEvent lists the events a connection traces, with the meaning of the fields of their records.
+     */
+    enum TraceEvent : uint8_t
+    {
+        /// A data packet was received: sequence of the packet, value its length, extra the next sequence expected.
+        TRACE_DATA_RECEIVED,
+        /// A data packet was sent: sequence of the packet, value the bytes sent.
+        TRACE_DATA_SENT,
+        /// An ACK was sent on its own: sequence of the packet acknowledged, value the bytes sent.
+        TRACE_ACK_SENT,
+        /// An ACK was received: sequence of the packet acknowledged, value the cumulative sequence, extra the SACK bits.
+        TRACE_ACK_RECEIVED,
+        /// A round trip time was measured: value the time in microseconds, extra the new timeout in microseconds.
+        TRACE_RTT_MEASURED,
+        /// A packet received ahead of a missing one was held: sequence of the packet, extra the next sequence expected.
+        TRACE_PACKET_HELD,
+        /// A packet started a new session with its sender: sequence of the window base, value the epoch.
+        TRACE_NEW_SESSION,
+        /// The sender abandoned packets so the receiver skipped them: sequence skipped from, value the window base.
+        TRACE_BASE_SKIPPED,
+        /// A packet was left unacknowledged as the receive queue was full: sequence of the next sequence expected.
+        TRACE_QUEUE_FULL,
+        /// A fragment of a message whose earlier fragments were abandoned was dropped: sequence of the fragment.
+        TRACE_FRAGMENT_DROPPED,
+        /// A packet was dropped as it was too far ahead to hold: sequence of the packet, extra the next sequence expected.
+        TRACE_PACKET_DROPPED,
+        /// A packet timed out waiting for its ACK: sequence of the packet, value its transmissions so far.
+        TRACE_TIMEOUT,
+        /// A packet was abandoned with its message: sequence of the packet, value its transmissions.
+        TRACE_PACKET_ABANDONED,
+        /// A packet or ACK of a session the sender has left was dropped: sequence of the packet, value its epoch.
+        TRACE_STALE_SESSION,
+        /// A packet was dropped as its message is larger than the maximum message size: sequence of the packet,
+        /// value the message length, extra the next sequence expected.
+        TRACE_MESSAGE_TOO_LARGE
+    };
+
+    /**
+     * @brief   Struct TraceRecord is one fixed-size binary trace event.
+     */
+    struct TraceRecord
+    {
+        /// Time of the event in nanoseconds of the steady clock.
+        int64_t timestamp_ns;
+        /// First value of the event, see TraceEvent.
+        uint32_t value;
+        /// Second value of the event, see TraceEvent.
+        uint32_t extra;
+        /// Endpoint the packet of the event was sent to or received from.
+        PeerKey peer;
+        /// Sequence number of the event, see TraceEvent.
+        uint32_t sequence;
+        /// Type of the event, a TraceEvent.
+        uint8_t event;
+
+        /**
+         * @brief   Method endpoint gets the endpoint the packet of the event was sent to or received from.
+         * @return  udp::endpoint endpoint of the peer.
+         */
+        boost::asio::ip::udp::endpoint endpoint() const;
+
+        /**
+         * @brief   Method to_string decodes the record into a line of text.
+         * @return  std::string description of the event, ending with a new line.
+         */
+        std::string to_string() const;
+    };
+
+    /**
+     * @brief   Type TraceHandler is a function that is given every trace record of a connection as it is made,
+     *          from any thread while the connection mutex is held, so it must be quick and must not call the
+     *          connection.
+     */
+    typedef std::function<void(const TraceRecord &record)> TraceHandler;
+
+    /**
+     * @brief   Class TraceBuffer is a bounded lock-free ring of trace records with a single producer and a single
+     *          consumer. Records made while the ring is full are counted and dropped, so tracing never blocks.
+     */
+    class TraceBuffer
+    {
+    public:
+        /**
+         * @brief           Constructor for the TraceBuffer class that allocates the records of the ring.
+         * @param capacity  size_t maximum number of records held in the ring, at least 1.
+         */
+        TraceBuffer(size_t capacity);
+
+        /**
+         * @brief Delete the cloning constructor so the ring can't be copied.
+         */
+        TraceBuffer(const TraceBuffer &) = delete;
+
+        /**
+         * @brief           Method push adds a record to the ring.
+         * @param record    const TraceRecord & record to add.
+         * @return          bool true if it was added, false if the ring was full and it was dropped.
+         * @note            Only the producer may call the method.
+         */
+        bool push(const TraceRecord &record);
+
+        /**
+         * @brief           Method pop takes the oldest records from the ring.
+         * @param records   [out]   TraceRecord * array to which the records will be written.
+         * @param count     size_t maximum number of records to take.
+         * @return          size_t number of records taken.
+         * @note            Only the consumer may call the method.
+         */
+        size_t pop(TraceRecord *records, size_t count);
+
+        /**
+         * @brief   Method dropped gets the number of records dropped because the ring was full.
+         * @return  uint64_t number of records dropped.
+         */
+        uint64_t dropped();
+
+    private:
+        /// Records of the ring, position p is held by record p % capacity.
+        std::unique_ptr<TraceRecord[]> records;
+        /// Number of records of the ring.
+        size_t record_count;
+        /// Number of records dropped because the ring was full.
+        std::atomic<uint64_t> dropped_count;
+        /// Position at which the producer adds the next record, on its own cache line.
+        alignas(64) std::atomic<size_t> write_position;
+        /// Position of the next record to be taken, on its own cache line.
+        alignas(64) std::atomic<size_t> read_position;
+    };
+}
+
+#endif /* TRACE_HPP */
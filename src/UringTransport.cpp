@@ -0,0 +1,440 @@
+/**
+ * @file 	UringTransport.cpp
+ * @author 	James Horner (jwehorner@gmail.com)
+ * @brief 	File UringTransport.cpp contains the definition of the UringTransport class of the RUDP library.
+ * @details The ring is set up with the system calls of the kernel directly, so no library is needed beyond the
+ * 			kernel headers.
+ * @date 	2022-07-18
+ * @copyright Copyright (c) 2022
+ */
+#ifndef URINGTRANSPORT_CPP
+#define URINGTRANSPORT_CPP
+
+#include "UringTransport.hpp"
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace rudp;
+
+/// User data of the completions of the multishot receive.
+static const uint64_t URING_RECEIVE_TAG = 1;
+/// User data of the completion of the cancellation of the receive.
+static const uint64_t URING_CANCEL_TAG = 2;
+/// Bit set in the user data of the completions of sends, whose other bits are the index of the datagram.
+static const uint64_t URING_SEND_TAG = 1ull << 63;
+/// Group of the provided buffers.
+static const uint16_t URING_BUFFER_GROUP = 0;
+
+/**
+ * @brief       Function uring_error makes the error of a failed step of setting up a ring.
+ * @param step  const std::string & step that failed.
+ * @param error int error number.
+ * @return      std::runtime_error error to be thrown.
+ */
+static std::runtime_error uring_error(const std::string &step, int error)
+{
+	return std::runtime_error("[RUDP] (ERROR) [INIT] Error setting up io_uring: " + step + " failed with error: " + strerror(error));
+}
+
+UringTransport::UringTransport(int socket) : ring(-1), event(-1), queue_memory(MAP_FAILED), queue_memory_size(0), sqes((io_uring_sqe *)MAP_FAILED), sqes_size(0), unsubmitted(0), buffer_ring((io_uring_buf_ring *)MAP_FAILED), buffers((char *)MAP_FAILED), buffer_tail(0), receiving(false), receive_stopped(false)
+{
+	// The kernel writes a header and the sender's address in front of the payload of each datagram.
+	buffer_size = sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in6) + 65536;
+	receive_header = msghdr();
+	receive_header.msg_namelen = sizeof(sockaddr_in6);
+	held_buffers.reserve(URING_BUFFER_COUNT);
+	try
+	{
+		io_uring_params params = io_uring_params();
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = URING_COMPLETION_ENTRIES;
+		ring = (int)syscall(__NR_io_uring_setup, URING_SUBMISSION_ENTRIES, &params);
+		if (ring < 0)
+		{
+			throw uring_error("io_uring_setup", errno);
+		}
+		// Completions must not be dropped when the queue overflows, and the two queues must share their mapping.
+		if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP))
+		{
+			throw uring_error("checking the features of the kernel", ENOTSUP);
+		}
+		queue_memory_size = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned), params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+		queue_memory = mmap(nullptr, queue_memory_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+		if (queue_memory == MAP_FAILED)
+		{
+			throw uring_error("mapping the queues", errno);
+		}
+		sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+		sqes = (io_uring_sqe *)mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+		if (sqes == MAP_FAILED)
+		{
+			throw uring_error("mapping the submission entries", errno);
+		}
+		char *queues = (char *)queue_memory;
+		sq_head = (unsigned *)(queues + params.sq_off.head);
+		sq_tail = (unsigned *)(queues + params.sq_off.tail);
+		sq_mask = (unsigned *)(queues + params.sq_off.ring_mask);
+		sq_array = (unsigned *)(queues + params.sq_off.array);
+		cq_head = (unsigned *)(queues + params.cq_off.head);
+		cq_tail = (unsigned *)(queues + params.cq_off.tail);
+		cq_mask = (unsigned *)(queues + params.cq_off.ring_mask);
+		cq_flags = (unsigned *)(queues + params.cq_off.flags);
+		cqes = (io_uring_cqe *)(queues + params.cq_off.cqes);
+		// Each slot of the submission queue always holds the entry of the same index.
+		for (unsigned i = 0; i < params.sq_entries; i++)
+		{
+			sq_array[i] = i;
+		}
+
+		// The socket is registered so the kernel does not look up the descriptor for each datagram.
+		if (syscall(__NR_io_uring_register, ring, IORING_REGISTER_FILES, &socket, 1) < 0)
+		{
+			throw uring_error("registering the socket", errno);
+		}
+		// The completions signal the eventfd, except while send() is waiting for its own.
+		event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (event < 0)
+		{
+			throw uring_error("eventfd", errno);
+		}
+		if (syscall(__NR_io_uring_register, ring, IORING_REGISTER_EVENTFD, &event, 1) < 0)
+		{
+			throw uring_error("registering the eventfd", errno);
+		}
+
+		buffer_ring = (io_uring_buf_ring *)mmap(nullptr, URING_BUFFER_COUNT * sizeof(io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (buffer_ring == MAP_FAILED)
+		{
+			throw uring_error("allocating the buffer ring", errno);
+		}
+		io_uring_buf_reg registration = io_uring_buf_reg();
+		registration.ring_addr = (uint64_t)buffer_ring;
+		registration.ring_entries = URING_BUFFER_COUNT;
+		registration.bgid = URING_BUFFER_GROUP;
+		if (syscall(__NR_io_uring_register, ring, IORING_REGISTER_PBUF_RING, &registration, 1) < 0)
+		{
+			throw uring_error("registering the buffer ring", errno);
+		}
+		// The buffers are only backed by memory once the kernel writes datagrams into them.
+		buffers = (char *)mmap(nullptr, URING_BUFFER_COUNT * buffer_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (buffers == MAP_FAILED)
+		{
+			throw uring_error("allocating the buffers", errno);
+		}
+		for (uint16_t i = 0; i < URING_BUFFER_COUNT; i++)
+		{
+			held_buffers.push_back(i);
+		}
+		provide_buffers();
+	}
+	catch (...)
+	{
+		close();
+		throw;
+	}
+}
+
+UringTransport::~UringTransport()
+{
+	try
+	{
+		stop();
+	}
+	catch (...)
+	{
+	}
+	close();
+}
+
+int UringTransport::descriptor() const
+{
+	return event;
+}
+
+void UringTransport::start_receive()
+{
+	if (receiving || receive_stopped)
+	{
+		return;
+	}
+	// The receive takes a buffer for each datagram from the group and keeps going until it runs out of them.
+	io_uring_sqe *sqe = get_sqe();
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = 0;
+	sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->addr = (uint64_t)&receive_header;
+	sqe->len = 1;
+	sqe->buf_group = URING_BUFFER_GROUP;
+	sqe->user_data = URING_RECEIVE_TAG;
+	receiving = true;
+	submit(0);
+}
+
+void UringTransport::receive(std::vector<UringDatagram> &datagrams)
+{
+	for (const io_uring_cqe &cqe : early_completions)
+	{
+		handle_receive_completion(cqe, &datagrams);
+	}
+	early_completions.clear();
+	unsigned head = *cq_head;
+	unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++)
+	{
+		const io_uring_cqe &cqe = cqes[head & *cq_mask];
+		if (cqe.user_data == URING_RECEIVE_TAG)
+		{
+			handle_receive_completion(cqe, &datagrams);
+		}
+	}
+	__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+}
+
+void UringTransport::release()
+{
+	provide_buffers();
+	start_receive();
+}
+
+void UringTransport::provide_buffers()
+{
+	// Every buffer is either held or owned by the kernel, so the ring of provided buffers cannot overflow. The
+	// entries are indexed from the start of the ring, as the flexible array of the kernel header is not laid out
+	// the same way in C++.
+	unsigned mask = URING_BUFFER_COUNT - 1;
+	io_uring_buf *entries = (io_uring_buf *)buffer_ring;
+	for (uint16_t buffer : held_buffers)
+	{
+		io_uring_buf &entry = entries[buffer_tail & mask];
+		entry.addr = (uint64_t)(buffers + buffer * buffer_size);
+		entry.len = buffer_size;
+		entry.bid = buffer;
+		buffer_tail++;
+	}
+	held_buffers.clear();
+	__atomic_store_n(&buffer_ring->tail, buffer_tail, __ATOMIC_RELEASE);
+}
+
+void UringTransport::send(msghdr *messages, size_t count, int *results)
+{
+	__atomic_store_n(cq_flags, *cq_flags | IORING_CQ_EVENTFD_DISABLED, __ATOMIC_RELEASE);
+	for (size_t first = 0; first < count;)
+	{
+		unsigned batch = (unsigned)std::min(count - first, (size_t)URING_SUBMISSION_ENTRIES);
+		for (unsigned i = 0; i < batch; i++)
+		{
+			io_uring_sqe *sqe = get_sqe();
+			sqe->opcode = IORING_OP_SENDMSG;
+			sqe->fd = 0;
+			sqe->flags = IOSQE_FIXED_FILE;
+			sqe->addr = (uint64_t)&messages[first + i];
+			sqe->len = 1;
+			sqe->user_data = URING_SEND_TAG | (first + i);
+		}
+		// Submit the batch and wait for it in the same system call, keeping any receive completions for later.
+		unsigned pending = batch;
+		submit(pending);
+		while (true)
+		{
+			unsigned head = *cq_head;
+			unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+			for (; head != tail; head++)
+			{
+				const io_uring_cqe &cqe = cqes[head & *cq_mask];
+				if (cqe.user_data & URING_SEND_TAG)
+				{
+					results[cqe.user_data & ~URING_SEND_TAG] = cqe.res;
+					pending--;
+				}
+				else if (cqe.user_data == URING_RECEIVE_TAG)
+				{
+					early_completions.push_back(cqe);
+				}
+			}
+			__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+			if (pending == 0)
+			{
+				break;
+			}
+			submit(pending);
+		}
+		first += batch;
+	}
+	// Take the receive completions that arrived while the eventfd was disabled, and signal it for them so that
+	// they are still handled.
+	__atomic_store_n(cq_flags, *cq_flags & ~IORING_CQ_EVENTFD_DISABLED, __ATOMIC_RELEASE);
+	unsigned head = *cq_head;
+	unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++)
+	{
+		const io_uring_cqe &cqe = cqes[head & *cq_mask];
+		if (cqe.user_data == URING_RECEIVE_TAG)
+		{
+			early_completions.push_back(cqe);
+		}
+	}
+	__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+	if (!early_completions.empty())
+	{
+		eventfd_write(event, 1);
+	}
+}
+
+void UringTransport::stop()
+{
+	if (ring < 0)
+	{
+		return;
+	}
+	receive_stopped = true;
+	if (receiving)
+	{
+		io_uring_sqe *sqe = get_sqe();
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = URING_RECEIVE_TAG;
+		sqe->user_data = URING_CANCEL_TAG;
+		submit(0);
+	}
+	// The receive has stopped once its last completion, which does not have the more flag, has been taken.
+	for (const io_uring_cqe &cqe : early_completions)
+	{
+		handle_receive_completion(cqe, nullptr);
+	}
+	early_completions.clear();
+	while (receiving)
+	{
+		submit(1);
+		unsigned head = *cq_head;
+		unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++)
+		{
+			const io_uring_cqe &cqe = cqes[head & *cq_mask];
+			if (cqe.user_data == URING_RECEIVE_TAG)
+			{
+				handle_receive_completion(cqe, nullptr);
+			}
+		}
+		__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+	}
+	held_buffers.clear();
+	// The ring keeps its reference to the socket until it is torn down, later, by the kernel, which would hold
+	// the port after the socket is closed, so the socket is unregistered now that nothing is using it.
+	syscall(__NR_io_uring_register, ring, IORING_UNREGISTER_FILES, nullptr, 0);
+}
+
+void UringTransport::close()
+{
+	// Closing the ring drops its references to the socket and to the buffer ring.
+	if (ring >= 0)
+	{
+		::close(ring);
+		ring = -1;
+	}
+	if (event >= 0)
+	{
+		::close(event);
+		event = -1;
+	}
+	if (queue_memory != MAP_FAILED)
+	{
+		munmap(queue_memory, queue_memory_size);
+		queue_memory = MAP_FAILED;
+	}
+	if (sqes != MAP_FAILED)
+	{
+		munmap(sqes, sqes_size);
+		sqes = (io_uring_sqe *)MAP_FAILED;
+	}
+	if (buffer_ring != MAP_FAILED)
+	{
+		munmap(buffer_ring, URING_BUFFER_COUNT * sizeof(io_uring_buf));
+		buffer_ring = (io_uring_buf_ring *)MAP_FAILED;
+	}
+	if (buffers != MAP_FAILED)
+	{
+		munmap(buffers, URING_BUFFER_COUNT * buffer_size);
+		buffers = (char *)MAP_FAILED;
+	}
+}
+
+io_uring_sqe *UringTransport::get_sqe()
+{
+	unsigned tail = *sq_tail;
+	if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) > *sq_mask)
+	{
+		submit(0);
+	}
+	io_uring_sqe *sqe = &sqes[tail & *sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+	unsubmitted++;
+	return sqe;
+}
+
+void UringTransport::submit(unsigned wait)
+{
+	while (true)
+	{
+		int submitted = (int)syscall(__NR_io_uring_enter, ring, unsubmitted, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+		if (submitted >= 0)
+		{
+			unsubmitted -= std::min((unsigned)submitted, unsubmitted);
+			return;
+		}
+		if (errno != EINTR)
+		{
+			throw std::runtime_error(std::string("[RUDP] (ERROR) [SEND] Error submitting to io_uring with error: ") + strerror(errno));
+		}
+	}
+}
+
+void UringTransport::handle_receive_completion(const io_uring_cqe &cqe, std::vector<UringDatagram> *datagrams)
+{
+	if (!(cqe.flags & IORING_CQE_F_MORE))
+	{
+		receiving = false;
+	}
+	if (cqe.flags & IORING_CQE_F_BUFFER)
+	{
+		uint16_t buffer = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+		held_buffers.push_back(buffer);
+		// The buffer holds the header of the receive, then the space kept for the address, then the payload.
+		char *data = buffers + buffer * buffer_size;
+		io_uring_recvmsg_out *out = (io_uring_recvmsg_out *)data;
+		if (datagrams != nullptr && cqe.res >= 0 && !(out->flags & MSG_TRUNC))
+		{
+			const char *payload = data + sizeof(io_uring_recvmsg_out) + receive_header.msg_namelen + receive_header.msg_controllen;
+			datagrams->push_back(UringDatagram{payload, out->payloadlen, (const sockaddr *)(data + sizeof(io_uring_recvmsg_out)), std::min(out->namelen, receive_header.msg_namelen), 0});
+		}
+	}
+	// The receive stops when the kernel runs out of buffers, and is started again once they are released. Other
+	// errors are reported, but one that means the kernel does not support the receive stops it for good.
+	if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED)
+	{
+		if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP)
+		{
+			receive_stopped = true;
+		}
+		if (datagrams != nullptr)
+		{
+			datagrams->push_back(UringDatagram{nullptr, 0, nullptr, 0, -cqe.res});
+		}
+	}
+}
+
+#endif /* __linux__ */
+
+#endif /* URINGTRANSPORT_CPP */
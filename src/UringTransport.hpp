@@ -0,0 +1,202 @@
+/**
+ * @file 	UringTransport.hpp
+ * @author 	James Horner (jwehorner@gmail.com)
+ * @brief 	File UringTransport.hpp contains the declaration of the UringTransport class of the RUDP library.
+ * @details On Linux a connection can move the datagrams of its socket through an io_uring instead of the Boost ASIO
+ * 			reactor: a single multishot receive reads every datagram into buffers the kernel picks from a ring of
+ * 			provided buffers, and each batch of data packets and ACKs is submitted to the kernel with one system
+ * 			call. The socket stays open in Boost ASIO, which still binds it and sends the datagrams of an impaired
+ * 			link.
+ * @date 	2022-07-18
+ * @copyright Copyright (c) 2022
+ */
+#ifndef URINGTRANSPORT_HPP
+#define URINGTRANSPORT_HPP
+
+#ifdef __linux__
+
+// Standard Libraries
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Socket and io_uring interfaces of the kernel
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+
+#include "rudp_macros.h"
+
+namespace rudp
+{
+    /// Number of submission queue entries of a ring, the most datagrams that are submitted with one system call.
+    constexpr unsigned URING_SUBMISSION_ENTRIES = 256;
+    /// Number of completion queue entries of a ring, which hold the datagrams received while a batch is handled.
+    constexpr unsigned URING_COMPLETION_ENTRIES = 4096;
+    /// Number of buffers the kernel receives datagrams into, a power of 2.
+    constexpr unsigned URING_BUFFER_COUNT = 128;
+
+    /**
+     * @brief   Struct UringDatagram is a datagram received by a ring, or an error of its receive.
+     */
+    struct UringDatagram
+    {
+        /// Bytes of the datagram, in a buffer of the ring held until UringTransport::release() is called.
+        const char *data;
+        /// Length in bytes of the datagram.
+        size_t length;
+        /// Address of the sender.
+        const sockaddr *name;
+        /// Length in bytes of the address.
+        socklen_t name_len;
+        /// Error number of a failed receive, in which case there is no datagram, 0 otherwise.
+        int error;
+    };
+
+    /**
+     * @brief   Class UringTransport sends and receives the datagrams of a socket through an io_uring.
+     * @details The socket is registered with the ring as a fixed file and read by one multishot receive, which
+     *          the kernel completes once for every datagram into a buffer taken from a ring of provided buffers.
+     *          The receive completions signal an eventfd, which the IO service waits on before calling receive(),
+     *          and the buffers of the datagrams received are given back to the kernel by release(). Sends are
+     *          submitted as one batch and waited for, as they complete straight away unless the socket is full,
+     *          so the caller sees the result of every datagram when send() returns. The transport is not thread
+     *          safe, the connection only uses it while holding its mutex.
+     */
+    class UringTransport
+    {
+    public:
+        /**
+         * @brief           Constructor for the UringTransport class that sets up the ring of a socket.
+         * @param socket    int descriptor of the socket, which must stay open until the transport is destroyed.
+         * @throws          runtime_error if the kernel does not support io_uring or the ring cannot be set up.
+         */
+        UringTransport(int socket);
+
+        /**
+         * @brief   Destructor for the UringTransport class which stops the receive and frees the ring.
+         */
+        ~UringTransport();
+
+        /**
+         * @brief Delete the cloning constructor so the ring can't be copied.
+         */
+        UringTransport(UringTransport &other) = delete;
+
+        /**
+         * @brief Delete the assignment operator so the ring can't be copied.
+         */
+        void operator=(const UringTransport &) = delete;
+
+        /**
+         * @brief   Method descriptor gets the eventfd that becomes readable when datagrams have been received.
+         * @return  int descriptor of the eventfd.
+         */
+        int descriptor() const;
+
+        /**
+         * @brief   Method start_receive starts the multishot receive of the socket unless it is running. The kernel
+         *          runs parts of the receive on the thread that started it, so it should be the thread of the IO
+         *          service.
+         */
+        void start_receive();
+
+        /**
+         * @brief           Method receive takes every datagram that has been received without blocking.
+         * @param datagrams [out]   std::vector<UringDatagram> & to which the datagrams are appended.
+         */
+        void receive(std::vector<UringDatagram> &datagrams);
+
+        /**
+         * @brief   Method release gives the buffers of the datagrams taken by receive() back to the kernel, and
+         *          restarts the receive if it stopped while the kernel had no buffers left.
+         */
+        void release();
+
+        /**
+         * @brief           Method send sends a batch of datagrams with one system call and waits for them to be sent.
+         * @param messages  msghdr * datagrams to be sent, each with the address it is sent to.
+         * @param count     size_t number of datagrams.
+         * @param results   [out]   int * number of bytes sent of each datagram, or the negative error number.
+         */
+        void send(msghdr *messages, size_t count, int *results);
+
+        /**
+         * @brief   Method stop cancels the receive, waits for the kernel to stop using the buffers and unregisters
+         *          the socket, after which the transport cannot be used.
+         */
+        void stop();
+
+    private:
+        /// Descriptor of the ring, -1 until it has been set up.
+        int ring;
+        /// Descriptor of the eventfd signalled by the receive completions.
+        int event;
+        /// Memory of the submission and completion queue rings, shared with the kernel.
+        void *queue_memory;
+        /// Size in bytes of the memory of the queue rings.
+        size_t queue_memory_size;
+        /// Submission queue entries, shared with the kernel.
+        io_uring_sqe *sqes;
+        /// Size in bytes of the submission queue entries.
+        size_t sqes_size;
+        /// Head, tail, mask and index array of the submission queue.
+        unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+        /// Head, tail, mask and flags of the completion queue.
+        unsigned *cq_head, *cq_tail, *cq_mask, *cq_flags;
+        /// Completion queue entries, shared with the kernel.
+        io_uring_cqe *cqes;
+        /// Number of entries added to the submission queue that have not been submitted.
+        unsigned unsubmitted;
+        /// Ring of provided buffers from which the kernel takes the buffer of each datagram.
+        io_uring_buf_ring *buffer_ring;
+        /// Memory of the provided buffers.
+        char *buffers;
+        /// Size in bytes of each provided buffer.
+        size_t buffer_size;
+        /// Tail of the ring of provided buffers, as it was last published to the kernel.
+        uint16_t buffer_tail;
+        /// Buffers of the datagrams taken by receive() that have not been released.
+        std::vector<uint16_t> held_buffers;
+        /// Header of the multishot receive, which gives the kernel the space kept for the sender's address.
+        msghdr receive_header;
+        /// Flag for if the multishot receive is running.
+        bool receiving;
+        /// Flag for if the receive must not be restarted, as it was stopped or is not supported.
+        bool receive_stopped;
+        /// Receive completions taken from the completion queue while waiting for sends.
+        std::vector<io_uring_cqe> early_completions;
+
+        /**
+         * @brief   Method close frees everything that has been set up.
+         */
+        void close();
+
+        /**
+         * @brief   Method provide_buffers adds the held buffers to the ring of provided buffers.
+         */
+        void provide_buffers();
+
+        /**
+         * @brief   Method get_sqe gets the next submission queue entry, submitting the queue first if it is full.
+         * @return  io_uring_sqe * cleared entry, which is submitted by the next call to submit().
+         */
+        io_uring_sqe *get_sqe();
+
+        /**
+         * @brief           Method submit submits the entries that have been added and waits for completions.
+         * @param wait      unsigned number of completions to wait for.
+         */
+        void submit(unsigned wait);
+
+        /**
+         * @brief           Method handle_receive_completion handles a completion of the multishot receive.
+         * @param cqe       const io_uring_cqe & completion.
+         * @param datagrams [out]   std::vector<UringDatagram> * to which the datagram is appended, null to release it.
+         */
+        void handle_receive_completion(const io_uring_cqe &cqe, std::vector<UringDatagram> *datagrams);
+    };
+}
+
+#endif /* __linux__ */
+
+#endif /* URINGTRANSPORT_HPP */
@@ -16,6 +16,22 @@
 
 using namespace rudp;
 
+void rudp_set_io_threads(int count, int pin_to_cores, int *error)
+{
+    try
+    {
+        ConnectionController::setIOServiceCount(count, pin_to_cores != 0);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
 int rudp_make_connection(int timeout_ms, int *error)
 {
     try
@@ -32,11 +48,134 @@ int rudp_make_connection(int timeout_ms, int *error)
     }
 }
 
+int rudp_make_connection_with_transport(int timeout_ms, int transport, int *error)
+{
+    try
+    {
+        int connection_number = ConnectionController::getInstance()->addConnection(timeout_ms, transport);
+        *error = 0;
+        return connection_number;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return -1;
+    }
+}
+
+int rudp_make_external_connection(int timeout_ms, int *error)
+{
+    try
+    {
+        int connection_number = ConnectionController::getInstance()->addExternalConnection(timeout_ms);
+        *error = 0;
+        return connection_number;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return -1;
+    }
+}
+
+int rudp_make_sharded_connections(int timeout_ms, unsigned short port, int shards, int *connections, int *error)
+{
+    try
+    {
+        if (shards < 1)
+        {
+            throw std::runtime_error("[RUDP] (ERROR) [INIT] Error adding sharded connections: there must be at least one shard.");
+        }
+        std::vector<int> connection_numbers = ConnectionController::getInstance()->addShardedConnections(timeout_ms, port, shards);
+        std::copy(connection_numbers.begin(), connection_numbers.end(), connections);
+        *error = 0;
+        return connection_numbers.size();
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return 0;
+    }
+}
+
+int rudp_get_fd(int connection, int *error)
+{
+    try
+    {
+        int fd = ConnectionController::getInstance()->acquireConnection(connection)->getFileDescriptor();
+        *error = 0;
+        return fd;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return -1;
+    }
+}
+
+int rudp_get_process_timeout(int connection, int *error)
+{
+    try
+    {
+        boost::posix_time::ptime deadline = ConnectionController::getInstance()->acquireConnection(connection)->getNextDeadline();
+        *error = 0;
+        if (deadline.is_pos_infinity())
+        {
+            return -1;
+        }
+        int64_t wait_us = (deadline - boost::asio::deadline_timer::traits_type::now()).total_microseconds();
+        return wait_us > 0 ? (int)std::min((wait_us + 999) / 1000, (int64_t)INT32_MAX) : 0;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return -1;
+    }
+}
+
+int rudp_process(int connection, int *error)
+{
+    try
+    {
+        size_t handlers = ConnectionController::getInstance()->acquireConnection(connection)->process();
+        *error = 0;
+        return (int)std::min(handlers, (size_t)INT32_MAX);
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return -1;
+    }
+}
+
+void rudp_remove_connection(int connection, int *error)
+{
+    try
+    {
+        ConnectionController::getInstance()->removeConnection(connection);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
 void rudp_set_remote_endpoint(int connection, char *address, unsigned short port, int *error)
 {
     try
     {
-        ConnectionController::getInstance()->getConnection(connection)->setEndpointRemote(std::string(address), port);
+        ConnectionController::getInstance()->acquireConnection(connection)->setEndpointRemote(std::string(address), port);
+        *error = 0;
         return;
     }
     catch (std::runtime_error runtime_error)
@@ -51,7 +190,8 @@ void rudp_set_local_endpoint(int connection, unsigned short port, int *error)
 {
     try
     {
-        ConnectionController::getInstance()->getConnection(connection)->setEndpointLocal(port);
+        ConnectionController::getInstance()->acquireConnection(connection)->setEndpointLocal(port);
+        *error = 0;
         return;
     }
     catch (std::runtime_error runtime_error)
@@ -66,7 +206,24 @@ void rudp_set_send_retries_limit(int connection, int send_retries_limit, int *er
 {
     try
     {
-        ConnectionController::getInstance()->getConnection(connection)->setSendRetriesLimit(send_retries_limit);
+        ConnectionController::getInstance()->acquireConnection(connection)->setSendRetriesLimit(send_retries_limit);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+void rudp_set_window_size(int connection, int window_size, int *error)
+{
+    try
+    {
+        ConnectionController::getInstance()->acquireConnection(connection)->setWindowSize(window_size);
+        *error = 0;
         return;
     }
     catch (std::runtime_error runtime_error)
@@ -81,7 +238,7 @@ void rudp_reset_connection_send(int connection, int *error)
 {
     try
     {
-        ConnectionController::getInstance()->getConnection(connection)->resetConnectionSend();
+        ConnectionController::getInstance()->acquireConnection(connection)->resetConnectionSend();
         *error = 0;
         return;
     }
@@ -97,7 +254,7 @@ void rudp_reset_connection_receive(int connection, int *error)
 {
     try
     {
-        ConnectionController::getInstance()->getConnection(connection)->resetConnectionReceive();
+        ConnectionController::getInstance()->acquireConnection(connection)->resetConnectionReceive();
         *error = 0;
         return;
     }
@@ -109,35 +266,722 @@ void rudp_reset_connection_receive(int connection, int *error)
     }
 }
 
-int rudp_send(int connection, const char *buf, int len, int *error)
+void rudp_set_mtu(int connection, int mtu, int *error)
 {
     try
     {
-        int sent_len = ConnectionController::getInstance()->getConnection(connection)->send(buf, len);
+        ConnectionController::getInstance()->acquireConnection(connection)->setMTU(mtu);
         *error = 0;
-        return sent_len;
+        return;
     }
     catch (std::runtime_error runtime_error)
     {
         std::cout << runtime_error.what() << std::endl;
         *error = -1;
-        return -1;
+        return;
     }
 }
 
-int rudp_receive(int connection, char *buf, int len, char *address_remote, int *port_remote, int *error)
+void rudp_set_ack_policy(int connection, int ack_packets, int ack_delay_us, int *error)
 {
     try
     {
-        int received_len = ConnectionController::getInstance()->getConnection(connection)->receive(buf, len, address_remote, port_remote);
+        ConnectionController::getInstance()->acquireConnection(connection)->setAckPolicy(ack_packets, ack_delay_us);
         *error = 0;
-        return received_len;
+        return;
     }
     catch (std::runtime_error runtime_error)
     {
         std::cout << runtime_error.what() << std::endl;
         *error = -1;
-        return -1;
+        return;
+    }
+}
+
+void rudp_set_adaptive_timeout(int connection, int adaptive, int *error)
+{
+    try
+    {
+        ConnectionController::getInstance()->acquireConnection(connection)->setAdaptiveTimeout(adaptive != 0);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+void rudp_set_timeout_limits(int connection, int min_ms, int max_ms, int *error)
+{
+    try
+    {
+        ConnectionController::getInstance()->acquireConnection(connection)->setTimeoutLimits(min_ms, max_ms);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+void rudp_set_peer_idle_timeout(int connection, int timeout_ms, int *error)
+{
+    try
+    {
+        ConnectionController::getInstance()->acquireConnection(connection)->setPeerIdleTimeout(timeout_ms);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+void rudp_set_max_message_size(int connection, int size, int *error)
+{
+    try
+    {
+        ConnectionController::getInstance()->acquireConnection(connection)->setMaxMessageSize(size);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+void rudp_set_buffer_pool_size(int connection, int bytes, int *error)
+{
+    try
+    {
+        ConnectionController::getInstance()->acquireConnection(connection)->setBufferPoolSize(bytes);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+void rudp_set_socket_buffer_sizes(int connection, int receive_bytes, int send_bytes, int *error)
+{
+    try
+    {
+        ConnectionController::getInstance()->acquireConnection(connection)->setSocketBufferSizes(receive_bytes, send_bytes);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+void rudp_set_dscp(int connection, int dscp, int *error)
+{
+    try
+    {
+        ConnectionController::getInstance()->acquireConnection(connection)->setDSCP(dscp);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+void rudp_set_busy_poll(int connection, int busy_poll_us, int *error)
+{
+    try
+    {
+        ConnectionController::getInstance()->acquireConnection(connection)->setBusyPoll(busy_poll_us);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+void rudp_set_segmentation_offload(int connection, int enabled, int *error)
+{
+    try
+    {
+        ConnectionController::getInstance()->acquireConnection(connection)->setSegmentationOffload(enabled != 0);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+void rudp_impairment_init(struct rudp_impairment *impairment)
+{
+    Impairment defaults;
+    impairment->loss = defaults.loss;
+    impairment->duplicate = defaults.duplicate;
+    impairment->reorder = defaults.reorder;
+    impairment->delay_us = defaults.delay_us;
+    impairment->jitter_us = defaults.jitter_us;
+    impairment->jitter_distribution = defaults.jitter_distribution;
+    impairment->reorder_delay_us = defaults.reorder_delay_us;
+    impairment->rate_bytes_per_s = defaults.rate_bytes_per_s;
+    impairment->queue_limit = defaults.queue_limit;
+    impairment->seed = defaults.seed;
+}
+
+void rudp_set_impairment(int connection, const struct rudp_impairment *impairment, int *error)
+{
+    try
+    {
+        ConnectionRef connection_ref = ConnectionController::getInstance()->acquireConnection(connection);
+        if (impairment == NULL)
+        {
+            connection_ref->clearImpairment();
+        }
+        else
+        {
+            Impairment link_impairment;
+            link_impairment.loss = impairment->loss;
+            link_impairment.duplicate = impairment->duplicate;
+            link_impairment.reorder = impairment->reorder;
+            link_impairment.delay_us = impairment->delay_us;
+            link_impairment.jitter_us = impairment->jitter_us;
+            link_impairment.jitter_distribution = (JitterDistribution)impairment->jitter_distribution;
+            link_impairment.reorder_delay_us = impairment->reorder_delay_us;
+            link_impairment.rate_bytes_per_s = impairment->rate_bytes_per_s;
+            link_impairment.queue_limit = impairment->queue_limit;
+            link_impairment.seed = impairment->seed;
+            connection_ref->setImpairment(link_impairment);
+        }
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+void rudp_set_congestion_control(int connection, int algorithm, int *error)
+{
+    try
+    {
+        ConnectionRef connection_ref = ConnectionController::getInstance()->acquireConnection(connection);
+        connection_ref->setCongestionControl(algorithm);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+void rudp_set_rate_limit(int connection, unsigned long long bytes_per_s, int *error)
+{
+    try
+    {
+        ConnectionRef connection_ref = ConnectionController::getInstance()->acquireConnection(connection);
+        connection_ref->setRateLimit(bytes_per_s);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+void rudp_set_coalescing(int connection, int delay_us, int *error)
+{
+    try
+    {
+        ConnectionRef connection_ref = ConnectionController::getInstance()->acquireConnection(connection);
+        connection_ref->setCoalescing(delay_us);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+int rudp_get_timeout(int connection, int *error)
+{
+    try
+    {
+        int timeout_ms = ConnectionController::getInstance()->acquireConnection(connection)->getTimeout();
+        *error = 0;
+        return timeout_ms;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return -1;
+    }
+}
+
+/**
+ * @brief       Function copy_stats copies the counters of connections into the struct of the C interface.
+ * @param from  const ConnectionStats & counters to copy.
+ * @param to    [out]   struct rudp_stats * to which the counters will be written.
+ */
+static void copy_stats(const ConnectionStats &from, struct rudp_stats *to)
+{
+    to->packets_sent = from.packets_sent;
+    to->packets_received = from.packets_received;
+    to->bytes_sent = from.bytes_sent;
+    to->bytes_received = from.bytes_received;
+    to->acks_sent = from.acks_sent;
+    to->acks_received = from.acks_received;
+    to->retransmissions = from.retransmissions;
+    to->timeouts = from.timeouts;
+    to->duplicates = from.duplicates;
+    to->packets_reordered = from.packets_reordered;
+    to->packets_dropped = from.packets_dropped;
+    to->messages_sent = from.messages_sent;
+    to->messages_received = from.messages_received;
+    to->messages_failed = from.messages_failed;
+    to->messages_expired = from.messages_expired;
+    to->kernel_drops = from.kernel_drops;
+    for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+    {
+        to->rtt_histogram[i] = from.rtt_histogram[i];
+        to->ack_latency_histogram[i] = from.ack_latency_histogram[i];
+    }
+}
+
+void rudp_get_stats(int connection, struct rudp_stats *stats, int *error)
+{
+    try
+    {
+        copy_stats(ConnectionController::getInstance()->acquireConnection(connection)->getStats(), stats);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+void rudp_get_global_stats(struct rudp_stats *stats, int *error)
+{
+    try
+    {
+        copy_stats(ConnectionController::getInstance()->getStats(), stats);
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+int rudp_send(int connection, const char *buf, int len, int *error)
+{
+    try
+    {
+        int sent_len = ConnectionController::getInstance()->acquireConnection(connection)->send(buf, len);
+        *error = 0;
+        return sent_len;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return -1;
+    }
+}
+
+int rudp_send_to(int connection, const char *buf, int len, char *address, unsigned short port, int *error)
+{
+    try
+    {
+        int sent_len = ConnectionController::getInstance()->acquireConnection(connection)->sendTo(buf, len, std::string(address), port);
+        *error = 0;
+        return sent_len;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return -1;
+    }
+}
+
+/**
+ * @brief           Function to_delivery converts a delivery of the C interface.
+ * @param delivery  const struct rudp_delivery * delivery to convert.
+ * @return          Delivery the delivery.
+ * @throws          runtime_error if the stream is not between 0 and USHRT_MAX.
+ */
+static Delivery to_delivery(const struct rudp_delivery *delivery)
+{
+    if (delivery->stream < 0 || delivery->stream > USHRT_MAX)
+    {
+        throw std::runtime_error("[RUDP] (ERROR) [SEND] Error sending packet: the stream must be between 0 and " + std::to_string(USHRT_MAX) + ".");
+    }
+    Delivery converted;
+    converted.delivery_class = (DeliveryClass)delivery->delivery_class;
+    converted.lifetime_ms = delivery->lifetime_ms;
+    converted.max_attempts = delivery->max_attempts;
+    converted.stream = (uint16_t)delivery->stream;
+    return converted;
+}
+
+void rudp_delivery_init(struct rudp_delivery *delivery)
+{
+    Delivery defaults;
+    delivery->delivery_class = defaults.delivery_class;
+    delivery->lifetime_ms = defaults.lifetime_ms;
+    delivery->max_attempts = defaults.max_attempts;
+    delivery->stream = defaults.stream;
+}
+
+int rudp_send_with_delivery(int connection, const char *buf, int len, const struct rudp_delivery *delivery, int *error)
+{
+    try
+    {
+        int sent_len = ConnectionController::getInstance()->acquireConnection(connection)->send(buf, len, to_delivery(delivery));
+        *error = 0;
+        return sent_len;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return -1;
+    }
+}
+
+int rudp_send_to_with_delivery(int connection, const char *buf, int len, char *address, unsigned short port, const struct rudp_delivery *delivery, int *error)
+{
+    try
+    {
+        int sent_len = ConnectionController::getInstance()->acquireConnection(connection)->sendTo(buf, len, std::string(address), port, to_delivery(delivery));
+        *error = 0;
+        return sent_len;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return -1;
+    }
+}
+
+int rudp_sendv(int connection, const struct iovec *iov, int iovcnt, int *error)
+{
+    try
+    {
+        int sent_len = ConnectionController::getInstance()->acquireConnection(connection)->sendv(iov, iovcnt);
+        *error = 0;
+        return sent_len;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return -1;
+    }
+}
+
+void rudp_message_init(struct rudp_message *message)
+{
+    message->buf = NULL;
+    message->len = 0;
+    message->address[0] = '\0';
+    message->port = 0;
+    rudp_delivery_init(&message->delivery);
+}
+
+/**
+ * @brief           Function set_batch_errors sets the error of each message of a batch, printing those that failed.
+ * @param messages  const std::vector<BatchMessage> & messages of the batch.
+ * @param errors    int * array of errors, one for each message.
+ */
+static void set_batch_errors(const std::vector<BatchMessage> &messages, int *errors)
+{
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+        errors[i] = messages[i].error ? -1 : 0;
+        if (messages[i].error)
+        {
+            try
+            {
+                std::rethrow_exception(messages[i].error);
+            }
+            catch (std::runtime_error runtime_error)
+            {
+                std::cout << runtime_error.what() << std::endl;
+            }
+        }
+    }
+}
+
+int rudp_send_batch(int connection, const struct rudp_message *messages, int count, int *errors)
+{
+    try
+    {
+        ConnectionRef connection_ref = ConnectionController::getInstance()->acquireConnection(connection);
+        // A message whose delivery can not be converted fails on its own, and the rest of the batch is still sent.
+        std::vector<BatchMessage> batch(std::max(count, 0));
+        std::vector<size_t> indices;
+        size_t valid = 0;
+        for (int i = 0; i < count; i++)
+        {
+            try
+            {
+                batch[valid].delivery = to_delivery(&messages[i].delivery);
+            }
+            catch (std::runtime_error runtime_error)
+            {
+                std::cout << runtime_error.what() << std::endl;
+                errors[i] = -1;
+                continue;
+            }
+            batch[valid].buf = messages[i].buf;
+            batch[valid].len = messages[i].len;
+            strncpy(batch[valid].address, messages[i].address, IPV4_ADDRESS_LENGTH_BYTES - 1);
+            batch[valid].port = messages[i].port;
+            indices.push_back(i);
+            ++valid;
+        }
+        batch.resize(valid);
+        int sent = (int)connection_ref->sendBatch(batch.data(), batch.size());
+        std::vector<int> batch_errors(valid);
+        set_batch_errors(batch, batch_errors.data());
+        for (size_t i = 0; i < valid; i++)
+        {
+            errors[indices[i]] = batch_errors[i];
+        }
+        return sent;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        for (int i = 0; i < count; i++)
+        {
+            errors[i] = -1;
+        }
+        return -1;
+    }
+}
+
+void rudp_async_send(int connection, const char *buf, int len, rudp_callback callback, void *context, int *error)
+{
+    try
+    {
+        ConnectionController::getInstance()->acquireConnection(connection)->asyncSend(buf, len, [connection, callback, context](int length, std::exception_ptr error_ptr)
+                                                                                   {
+            if (error_ptr)
+            {
+                try
+                {
+                    std::rethrow_exception(error_ptr);
+                }
+                catch (std::runtime_error runtime_error)
+                {
+                    std::cout << runtime_error.what() << std::endl;
+                }
+            }
+            callback(connection, length, error_ptr ? -1 : 0, context); });
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+void rudp_async_send_to(int connection, const char *buf, int len, char *address, unsigned short port, rudp_callback callback, void *context, int *error)
+{
+    try
+    {
+        ConnectionController::getInstance()->acquireConnection(connection)->asyncSendTo(buf, len, std::string(address), port, [connection, callback, context](int length, std::exception_ptr error_ptr)
+                                                                                     {
+            if (error_ptr)
+            {
+                try
+                {
+                    std::rethrow_exception(error_ptr);
+                }
+                catch (std::runtime_error runtime_error)
+                {
+                    std::cout << runtime_error.what() << std::endl;
+                }
+            }
+            callback(connection, length, error_ptr ? -1 : 0, context); });
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+void rudp_flush(int connection, int *error)
+{
+    try
+    {
+        ConnectionController::getInstance()->acquireConnection(connection)->flush();
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
+    }
+}
+
+int rudp_receive(int connection, char *buf, int len, char *address_remote, int *port_remote, int *error)
+{
+    try
+    {
+        int received_len = ConnectionController::getInstance()->acquireConnection(connection)->receive(buf, len, address_remote, port_remote);
+        *error = 0;
+        return received_len;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return -1;
+    }
+}
+
+int rudp_receive_with_stream(int connection, char *buf, int len, char *address_remote, int *port_remote, int *stream, int *error)
+{
+    try
+    {
+        uint16_t received_stream;
+        int received_len = ConnectionController::getInstance()->acquireConnection(connection)->receive(buf, len, address_remote, port_remote, &received_stream);
+        *stream = received_stream;
+        *error = 0;
+        return received_len;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return -1;
+    }
+}
+
+int rudp_receive_batch(int connection, struct rudp_message *messages, int count, int *errors)
+{
+    try
+    {
+        ConnectionRef connection_ref = ConnectionController::getInstance()->acquireConnection(connection);
+        std::vector<BatchMessage> batch(std::max(count, 0));
+        for (int i = 0; i < count; i++)
+        {
+            batch[i].buf = messages[i].buf;
+            batch[i].len = messages[i].len;
+        }
+        batch.resize(connection_ref->receiveBatch(batch.data(), batch.size()));
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            if (!batch[i].error)
+            {
+                messages[i].len = batch[i].result;
+                strcpy(messages[i].address, batch[i].address);
+                messages[i].port = batch[i].port;
+                messages[i].delivery.stream = batch[i].delivery.stream;
+            }
+        }
+        set_batch_errors(batch, errors);
+        return (int)batch.size();
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        for (int i = 0; i < count; i++)
+        {
+            errors[i] = -1;
+        }
+        return -1;
+    }
+}
+
+void rudp_async_receive(int connection, char *buf, int len, char *address_remote, int *port_remote, rudp_callback callback, void *context, int *error)
+{
+    try
+    {
+        ConnectionController::getInstance()->acquireConnection(connection)->asyncReceive(buf, len, address_remote, port_remote, [connection, callback, context](int length, std::exception_ptr error_ptr)
+                                                                                      {
+            if (error_ptr)
+            {
+                try
+                {
+                    std::rethrow_exception(error_ptr);
+                }
+                catch (std::runtime_error runtime_error)
+                {
+                    std::cout << runtime_error.what() << std::endl;
+                }
+            }
+            callback(connection, length, error_ptr ? -1 : 0, context); });
+        *error = 0;
+        return;
+    }
+    catch (std::runtime_error runtime_error)
+    {
+        std::cout << runtime_error.what() << std::endl;
+        *error = -1;
+        return;
     }
 }
 
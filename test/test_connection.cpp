@@ -1,6 +1,20 @@
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <iostream>
 #include <string>
 #include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
 
 #include "rudp_macros.h"
 #include "Connection.hpp"
@@ -25,9 +39,47 @@ void test_receiver_ahead_out_of_sync_recv_thread(bool *success);
 int test_multi_connection();
 void test_multi_connection_send_thread(unsigned short port, bool *success);
 void test_multi_connection_recv_thread(bool *success);
+int test_windowed_connection();
+void test_windowed_connection_send_thread(bool *success);
+void test_windowed_connection_recv_thread(bool *success);
+int test_async_connection();
+int test_io_service_pool();
+int test_multiplexed_connection();
+int test_receive_buffers();
+int test_steady_state_memory();
+int test_adaptive_timeout();
+int test_ack_policy();
+int test_fragmentation();
+int test_concurrent_receive();
+int test_reorder_buffer();
+int test_peer_eviction();
+int test_connection_handles();
+int test_stats();
+int test_trace();
+int test_impairment();
+int test_congestion_control();
+int test_delivery_classes();
+int test_streams();
+int test_coalescing();
+int test_batched_io();
+int test_batch();
+int test_external_loop();
+int test_uring_transport();
+int test_sharded_listener();
+int test_buffer_pool();
+int test_socket_tuning();
+int test_sequence_space();
+bool run_external_loop(vector<Connection *> connections, const function<bool()> &done, int timeout_ms);
+long resident_set_size_kb();
+void send_raw_data(boost::asio::ip::udp::socket &socket, unsigned short port, uint32_t sequence, uint32_t base, const string &message = "Hello World!", uint32_t epoch = 0, DeliveryClass delivery = DELIVERY_RELIABLE, uint16_t stream = 0);
+bool receive_raw_ack(boost::asio::ip::udp::socket &socket, char *type, uint32_t *sequence, uint32_t *cumulative, uint32_t *sack = nullptr, uint16_t *stream = nullptr, uint32_t *epoch = nullptr);
+bool receive_raw_data(boost::asio::ip::udp::socket &socket, boost::asio::ip::udp::endpoint *sender, uint32_t *sequence, int *offset, uint32_t *epoch = nullptr);
+void send_raw_ack(boost::asio::ip::udp::socket &socket, const boost::asio::ip::udp::endpoint &endpoint, uint32_t sequence, uint32_t cumulative, uint32_t epoch);
 
 int main()
 {
+	// Spread the connections across a pool of two IO services.
+	ConnectionController::setIOServiceCount(2, true);
 	int tests_passed = test_basic_connection();
 	cout << "Test basic connection passed " << tests_passed << "/1 test cases." << endl;
 	tests_passed = test_basic_controller();
@@ -38,6 +90,62 @@ int main()
 	cout << "Test sender ahead connection passed " << tests_passed << "/1 test cases." << endl;
 	tests_passed = test_receiver_ahead_out_of_sync();
 	cout << "Test receiver ahead connection passed " << tests_passed << "/1 test cases." << endl;
+	tests_passed = test_windowed_connection();
+	cout << "Test windowed connection passed " << tests_passed << "/1 test cases." << endl;
+	tests_passed = test_async_connection();
+	cout << "Test async connection passed " << tests_passed << "/1 test cases." << endl;
+	tests_passed = test_io_service_pool();
+	cout << "Test IO service pool passed " << tests_passed << "/2 test cases." << endl;
+	tests_passed = test_multiplexed_connection();
+	cout << "Test multiplexed connection passed " << tests_passed << "/1 test cases." << endl;
+	tests_passed = test_receive_buffers();
+	cout << "Test receive buffers passed " << tests_passed << "/2 test cases." << endl;
+	tests_passed = test_steady_state_memory();
+	cout << "Test steady state memory passed " << tests_passed << "/1 test cases." << endl;
+	tests_passed = test_adaptive_timeout();
+	cout << "Test adaptive timeout passed " << tests_passed << "/3 test cases." << endl;
+	tests_passed = test_ack_policy();
+	cout << "Test ACK policy passed " << tests_passed << "/3 test cases." << endl;
+	tests_passed = test_fragmentation();
+	cout << "Test fragmentation passed " << tests_passed << "/5 test cases." << endl;
+	tests_passed = test_concurrent_receive();
+	cout << "Test concurrent receive passed " << tests_passed << "/2 test cases." << endl;
+	tests_passed = test_reorder_buffer();
+	cout << "Test reorder buffer passed " << tests_passed << "/3 test cases." << endl;
+	tests_passed = test_peer_eviction();
+	cout << "Test peer eviction passed " << tests_passed << "/3 test cases." << endl;
+	tests_passed = test_connection_handles();
+	cout << "Test connection handles passed " << tests_passed << "/5 test cases." << endl;
+	tests_passed = test_stats();
+	cout << "Test stats passed " << tests_passed << "/3 test cases." << endl;
+	tests_passed = test_trace();
+	cout << "Test trace passed " << tests_passed << "/2 test cases." << endl;
+	tests_passed = test_impairment();
+	cout << "Test impairment passed " << tests_passed << "/4 test cases." << endl;
+	tests_passed = test_congestion_control();
+	cout << "Test congestion control passed " << tests_passed << "/5 test cases." << endl;
+	tests_passed = test_delivery_classes();
+	cout << "Test delivery classes passed " << tests_passed << "/4 test cases." << endl;
+	tests_passed = test_streams();
+	cout << "Test streams passed " << tests_passed << "/3 test cases." << endl;
+	tests_passed = test_coalescing();
+	cout << "Test coalescing passed " << tests_passed << "/4 test cases." << endl;
+	tests_passed = test_batched_io();
+	cout << "Test batched IO passed " << tests_passed << "/1 test cases." << endl;
+	tests_passed = test_batch();
+	cout << "Test batch passed " << tests_passed << "/3 test cases." << endl;
+	tests_passed = test_external_loop();
+	cout << "Test external loop passed " << tests_passed << "/3 test cases." << endl;
+	tests_passed = test_uring_transport();
+	cout << "Test io_uring transport passed " << tests_passed << "/3 test cases." << endl;
+	tests_passed = test_sharded_listener();
+	cout << "Test sharded listener passed " << tests_passed << "/3 test cases." << endl;
+	tests_passed = test_buffer_pool();
+	cout << "Test buffer pool passed " << tests_passed << "/3 test cases." << endl;
+	tests_passed = test_socket_tuning();
+	cout << "Test socket tuning passed " << tests_passed << "/3 test cases." << endl;
+	tests_passed = test_sequence_space();
+	cout << "Test sequence space passed " << tests_passed << "/3 test cases." << endl;
 }
 
 int test_basic_connection()
@@ -274,6 +382,7 @@ void test_receiver_ahead_out_of_sync_recv_thread(bool *success)
 		int port;
 		connection_recv.receive(recv_buffer, 64, address_buffer, &port);
 		connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+		connection_recv.receive(recv_buffer, 64, address_buffer, &port);
 		*success = true;
 	}
 	catch (runtime_error error)
@@ -340,3 +449,2664 @@ void test_multi_connection_recv_thread(bool *success)
 		*success = false;
 	}
 }
+
+int test_windowed_connection()
+{
+	int tests_passed = 0;
+	bool send_successful = false;
+	bool recv_successful = false;
+	thread thread_recv(test_windowed_connection_recv_thread, &recv_successful);
+	thread thread_send(test_windowed_connection_send_thread, &send_successful);
+	thread_send.join();
+	thread_recv.join();
+	if (send_successful && recv_successful)
+		tests_passed += 1;
+	return tests_passed;
+}
+
+void test_windowed_connection_send_thread(bool *success)
+{
+	try
+	{
+		Connection connection_send = Connection(200);
+		connection_send.setEndpointRemote("127.0.0.1", 3211);
+		connection_send.setWindowSize(8);
+		for (int i = 0; i < 100; i++)
+		{
+			string message = "Message " + to_string(i);
+			connection_send.send(message.c_str(), message.size());
+		}
+		connection_send.flush();
+		*success = true;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+		*success = false;
+	}
+}
+
+void test_windowed_connection_recv_thread(bool *success)
+{
+	try
+	{
+		Connection connection_recv = Connection(200);
+		connection_recv.setEndpointLocal(3211);
+		char recv_buffer[64];
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		*success = true;
+		for (int i = 0; i < 100; i++)
+		{
+			int received_len = connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+			if (string(recv_buffer, received_len) != "Message " + to_string(i))
+				*success = false;
+		}
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+		*success = false;
+	}
+}
+
+int test_async_connection()
+{
+	int tests_passed = 0;
+	// Declared before the connections so they outlive any handler invoked when the connections are closed.
+	// The messages are sent from their buffers so they must also remain valid until the sends complete.
+	atomic<int> sends_acknowledged(0);
+	promise<void> sends_complete;
+	const int message_count = 50;
+	vector<string> messages;
+	for (int i = 0; i < message_count; i++)
+	{
+		messages.push_back("Message " + to_string(i));
+	}
+	try
+	{
+		Connection connection_recv = Connection(200);
+		connection_recv.setEndpointLocal(3212);
+		Connection connection_send = Connection(200);
+		connection_send.setEndpointRemote("127.0.0.1", 3212);
+		connection_send.setWindowSize(4);
+
+		// Start every receive before any message is sent.
+		vector<array<char, 64>> recv_buffers(message_count);
+		vector<array<char, IPV4_ADDRESS_LENGTH_BYTES>> address_buffers(message_count);
+		vector<int> ports(message_count);
+		vector<future<int>> receives;
+		for (int i = 0; i < message_count; i++)
+		{
+			receives.push_back(connection_recv.asyncReceive(recv_buffers[i].data(), 64, address_buffers[i].data(), &ports[i]));
+		}
+
+		// Send every message from this thread with a completion handler.
+		for (int i = 0; i < message_count; i++)
+		{
+			connection_send.asyncSend(messages[i].c_str(), messages[i].size(), [&](int, exception_ptr error)
+									  {
+				if (!error && ++sends_acknowledged == message_count)
+					sends_complete.set_value(); });
+		}
+
+		bool in_order = true;
+		for (int i = 0; i < message_count; i++)
+		{
+			int received_len = receives[i].get();
+			if (string(recv_buffers[i].data(), received_len) != "Message " + to_string(i))
+				in_order = false;
+		}
+		if (sends_complete.get_future().wait_for(chrono::seconds(5)) == future_status::ready && in_order)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_io_service_pool()
+{
+	int tests_passed = 0;
+	// The pool has been started by the previous tests so it can no longer be resized.
+	try
+	{
+		ConnectionController::setIOServiceCount(4, false);
+	}
+	catch (runtime_error error)
+	{
+		if (ConnectionController::getIOServiceCount() == 2)
+			tests_passed += 1;
+	}
+
+	// Consecutive connections are assigned to different IO services but can still talk to each other.
+	try
+	{
+		boost::asio::io_service &io_service_recv = ConnectionController::getIOService();
+		boost::asio::io_service &io_service_send = ConnectionController::getIOService();
+		Connection connection_recv = Connection(200, io_service_recv);
+		connection_recv.setEndpointLocal(3213);
+		Connection connection_send = Connection(200, io_service_send);
+		connection_send.setEndpointRemote("127.0.0.1", 3213);
+		string message = "Hello World!";
+		future<int> received = async(launch::async, [&]()
+									 {
+			char recv_buffer[64];
+			char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+			int port;
+			return connection_recv.receive(recv_buffer, 64, address_buffer, &port); });
+		connection_send.send(message.c_str(), message.size());
+		if (&io_service_recv != &io_service_send && received.get() == (int)message.size())
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_multiplexed_connection()
+{
+	int tests_passed = 0;
+	// Declared before the connections so that the buffers being sent outlive them.
+	const int peer_count = 4;
+	vector<string> messages;
+	for (int i = 0; i < peer_count; i++)
+	{
+		for (int j = 0; j <= i; j++)
+		{
+			messages.push_back("Hub " + to_string(j));
+		}
+		messages.push_back("Peer " + to_string(i));
+	}
+	try
+	{
+		// One hub socket exchanges messages with several peers, each with its own sequence numbers.
+		Connection hub = Connection(200);
+		hub.setEndpointLocal(3214);
+		hub.setWindowSize(4);
+		vector<unique_ptr<Connection>> peers;
+		for (int i = 0; i < peer_count; i++)
+		{
+			peers.push_back(unique_ptr<Connection>(new Connection(200)));
+			peers[i]->setEndpointLocal(3215 + i);
+			peers[i]->setEndpointRemote("127.0.0.1", 3214);
+		}
+
+		// Every peer sends to the hub while the hub sends a different number of messages to each peer.
+		vector<future<int>> sends;
+		size_t message = 0;
+		for (int i = 0; i < peer_count; i++)
+		{
+			for (int j = 0; j <= i; j++, message++)
+			{
+				sends.push_back(hub.asyncSendTo(messages[message].c_str(), messages[message].size(), "127.0.0.1", 3215 + i));
+			}
+			sends.push_back(peers[i]->asyncSend(messages[message].c_str(), messages[message].size()));
+			message++;
+		}
+
+		bool success = true;
+		char recv_buffer[64];
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		vector<bool> peers_received(peer_count, false);
+		for (int i = 0; i < peer_count; i++)
+		{
+			int received_len = hub.receive(recv_buffer, 64, address_buffer, &port);
+			if (port < 3215 || port >= 3215 + peer_count || string(recv_buffer, received_len) != "Peer " + to_string(port - 3215))
+				success = false;
+			else
+				peers_received[port - 3215] = true;
+		}
+		for (int i = 0; i < peer_count; i++)
+		{
+			success = success && peers_received[i];
+			for (int j = 0; j <= i; j++)
+			{
+				int received_len = peers[i]->receive(recv_buffer, 64, address_buffer, &port);
+				if (port != 3214 || string(recv_buffer, received_len) != "Hub " + to_string(j))
+					success = false;
+			}
+		}
+		for (future<int> &send : sends)
+		{
+			send.get();
+		}
+		if (success)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_receive_buffers()
+{
+	int tests_passed = 0;
+	// Declared before the connections so that the buffers being sent outlive them.
+	const int message_count = 20;
+	vector<string> messages;
+	for (int i = 0; i < message_count; i++)
+	{
+		messages.push_back(string(1 + (i * 37) % 200, 'a' + i));
+	}
+	try
+	{
+		Connection connection_recv = Connection(200);
+		connection_recv.setEndpointLocal(3219);
+		Connection connection_send = Connection(200);
+		connection_send.setEndpointRemote("127.0.0.1", 3219);
+
+		// The first message is read before the receives exist, then the next one is read into a buffer that is too
+		// small for it, which fails that receive but leaves the whole message for the next one.
+		char first_buffer[64];
+		char small_buffer[4];
+		char large_buffer[64];
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		future<int> first = connection_recv.asyncReceive(first_buffer, 64, address_buffer, &port);
+		future<int> small = connection_recv.asyncReceive(small_buffer, 4, address_buffer, &port);
+		future<int> large = connection_recv.asyncReceive(large_buffer, 64, address_buffer, &port);
+		string message = "Hello World!";
+		connection_send.send(message.c_str(), message.size());
+		connection_send.send(message.c_str(), message.size());
+		bool small_failed = false;
+		try
+		{
+			small.get();
+		}
+		catch (runtime_error error)
+		{
+			small_failed = true;
+		}
+		int received_len = large.get();
+		if (first.get() == (int)message.size() && small_failed && string(large_buffer, received_len) == message)
+			tests_passed += 1;
+
+		// Messages of different sizes that are queued before they are received twice over, so that the second
+		// time they are held in buffers reused from the first.
+		connection_send.setWindowSize(4);
+		bool in_order = true;
+		for (int round = 0; round < 2; round++)
+		{
+			for (int i = 0; i < message_count; i++)
+			{
+				connection_send.asyncSend(messages[i].c_str(), messages[i].size(), CompletionHandler());
+			}
+			connection_send.flush();
+			for (int i = 0; i < message_count; i++)
+			{
+				char recv_buffer[256];
+				received_len = connection_recv.receive(recv_buffer, 256, address_buffer, &port);
+				if (string(recv_buffer, received_len) != messages[i])
+					in_order = false;
+			}
+		}
+		if (in_order)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_steady_state_memory()
+{
+	int tests_passed = 0;
+	try
+	{
+		Connection connection_recv = Connection(200);
+		connection_recv.setEndpointLocal(3220);
+		Connection connection_send = Connection(200);
+		connection_send.setEndpointRemote("127.0.0.1", 3220);
+		connection_send.setWindowSize(8);
+
+		// Receive every message of both rounds on another thread.
+		const int warm_up_count = 2000;
+		const int message_count = 20000;
+		future<bool> received = async(launch::async, [&]()
+									  {
+			char recv_buffer[64];
+			char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+			int port;
+			for (int i = 0; i < warm_up_count + message_count; i++)
+			{
+				if (connection_recv.receive(recv_buffer, 64, address_buffer, &port) != 12)
+					return false;
+			}
+			return true; });
+
+		// Sending and receiving under sustained load should not grow the memory of the process once the
+		// buffers and queues of both connections have reached their working size.
+		string message = "Hello World!";
+		for (int i = 0; i < warm_up_count; i++)
+		{
+			connection_send.send(message.c_str(), message.size());
+		}
+		connection_send.flush();
+		long warm_size_kb = resident_set_size_kb();
+		for (int i = 0; i < message_count; i++)
+		{
+			connection_send.send(message.c_str(), message.size());
+		}
+		connection_send.flush();
+		long final_size_kb = resident_set_size_kb();
+		if (received.get() && final_size_kb - warm_size_kb < 256)
+			tests_passed += 1;
+		else
+			cout << "Resident set grew from " << warm_size_kb << " KB to " << final_size_kb << " KB." << endl;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+long resident_set_size_kb()
+{
+	// The second field of statm is the number of resident pages, reading zero where it is not available.
+	long pages_total = 0;
+	long pages_resident = 0;
+	ifstream statm("/proc/self/statm");
+	statm >> pages_total >> pages_resident;
+	return pages_resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int test_adaptive_timeout()
+{
+	int tests_passed = 0;
+	try
+	{
+		// On the loopback interface the timeout falls from its initial value to the minimum.
+		Connection connection_recv = Connection(500);
+		connection_recv.setEndpointLocal(3221);
+		Connection connection_send = Connection(500);
+		connection_send.setEndpointRemote("127.0.0.1", 3221);
+		connection_send.setTimeoutLimits(20, 2000);
+		future<void> received = async(launch::async, [&]()
+									  {
+			char recv_buffer[64];
+			char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+			int port;
+			for (int i = 0; i < 40; i++)
+				connection_recv.receive(recv_buffer, 64, address_buffer, &port); });
+		string message = "Hello World!";
+		int initial_timeout = connection_send.getTimeout();
+		for (int i = 0; i < 20; i++)
+		{
+			connection_send.send(message.c_str(), message.size());
+		}
+		if (initial_timeout == 500 && connection_send.getTimeout() < 100)
+			tests_passed += 1;
+
+		// A fixed timeout ignores the measurements.
+		connection_send.setAdaptiveTimeout(false);
+		for (int i = 0; i < 20; i++)
+		{
+			connection_send.send(message.c_str(), message.size());
+		}
+		received.get();
+		if (connection_send.getTimeout() == 500)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+
+	// Without a receiver the timeout doubles on each retransmission, so three tries take 100 + 200 + 400 ms.
+	try
+	{
+		Connection connection_send = Connection(100);
+		connection_send.setEndpointRemote("127.0.0.1", 3222);
+		connection_send.setSendRetriesLimit(3);
+		string message = "Hello World!";
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		try
+		{
+			connection_send.send(message.c_str(), message.size());
+		}
+		catch (runtime_error error)
+		{
+			chrono::milliseconds elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+			if (elapsed.count() >= 650 && connection_send.getTimeout() == 400)
+				tests_passed += 1;
+		}
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+void send_raw_data(boost::asio::ip::udp::socket &socket, unsigned short port, uint32_t sequence, uint32_t base, const string &message, uint32_t epoch, DeliveryClass delivery, uint16_t stream)
+{
+	// A DATA packet is the type, sequence number, window base, length, message length and offset of the
+	// fragment, the session epoch, the delivery class and the stream followed by the payload, here a whole message.
+	int len = message.size();
+	int offset = 0;
+	vector<char> packet(DATA_HEADER_SIZE + len, 0);
+	memcpy(packet.data() + 1, &sequence, sizeof(sequence));
+	memcpy(packet.data() + 1 + sizeof(sequence), &base, sizeof(base));
+	memcpy(packet.data() + 1 + sizeof(sequence) + sizeof(base), &len, sizeof(len));
+	memcpy(packet.data() + 1 + sizeof(sequence) + sizeof(base) + sizeof(len), &len, sizeof(len));
+	memcpy(packet.data() + 1 + sizeof(sequence) + sizeof(base) + 2 * sizeof(len), &offset, sizeof(offset));
+	memcpy(packet.data() + 1 + sizeof(sequence) + sizeof(base) + 3 * sizeof(len), &epoch, sizeof(epoch));
+	packet[DATA_DELIVERY_OFFSET] = delivery;
+	memcpy(packet.data() + DATA_STREAM_OFFSET, &stream, sizeof(stream));
+	memcpy(packet.data() + DATA_HEADER_SIZE, message.c_str(), len);
+	socket.send_to(boost::asio::buffer(packet), boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+}
+
+bool receive_raw_ack(boost::asio::ip::udp::socket &socket, char *type, uint32_t *sequence, uint32_t *cumulative, uint32_t *sack, uint16_t *stream, uint32_t *epoch)
+{
+	// An ACK is the type followed by the sequence number that triggered it, the cumulative sequence number, the
+	// SACK bits, the epoch and the stream, which a DATA_ACK packet carries after its payload instead.
+	// Boost ASIO waits out a receive timeout, so the socket is read directly.
+	char packet[64];
+	ssize_t length = recv(socket.native_handle(), packet, sizeof(packet), 0);
+	size_t offset = 1;
+	if (length >= (ssize_t)DATA_HEADER_SIZE && packet[0] == 2)
+	{
+		int len;
+		memcpy(&len, packet + 1 + 2 * sizeof(uint32_t), sizeof(len));
+		offset = DATA_HEADER_SIZE + len;
+	}
+	else if (length < 1 || packet[0] != 1)
+		return false;
+	if (length < (ssize_t)(offset + ACK_INFO_SIZE))
+		return false;
+	*type = packet[0];
+	memcpy(sequence, packet + offset, sizeof(*sequence));
+	memcpy(cumulative, packet + offset + sizeof(*sequence), sizeof(*cumulative));
+	if (sack != nullptr)
+		memcpy(sack, packet + offset + sizeof(*sequence) + sizeof(*cumulative), sizeof(*sack));
+	if (epoch != nullptr)
+		memcpy(epoch, packet + offset + sizeof(*sequence) + sizeof(*cumulative) + sizeof(uint32_t), sizeof(*epoch));
+	if (stream != nullptr)
+		memcpy(stream, packet + offset + sizeof(*sequence) + sizeof(*cumulative) + 2 * sizeof(uint32_t), sizeof(*stream));
+	return true;
+}
+
+int test_ack_policy()
+{
+	int tests_passed = 0;
+	try
+	{
+		// Drive the receiver from a plain socket, which gives up on an ACK after 200 ms.
+		Connection connection_recv = Connection(500);
+		connection_recv.setEndpointLocal(3223);
+		connection_recv.setAckPolicy(4, 1000000);
+		boost::asio::io_service io_service;
+		boost::asio::ip::udp::socket socket(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+		struct timeval timeout = {0, 200000};
+		setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		// The first packet is acknowledged straight away as nothing else is in flight, then the next four are
+		// acknowledged together by the cumulative sequence number of a single ACK.
+		for (uint32_t sequence = 0; sequence < 5; sequence++)
+		{
+			send_raw_data(socket, 3223, sequence, 0);
+		}
+		char type = 0;
+		uint32_t sequence = 0;
+		uint32_t cumulative = 0;
+		bool acks_expected = receive_raw_ack(socket, &type, &sequence, &cumulative) && sequence == 0 && cumulative == 1;
+		acks_expected = acks_expected && receive_raw_ack(socket, &type, &sequence, &cumulative) && sequence == 4 && cumulative == 5;
+		if (acks_expected && !receive_raw_ack(socket, &type, &sequence, &cumulative))
+			tests_passed += 1;
+
+		// A single packet is acknowledged once the delay has passed.
+		connection_recv.setAckPolicy(4, 100000);
+		timeout = {1, 0};
+		setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		send_raw_data(socket, 3223, 5, 4);
+		if (receive_raw_ack(socket, &type, &sequence, &cumulative) && sequence == 5 && cumulative == 6)
+		{
+			chrono::milliseconds elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+			if (elapsed.count() >= 80)
+				tests_passed += 1;
+		}
+
+		// An ACK that would be delayed for 10 s is carried by the data sent back instead.
+		connection_recv.setAckPolicy(100, 10000000);
+		send_raw_data(socket, 3223, 6, 5);
+		string message = "Hello World!";
+		connection_recv.asyncSendTo(message.c_str(), message.size(), "127.0.0.1", socket.local_endpoint().port(), [](int, exception_ptr) {});
+		if (receive_raw_ack(socket, &type, &sequence, &cumulative) && type == 2 && sequence == 6 && cumulative == 7)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+bool receive_raw_data(boost::asio::ip::udp::socket &socket, boost::asio::ip::udp::endpoint *sender, uint32_t *sequence, int *offset, uint32_t *epoch)
+{
+	// The sequence number follows the type and the offset of the fragment comes before the epoch, the delivery
+	// class and the stream at the end of the header.
+	char packet[MAX_DATAGRAM_SIZE];
+	socklen_t sender_len = sender->capacity();
+	ssize_t length = recvfrom(socket.native_handle(), packet, sizeof(packet), 0, sender->data(), &sender_len);
+	if (length < (ssize_t)DATA_HEADER_SIZE || (packet[0] != 0 && packet[0] != 2))
+		return false;
+	sender->resize(sender_len);
+	memcpy(sequence, packet + 1, sizeof(*sequence));
+	memcpy(offset, packet + DATA_DELIVERY_OFFSET - sizeof(uint32_t) - sizeof(*offset), sizeof(*offset));
+	if (epoch != nullptr)
+		memcpy(epoch, packet + DATA_DELIVERY_OFFSET - sizeof(uint32_t), sizeof(*epoch));
+	return true;
+}
+
+void send_raw_ack(boost::asio::ip::udp::socket &socket, const boost::asio::ip::udp::endpoint &endpoint, uint32_t sequence, uint32_t cumulative, uint32_t epoch)
+{
+	// The ACK echoes the epoch of the packets it acknowledges, with no SACK bits and on stream 0.
+	char packet[ACK_PACKET_SIZE] = {1};
+	memcpy(packet + 1, &sequence, sizeof(sequence));
+	memcpy(packet + 1 + sizeof(sequence), &cumulative, sizeof(cumulative));
+	memcpy(packet + 1 + sizeof(sequence) + sizeof(cumulative) + sizeof(uint32_t), &epoch, sizeof(epoch));
+	socket.send_to(boost::asio::buffer(packet), endpoint);
+}
+
+int test_fragmentation()
+{
+	int tests_passed = 0;
+	vector<char> message(1 << 20);
+	for (size_t i = 0; i < message.size(); i++)
+	{
+		message[i] = (char)(i * 7 + i / 4096);
+	}
+	try
+	{
+		Connection connection_recv = Connection(200);
+		connection_recv.setEndpointLocal(3226);
+		Connection connection_send = Connection(200);
+		connection_send.setEndpointRemote("127.0.0.1", 3226);
+		connection_send.setWindowSize(32);
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+
+		// A message of 1 MB is reassembled into the buffer of the receive that is waiting for it.
+		vector<char> recv_buffer(message.size());
+		future<int> received = connection_recv.asyncReceive(recv_buffer.data(), recv_buffer.size(), address_buffer, &port);
+		connection_send.send(message.data(), message.size());
+		connection_send.flush();
+		if (received.get() == (int)message.size() && recv_buffer == message)
+			tests_passed += 1;
+
+		// Messages that arrive before a receive is waiting are reassembled in the receive queue.
+		for (int i = 0; i < 3; i++)
+		{
+			connection_send.send(message.data() + i, 100000);
+		}
+		connection_send.flush();
+		bool messages_equal = true;
+		for (int i = 0; i < 3; i++)
+		{
+			int received_len = connection_recv.receive(recv_buffer.data(), recv_buffer.size(), address_buffer, &port);
+			messages_equal = messages_equal && received_len == 100000 && equal(message.begin() + i, message.begin() + i + 100000, recv_buffer.begin());
+		}
+		if (messages_equal)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+
+	// Only the fragment that was not acknowledged is retransmitted.
+	try
+	{
+		boost::asio::io_service io_service;
+		boost::asio::ip::udp::socket socket(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+		struct timeval timeout = {1, 0};
+		setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		Connection connection_send = Connection(100);
+		connection_send.setEndpointRemote("127.0.0.1", socket.local_endpoint().port());
+		connection_send.setWindowSize(8);
+		connection_send.setMTU(IPV4_UDP_HEADER_SIZE + DATA_HEADER_SIZE + ACK_INFO_SIZE + 100);
+		future<int> sent = connection_send.asyncSend(message.data(), 300);
+		boost::asio::ip::udp::endpoint sender;
+		uint32_t sequence = 0;
+		uint32_t epoch = 0;
+		int offset = 0;
+		bool fragments_expected = true;
+		for (int i = 0; i < 3; i++)
+		{
+			fragments_expected = fragments_expected && receive_raw_data(socket, &sender, &sequence, &offset, &epoch) && sequence == (uint32_t)i && offset == i * 100;
+		}
+		send_raw_ack(socket, sender, 0, 1, epoch);
+		send_raw_ack(socket, sender, 2, 1, epoch);
+		fragments_expected = fragments_expected && receive_raw_data(socket, &sender, &sequence, &offset) && sequence == 1 && offset == 100;
+		send_raw_ack(socket, sender, 1, 3, epoch);
+		if (fragments_expected && sent.get() == 3 * (int)DATA_HEADER_SIZE + 300)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+
+	// The MTU must leave room for a payload.
+	try
+	{
+		Connection connection = Connection(100);
+		connection.setMTU(IPV4_UDP_HEADER_SIZE + DATA_HEADER_SIZE + ACK_INFO_SIZE);
+	}
+	catch (runtime_error error)
+	{
+		tests_passed += 1;
+	}
+
+	// A fragment claiming a message larger than the maximum message size is dropped without being acknowledged.
+	try
+	{
+		Connection connection_recv = Connection(100);
+		connection_recv.setEndpointLocal(3264);
+		connection_recv.setTraceBuffer(16);
+		bool rejected = false;
+		try
+		{
+			connection_recv.setMaxMessageSize(0);
+		}
+		catch (runtime_error error)
+		{
+			rejected = true;
+		}
+		boost::asio::io_service io_service;
+		boost::asio::ip::udp::socket socket(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+		struct timeval timeout = {0, 200000};
+		setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		string fragment = "Hello World!";
+		int len = fragment.size();
+		int message_len = INT_MAX;
+		vector<char> packet(DATA_HEADER_SIZE + len, 0);
+		memcpy(packet.data() + 1 + 2 * sizeof(uint32_t), &len, sizeof(len));
+		memcpy(packet.data() + 1 + 2 * sizeof(uint32_t) + sizeof(len), &message_len, sizeof(message_len));
+		memcpy(packet.data() + DATA_HEADER_SIZE, fragment.c_str(), len);
+		socket.send_to(boost::asio::buffer(packet), boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), 3264));
+		char type = 0;
+		uint32_t sequence = 0;
+		uint32_t cumulative = 0;
+		bool dropped = !receive_raw_ack(socket, &type, &sequence, &cumulative) && connection_recv.getPeerCount() == 0;
+		TraceRecord records[16];
+		size_t count = connection_recv.readTrace(records, 16);
+		bool traced = false;
+		for (size_t i = 0; i < count; i++)
+		{
+			traced = traced || (records[i].event == TRACE_MESSAGE_TOO_LARGE && records[i].value == (uint32_t)INT_MAX);
+		}
+
+		// The sender can still deliver a message within the limit with the same sequence number.
+		send_raw_data(socket, 3264, 0, 0);
+		bool delivered = receive_raw_ack(socket, &type, &sequence, &cumulative) && cumulative == 1;
+		if (rejected && dropped && traced && delivered)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_concurrent_receive()
+{
+	int tests_passed = 0;
+	// Declared before the connections so that the buffers being sent outlive them.
+	const int message_count = 4000;
+	const int consumer_count = 4;
+	vector<int> messages(message_count);
+	for (int i = 0; i < message_count; i++)
+	{
+		messages[i] = i;
+	}
+	try
+	{
+		Connection connection_recv = Connection(200);
+		connection_recv.setEndpointLocal(3227);
+		Connection connection_send = Connection(200);
+		connection_send.setEndpointRemote("127.0.0.1", 3227);
+		connection_send.setWindowSize(8);
+
+		// Several threads drain the same connection, between them receiving every message exactly once and each
+		// receiving its share in the order the messages were sent.
+		atomic<int> receives_started(0);
+		vector<future<vector<int>>> consumers;
+		for (int c = 0; c < consumer_count; c++)
+		{
+			consumers.push_back(async(launch::async, [&]()
+									  {
+				vector<int> received;
+				char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+				int port;
+				while (receives_started.fetch_add(1) < message_count)
+				{
+					int index;
+					if (connection_recv.receive((char *)&index, sizeof(index), address_buffer, &port) == sizeof(index))
+						received.push_back(index);
+				}
+				return received; }));
+		}
+		for (int i = 0; i < message_count; i++)
+		{
+			connection_send.asyncSend((const char *)&messages[i], sizeof(int), CompletionHandler());
+		}
+		connection_send.flush();
+		vector<int> received_count(message_count, 0);
+		bool in_order = true;
+		for (future<vector<int>> &consumer : consumers)
+		{
+			vector<int> received = consumer.get();
+			for (size_t i = 0; i < received.size(); i++)
+			{
+				in_order = in_order && received[i] >= 0 && received[i] < message_count && (i == 0 || received[i] > received[i - 1]);
+				if (received[i] >= 0 && received[i] < message_count)
+					received_count[received[i]] += 1;
+			}
+		}
+		if (in_order && count(received_count.begin(), received_count.end(), 1) == message_count)
+			tests_passed += 1;
+
+		// Raising the receive queue limit beyond its capacity moves the queued messages to a larger queue in order.
+		for (int i = 0; i < 5; i++)
+		{
+			connection_send.asyncSend((const char *)&messages[i], sizeof(int), CompletionHandler());
+		}
+		connection_send.flush();
+		connection_recv.setReceiveQueueLimit(4 * DEFAULT_RECEIVE_QUEUE_LIMIT);
+		bool moved = true;
+		for (int i = 0; i < 5; i++)
+		{
+			int index = -1;
+			char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+			int port;
+			moved = moved && connection_recv.receive((char *)&index, sizeof(index), address_buffer, &port) == sizeof(index) && index == i;
+		}
+		if (moved)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_reorder_buffer()
+{
+	int tests_passed = 0;
+	try
+	{
+		// Drive the receiver from a plain socket, which gives up on an ACK after 200 ms.
+		Connection connection_recv = Connection(500);
+		connection_recv.setEndpointLocal(3228);
+		boost::asio::io_service io_service;
+		boost::asio::ip::udp::socket socket(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+		struct timeval timeout = {0, 200000};
+		setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		char type = 0;
+		uint32_t sequence = 0;
+		uint32_t cumulative = 0;
+		uint32_t sack = 0;
+		char recv_buffer[64];
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+
+		// Packets that arrive ahead of the one expected are held and reported in the SACK bits, then delivered in
+		// order once the gap is filled.
+		send_raw_data(socket, 3228, 0, 0, "first");
+		bool acks_expected = receive_raw_ack(socket, &type, &sequence, &cumulative, &sack) && sequence == 0 && cumulative == 1 && sack == 0;
+		send_raw_data(socket, 3228, 3, 1, "fourth");
+		acks_expected = acks_expected && receive_raw_ack(socket, &type, &sequence, &cumulative, &sack) && sequence == 3 && cumulative == 1 && sack == 2;
+		send_raw_data(socket, 3228, 2, 1, "third");
+		acks_expected = acks_expected && receive_raw_ack(socket, &type, &sequence, &cumulative, &sack) && sequence == 2 && cumulative == 1 && sack == 3;
+		send_raw_data(socket, 3228, 1, 1, "second");
+		acks_expected = acks_expected && receive_raw_ack(socket, &type, &sequence, &cumulative, &sack) && sequence == 1 && cumulative == 4 && sack == 0;
+		bool in_order = true;
+		vector<string> messages = {"first", "second", "third", "fourth"};
+		for (const string &message : messages)
+		{
+			int received_len = connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+			in_order = in_order && string(recv_buffer, received_len) == message;
+		}
+		if (acks_expected && in_order)
+			tests_passed += 1;
+
+		// A packet beyond the reorder buffer is left for the sender to retransmit, while a held packet after the
+		// window base is delivered when the sender abandons the packets before it.
+		send_raw_data(socket, 3228, 4 + REORDER_BUFFER_SIZE + 1, 4, "too far");
+		acks_expected = !receive_raw_ack(socket, &type, &sequence, &cumulative, &sack);
+		send_raw_data(socket, 3228, 5, 4, "sixth");
+		acks_expected = acks_expected && receive_raw_ack(socket, &type, &sequence, &cumulative, &sack) && sequence == 5 && cumulative == 4 && sack == 1;
+		send_raw_data(socket, 3228, 6, 5, "seventh");
+		acks_expected = acks_expected && receive_raw_ack(socket, &type, &sequence, &cumulative, &sack) && sequence == 6 && cumulative == 7;
+		in_order = true;
+		messages = {"sixth", "seventh"};
+		for (const string &message : messages)
+		{
+			int received_len = connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+			in_order = in_order && string(recv_buffer, received_len) == message;
+		}
+		if (acks_expected && in_order)
+			tests_passed += 1;
+
+		// A packet from a new session epoch restarts the sequence from its window base rather than being taken as
+		// a retransmission.
+		send_raw_data(socket, 3228, 0, 0, "new session", 1);
+		acks_expected = receive_raw_ack(socket, &type, &sequence, &cumulative, &sack) && sequence == 0 && cumulative == 1;
+		int received_len = connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+		if (acks_expected && string(recv_buffer, received_len) == "new session")
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_peer_eviction()
+{
+	int tests_passed = 0;
+	try
+	{
+		Connection connection_recv = Connection(500);
+		connection_recv.setEndpointLocal(3229);
+		boost::asio::io_service io_service;
+		vector<unique_ptr<boost::asio::ip::udp::socket>> sockets;
+		for (int i = 0; i < 16; i++)
+		{
+			sockets.emplace_back(new boost::asio::ip::udp::socket(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), 0)));
+			struct timeval timeout = {0, 200000};
+			setsockopt(sockets.back()->native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		}
+		char type = 0;
+		uint32_t sequence = 0;
+		uint32_t cumulative = 0;
+		char recv_buffer[64];
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+
+		// Every sender gets its own receive state, so the table grows past its initial slots.
+		bool delivered = true;
+		for (auto &socket : sockets)
+		{
+			send_raw_data(*socket, 3229, 0, 0);
+			delivered = delivered && receive_raw_ack(*socket, &type, &sequence, &cumulative) && cumulative == 1;
+			int received_len = connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+			delivered = delivered && string(recv_buffer, received_len) == "Hello World!" && port == socket->local_endpoint().port();
+		}
+		if (delivered && connection_recv.getPeerCount() == 16)
+			tests_passed += 1;
+
+		// Senders that have been idle for longer than the timeout are evicted when the next datagram arrives.
+		bool rejected = false;
+		try
+		{
+			connection_recv.setPeerIdleTimeout(0);
+		}
+		catch (runtime_error error)
+		{
+			rejected = true;
+		}
+		connection_recv.setPeerIdleTimeout(100);
+		this_thread::sleep_for(chrono::milliseconds(300));
+		boost::asio::ip::udp::socket socket(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+		struct timeval timeout = {0, 200000};
+		setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		send_raw_data(socket, 3229, 0, 0, "newcomer");
+		delivered = receive_raw_ack(socket, &type, &sequence, &cumulative) && cumulative == 1;
+		int received_len = connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+		delivered = delivered && string(recv_buffer, received_len) == "newcomer";
+		if (rejected && delivered && connection_recv.getPeerCount() == 1)
+			tests_passed += 1;
+
+		// An evicted sender is treated as new, so a packet that was a duplicate before is delivered again.
+		send_raw_data(*sockets[0], 3229, 0, 0, "returning");
+		delivered = receive_raw_ack(*sockets[0], &type, &sequence, &cumulative) && cumulative == 1;
+		received_len = connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+		delivered = delivered && string(recv_buffer, received_len) == "returning";
+		if (delivered && connection_recv.getPeerCount() == 2)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_connection_handles()
+{
+	int tests_passed = 0;
+	// Declared before the connections so it outlives the handler that removes its connection.
+	promise<void> removed;
+	try
+	{
+		ConnectionController *controller = ConnectionController::getInstance();
+
+		// The number of a removed connection stays invalid once its slot is reused by a new connection.
+		int connection_number = controller->addConnection(500);
+		bool found = controller->getConnection(connection_number) != nullptr;
+		controller->removeConnection(connection_number);
+		int reused_number = controller->addConnection(500);
+		bool stale_rejected = false;
+		try
+		{
+			controller->getConnection(connection_number);
+		}
+		catch (runtime_error error)
+		{
+			stale_rejected = true;
+		}
+		found = found && controller->acquireConnection(reused_number)->getTimeout() == 500;
+		controller->removeConnection(reused_number);
+		if (found && stale_rejected && reused_number != connection_number)
+			tests_passed += 1;
+
+		// Removing a connection destroys it, closing its socket so the port can be bound again.
+		connection_number = controller->addConnection(500);
+		controller->getConnection(connection_number)->setEndpointLocal(3230);
+		controller->removeConnection(connection_number);
+		connection_number = controller->addConnection(500);
+		controller->getConnection(connection_number)->setEndpointLocal(3230);
+		controller->removeConnection(connection_number);
+		tests_passed += 1;
+
+		// A connection removed while a reference is held is destroyed once the reference is released.
+		connection_number = controller->addConnection(500);
+		controller->getConnection(connection_number)->setEndpointLocal(3231);
+		int other_number = controller->addConnection(500);
+		bool kept = false;
+		{
+			ConnectionRef connection = controller->acquireConnection(connection_number);
+			controller->removeConnection(connection_number);
+			try
+			{
+				controller->getConnection(other_number)->setEndpointLocal(3231);
+			}
+			catch (runtime_error error)
+			{
+				kept = connection->getTimeout() == 500;
+			}
+		}
+		controller->getConnection(other_number)->setEndpointLocal(3231);
+		controller->removeConnection(other_number);
+		if (kept)
+			tests_passed += 1;
+
+		// Connections can be looked up by many threads while others are added and removed.
+		atomic<bool> running(true);
+		atomic<int> lookups(0);
+		vector<int> numbers;
+		for (int i = 0; i < 8; i++)
+		{
+			numbers.push_back(controller->addConnection(500));
+		}
+		vector<thread> threads;
+		for (int i = 0; i < 4; i++)
+		{
+			threads.emplace_back([&]()
+								 {
+				while (running)
+				{
+					for (int number : numbers)
+					{
+						try
+						{
+							if (controller->acquireConnection(number)->getTimeout() == 500)
+								lookups++;
+						}
+						catch (runtime_error error)
+						{
+						}
+					}
+				} });
+		}
+		for (int i = 0; i < 100; i++)
+		{
+			controller->removeConnection(controller->addConnection(500));
+		}
+		running = false;
+		for (thread &lookup_thread : threads)
+		{
+			lookup_thread.join();
+		}
+		for (int number : numbers)
+		{
+			controller->removeConnection(number);
+		}
+		if (lookups > 0)
+			tests_passed += 1;
+
+		// A connection removed from its own completion handler is closed straight away, fails its outstanding
+		// receive once the handler returns and leaves its IO service running the other connections.
+		Connection connection_recv = Connection(200);
+		connection_recv.setEndpointLocal(3262);
+		connection_number = controller->addConnection(200);
+		controller->getConnection(connection_number)->setEndpointLocal(3263);
+		controller->getConnection(connection_number)->setEndpointRemote("127.0.0.1", 3262);
+		char recv_buffer[64];
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port = 0;
+		future<int> receive = controller->getConnection(connection_number)->asyncReceive(recv_buffer, 64, address_buffer, &port);
+		string message = "Removed";
+		controller->getConnection(connection_number)->asyncSend(message.c_str(), message.size(), [&](int, exception_ptr)
+																  {
+			controller->removeConnection(connection_number);
+			removed.set_value(); });
+		bool receive_failed = false;
+		if (removed.get_future().wait_for(chrono::seconds(5)) == future_status::ready)
+		{
+			try
+			{
+				receive.get();
+			}
+			catch (runtime_error error)
+			{
+				receive_failed = true;
+			}
+		}
+		other_number = controller->addConnection(200);
+		controller->getConnection(other_number)->setEndpointLocal(3263);
+		controller->getConnection(other_number)->setEndpointRemote("127.0.0.1", 3262);
+		bool sent = controller->getConnection(other_number)->send(message.c_str(), message.size()) > 0;
+		controller->removeConnection(other_number);
+		if (receive_failed && sent)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_stats()
+{
+	int tests_passed = 0;
+	try
+	{
+		// Every message sent and received is counted, along with its packets, ACKs and round trip time.
+		Connection connection_send = Connection(500);
+		Connection connection_recv = Connection(500);
+		connection_send.setEndpointRemote("127.0.0.1", 3232);
+		connection_recv.setEndpointLocal(3232);
+		string message = "Hello World!";
+		char recv_buffer[64];
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		for (int i = 0; i < 5; i++)
+		{
+			connection_send.send(message.c_str(), message.size());
+			connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+		}
+		ConnectionStats send_stats = connection_send.getStats();
+		ConnectionStats recv_stats = connection_recv.getStats();
+		uint64_t rtt_samples = 0;
+		for (uint64_t count : send_stats.rtt_histogram)
+		{
+			rtt_samples += count;
+		}
+		if (send_stats.messages_sent == 5 && send_stats.packets_sent >= 5 && send_stats.acks_received >= 5 && rtt_samples >= 1 && recv_stats.messages_received == 5 && recv_stats.packets_received == send_stats.packets_sent && recv_stats.bytes_received == send_stats.bytes_sent && recv_stats.acks_sent == send_stats.acks_received)
+			tests_passed += 1;
+
+		// Duplicates, packets held out of order and packets too far ahead to hold are counted by the receiver.
+		Connection connection_raw = Connection(500);
+		connection_raw.setEndpointLocal(3233);
+		boost::asio::io_service io_service;
+		boost::asio::ip::udp::socket socket(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+		struct timeval timeout = {0, 200000};
+		setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		char type = 0;
+		uint32_t sequence = 0;
+		uint32_t cumulative = 0;
+		send_raw_data(socket, 3233, 0, 0);
+		receive_raw_ack(socket, &type, &sequence, &cumulative);
+		send_raw_data(socket, 3233, 0, 0);
+		receive_raw_ack(socket, &type, &sequence, &cumulative);
+		send_raw_data(socket, 3233, 2, 1);
+		receive_raw_ack(socket, &type, &sequence, &cumulative);
+		send_raw_data(socket, 3233, 1 + REORDER_BUFFER_SIZE + 1, 1);
+		receive_raw_ack(socket, &type, &sequence, &cumulative);
+		ConnectionStats raw_stats = connection_raw.getStats();
+		if (raw_stats.packets_received == 4 && raw_stats.duplicates == 1 && raw_stats.packets_reordered == 1 && raw_stats.packets_dropped == 1 && raw_stats.messages_received == 1)
+			tests_passed += 1;
+
+		// The controller sums the counters of its connections, keeping those of the connections it has removed.
+		ConnectionController *controller = ConnectionController::getInstance();
+		ConnectionStats global_before = controller->getStats();
+		int number_send = controller->addConnection(500);
+		int number_recv = controller->addConnection(500);
+		controller->getConnection(number_send)->setEndpointRemote("127.0.0.1", 3234);
+		controller->getConnection(number_recv)->setEndpointLocal(3234);
+		for (int i = 0; i < 3; i++)
+		{
+			controller->getConnection(number_send)->send(message.c_str(), message.size());
+			controller->getConnection(number_recv)->receive(recv_buffer, 64, address_buffer, &port);
+		}
+		ConnectionStats global_during = controller->getStats();
+		controller->removeConnection(number_send);
+		controller->removeConnection(number_recv);
+		ConnectionStats global_after = controller->getStats();
+		if (global_during.messages_sent == global_before.messages_sent + 3 && global_during.messages_received == global_before.messages_received + 3 && global_after.messages_sent == global_during.messages_sent)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_trace()
+{
+	int tests_passed = 0;
+	try
+	{
+		// The sender gives its records to a handler as they are made, and the receiver keeps them in its buffer.
+		Connection connection_send = Connection(500);
+		Connection connection_recv = Connection(500);
+		connection_send.setEndpointRemote("127.0.0.1", 3235);
+		connection_recv.setEndpointLocal(3235);
+		mutex handler_mutex;
+		int data_sent = 0;
+		int acks_received = 0;
+		connection_send.setTraceHandler([&](const TraceRecord &record)
+										{
+			lock_guard<mutex> lock(handler_mutex);
+			data_sent += record.event == TRACE_DATA_SENT;
+			acks_received += record.event == TRACE_ACK_RECEIVED; });
+		connection_recv.setTraceBuffer(64);
+		string message = "Hello World!";
+		char recv_buffer[64];
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		for (int i = 0; i < 3; i++)
+		{
+			connection_send.send(message.c_str(), message.size());
+			connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+		}
+		// The receiver records each ACK once it has been sent, which can be after the sender has received it, so
+		// the buffer is read until every ACK has been recorded.
+		TraceRecord records[64];
+		size_t count = 0;
+		vector<uint32_t> received;
+		int acks_sent = 0;
+		bool decoded = true;
+		chrono::steady_clock::time_point trace_deadline = chrono::steady_clock::now() + chrono::seconds(2);
+		while (acks_sent < 3 && chrono::steady_clock::now() < trace_deadline)
+		{
+			count = connection_recv.readTrace(records, 64);
+			for (size_t i = 0; i < count; i++)
+			{
+				if (records[i].event == TRACE_DATA_RECEIVED)
+				{
+					received.push_back(records[i].sequence);
+					decoded = decoded && records[i].value == message.size() && records[i].endpoint().address().to_string() == "127.0.0.1" && records[i].to_string().find("Received packet") != string::npos;
+				}
+				acks_sent += records[i].event == TRACE_ACK_SENT;
+			}
+			if (count == 0)
+			{
+				this_thread::yield();
+			}
+		}
+		unique_lock<mutex> lock(handler_mutex);
+		if (received == vector<uint32_t>({0, 1, 2}) && acks_sent == 3 && decoded && data_sent == 3 && acks_received == 3)
+			tests_passed += 1;
+		lock.unlock();
+
+		// Records made while the buffer is full are dropped and counted rather than blocking the connection.
+		connection_recv.setTraceBuffer(2);
+		for (int i = 0; i < 3; i++)
+		{
+			connection_send.send(message.c_str(), message.size());
+			connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+		}
+		count = connection_recv.readTrace(records, 64);
+		if (count == 2 && connection_recv.getTraceDropped() > 0 && records[0].event == TRACE_DATA_RECEIVED && records[0].sequence == 3)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_impairment()
+{
+	int tests_passed = 0;
+	try
+	{
+		// An impairment is checked before it is used.
+		int rejected = 0;
+		Impairment invalid;
+		invalid.loss = 1.5;
+		try
+		{
+			invalid.validate();
+		}
+		catch (runtime_error error)
+		{
+			rejected++;
+		}
+		invalid = Impairment();
+		invalid.queue_limit = 0;
+		try
+		{
+			Connection connection_invalid = Connection(500);
+			connection_invalid.setImpairment(invalid);
+		}
+		catch (runtime_error error)
+		{
+			rejected++;
+		}
+		if (rejected == 2)
+			tests_passed += 1;
+
+		// The same seed drops, delays and reorders the same datagrams, and the rate limit spaces them out.
+		Impairment impairment;
+		impairment.loss = 0.3;
+		impairment.jitter_us = 500;
+		impairment.reorder = 0.2;
+		impairment.seed = 42;
+		boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+		boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), 3236);
+		vector<vector<char>> orders;
+		vector<uint64_t> drops;
+		for (int run = 0; run < 2; run++)
+		{
+			ImpairedLink link(impairment);
+			for (char i = 0; i < 100; i++)
+			{
+				link.enqueue(endpoint, {{boost::asio::buffer(&i, 1), boost::asio::const_buffer(), boost::asio::const_buffer()}}, start);
+			}
+			ImpairedDatagram datagram;
+			vector<char> order;
+			while (link.pop(boost::posix_time::pos_infin, datagram))
+			{
+				order.push_back(datagram.data[0]);
+			}
+			orders.push_back(order);
+			drops.push_back(link.dropped());
+		}
+		impairment = Impairment();
+		impairment.rate_bytes_per_s = 1000000;
+		ImpairedLink rate_link(impairment);
+		vector<char> payload(1000);
+		for (int i = 0; i < 10; i++)
+		{
+			rate_link.enqueue(endpoint, {{boost::asio::buffer(payload), boost::asio::const_buffer(), boost::asio::const_buffer()}}, start);
+		}
+		ImpairedDatagram datagram;
+		boost::posix_time::ptime last_release;
+		while (rate_link.pop(boost::posix_time::pos_infin, datagram))
+		{
+			last_release = datagram.release;
+		}
+		if (orders[0] == orders[1] && drops[0] == drops[1] && drops[0] > 0 && orders[0].size() == 100 - drops[0] && !is_sorted(orders[0].begin(), orders[0].end()) && last_release - start == boost::posix_time::milliseconds(10))
+			tests_passed += 1;
+
+		// The datagrams of an impaired connection are delayed before they are sent.
+		Connection connection_send = Connection(500);
+		Connection connection_recv = Connection(500);
+		connection_send.setEndpointRemote("127.0.0.1", 3236);
+		connection_recv.setEndpointLocal(3236);
+		impairment = Impairment();
+		impairment.delay_us = 20000;
+		connection_send.setImpairment(impairment);
+		string message = "Hello World!";
+		char recv_buffer[64];
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		chrono::steady_clock::time_point send_start = chrono::steady_clock::now();
+		connection_send.send(message.c_str(), message.size());
+		chrono::steady_clock::duration elapsed = chrono::steady_clock::now() - send_start;
+		int len = connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+		connection_send.clearImpairment();
+		send_start = chrono::steady_clock::now();
+		connection_send.send(message.c_str(), message.size());
+		chrono::steady_clock::duration elapsed_clear = chrono::steady_clock::now() - send_start;
+		connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+		if (len == (int)message.size() && elapsed >= chrono::milliseconds(20) && elapsed_clear < chrono::milliseconds(20))
+			tests_passed += 1;
+
+		// Messages still arrive once and in order through loss and duplication, which are retransmitted and discarded.
+		Connection connection_lossy = Connection(50);
+		Connection connection_lossy_recv = Connection(50);
+		connection_lossy.setWindowSize(8);
+		connection_lossy.setEndpointRemote("127.0.0.1", 3237);
+		connection_lossy_recv.setEndpointLocal(3237);
+		impairment = Impairment();
+		impairment.loss = 0.2;
+		impairment.duplicate = 0.2;
+		impairment.seed = 7;
+		connection_lossy.setImpairment(impairment);
+		bool in_order = true;
+		thread recv_thread([&]()
+						   {
+			for (int i = 0; i < 50; i++)
+			{
+				char buffer[16];
+				int recv_len = connection_lossy_recv.receive(buffer, 16, address_buffer, &port);
+				in_order = in_order && recv_len == sizeof(int) && memcmp(buffer, &i, sizeof(int)) == 0;
+			} });
+		for (int i = 0; i < 50; i++)
+		{
+			connection_lossy.send((const char *)&i, sizeof(int));
+		}
+		connection_lossy.flush();
+		recv_thread.join();
+		ConnectionStats lossy_stats = connection_lossy.getStats();
+		ConnectionStats lossy_recv_stats = connection_lossy_recv.getStats();
+		if (in_order && lossy_stats.retransmissions > 0 && lossy_recv_stats.duplicates > 0 && lossy_recv_stats.messages_received == 50)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+/**
+ * @brief   Class FixedWindowController is a congestion controller made by the application that keeps two packets in
+ *          flight, counting the packets left in flight after each ACK.
+ */
+class FixedWindowController : public CongestionController
+{
+public:
+	FixedWindowController(size_t *acks, size_t *max_in_flight) : acks(acks), max_in_flight(max_in_flight) {}
+	void on_loss(const boost::posix_time::ptime &/*now*/) override {}
+	void on_timeout(const boost::posix_time::ptime &/*now*/) override {}
+	size_t congestion_window() const override { return 2; }
+	double pacing_rate() const override { return 0; }
+
+protected:
+	void on_ack(const AckSample &sample) override
+	{
+		++*acks;
+		*max_in_flight = max(*max_in_flight, sample.in_flight);
+	}
+
+private:
+	size_t *acks;
+	size_t *max_in_flight;
+};
+
+int test_congestion_control()
+{
+	int tests_passed = 0;
+	try
+	{
+		// The NewReno window doubles over a round trip of slow start, halves on a loss and drops to one packet on
+		// a timeout.
+		NewRenoController newreno;
+		boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+		size_t initial_window = newreno.congestion_window();
+		vector<DeliveryState> states;
+		for (int i = 0; i < 10; i++)
+		{
+			states.push_back(newreno.sent(1000, start));
+		}
+		for (int i = 0; i < 10; i++)
+		{
+			newreno.acked(states[i], 1000, false, 10, 10, start + boost::posix_time::milliseconds(10));
+		}
+		size_t slow_start_window = newreno.congestion_window();
+		newreno.on_loss(start);
+		size_t loss_window = newreno.congestion_window();
+		newreno.on_timeout(start);
+		if (initial_window == INITIAL_CONGESTION_WINDOW && slow_start_window == 2 * INITIAL_CONGESTION_WINDOW && loss_window == INITIAL_CONGESTION_WINDOW && newreno.congestion_window() == 1 && newreno.pacing_rate() > 0)
+			tests_passed += 1;
+
+		// The token bucket lets a burst through then spaces the packets at its rate.
+		TokenBucket bucket;
+		bucket.set_rate(1000000, 1000);
+		bool burst_ready = bucket.ready_time(start) == start;
+		for (int i = 0; i < 3; i++)
+		{
+			bucket.consume(1000, start);
+		}
+		if (burst_ready && bucket.ready_time(start) == start + boost::posix_time::microseconds(1001) && bucket.ready_time(start + boost::posix_time::microseconds(1001)) == start + boost::posix_time::microseconds(1001))
+			tests_passed += 1;
+
+		// The rate limit of a connection spaces its packets out even when its window would let them all through.
+		Connection connection_send = Connection(500);
+		Connection connection_recv = Connection(500);
+		connection_send.setWindowSize(16);
+		connection_send.setEndpointRemote("127.0.0.1", 3238);
+		connection_recv.setEndpointLocal(3238);
+		connection_send.setRateLimit(100000);
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		vector<char> payload(1000, 'x');
+		chrono::steady_clock::time_point send_start = chrono::steady_clock::now();
+		thread recv_thread([&]()
+						   {
+			vector<char> buffer(1000);
+			for (int i = 0; i < 20; i++)
+			{
+				connection_recv.receive(buffer.data(), 1000, address_buffer, &port);
+			} });
+		for (int i = 0; i < 20; i++)
+		{
+			connection_send.send(payload.data(), payload.size());
+		}
+		connection_send.flush();
+		recv_thread.join();
+		chrono::steady_clock::duration elapsed = chrono::steady_clock::now() - send_start;
+		if (connection_send.getRateLimit() == 100000 && elapsed >= chrono::milliseconds(100))
+			tests_passed += 1;
+
+		// A controller made by the application limits the packets in flight below the window size.
+		size_t acks = 0;
+		size_t max_in_flight = 0;
+		Connection connection_fixed = Connection(500);
+		Connection connection_fixed_recv = Connection(500);
+		connection_fixed.setWindowSize(16);
+		connection_fixed.setCongestionControl([&]()
+											  { return unique_ptr<CongestionController>(new FixedWindowController(&acks, &max_in_flight)); });
+		connection_fixed.setEndpointRemote("127.0.0.1", 3239);
+		connection_fixed_recv.setEndpointLocal(3239);
+		bool in_order = true;
+		thread fixed_recv_thread([&]()
+								 {
+			for (int i = 0; i < 20; i++)
+			{
+				char buffer[16];
+				int recv_len = connection_fixed_recv.receive(buffer, 16, address_buffer, &port);
+				in_order = in_order && recv_len == sizeof(int) && memcmp(buffer, &i, sizeof(int)) == 0;
+			} });
+		for (int i = 0; i < 20; i++)
+		{
+			connection_fixed.send((const char *)&i, sizeof(int));
+		}
+		connection_fixed.flush();
+		fixed_recv_thread.join();
+		if (in_order && acks == 20 && max_in_flight <= 1 && connection_fixed.getCongestionWindow() == 2)
+			tests_passed += 1;
+
+		// The BBR controller delivers every message through a delay, and unknown algorithms are rejected.
+		Connection connection_bbr = Connection(500);
+		Connection connection_bbr_recv = Connection(500);
+		connection_bbr.setWindowSize(REORDER_BUFFER_SIZE);
+		connection_bbr.setCongestionControl(CONGESTION_CONTROL_BBR);
+		connection_bbr.setEndpointRemote("127.0.0.1", 3240);
+		connection_bbr_recv.setEndpointLocal(3240);
+		Impairment impairment;
+		impairment.delay_us = 2000;
+		connection_bbr.setImpairment(impairment);
+		in_order = true;
+		thread bbr_recv_thread([&]()
+							   {
+			for (int i = 0; i < 200; i++)
+			{
+				char buffer[16];
+				int recv_len = connection_bbr_recv.receive(buffer, 16, address_buffer, &port);
+				in_order = in_order && recv_len == sizeof(int) && memcmp(buffer, &i, sizeof(int)) == 0;
+			} });
+		for (int i = 0; i < 200; i++)
+		{
+			connection_bbr.send((const char *)&i, sizeof(int));
+		}
+		connection_bbr.flush();
+		bbr_recv_thread.join();
+		bool rejected = false;
+		try
+		{
+			connection_bbr.setCongestionControl(7);
+		}
+		catch (runtime_error error)
+		{
+			rejected = true;
+		}
+		if (in_order && connection_bbr.getCongestionWindow() >= 4 && rejected)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_delivery_classes()
+{
+	int tests_passed = 0;
+	try
+	{
+		// Unreliable messages are sent once, so some are lost through an impairment, while the reliable message
+		// sent after them is retransmitted until it arrives. An unreliable message must fit in one packet.
+		Connection connection_send = Connection(20);
+		Connection connection_recv = Connection(20);
+		connection_send.setEndpointRemote("127.0.0.1", 3241);
+		connection_recv.setEndpointLocal(3241);
+		Impairment impairment;
+		impairment.loss = 0.5;
+		impairment.seed = 3;
+		connection_send.setImpairment(impairment);
+		Delivery unreliable;
+		unreliable.delivery_class = DELIVERY_UNRELIABLE;
+		for (int i = 0; i < 20; i++)
+		{
+			connection_send.send((const char *)&i, sizeof(int), unreliable);
+		}
+		string end = "end";
+		connection_send.send(end.c_str(), end.size());
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		char recv_buffer[16];
+		int unreliable_received = 0;
+		while (connection_recv.receive(recv_buffer, 16, address_buffer, &port) == sizeof(int))
+		{
+			unreliable_received++;
+		}
+		bool rejected = false;
+		vector<char> large(connection_send.getMTU(), 'x');
+		try
+		{
+			connection_send.send(large.data(), large.size(), unreliable);
+		}
+		catch (runtime_error error)
+		{
+			rejected = true;
+		}
+		if (unreliable_received > 0 && unreliable_received < 20 && memcmp(recv_buffer, end.c_str(), end.size()) == 0 && rejected)
+			tests_passed += 1;
+
+		// An unordered message is delivered ahead of a missing one, and is not delivered again when the
+		// receiver reaches its sequence.
+		boost::asio::io_service io_service;
+		boost::asio::ip::udp::socket socket(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 0));
+		Connection connection_unordered = Connection(500);
+		connection_unordered.setEndpointLocal(3242);
+		send_raw_data(socket, 3242, 1, 0, "second", 9, DELIVERY_UNORDERED);
+		int len_second = connection_unordered.receive(recv_buffer, 16, address_buffer, &port);
+		bool second = len_second == 6 && memcmp(recv_buffer, "second", 6) == 0;
+		send_raw_data(socket, 3242, 0, 0, "first", 9);
+		int len_first = connection_unordered.receive(recv_buffer, 16, address_buffer, &port);
+		bool first = len_first == 5 && memcmp(recv_buffer, "first", 5) == 0;
+		send_raw_data(socket, 3242, 2, 0, "third", 9);
+		int len_third = connection_unordered.receive(recv_buffer, 16, address_buffer, &port);
+		if (second && first && len_third == 5 && memcmp(recv_buffer, "third", 5) == 0)
+			tests_passed += 1;
+
+		// Messages with a lifetime or a limit of transmissions that nobody acknowledges are dropped, one that
+		// expires while waiting for the window is never sent, and none are reported by a later flush.
+		Connection connection_timed = Connection(20);
+		connection_timed.setEndpointRemote("127.0.0.1", 3243);
+		auto timed_send = [&connection_timed](const char *buf, int len, int lifetime_ms, int max_attempts)
+		{
+			Delivery delivery;
+			delivery.lifetime_ms = lifetime_ms;
+			delivery.max_attempts = max_attempts;
+			shared_ptr<promise<int>> sent = make_shared<promise<int>>();
+			connection_timed.asyncSend(buf, len, delivery, [sent](int length, exception_ptr error)
+									   {
+				if (error)
+					sent->set_exception(error);
+				else
+					sent->set_value(length); });
+			return sent->get_future();
+		};
+		chrono::steady_clock::time_point timed_start = chrono::steady_clock::now();
+		future<int> lifetime = timed_send("a", 1, 100, -1);
+		future<int> queued = timed_send("b", 1, 20, -1);
+		future<int> attempts = timed_send("c", 1, -1, 2);
+		int dropped = 0;
+		for (future<int> *timed : {&lifetime, &queued, &attempts})
+		{
+			try
+			{
+				timed->get();
+			}
+			catch (runtime_error error)
+			{
+				dropped++;
+			}
+		}
+		chrono::steady_clock::duration timed_elapsed = chrono::steady_clock::now() - timed_start;
+		connection_timed.flush();
+		ConnectionStats timed_stats = connection_timed.getStats();
+		if (dropped == 3 && timed_elapsed >= chrono::milliseconds(100) && timed_stats.messages_expired == 3 && timed_stats.messages_failed == 0 && timed_stats.packets_sent >= 2 + 2)
+			tests_passed += 1;
+
+		// An unreliable message is not held behind a reliable one that is being retransmitted, even with a
+		// window of one packet.
+		Connection connection_blocked = Connection(300);
+		Connection connection_blocked_recv = Connection(300);
+		connection_blocked.setAdaptiveTimeout(false);
+		connection_blocked.setEndpointRemote("127.0.0.1", 3244);
+		connection_blocked_recv.setEndpointLocal(3244);
+		impairment = Impairment();
+		impairment.loss = 1;
+		connection_blocked.setImpairment(impairment);
+		string reliable = "reliable";
+		future<int> reliable_sent = connection_blocked.asyncSend(reliable.c_str(), reliable.size());
+		this_thread::sleep_for(chrono::milliseconds(20));
+		connection_blocked.clearImpairment();
+		string fast = "fast";
+		connection_blocked.send(fast.c_str(), fast.size(), unreliable);
+		int len_fast = connection_blocked_recv.receive(recv_buffer, 16, address_buffer, &port);
+		bool fast_first = len_fast == (int)fast.size() && memcmp(recv_buffer, fast.c_str(), fast.size()) == 0;
+		int len_reliable = connection_blocked_recv.receive(recv_buffer, 16, address_buffer, &port);
+		reliable_sent.get();
+		if (fast_first && len_reliable == (int)reliable.size() && memcmp(recv_buffer, reliable.c_str(), reliable.size()) == 0)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_streams()
+{
+	int tests_passed = 0;
+	try
+	{
+		// Each stream has its own sequence numbers, so a message on stream 2 is delivered while stream 1 waits for
+		// the packet missing before the one it holds, and each ACK is for the stream of its packet.
+		Connection connection_recv = Connection(500);
+		connection_recv.setEndpointLocal(3245);
+		boost::asio::io_service io_service;
+		boost::asio::ip::udp::socket socket(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+		struct timeval timeout = {0, 200000};
+		setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		char type = 0;
+		uint32_t sequence = 0;
+		uint32_t cumulative = 0;
+		uint32_t sack = 0;
+		uint16_t stream = 0;
+		send_raw_data(socket, 3245, 1, 0, "second", 0, DELIVERY_RELIABLE, 1);
+		bool acks_expected = receive_raw_ack(socket, &type, &sequence, &cumulative, &sack, &stream) && sequence == 1 && cumulative == 0 && sack == 1 && stream == 1;
+		send_raw_data(socket, 3245, 0, 0, "other", 0, DELIVERY_RELIABLE, 2);
+		acks_expected = acks_expected && receive_raw_ack(socket, &type, &sequence, &cumulative, &sack, &stream) && sequence == 0 && cumulative == 1 && stream == 2;
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		char recv_buffer[16];
+		uint16_t received_stream = 0;
+		int len = connection_recv.receive(recv_buffer, 16, address_buffer, &port, &received_stream);
+		bool delivered = len == 5 && memcmp(recv_buffer, "other", 5) == 0 && received_stream == 2;
+		send_raw_data(socket, 3245, 0, 0, "first", 0, DELIVERY_RELIABLE, 1);
+		acks_expected = acks_expected && receive_raw_ack(socket, &type, &sequence, &cumulative, &sack, &stream) && sequence == 0 && cumulative == 2 && stream == 1;
+		len = connection_recv.receive(recv_buffer, 16, address_buffer, &port, &received_stream);
+		delivered = delivered && len == 5 && memcmp(recv_buffer, "first", 5) == 0 && received_stream == 1;
+		len = connection_recv.receive(recv_buffer, 16, address_buffer, &port, &received_stream);
+		delivered = delivered && len == 6 && memcmp(recv_buffer, "second", 6) == 0 && received_stream == 1;
+		if (acks_expected && delivered && connection_recv.getPeerCount() == 2)
+			tests_passed += 1;
+
+		// A message being retransmitted on one stream does not hold back a message on another, even with a window
+		// of one packet.
+		Connection connection_blocked = Connection(300);
+		Connection connection_blocked_recv = Connection(300);
+		connection_blocked.setAdaptiveTimeout(false);
+		connection_blocked.setEndpointRemote("127.0.0.1", 3246);
+		connection_blocked_recv.setEndpointLocal(3246);
+		Impairment impairment;
+		impairment.loss = 1;
+		connection_blocked.setImpairment(impairment);
+		Delivery control;
+		control.stream = 1;
+		string reliable = "control";
+		promise<int> reliable_sent;
+		connection_blocked.asyncSend(reliable.c_str(), reliable.size(), control, [&reliable_sent](int length, exception_ptr)
+									 { reliable_sent.set_value(length); });
+		this_thread::sleep_for(chrono::milliseconds(20));
+		connection_blocked.clearImpairment();
+		string fast = "fast";
+		connection_blocked.send(fast.c_str(), fast.size());
+		int len_fast = connection_blocked_recv.receive(recv_buffer, 16, address_buffer, &port, &received_stream);
+		bool fast_first = len_fast == (int)fast.size() && memcmp(recv_buffer, fast.c_str(), fast.size()) == 0 && received_stream == 0;
+		int len_reliable = connection_blocked_recv.receive(recv_buffer, 16, address_buffer, &port, &received_stream);
+		bool reliable_second = len_reliable == (int)reliable.size() && memcmp(recv_buffer, reliable.c_str(), reliable.size()) == 0 && received_stream == 1;
+		if (fast_first && reliable_second && reliable_sent.get_future().get() > 0)
+			tests_passed += 1;
+
+		// Messages sent on many streams through a lossy link are each delivered in the order of their stream.
+		Connection connection_send = Connection(20);
+		Connection connection_lossy_recv = Connection(20);
+		connection_send.setWindowSize(8);
+		connection_send.setEndpointRemote("127.0.0.1", 3247);
+		connection_lossy_recv.setEndpointLocal(3247);
+		impairment.loss = 0.1;
+		impairment.seed = 5;
+		connection_send.setImpairment(impairment);
+		const int streams = 4;
+		const int messages = 50;
+		for (int i = 0; i < messages; i++)
+		{
+			for (int j = 0; j < streams; j++)
+			{
+				Delivery delivery;
+				delivery.stream = j;
+				connection_send.send((const char *)&i, sizeof(i), delivery);
+			}
+		}
+		int next[streams] = {0, 0, 0, 0};
+		bool in_order = true;
+		for (int i = 0; i < streams * messages; i++)
+		{
+			int value = -1;
+			connection_lossy_recv.receive((char *)&value, sizeof(value), address_buffer, &port, &received_stream);
+			in_order = in_order && received_stream < streams && value == next[received_stream];
+			if (received_stream < streams)
+				next[received_stream] += 1;
+		}
+		connection_send.flush();
+		if (in_order && connection_lossy_recv.getPeerCount() == streams)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_coalescing()
+{
+	int tests_passed = 0;
+	try
+	{
+		// Small messages sent in a burst share packets but are still received one by one and in order.
+		Connection connection_send = Connection(100);
+		Connection connection_recv = Connection(100);
+		connection_send.setWindowSize(32);
+		connection_send.setCoalescing(20000);
+		connection_send.setEndpointRemote("127.0.0.1", 3248);
+		connection_recv.setEndpointLocal(3248);
+		const int messages = 200;
+		for (int i = 0; i < messages; i++)
+		{
+			string message = "message " + to_string(i);
+			connection_send.send(message.c_str(), message.size());
+		}
+		connection_send.flush();
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		char recv_buffer[32];
+		bool in_order = true;
+		for (int i = 0; i < messages; i++)
+		{
+			string message = "message " + to_string(i);
+			int len = connection_recv.receive(recv_buffer, sizeof(recv_buffer), address_buffer, &port);
+			in_order = in_order && len == (int)message.size() && memcmp(recv_buffer, message.c_str(), len) == 0;
+		}
+		ConnectionStats stats = connection_send.getStats();
+		if (in_order && stats.messages_sent == (uint64_t)messages && stats.packets_sent > 0 && stats.packets_sent <= (uint64_t)messages / 10 && connection_recv.getStats().messages_received == (uint64_t)messages)
+			tests_passed += 1;
+
+		// A message sent on its own waits for the coalescing delay before it is sent.
+		connection_send.setCoalescing(50000);
+		string single = "single";
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		future<int> single_sent = connection_send.asyncSend(single.c_str(), single.size());
+		int len = connection_recv.receive(recv_buffer, sizeof(recv_buffer), address_buffer, &port);
+		chrono::steady_clock::duration waited = chrono::steady_clock::now() - start;
+		if (len == (int)single.size() && memcmp(recv_buffer, single.c_str(), len) == 0 && waited >= chrono::milliseconds(45) && single_sent.get() > 0)
+			tests_passed += 1;
+
+		// A flush sends the messages waiting to be coalesced without waiting for the delay, completing each of
+		// them with the size of its own message.
+		connection_send.setCoalescing(10000000);
+		string first = "first";
+		string second = "second message";
+		start = chrono::steady_clock::now();
+		future<int> first_sent = connection_send.asyncSend(first.c_str(), first.size());
+		future<int> second_sent = connection_send.asyncSend(second.c_str(), second.size());
+		this_thread::sleep_for(chrono::milliseconds(10));
+		connection_send.flush();
+		bool flushed = chrono::steady_clock::now() - start < chrono::seconds(1);
+		int len_first = connection_recv.receive(recv_buffer, sizeof(recv_buffer), address_buffer, &port);
+		bool first_received = len_first == (int)first.size() && memcmp(recv_buffer, first.c_str(), len_first) == 0;
+		int len_second = connection_recv.receive(recv_buffer, sizeof(recv_buffer), address_buffer, &port);
+		bool second_received = len_second == (int)second.size() && memcmp(recv_buffer, second.c_str(), len_second) == 0;
+		if (flushed && first_received && second_received && first_sent.get() < second_sent.get())
+			tests_passed += 1;
+
+		// A packet whose messages do not add up to its payload is dropped without an ACK, while one that does is
+		// acknowledged and delivered as its messages.
+		Connection connection_raw_recv = Connection(500);
+		connection_raw_recv.setEndpointLocal(3249);
+		boost::asio::io_service io_service;
+		boost::asio::ip::udp::socket socket(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+		struct timeval timeout = {0, 200000};
+		setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		DeliveryClass coalesced = (DeliveryClass)(DELIVERY_RELIABLE | DATA_FLAG_COALESCED);
+		string records;
+		for (string message : {"one", "three"})
+		{
+			int message_len = message.size();
+			records.append((const char *)&message_len, sizeof(message_len));
+			records.append(message);
+		}
+		char type = 0;
+		uint32_t sequence = 0;
+		uint32_t cumulative = 0;
+		send_raw_data(socket, 3249, 0, 0, records.substr(0, records.size() - 1), 0, coalesced);
+		bool malformed_dropped = !receive_raw_ack(socket, &type, &sequence, &cumulative);
+		send_raw_data(socket, 3249, 0, 0, records, 0, coalesced);
+		bool acked = receive_raw_ack(socket, &type, &sequence, &cumulative) && sequence == 0 && cumulative == 1;
+		len_first = connection_raw_recv.receive(recv_buffer, sizeof(recv_buffer), address_buffer, &port);
+		first_received = len_first == 3 && memcmp(recv_buffer, "one", 3) == 0;
+		len_second = connection_raw_recv.receive(recv_buffer, sizeof(recv_buffer), address_buffer, &port);
+		second_received = len_second == 5 && memcmp(recv_buffer, "three", 5) == 0;
+		if (malformed_dropped && acked && first_received && second_received && connection_raw_recv.getStats().packets_dropped == 1)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_batched_io()
+{
+	int tests_passed = 0;
+	try
+	{
+		// Datagrams waiting on the socket are read by one handler with one system call, up to a batch, and are
+		// all acknowledged.
+		Connection connection_recv = Connection(100, unique_ptr<boost::asio::io_service>(new boost::asio::io_service()));
+		connection_recv.setEndpointLocal(3265);
+		boost::asio::io_service io_service;
+		boost::asio::ip::udp::socket socket(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+		struct timeval timeout = {0, 200000};
+		setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		for (uint32_t i = 0; i < IO_BATCH_SIZE; i++)
+		{
+			send_raw_data(socket, 3265, i, 0, "batched " + to_string(i));
+		}
+		size_t handlers = connection_recv.process();
+		bool batched = connection_recv.getStats().packets_received == IO_BATCH_SIZE;
+#ifdef __linux__
+		batched = batched && handlers < IO_BATCH_SIZE;
+#endif
+		char type = 0;
+		uint32_t sequence = 0;
+		uint32_t cumulative = 0;
+		// The ACK of the last packet may be delayed, so the connection is processed until it is sent.
+		for (int i = 0; i < 10 && cumulative < IO_BATCH_SIZE; i++)
+		{
+			if (!receive_raw_ack(socket, &type, &sequence, &cumulative))
+			{
+				connection_recv.process();
+			}
+		}
+		char recv_buffer[32];
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		bool in_order = true;
+		for (uint32_t i = 0; i < IO_BATCH_SIZE; i++)
+		{
+			int received_len = connection_recv.receive(recv_buffer, sizeof(recv_buffer), address_buffer, &port);
+			in_order = in_order && string(recv_buffer, received_len) == "batched " + to_string(i);
+		}
+		if (batched && cumulative == IO_BATCH_SIZE && in_order)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_batch()
+{
+	int tests_passed = 0;
+	try
+	{
+		// A batch sent to the remote endpoint and to an address is received in order by batches, each message with
+		// its own result and stream.
+		Connection connection_send = Connection(100);
+		Connection connection_recv = Connection(100);
+		connection_send.setWindowSize(8);
+		connection_send.setEndpointRemote("127.0.0.1", 3250);
+		connection_recv.setEndpointLocal(3250);
+		const int messages = 20;
+		vector<string> payloads(messages);
+		vector<BatchMessage> batch(messages);
+		for (int i = 0; i < messages; i++)
+		{
+			payloads[i] = "batch " + to_string(i);
+			batch[i].buf = (char *)payloads[i].c_str();
+			batch[i].len = payloads[i].size();
+			batch[i].delivery.stream = i % 2;
+			if (i % 3 == 0)
+			{
+				strcpy(batch[i].address, "127.0.0.1");
+				batch[i].port = 3250;
+			}
+		}
+		bool results_set = connection_send.sendBatch(batch.data(), batch.size()) == (size_t)messages;
+		for (BatchMessage &message : batch)
+		{
+			results_set = results_set && message.result > message.len && !message.error;
+		}
+		vector<vector<char>> buffers(messages, vector<char>(32));
+		vector<BatchMessage> received(messages);
+		int next[2] = {0, 1};
+		int count = 0;
+		bool in_order = true;
+		while (count < messages)
+		{
+			for (int i = 0; i < messages; i++)
+			{
+				received[i].buf = buffers[i].data();
+				received[i].len = buffers[i].size();
+			}
+			size_t batch_count = connection_recv.receiveBatch(received.data(), received.size());
+			for (size_t i = 0; i < batch_count; i++)
+			{
+				BatchMessage &message = received[i];
+				int stream = message.delivery.stream;
+				in_order = in_order && !message.error && stream < 2 && message.result == (int)payloads[next[stream]].size() && memcmp(message.buf, payloads[next[stream]].c_str(), message.result) == 0 && strcmp(message.address, "127.0.0.1") == 0;
+				next[stream % 2] += 2;
+			}
+			count += batch_count;
+		}
+		connection_send.flush();
+		if (results_set && in_order && count == messages)
+			tests_passed += 1;
+
+		// A message that can not be sent fails on its own while the rest of the batch is sent.
+		vector<char> large(connection_send.getMTU(), 'x');
+		string first = "first";
+		string last = "last";
+		vector<BatchMessage> mixed(3);
+		mixed[0].buf = (char *)first.c_str();
+		mixed[0].len = first.size();
+		mixed[1].buf = large.data();
+		mixed[1].len = large.size();
+		mixed[1].delivery.delivery_class = DELIVERY_UNRELIABLE;
+		mixed[2].buf = (char *)last.c_str();
+		mixed[2].len = last.size();
+		size_t sent = connection_send.sendBatch(mixed.data(), mixed.size());
+		char recv_buffer[32];
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		int len_first = connection_recv.receive(recv_buffer, sizeof(recv_buffer), address_buffer, &port);
+		bool first_received = len_first == (int)first.size() && memcmp(recv_buffer, first.c_str(), len_first) == 0;
+		int len_last = connection_recv.receive(recv_buffer, sizeof(recv_buffer), address_buffer, &port);
+		bool last_received = len_last == (int)last.size() && memcmp(recv_buffer, last.c_str(), len_last) == 0;
+		if (sent == 2 && !mixed[0].error && mixed[1].error && mixed[1].result == -1 && !mixed[2].error && first_received && last_received)
+			tests_passed += 1;
+
+		// A message gathered from several buffers arrives whole, a batch sent with Stop-and-Wait returns once every
+		// message has been acknowledged, and a buffer too small for the next message fails without losing it.
+		connection_send.setWindowSize(1);
+		string header = "header:";
+		string body = "body";
+		struct iovec iov[3] = {{(void *)header.c_str(), header.size()}, {nullptr, 0}, {(void *)body.c_str(), body.size()}};
+		int sent_len = connection_send.sendv(iov, 3);
+		int len = connection_recv.receive(recv_buffer, sizeof(recv_buffer), address_buffer, &port);
+		bool gathered = sent_len > (int)(header.size() + body.size()) && len == (int)(header.size() + body.size()) && memcmp(recv_buffer, "header:body", len) == 0;
+		vector<BatchMessage> acknowledged(2);
+		acknowledged[0].buf = (char *)first.c_str();
+		acknowledged[0].len = first.size();
+		acknowledged[1].buf = (char *)body.c_str();
+		acknowledged[1].len = body.size();
+		bool waited = connection_send.sendBatch(acknowledged.data(), acknowledged.size()) == 2 && acknowledged[0].result > 0 && acknowledged[1].result > 0 && connection_send.getStats().messages_sent == (uint64_t)messages + 3 + 2;
+		char small_buffer[2];
+		char large_buffer[32];
+		vector<BatchMessage> small(2);
+		small[0].buf = large_buffer;
+		small[0].len = sizeof(large_buffer);
+		small[1].buf = small_buffer;
+		small[1].len = sizeof(small_buffer);
+		size_t small_count = connection_recv.receiveBatch(small.data(), small.size());
+		bool kept = small_count == 2 && small[0].result == (int)first.size() && small[1].error;
+		len = connection_recv.receive(recv_buffer, sizeof(recv_buffer), address_buffer, &port);
+		kept = kept && len == (int)body.size() && memcmp(recv_buffer, body.c_str(), len) == 0;
+		if (gathered && waited && kept)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_external_loop()
+{
+	int tests_passed = 0;
+	try
+	{
+		// Two connections driven by one thread polling their descriptors and deadlines exchange a window of
+		// messages, and go idle with no timer armed once every message has been acknowledged.
+		Connection connection_send = Connection(100, unique_ptr<boost::asio::io_service>(new boost::asio::io_service()));
+		Connection connection_recv = Connection(100, unique_ptr<boost::asio::io_service>(new boost::asio::io_service()));
+		connection_send.setWindowSize(8);
+		connection_send.setEndpointRemote("127.0.0.1", 3251);
+		connection_recv.setEndpointLocal(3251);
+		const int messages = 50;
+		int acknowledged = 0;
+		int received = 0;
+		bool in_order = true;
+		char recv_buffer[64];
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		vector<string> payloads(messages);
+		function<void()> receive_next = [&]()
+		{
+			connection_recv.asyncReceive(recv_buffer, sizeof(recv_buffer), address_buffer, &port, [&](int length, exception_ptr error)
+										 {
+				if (error)
+					return;
+				in_order = in_order && string(recv_buffer, length) == payloads[received];
+				if (++received < messages)
+					receive_next(); });
+		};
+		receive_next();
+		for (int i = 0; i < messages; i++)
+		{
+			payloads[i] = "external " + to_string(i);
+			connection_send.asyncSend(payloads[i].c_str(), payloads[i].size(), [&](int, exception_ptr error)
+									  {
+				if (!error)
+					++acknowledged; });
+		}
+		bool finished = run_external_loop({&connection_send, &connection_recv}, [&]()
+										  { return received == messages && acknowledged == messages; }, 5000);
+		run_external_loop({&connection_send, &connection_recv}, []()
+						  { return false; }, 50);
+		bool idle = connection_send.getNextDeadline().is_pos_infinity() && connection_recv.getNextDeadline().is_pos_infinity();
+		bool shared_refused = false;
+		try
+		{
+			Connection connection_shared = Connection(100);
+			connection_shared.process();
+		}
+		catch (runtime_error error)
+		{
+			shared_refused = true;
+		}
+		if (finished && in_order && idle && shared_refused && connection_send.isExternallyDriven() && connection_send.getFileDescriptor() >= 0)
+			tests_passed += 1;
+
+		// A packet sent while the receiver is not processed is retransmitted when the deadline of the sender's
+		// timer is reached.
+		int delivered = 0;
+		connection_recv.asyncReceive(recv_buffer, sizeof(recv_buffer), address_buffer, &port, [&](int, exception_ptr error)
+									 {
+			if (!error)
+				++delivered; });
+		connection_send.asyncSend(payloads[0].c_str(), payloads[0].size(), CompletionHandler());
+		connection_send.process();
+		boost::posix_time::ptime deadline = connection_send.getNextDeadline();
+		usleep(250000);
+		finished = run_external_loop({&connection_send, &connection_recv}, [&]()
+									 { return delivered == 1 && connection_send.getStats().retransmissions > 0; }, 5000);
+		if (!deadline.is_special() && finished)
+			tests_passed += 1;
+
+		// The blocking methods of a connection driven by an event loop run it while they wait, and the connection
+		// can be destroyed without being processed.
+		Connection connection_blocking = Connection(100, unique_ptr<boost::asio::io_service>(new boost::asio::io_service()));
+		Connection connection_threaded = Connection(100);
+		connection_blocking.setEndpointRemote("127.0.0.1", 3252);
+		connection_threaded.setEndpointLocal(3252);
+		string message = "blocking";
+		thread recv_thread([&]()
+						   {
+			char buffer[64];
+			char address[IPV4_ADDRESS_LENGTH_BYTES];
+			int recv_port;
+			int len = connection_threaded.receive(buffer, sizeof(buffer), address, &recv_port);
+			received = len == (int)message.size() && memcmp(buffer, message.c_str(), len) == 0; });
+		int sent = connection_blocking.send(message.c_str(), message.size());
+		recv_thread.join();
+		if (sent > 0 && received == 1)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_uring_transport()
+{
+	int tests_passed = 0;
+	try
+	{
+		// A window of messages sent through a ring is received in order by a ring and by the Boost ASIO transport,
+		// and the ACKs of a receiver using Boost ASIO are received by the ring.
+		Connection connection_send = Connection(100, ConnectionController::getIOService(), TRANSPORT_IO_URING);
+		Connection connection_recv = Connection(100, ConnectionController::getIOService(), TRANSPORT_IO_URING);
+		Connection connection_asio = Connection(100);
+		connection_send.setWindowSize(32);
+		connection_recv.setEndpointLocal(3253);
+		connection_asio.setEndpointLocal(3254);
+		const int messages = 500;
+		char recv_buffer[64];
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+		bool in_order = true;
+		for (unsigned short recv_port : {3253, 3254})
+		{
+			Connection &connection = recv_port == 3253 ? connection_recv : connection_asio;
+			connection_send.setEndpointRemote("127.0.0.1", recv_port);
+			thread send_thread([&]()
+							   {
+				for (int i = 0; i < messages; i++)
+				{
+					string message = "uring " + to_string(i);
+					connection_send.send(message.c_str(), message.size());
+				}
+				connection_send.flush(); });
+			for (int i = 0; i < messages; i++)
+			{
+				int len = connection.receive(recv_buffer, sizeof(recv_buffer), address_buffer, &port);
+				in_order = in_order && string(recv_buffer, len) == "uring " + to_string(i);
+			}
+			send_thread.join();
+		}
+		ConnectionStats stats = connection_send.getStats();
+		if (in_order && stats.messages_sent == (uint64_t)messages * 2 && stats.acks_received > 0)
+			tests_passed += 1;
+
+		// A message larger than the MTU is fragmented and reassembled by rings, and a receiver that is not reading
+		// while a burst arrives still holds every message once it does.
+		connection_send.setEndpointRemote("127.0.0.1", 3253);
+		string large(20000, 'u');
+		for (size_t i = 0; i < large.size(); i++)
+		{
+			large[i] = 'a' + i % 26;
+		}
+		vector<char> large_buffer(large.size());
+		thread large_thread([&]()
+							{ connection_send.send(large.c_str(), large.size()); });
+		int large_len = connection_recv.receive(large_buffer.data(), large_buffer.size(), address_buffer, &port);
+		large_thread.join();
+		bool reassembled = large_len == (int)large.size() && memcmp(large_buffer.data(), large.c_str(), large_len) == 0;
+		for (int i = 0; i < 300; i++)
+		{
+			string message = "burst " + to_string(i);
+			connection_send.send(message.c_str(), message.size());
+		}
+		usleep(100000);
+		bool burst = true;
+		for (int i = 0; i < 300; i++)
+		{
+			int len = connection_recv.receive(recv_buffer, sizeof(recv_buffer), address_buffer, &port);
+			burst = burst && string(recv_buffer, len) == "burst " + to_string(i);
+		}
+		connection_send.flush();
+		if (reassembled && burst)
+			tests_passed += 1;
+
+		// A connection driven by an event loop waits on the eventfd of its ring, and an unknown transport fails.
+		Connection connection_external = Connection(100, unique_ptr<boost::asio::io_service>(new boost::asio::io_service()), TRANSPORT_IO_URING);
+		connection_external.setEndpointLocal(3255);
+		connection_send.setEndpointRemote("127.0.0.1", 3255);
+		int received = 0;
+		connection_external.asyncReceive(recv_buffer, sizeof(recv_buffer), address_buffer, &port, [&](int length, exception_ptr error)
+										 {
+			if (!error && string(recv_buffer, length) == "external")
+				++received; });
+		connection_external.process();
+		connection_send.send("external", 8);
+		bool delivered = run_external_loop({&connection_external}, [&]()
+										   { return received == 1; }, 5000);
+		connection_send.flush();
+		bool refused = false;
+		try
+		{
+			Connection connection_unknown = Connection(100, ConnectionController::getIOService(), 7);
+		}
+		catch (runtime_error error)
+		{
+			refused = true;
+		}
+		if (delivered && refused && connection_external.getFileDescriptor() != connection_send.getFileDescriptor())
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+bool run_external_loop(vector<Connection *> connections, const function<bool()> &done, int timeout_ms)
+{
+	boost::posix_time::ptime end = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(timeout_ms);
+	vector<pollfd> fds(connections.size());
+	for (size_t i = 0; i < connections.size(); i++)
+	{
+		fds[i] = pollfd{connections[i]->getFileDescriptor(), POLLIN, 0};
+	}
+	while (!done())
+	{
+		// Wait for a socket to become readable or for the earliest deadline, but no longer than the test allows.
+		boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+		if (now >= end)
+		{
+			return false;
+		}
+		boost::posix_time::ptime deadline = end;
+		for (Connection *connection : connections)
+		{
+			deadline = min(deadline, connection->getNextDeadline());
+		}
+		int wait_ms = deadline > now ? (int)((deadline - now).total_microseconds() + 999) / 1000 : 0;
+		poll(fds.data(), fds.size(), wait_ms);
+		for (Connection *connection : connections)
+		{
+			connection->process();
+		}
+	}
+	return true;
+}
+
+int test_sharded_listener()
+{
+	int tests_passed = 0;
+	try
+	{
+		// Peers sending to a sharded port are spread across the shards by the kernel, and every message of a peer
+		// is received in order by the one shard that it hashes to.
+		vector<int> shards = ConnectionController::addShardedConnections(100, 3256, 4);
+		const int peers = 16;
+		const int messages = 20;
+		vector<unique_ptr<Connection>> senders;
+		for (int i = 0; i < peers; i++)
+		{
+			senders.emplace_back(new Connection(100));
+			senders.back()->setEndpointRemote("127.0.0.1", 3256);
+		}
+		vector<thread> send_threads;
+		for (int i = 0; i < peers; i++)
+		{
+			send_threads.emplace_back([&, i]()
+									  {
+				for (int j = 0; j < messages; j++)
+				{
+					string message = to_string(i) + " " + to_string(j);
+					senders[i]->send(message.c_str(), message.size());
+				}
+				senders[i]->flush(); });
+		}
+		for (thread &send_thread : send_threads)
+		{
+			send_thread.join();
+		}
+		// Each shard is read by its own thread, which knows how many messages it holds from its counters.
+		map<int, int> peer_shards;
+		map<int, int> peer_next;
+		int shards_used = 0;
+		bool in_order = true;
+		mutex results_mutex;
+		vector<thread> recv_threads;
+		for (size_t s = 0; s < shards.size(); s++)
+		{
+			recv_threads.emplace_back([&, s]()
+									  {
+				ConnectionRef shard = ConnectionController::acquireConnection(shards[s]);
+				uint64_t held = shard->getStats().messages_received;
+				char buffer[64];
+				char address[IPV4_ADDRESS_LENGTH_BYTES];
+				int port;
+				for (uint64_t j = 0; j < held; j++)
+				{
+					int len = shard->receive(buffer, sizeof(buffer), address, &port);
+					string message(buffer, len);
+					int peer = stoi(message.substr(0, message.find(' ')));
+					int sequence = stoi(message.substr(message.find(' ') + 1));
+					lock_guard<mutex> lock(results_mutex);
+					if (peer_shards.count(peer) != 0 && peer_shards[peer] != (int)s)
+						in_order = false;
+					peer_shards[peer] = s;
+					in_order = in_order && sequence == peer_next[peer]++;
+				}
+				lock_guard<mutex> lock(results_mutex);
+				shards_used += held > 0; });
+		}
+		for (thread &recv_thread : recv_threads)
+		{
+			recv_thread.join();
+		}
+		bool all_received = (int)peer_shards.size() == peers;
+		for (auto &next : peer_next)
+		{
+			all_received = all_received && next.second == messages;
+		}
+		if (in_order && all_received && shards_used > 1)
+			tests_passed += 1;
+
+		// A socket that does not share the port cannot join the shards, and the shards cannot join a port that is
+		// already bound without sharing it.
+		bool refused = false;
+		try
+		{
+			Connection connection_plain = Connection(100);
+			connection_plain.setEndpointLocal(3256);
+		}
+		catch (runtime_error error)
+		{
+			refused = true;
+		}
+		Connection connection_exclusive = Connection(100);
+		connection_exclusive.setEndpointLocal(3257);
+		bool shards_refused = false;
+		try
+		{
+			ConnectionController::addShardedConnections(100, 3257, 2);
+		}
+		catch (runtime_error error)
+		{
+			shards_refused = true;
+		}
+		if (refused && shards_refused)
+			tests_passed += 1;
+
+		// Removing the shards frees the port, and by default there is one shard for each IO service of the pool.
+		for (int shard : shards)
+		{
+			ConnectionController::removeConnection(shard);
+		}
+		Connection connection_rebound = Connection(100);
+		connection_rebound.setEndpointLocal(3256);
+		vector<int> default_shards = ConnectionController::addShardedConnections(100, 3258, 0);
+		bool counted = (int)default_shards.size() == ConnectionController::getIOServiceCount();
+		for (int shard : default_shards)
+		{
+			ConnectionController::removeConnection(shard);
+		}
+		if (counted)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_buffer_pool()
+{
+	int tests_passed = 0;
+	try
+	{
+		// A freed block is reused for the next block of its size, larger blocks are allocated on their own, and
+		// moving a pooled buffer keeps its data in place.
+		BufferPool pool(0);
+		void *first = pool.allocate(100);
+		pool.deallocate(first, 100);
+		void *second = pool.allocate(128);
+		bool reused = first == second && pool.capacity() == DEFAULT_BUFFER_POOL_SLAB_BYTES;
+		pool.deallocate(second, 128);
+		char *large = static_cast<char *>(pool.allocate(BUFFER_POOL_MAX_BLOCK + 1));
+		memset(large, 'x', BUFFER_POOL_MAX_BLOCK + 1);
+		pool.deallocate(large, BUFFER_POOL_MAX_BLOCK + 1);
+		PooledBuffer buffer(&pool, 300);
+		memcpy(buffer.data(), "Hello World!", 12);
+		char *data = buffer.data();
+		PooledBuffer moved(std::move(buffer));
+		bool kept = moved.data() == data && moved.size() == 300 && buffer.empty() && memcmp(moved.data(), "Hello World!", 12) == 0;
+		if (reused && kept && pool.capacity() == DEFAULT_BUFFER_POOL_SLAB_BYTES)
+			tests_passed += 1;
+
+		// The pool of a connection can be reserved up front and never shrinks.
+		Connection connection_sized = Connection(100);
+		bool sized = connection_sized.getBufferPoolSize() == DEFAULT_BUFFER_POOL_BYTES;
+		connection_sized.setBufferPoolSize(1 << 20);
+		sized = sized && connection_sized.getBufferPoolSize() >= (1 << 20);
+		connection_sized.setBufferPoolSize(1024);
+		sized = sized && connection_sized.getBufferPoolSize() >= (1 << 20);
+		bool rejected = false;
+		try
+		{
+			connection_sized.setBufferPoolSize(-1);
+		}
+		catch (runtime_error error)
+		{
+			rejected = true;
+		}
+		if (sized && rejected)
+			tests_passed += 1;
+
+		// Once the connections have sent a window of messages their pools hold what they need, so sending more
+		// messages takes blocks that were freed rather than growing the pools.
+		Connection connection_recv = Connection(100);
+		connection_recv.setEndpointLocal(3259);
+		Connection connection_send = Connection(100);
+		connection_send.setWindowSize(16);
+		connection_send.setEndpointRemote("127.0.0.1", 3259);
+		const int messages = 2000;
+		bool in_order = true;
+		thread recv_thread([&]()
+						   {
+			char recv_buffer[64];
+			char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+			int port;
+			for (int i = 0; i < 2 * messages; i++)
+			{
+				int len = connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+				in_order = in_order && string(recv_buffer, len) == to_string(i);
+			} });
+		for (int i = 0; i < messages; i++)
+		{
+			string message = to_string(i);
+			connection_send.send(message.c_str(), message.size());
+		}
+		connection_send.flush();
+		size_t send_pool = connection_send.getBufferPoolSize();
+		size_t recv_pool = connection_recv.getBufferPoolSize();
+		for (int i = messages; i < 2 * messages; i++)
+		{
+			string message = to_string(i);
+			connection_send.send(message.c_str(), message.size());
+		}
+		connection_send.flush();
+		recv_thread.join();
+		if (in_order && connection_send.getBufferPoolSize() == send_pool && connection_recv.getBufferPoolSize() == recv_pool)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_socket_tuning()
+{
+	int tests_passed = 0;
+	try
+	{
+		// A buffer size within the limit of the kernel is taken as it is, which Linux reports doubled, 0 leaves a
+		// size as it was, and a negative size is rejected.
+		Connection connection_buffers = Connection(100);
+		int send_size = connection_buffers.getSendBufferSize();
+		connection_buffers.setSocketBufferSizes(100000, 0);
+		bool sized = connection_buffers.getReceiveBufferSize() >= 100000 && connection_buffers.getSendBufferSize() == send_size;
+		bool rejected = false;
+		try
+		{
+			connection_buffers.setSocketBufferSizes(-1, 0);
+		}
+		catch (runtime_error error)
+		{
+			rejected = true;
+		}
+		if (sized && rejected)
+			tests_passed += 1;
+
+		// A code point is written into the upper six bits of the TOS byte, one out of range is rejected, and busy
+		// polling can always be turned off.
+		connection_buffers.setDSCP(46);
+		int tos = 0;
+		socklen_t tos_len = sizeof(tos);
+		getsockopt(connection_buffers.getFileDescriptor(), IPPROTO_IP, IP_TOS, &tos, &tos_len);
+		bool marked = tos == (46 << 2);
+		rejected = false;
+		try
+		{
+			connection_buffers.setDSCP(64);
+		}
+		catch (runtime_error error)
+		{
+			rejected = true;
+		}
+		connection_buffers.setBusyPoll(0);
+		if (marked && rejected)
+			tests_passed += 1;
+
+		// With segmentation offload at both ends a window of messages of the same length is sent in GSO sends and
+		// received in GRO reads, and every message is still delivered once and in order.
+		Connection connection_recv = Connection(100);
+		connection_recv.setEndpointLocal(3260);
+		connection_recv.setSocketBufferSizes(1 << 20, 0);
+		connection_recv.setSegmentationOffload(true);
+		Connection connection_send = Connection(100);
+		connection_send.setWindowSize(32);
+		connection_send.setEndpointRemote("127.0.0.1", 3260);
+		connection_send.setSegmentationOffload(true);
+		const int messages = 2000;
+		bool in_order = true;
+		thread recv_thread([&]()
+						   {
+			char recv_buffer[64];
+			char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+			int port;
+			for (int i = 0; i < messages; i++)
+			{
+				int len = connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+				string expected = to_string(i);
+				in_order = in_order && string(recv_buffer, len) == string(8 - expected.size(), '0') + expected;
+			} });
+		for (int i = 0; i < messages; i++)
+		{
+			string message = to_string(i);
+			message = string(8 - message.size(), '0') + message;
+			connection_send.send(message.c_str(), message.size());
+		}
+		connection_send.flush();
+		recv_thread.join();
+		ConnectionStats stats = connection_recv.getStats();
+		if (in_order && stats.messages_received == (uint64_t)messages && stats.kernel_drops == 0)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}
+
+int test_sequence_space()
+{
+	int tests_passed = 0;
+	try
+	{
+		// Drive the receiver from a plain socket, which gives up on an ACK after 200 ms.
+		Connection connection_recv = Connection(500);
+		connection_recv.setEndpointLocal(3261);
+		boost::asio::io_service io_service;
+		boost::asio::ip::udp::socket socket(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+		struct timeval timeout = {0, 200000};
+		setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		char type = 0;
+		uint32_t sequence = 0;
+		uint32_t cumulative = 0;
+		uint32_t sack = 0;
+		uint16_t stream = 0;
+		uint32_t epoch = 0;
+		char recv_buffer[64];
+		char address_buffer[IPV4_ADDRESS_LENGTH_BYTES];
+		int port;
+
+		// Sequence numbers use all 32 bits, so 65535 is not skipped, and a packet that arrives ahead of the wrap
+		// of the sequence is held and delivered in order rather than taken as a retransmission.
+		send_raw_data(socket, 3261, 65535, 65535, "first", 1);
+		bool acks_expected = receive_raw_ack(socket, &type, &sequence, &cumulative, &sack, &stream, &epoch) && sequence == 65535 && cumulative == 65536 && epoch == 1;
+		send_raw_data(socket, 3261, 0xFFFFFFFF, 0xFFFFFFFF, "second", 2);
+		acks_expected = acks_expected && receive_raw_ack(socket, &type, &sequence, &cumulative, &sack, &stream, &epoch) && sequence == 0xFFFFFFFF && cumulative == 0 && epoch == 2;
+		send_raw_data(socket, 3261, 1, 0, "fourth", 2);
+		acks_expected = acks_expected && receive_raw_ack(socket, &type, &sequence, &cumulative, &sack) && sequence == 1 && cumulative == 0 && sack == 1;
+		send_raw_data(socket, 3261, 0, 0, "third", 2);
+		acks_expected = acks_expected && receive_raw_ack(socket, &type, &sequence, &cumulative, &sack) && sequence == 0 && cumulative == 2 && sack == 0;
+		send_raw_data(socket, 3261, 0xFFFFFFFF, 2, "second", 2);
+		acks_expected = acks_expected && receive_raw_ack(socket, &type, &sequence, &cumulative, &sack) && sequence == 0xFFFFFFFF && cumulative == 2;
+		bool in_order = true;
+		vector<string> messages = {"first", "second", "third", "fourth"};
+		for (const string &message : messages)
+		{
+			int received_len = connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+			in_order = in_order && string(recv_buffer, received_len) == message;
+		}
+		if (acks_expected && in_order)
+			tests_passed += 1;
+
+		// Once the sender has started a new session, a late packet of the session it left is dropped without an
+		// ACK instead of moving the receiver back to it.
+		send_raw_data(socket, 3261, 0, 0, "restarted", 3);
+		acks_expected = receive_raw_ack(socket, &type, &sequence, &cumulative, &sack, &stream, &epoch) && sequence == 0 && cumulative == 1 && epoch == 3;
+		send_raw_data(socket, 3261, 2, 2, "stale", 2);
+		acks_expected = acks_expected && !receive_raw_ack(socket, &type, &sequence, &cumulative);
+		send_raw_data(socket, 3261, 1, 1, "resumed", 3);
+		acks_expected = acks_expected && receive_raw_ack(socket, &type, &sequence, &cumulative, &sack, &stream, &epoch) && sequence == 1 && cumulative == 2 && epoch == 3;
+		in_order = true;
+		messages = {"restarted", "resumed"};
+		for (const string &message : messages)
+		{
+			int received_len = connection_recv.receive(recv_buffer, 64, address_buffer, &port);
+			in_order = in_order && string(recv_buffer, received_len) == message;
+		}
+		if (acks_expected && in_order)
+			tests_passed += 1;
+
+		// An ACK from before the sender was reset carries the old epoch, so it does not acknowledge the packet of
+		// the new session that has the same sequence number, while an ACK echoing the new epoch does.
+		Connection connection_send = Connection(1000);
+		connection_send.setEndpointRemote("127.0.0.1", socket.local_endpoint().port());
+		connection_send.setWindowSize(8);
+		string message = "Hello World!";
+		future<int> sent_before = connection_send.asyncSend(message.c_str(), message.size());
+		boost::asio::ip::udp::endpoint sender;
+		int offset = 0;
+		uint32_t old_epoch = 0;
+		uint32_t new_epoch = 0;
+		bool resynced = receive_raw_data(socket, &sender, &sequence, &offset, &old_epoch) && sequence == 0;
+		connection_send.resetConnectionSend();
+		future<int> sent_after = connection_send.asyncSend(message.c_str(), message.size());
+		resynced = resynced && receive_raw_data(socket, &sender, &sequence, &offset, &new_epoch) && sequence == 0 && new_epoch != old_epoch;
+		send_raw_ack(socket, sender, 0, 1, old_epoch);
+		resynced = resynced && sent_after.wait_for(chrono::milliseconds(100)) == future_status::timeout;
+		send_raw_ack(socket, sender, 0, 1, new_epoch);
+		resynced = resynced && sent_after.wait_for(chrono::milliseconds(500)) == future_status::ready && sent_after.get() == (int)(DATA_HEADER_SIZE + message.size());
+		if (resynced)
+			tests_passed += 1;
+	}
+	catch (runtime_error error)
+	{
+		cout << error.what() << endl;
+	}
+	return tests_passed;
+}